@@ -310,34 +310,67 @@ CUDAExecutionContext CreateContextAndKernelFromFile( int deviceNum,
 /// implementing reference counting for mem objects!!
 class CUMemObj
 {
-    typedef SimpleCounter Counter; //need to perform reference counting
+    typedef AtomicCounter Counter; //need to perform reference counting
                                    //since cuda does not have reference counted mem objects
+    /// Device memory and reference counter shared by all the copies of an
+    /// instance, allocated once per allocation of device memory.
+    struct Record
+    {
+        Record( CUdeviceptr mo ) : memObj( mo ) {}
+        CUdeviceptr memObj;
+        Counter counter;
+    };
     CUMemObj(); // do not allow default construction; force client
                 // code to specify valid context
 public:
     CUMemObj( CUcontext ctx, // force to specify context
               unsigned size, 
               void* hostPtr = 0 ) 
-              : ctx_( ctx ), size_( size ), hostPtr_( hostPtr ), counter_( new Counter )
+              : ctx_( ctx ), memObj_( CUdeviceptr() ), size_( size ), hostPtr_( hostPtr ), record_( 0 )
     {
         AllocateMemObj( size );
     }
     CUMemObj( const CUMemObj& other )
+              : ctx_( other.ctx_ ), memObj_( other.memObj_ ), size_( other.size_ ),
+                hostPtr_( other.hostPtr_ ), record_( other.record_ )
+    {
+        if( record_ ) record_->counter.Inc();
+    }
+    /// Move constructor: the reference count is not modified; \c noexcept so
+    /// that standard containers move instead of copying on reallocation.
+    CUMemObj( CUMemObj&& other ) noexcept
+              : ctx_( other.ctx_ ), memObj_( other.memObj_ ), size_( other.size_ ),
+                hostPtr_( other.hostPtr_ ), record_( other.record_ )
+    {
+        other.memObj_ = CUdeviceptr();
+        other.record_ = 0;
+    }
+    CUMemObj& operator=( const CUMemObj& other )
     {
-        counter_ = other.counter_;
+        if( other.record_ != record_ )
+        {
+            if( other.record_ ) other.record_->counter.Inc();
+            ReleaseMemObj();
+            record_ = other.record_;
+        }
         ctx_ = other.ctx_;
-        hostPtr_ = other.hostPtr_;
+        memObj_ = other.memObj_;
         size_ = other.size_;
-        AcquireMemObj( other.memObj_ );
+        hostPtr_ = other.hostPtr_;
+        return *this;
     }
-    CUMemObj operator=( const CUMemObj& other )
+    /// Move assignment: the reference count of \c other is not modified.
+    CUMemObj& operator=( CUMemObj&& other )
     {
+        if( &other == this ) return *this;
         ReleaseMemObj();
-        counter_ = other.counter_;
         ctx_ = other.ctx_;
+        memObj_ = other.memObj_;
         size_ = other.size_;
         hostPtr_ = other.hostPtr_;
-        AcquireMemObj( other.memObj_ );
+        record_ = other.record_;
+        other.memObj_ = CUdeviceptr();
+        other.record_ = 0;
         return *this;
     }
     ~CUMemObj() { ReleaseMemObj(); }
@@ -373,35 +406,32 @@ private:
             {
                 throw std::runtime_error( "Error - cuMemAlloc()" );
             }
+            record_ = new Record( memObj_ );
             size_ = bytesize;
         }
         
     }
+    /// Release reference held by this instance, freeing device memory when
+    /// it is the last one.
     void ReleaseMemObj()
     {
-        if( !counter_ ) return;
-        if( counter_->Dec() == 0 )
+        Record* r = record_;
+        record_ = 0;
+        memObj_ = CUdeviceptr();
+        if( !r || r->counter.Dec() != 0 ) return;
+        CUresult status = ::cuMemFree( r->memObj );
+        delete r;
+        if( status != CUDA_SUCCESS )
         {
-            CUresult status = ::cuMemFree( memObj_ );
-            if( status != CUDA_SUCCESS )
-            {
-                throw std::runtime_error( "Error - cuMemFree()" );
-            }
-            delete counter_;
-            counter_ = 0;
-        }        
-    }
-    void AcquireMemObj( CUdeviceptr mo )
-    {
-        memObj_ = mo;
-        counter_->Inc();        
+            throw std::runtime_error( "Error - cuMemFree()" );
+        }
     }
 private:
     CUcontext ctx_;
     CUdeviceptr memObj_;
     size_t size_;
     void* hostPtr_;
-    Counter* counter_;
+    Record* record_;
 };
 
 
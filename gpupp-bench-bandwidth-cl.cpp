@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "opencl/gpupp.h"
+#include "opencl/StagingPool.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+
+// Host <-> device bandwidth through the available transfer paths:
+// - pageable: clEnqueueRead/WriteBuffer from memory allocated with new
+// - pinned:   clEnqueueRead/WriteBuffer from a persistently mapped
+//             CL_MEM_ALLOC_HOST_PTR block, data already in pinned memory
+// - staged:   CLStagingPool copies from pageable memory, i.e. memcpy to or
+//             from pinned blocks overlapped with the transfers
+// - mapped:   zero-copy CLMemObj accessed with CLMap()/CLUnmap() and memcpy
+//             to or from pageable memory
+
+static const size_t MIN_SIZE = 64 * 1024;
+
+//------------------------------------------------------------------------------
+/// Transfer function: moves \c size bytes in the given direction, blocking.
+struct Path {
+    virtual ~Path() {}
+    virtual const char* Name() const = 0;
+    virtual void HtoD( size_t size ) = 0;
+    virtual void DtoH( size_t size ) = 0;
+};
+
+//------------------------------------------------------------------------------
+struct PageablePath : Path {
+    PageablePath( cl_command_queue cq, CLMemObj& d, std::vector< char >& h )
+        : cq_( cq ), d_( d ), h_( h ) {}
+    const char* Name() const { return "pageable"; }
+    void HtoD( size_t size ) { CLCopyHtoD( cq_, &h_[ 0 ], d_, CL_TRUE, 0, size ); }
+    void DtoH( size_t size ) { CLCopyDtoH( cq_, d_, &h_[ 0 ], CL_TRUE, 0, size ); }
+    cl_command_queue cq_;
+    CLMemObj& d_;
+    std::vector< char >& h_;
+};
+
+//------------------------------------------------------------------------------
+struct PinnedPath : Path {
+    PinnedPath( cl_command_queue cq, CLMemObj& d, const CLStagingPool::Block& b )
+        : cq_( cq ), d_( d ), b_( b ) {}
+    const char* Name() const { return "pinned"; }
+    void HtoD( size_t size ) {
+        const cl_int status = ::clEnqueueWriteBuffer( cq_, d_, CL_TRUE, 0, size, b_.hostPtr, 0, 0, 0 );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clEnqueueWriteBuffer()" );
+    }
+    void DtoH( size_t size ) {
+        const cl_int status = ::clEnqueueReadBuffer( cq_, d_, CL_TRUE, 0, size, b_.hostPtr, 0, 0, 0 );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clEnqueueReadBuffer()" );
+    }
+    cl_command_queue cq_;
+    CLMemObj& d_;
+    CLStagingPool::Block b_;
+};
+
+//------------------------------------------------------------------------------
+struct StagedPath : Path {
+    StagedPath( cl_command_queue cq, CLMemObj& d, std::vector< char >& h, CLStagingPool& pool )
+        : cq_( cq ), d_( d ), h_( h ), pool_( pool ) {}
+    const char* Name() const { return "staged"; }
+    void HtoD( size_t size ) {
+        const HEvent copied = pool_.CopyHtoD( cq_, &h_[ 0 ], d_, 0, size );
+        cl_event e = cl_event( copied );
+        ::clWaitForEvents( 1, &e );
+    }
+    void DtoH( size_t size ) { pool_.CopyDtoH( cq_, d_, &h_[ 0 ], 0, size ); }
+    cl_command_queue cq_;
+    CLMemObj& d_;
+    std::vector< char >& h_;
+    CLStagingPool& pool_;
+};
+
+//------------------------------------------------------------------------------
+struct MappedPath : Path {
+    MappedPath( cl_command_queue cq, CLMemObj& z, std::vector< char >& h )
+        : cq_( cq ), z_( z ), h_( h ) {}
+    const char* Name() const { return "mapped"; }
+    void HtoD( size_t size ) {
+        void* p = CLMap( cq_, z_, CL_MAP_WRITE_INVALIDATE_REGION, 0, size );
+        std::memcpy( p, &h_[ 0 ], size );
+        const HEvent unmapped = CLUnmap( cq_, z_, p );
+        cl_event e = cl_event( unmapped );
+        ::clWaitForEvents( 1, &e );
+    }
+    void DtoH( size_t size ) {
+        void* p = CLMap( cq_, z_, CL_MAP_READ, 0, size );
+        std::memcpy( &h_[ 0 ], p, size );
+        const HEvent unmapped = CLUnmap( cq_, z_, p );
+        cl_event e = cl_event( unmapped );
+        ::clWaitForEvents( 1, &e );
+    }
+    cl_command_queue cq_;
+    CLMemObj& z_;
+    std::vector< char >& h_;
+};
+
+//------------------------------------------------------------------------------
+/// Returns bandwidth in GB/s of a single transfer.
+struct Transfer {
+    void ( Path::*transfer )( size_t );
+    Path* path;
+    size_t size;
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        ( path->*transfer )( size );
+        timer.Stop();
+        return double( size ) / timer.ElapsedNs();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Bandwidth in GB/s of repeated transfers.
+Measurement Bandwidth( void ( Path::*transfer )( size_t ), Path& path, size_t size,
+                       const MeasureOptions& options ) {
+    const Transfer t = { transfer, &path, size };
+    return RepeatSample( t, options );
+}
+
+//------------------------------------------------------------------------------
+/// Print median bandwidth, marked with '*' if the confidence interval did not
+/// reach the target.
+void PrintBandwidth( const Measurement& m ) {
+    std::cout << std::setw( 13 ) << m.median << ( m.converged ? ' ' : '*' );
+}
+
+//------------------------------------------------------------------------------
+void BandwidthBenchmark( const char* platformName, int deviceNum, size_t maxSize, int reps ) {
+    try {
+        CLExecutionContext ec =
+            CreateCommandQueue( CreateCLExecutionContext( platformName,
+                                                          deviceNum,
+                                                          CL_DEVICE_TYPE_ALL ) );
+        std::vector< char > host( maxSize, char( 1 ) );
+        CLMemObj device( ec.context, maxSize );
+        CLMemObj zeroCopy( ec.context, maxSize, CL_MEM_READ_WRITE, CLMemObj::ZERO_COPY );
+        CLStagingPool pool( ec.context, ec.commandQueue );
+        CLStagingPool::Block pinned = pool.Acquire( maxSize );
+        std::memset( pinned.hostPtr, 1, maxSize );
+
+        PageablePath pageable( ec.commandQueue, device, host );
+        PinnedPath pinnedPath( ec.commandQueue, device, pinned );
+        StagedPath staged( ec.commandQueue, device, host, pool );
+        MappedPath mapped( ec.commandQueue, zeroCopy, host );
+        Path* paths[] = { &pageable, &pinnedPath, &staged, &mapped };
+        const int numPaths = sizeof( paths ) / sizeof( paths[ 0 ] );
+
+        MeasureOptions options;
+        options.minRuns = reps;
+        std::cout << "Median bandwidth in GB/s of at least " << reps << " transfers,"
+                     " * if the 95% confidence interval is wider than +-"
+                  << 100. * options.targetCI << "%\n";
+        std::cout << std::setw( 10 ) << "size (KB)";
+        for( int p = 0; p != numPaths; ++p ) {
+            std::cout << std::setw( 10 ) << paths[ p ]->Name() << " H>D"
+                      << std::setw( 10 ) << paths[ p ]->Name() << " D>H";
+        }
+        std::cout << '\n' << std::fixed << std::setprecision( 2 );
+        for( size_t size = MIN_SIZE; size <= maxSize; size *= 4 ) {
+            std::cout << std::setw( 10 ) << size / 1024;
+            for( int p = 0; p != numPaths; ++p ) {
+                PrintBandwidth( Bandwidth( &Path::HtoD, *paths[ p ], size, options ) );
+                PrintBandwidth( Bandwidth( &Path::DtoH, *paths[ p ], size, options ) );
+            }
+            std::cout << '\n';
+        }
+        pool.Recycle( pinned );
+        std::cout << "Staging pool: " << pool.GetStats() << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[device id - default is 0] "
+                     "[max transfer size in MB - default is 64] "
+                     "[minimum repetitions - default is 10]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    size_t maxSize = 64;
+    if( argc > 3 ) maxSize = size_t( atoi( argv[ 3 ] ) );
+    int reps = 10;
+    if( argc > 4 ) reps = atoi( argv[ 4 ] );
+    if( maxSize == 0 || reps <= 0 ) {
+        std::cerr << "Invalid size or repetitions" << std::endl;
+        return 1;
+    }
+    BandwidthBenchmark( argv[ 1 ], deviceNum, maxSize * 1024 * 1024, reps );
+    return 0;
+}
@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include "opencl/gpupp.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+
+// Throughput of back to back launches of a small kernel as a function of the
+// number of launches submitted with a single clFlush through CLBatchScope;
+// time includes the execution of all the kernels (clFinish). Each sample is a
+// run of numLaunches launches, repeated until the median is stable.
+
+static const char* SMALL_KERNEL_SRC =
+    "__kernel void Add( __global float* a, float v ) {\n"
+    "    a[ get_global_id( 0 ) ] += v;\n"
+    "}\n";
+
+//------------------------------------------------------------------------------
+/// Launch kernel \c numLaunches times and return the time per launch in
+/// microseconds; \c batchSize < 0 flushes after each launch, zero flushes
+/// once at the end, other values every \c batchSize launches.
+struct BatchRun {
+    const CLExecutionContext* ec;
+    cl_mem a;
+    SizeArray gwgs;
+    SizeArray lwgs;
+    int batchSize;
+    int numLaunches;
+    unsigned long long* flushes; //!< flushes issued by the last run
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        if( batchSize < 0 ) {
+            for( int i = 0; i != numLaunches; ++i ) Launch( *ec, gwgs, lwgs, a, 1.0f );
+            *flushes = numLaunches;
+        } else {
+            CLBatchScope batch( ec->commandQueue, size_t( batchSize ) );
+            for( int i = 0; i != numLaunches; ++i ) Launch( *ec, gwgs, lwgs, a, 1.0f );
+            batch.Flush();
+            *flushes = batch.Flushes();
+        }
+        ::clFinish( ec->commandQueue );
+        return 1000. * timer.Stop() / numLaunches;
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Time per launch in microseconds and number of flushes per run.
+struct BatchStats {
+    Measurement time;
+    unsigned long long flushes;
+};
+
+//------------------------------------------------------------------------------
+BatchStats MeasureBatch( const CLExecutionContext& ec, const CLMemObj& dA,
+                         const SizeArray& gwgs, const SizeArray& lwgs,
+                         int batchSize, int numLaunches ) {
+    BatchStats s;
+    s.flushes = 0;
+    const BatchRun run = { &ec, dA, gwgs, lwgs, batchSize, numLaunches, &s.flushes };
+    s.time = RepeatSample( run );
+    return s;
+}
+
+//------------------------------------------------------------------------------
+void BatchBenchmark( const char* platformName, int deviceNum, int numLaunches ) {
+    try {
+        std::string buildOutput;
+        CLExecutionContext ec =
+            CreateContextAndKernel( platformName,
+                                    CL_DEVICE_TYPE_ALL,
+                                    deviceNum,
+                                    SMALL_KERNEL_SRC,
+                                    "Add",
+                                    buildOutput );
+        const size_t SIZE = 256;
+        CLMemObj dA( ec.context, SIZE * sizeof( float ), CL_MEM_READ_WRITE );
+        const SizeArray gwgs( 1, SIZE );
+        const SizeArray lwgs( 1, 64 );
+        std::cout << "Launches per sample: " << numLaunches << '\n';
+        const BatchStats unbatched = MeasureBatch( ec, dA, gwgs, lwgs, -1, numLaunches );
+        std::cout << "  no batch   launch/s: " << 1E6 / unbatched.time.median
+                  << "  flushes: " << unbatched.flushes << '\n'
+                  << "    us/launch " << unbatched.time << '\n';
+        const int BATCH_SIZES[] = { 1, 4, 16, 64, 256, 1024, 0 };
+        for( size_t i = 0; i != sizeof( BATCH_SIZES ) / sizeof( int ); ++i ) {
+            const BatchStats b = MeasureBatch( ec, dA, gwgs, lwgs, BATCH_SIZES[ i ], numLaunches );
+            std::cout << "  batch ";
+            if( BATCH_SIZES[ i ] == 0 ) std::cout << " all";
+            else {
+                std::cout.width( 4 );
+                std::cout << BATCH_SIZES[ i ];
+            }
+            std::cout << " launch/s: " << 1E6 / b.time.median
+                      << "  flushes: " << b.flushes
+                      << "  speedup: " << unbatched.time.median / b.time.median << '\n'
+                      << "    us/launch " << b.time << '\n';
+        }
+        std::cout << std::flush;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[device id - default is 0] "
+                     "[launches per sample - default is 10000]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    int numLaunches = 10000;
+    if( argc > 3 ) numLaunches = atoi( argv[ 3 ] );
+    if( numLaunches <= 0 ) {
+        std::cerr << "Invalid number of launches" << std::endl;
+        return 1;
+    }
+    BatchBenchmark( argv[ 1 ], deviceNum, numLaunches );
+    return 0;
+}
@@ -0,0 +1,430 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include "opencl/gpupp.h"
+#include "opencl/ProgramBinaryCache.h"
+#include "opencl/ProgramRegistry.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+#include "utility/Json.h"
+
+// Benchmark suite writing machine readable results, meant to be run on a
+// CPU OpenCL implementation to track regressions of the host side paths:
+// - launch/<API>:            host time per launch of an empty kernel in us,
+//                            including the final clFinish of each batch
+// - copy/<htod|dtoh>/<size>: blocking copy bandwidth in GB/s
+// - matmul/<size>/tile<T>:   GFLOP/s of test/matmul.cl from device time
+// - build/context:           context and command queue creation time in ms
+// - build/program/<name>:    program build time in ms
+//
+// Each benchmark is repeated until the median is known within the target
+// confidence interval, see utility/Measure.h; all the samples are written
+// so that runs can be compared statistically with gpupp-bench-compare.
+
+static const char* EMPTY_KERNEL_SRC =
+    "__kernel void Empty( __global float* a, uint n ) {}\n";
+
+/// Launches per sample: a single launch is below the timer overhead.
+static const int LAUNCH_BATCH = 100;
+
+//------------------------------------------------------------------------------
+/// Result of a benchmark.
+struct BenchmarkResult {
+    std::string name;
+    std::string unit;
+    bool higherIsBetter;
+    Measurement measurement;
+};
+
+typedef std::vector< BenchmarkResult > Results;
+
+//------------------------------------------------------------------------------
+/// Store result and print summary.
+void AddResult( Results& results, const std::string& name, const std::string& unit,
+                bool higherIsBetter, const Measurement& m ) {
+    const BenchmarkResult r = { name, unit, higherIsBetter, m };
+    results.push_back( r );
+    std::cout << std::left << std::setw( 28 ) << name << std::right
+              << " (" << unit << ") " << m << std::endl;
+}
+
+//------------------------------------------------------------------------------
+/// Write results in JSON format.
+void WriteJSON( std::ostream& os, const std::string& platform,
+                const std::string& device, const Results& results ) {
+    os << std::setprecision( 9 );
+    os << "{\n\"platform\": ";
+    WriteJSONString( os, platform );
+    os << ",\n\"device\": ";
+    WriteJSONString( os, device );
+    os << ",\n\"benchmarks\": [\n";
+    for( Results::const_iterator r = results.begin(); r != results.end(); ++r ) {
+        const Measurement& m = r->measurement;
+        os << "{\"name\": ";
+        WriteJSONString( os, r->name );
+        os << ", \"unit\": ";
+        WriteJSONString( os, r->unit );
+        os << ", \"better\": \"" << ( r->higherIsBetter ? "higher" : "lower" ) << '"'
+           << ", \"median\": " << m.median << ", \"mad\": " << m.mad
+           << ", \"ci_low\": " << m.ciLow << ", \"ci_high\": " << m.ciHigh
+           << ", \"converged\": " << ( m.converged ? "true" : "false" )
+           << ", \"samples\": [";
+        for( std::vector< double >::const_iterator s = m.samples.begin(); s != m.samples.end(); ++s ) {
+            if( s != m.samples.begin() ) os << ", ";
+            os << *s;
+        }
+        os << "]}" << ( r + 1 != results.end() ? "," : "" ) << '\n';
+    }
+    os << "]\n}\n";
+}
+
+//------------------------------------------------------------------------------
+/// Returns platform and device names.
+std::pair< std::string, std::string > Names( const CLExecutionContext& ec ) {
+    std::vector< char > buf( 1024, char() );
+    std::pair< std::string, std::string > n;
+    if( ::clGetPlatformInfo( ec.platform, CL_PLATFORM_NAME, buf.size() - 1, &buf[ 0 ], 0 ) == CL_SUCCESS ) {
+        n.first = &buf[ 0 ];
+    }
+    std::fill( buf.begin(), buf.end(), char() );
+    if( ::clGetDeviceInfo( ec.device, CL_DEVICE_NAME, buf.size() - 1, &buf[ 0 ], 0 ) == CL_SUCCESS ) {
+        n.second = &buf[ 0 ];
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+/// Arguments of the empty kernel.
+struct LaunchArgs {
+    const CLExecutionContext* ec;
+    SizeArray gwgs;
+    SizeArray lwgs;
+    cl_mem a;
+    cl_uint n;
+};
+
+//------------------------------------------------------------------------------
+/// Launch through InvokeKernelAsync and a VArgList.
+struct InvokeAsyncLaunch {
+    LaunchArgs p;
+    void operator()() const {
+        cl_event e = InvokeKernelAsync( *p.ec, p.gwgs, p.lwgs, ( VArgList(), p.a, p.n ) );
+        ::clReleaseEvent( e );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Launch through InvokeKernelSync and a VArgList.
+struct InvokeSyncLaunch {
+    LaunchArgs p;
+    void operator()() const {
+        InvokeKernelSync( *p.ec, p.gwgs, p.lwgs, ( VArgList(), p.a, p.n ), EventArray() );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Launch through the variadic Launch function.
+struct VariadicLaunch {
+    LaunchArgs p;
+    void operator()() const {
+        Launch( *p.ec, p.gwgs, p.lwgs, p.a, p.n );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Launch through CLKernelHandler, setting all the parameters.
+struct HandlerLaunch {
+    LaunchArgs p;
+    bool sync;
+    void operator()() const {
+        CLKernelHandler kh( *p.ec, p.gwgs, p.lwgs );
+        kh.SetParam( 0, p.a );
+        kh.SetParam( 1, p.n );
+        if( sync ) kh.SyncRun();
+        else kh.AsyncRun();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Returns the time in microseconds per launch of a batch of launches.
+template < class LaunchT >
+struct LaunchBatch {
+    LaunchT launch;
+    cl_command_queue cq;
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        for( int i = 0; i != LAUNCH_BATCH; ++i ) launch();
+        ::clFinish( cq );
+        return 1000. * timer.Stop() / LAUNCH_BATCH;
+    }
+};
+
+//------------------------------------------------------------------------------
+template < class LaunchT >
+void MeasureLaunch( Results& results, const char* name, const LaunchT& launch,
+                    cl_command_queue cq ) {
+    const LaunchBatch< LaunchT > batch = { launch, cq };
+    AddResult( results, std::string( "launch/" ) + name, "us", false, RepeatSample( batch ) );
+}
+
+//------------------------------------------------------------------------------
+void LaunchBenchmarks( Results& results, const CLExecutionContext& ec ) {
+    std::string buildOutput;
+    const CLExecutionContext k = BuildKernel( ec, EMPTY_KERNEL_SRC, "Empty", buildOutput );
+    CLMemObj a( ec.context, 1024 * sizeof( float ) );
+    const LaunchArgs p = { &k, SizeArray( 1, 16 ), SizeArray( 1, 16 ), a, 16 };
+    const InvokeAsyncLaunch invokeAsync = { p };
+    const InvokeSyncLaunch invokeSync = { p };
+    const VariadicLaunch variadic = { p };
+    const HandlerLaunch handlerAsync = { p, false };
+    const HandlerLaunch handlerSync = { p, true };
+    MeasureLaunch( results, "InvokeKernelAsync", invokeAsync, k.commandQueue );
+    MeasureLaunch( results, "InvokeKernelSync", invokeSync, k.commandQueue );
+    MeasureLaunch( results, "Launch", variadic, k.commandQueue );
+    MeasureLaunch( results, "CLKernelHandler::AsyncRun", handlerAsync, k.commandQueue );
+    MeasureLaunch( results, "CLKernelHandler::SyncRun", handlerSync, k.commandQueue );
+}
+
+//------------------------------------------------------------------------------
+/// Returns bandwidth in GB/s of a blocking copy.
+struct Copy {
+    cl_command_queue cq;
+    CLMemObj* d;
+    std::vector< char >* h;
+    size_t size;
+    bool htod;
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        if( htod ) CLCopyHtoD( cq, &( *h )[ 0 ], *d, CL_TRUE, 0, size );
+        else CLCopyDtoH( cq, *d, &( *h )[ 0 ], CL_TRUE, 0, size );
+        timer.Stop();
+        return double( size ) / timer.ElapsedNs();
+    }
+};
+
+//------------------------------------------------------------------------------
+void CopyBenchmarks( Results& results, const CLExecutionContext& ec, size_t maxSize ) {
+    std::vector< char > h( maxSize, char( 1 ) );
+    CLMemObj d( ec.context, maxSize );
+    for( size_t size = 4096; size <= maxSize; size *= 4 ) {
+        for( int dir = 0; dir != 2; ++dir ) {
+            const Copy copy = { ec.commandQueue, &d, &h, size, dir == 0 };
+            std::ostringstream name;
+            name << "copy/" << ( dir == 0 ? "htod/" : "dtoh/" ) << size;
+            AddResult( results, name.str(), "GB/s", true, RepeatSample( copy ) );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Returns execution time in milliseconds of the matrix multiply kernel,
+/// read from the event.
+struct MatMulRun {
+    const CLExecutionContext* ec;
+    cl_mem a, b, c;
+    cl_uint size;
+    cl_uint tile;
+    double operator()() const {
+        const HEvent e = InvokeKernelSync( *ec, SizeArray( 2, size ), SizeArray( 2, tile ),
+                                           ( VArgList(), a, b, c, cl_int( size ), cl_int( size ) ),
+                                           EventArray() );
+        return ProfilingInfo( e ).ExecutionTime();
+    }
+};
+
+//------------------------------------------------------------------------------
+void MatMulBenchmarks( Results& results, const CLExecutionContext& ec,
+                       const std::string& src ) {
+    const cl_uint SIZES[] = { 128, 256, 512, 1024 };
+    const cl_uint TILES[] = { 4, 8, 16 };
+    const cl_uint MAX_SIZE = SIZES[ sizeof( SIZES ) / sizeof( SIZES[ 0 ] ) - 1 ];
+    const size_t BYTE_SIZE = MAX_SIZE * MAX_SIZE * sizeof( float );
+    const std::vector< float > ones( MAX_SIZE * MAX_SIZE, 1.f );
+    CLMemObj a( ec.context, BYTE_SIZE, CL_MEM_READ_ONLY );
+    CLMemObj b( ec.context, BYTE_SIZE, CL_MEM_READ_ONLY );
+    CLMemObj c( ec.context, BYTE_SIZE, CL_MEM_WRITE_ONLY );
+    CLCopyHtoD( ec.commandQueue, &ones[ 0 ], a );
+    CLCopyHtoD( ec.commandQueue, &ones[ 0 ], b );
+    MeasureOptions options;
+    options.targetCI = 0.02;
+    options.maxRuns = 100;
+    for( int t = 0; t != sizeof( TILES ) / sizeof( TILES[ 0 ] ); ++t ) {
+        std::ostringstream buildOptions;
+        buildOptions << "-DTILE_SIZE=" << TILES[ t ];
+        std::string buildOutput;
+        const CLExecutionContext k = BuildKernel( ec, src, "MatMul", buildOutput, buildOptions.str() );
+        size_t maxWGroupSize = 0;
+        const cl_int status = ::clGetKernelWorkGroupInfo( k.kernel, k.device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                          sizeof( size_t ), &maxWGroupSize, 0 );
+        if( status != CL_SUCCESS || maxWGroupSize < TILES[ t ] * TILES[ t ] ) {
+            std::cout << "matmul: tile " << TILES[ t ] << " exceeds work-group size, skipped" << std::endl;
+            continue;
+        }
+        for( int s = 0; s != sizeof( SIZES ) / sizeof( SIZES[ 0 ] ); ++s ) {
+            const MatMulRun run = { &k, a, b, c, SIZES[ s ], TILES[ t ] };
+            Measurement m = RepeatSample( run, options );
+            // convert execution times to GFLOP/s and recompute statistics;
+            // the relative confidence interval is about the same
+            const double ops = 2. * SIZES[ s ] * SIZES[ s ] * SIZES[ s ];
+            for( std::vector< double >::iterator i = m.samples.begin(); i != m.samples.end(); ++i ) {
+                *i = ops / ( *i * 1E6 );
+            }
+            ComputeStatistics( m );
+            std::ostringstream name;
+            name << "matmul/" << SIZES[ s ] << "/tile" << TILES[ t ];
+            AddResult( results, name.str(), "GFLOP/s", true, m );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Returns time in milliseconds to create and release context and command queue.
+struct ContextSetup {
+    std::string platformName;
+    int deviceNum;
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        {
+            const CLExecutionContext ec =
+                CreateCommandQueue( CreateCLExecutionContext( platformName, deviceNum, CL_DEVICE_TYPE_ALL ) );
+        }
+        return timer.Stop();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Returns time in milliseconds to build program. Each build has a distinct
+/// source text, so that compiler caches of the run-time are not hit.
+struct ProgramBuild {
+    const CLExecutionContext* ec;
+    std::string src;
+    std::string buildOptions;
+    int* counter;
+    double operator()() const {
+        std::ostringstream os;
+        os << "// build " << ( *counter )++ << '\n' << src;
+        const std::string s = os.str();
+        std::string buildOutput;
+        Timer timer;
+        timer.Start();
+        {
+            const HProgram p = BuildProgram( *ec, s, buildOutput, buildOptions );
+        }
+        return timer.Stop();
+    }
+};
+
+//------------------------------------------------------------------------------
+void BuildBenchmarks( Results& results, const CLExecutionContext& ec,
+                      const char* platformName, int deviceNum,
+                      const std::string& matmulSrc ) {
+    // measure compilation: programs must not be served by gpupp caches
+    ProgramBinaryCache::Instance().SetDirectory( "" );
+    ProgramRegistry::Instance().SetEnabled( false );
+    MeasureOptions options;
+    options.warmupRuns = 1;
+    options.minRuns = 5;
+    options.maxRuns = 30;
+    options.targetCI = 0.05;
+    options.maxTime = 10000.;
+    const ContextSetup setup = { platformName, deviceNum };
+    AddResult( results, "build/context", "ms", false, RepeatSample( setup, options ) );
+    int counter = 0;
+    const ProgramBuild empty = { &ec, EMPTY_KERNEL_SRC, "", &counter };
+    AddResult( results, "build/program/empty", "ms", false, RepeatSample( empty, options ) );
+    if( matmulSrc.empty() ) return;
+    const ProgramBuild matmul = { &ec, matmulSrc, "-DTILE_SIZE=16", &counter };
+    AddResult( results, "build/program/matmul", "ms", false, RepeatSample( matmul, options ) );
+}
+
+//------------------------------------------------------------------------------
+int Benchmark( const char* platformName, int deviceNum, const std::string& outFileName,
+               size_t maxSize ) {
+    try {
+        std::string KERNEL_PATH = "test";
+        if( getenv( "OPENCL_KERNEL_PATH" ) ) KERNEL_PATH = getenv( "OPENCL_KERNEL_PATH" );
+#ifdef WIN32
+        KERNEL_PATH += "\\matmul.cl";
+#else
+        KERNEL_PATH += "/matmul.cl";
+#endif
+        std::string matmulSrc;
+        try {
+            matmulSrc = LoadText( KERNEL_PATH );
+        }
+        catch( const std::exception& ) {
+            std::cerr << "Cannot load " << KERNEL_PATH << ": matmul benchmarks skipped; "
+                         "set the kernel directory with the OPENCL_KERNEL_PATH env var" << std::endl;
+        }
+        const CLExecutionContext ec =
+            CreateCommandQueue( CreateCLExecutionContext( platformName, deviceNum, CL_DEVICE_TYPE_ALL ),
+                                CL_QUEUE_PROFILING_ENABLE );
+        const std::pair< std::string, std::string > names = Names( ec );
+        std::cout << "Platform: " << names.first << "\nDevice:   " << names.second
+                  << "\nClock:    " << ( MonotonicClock::UsesTsc() ? "TSC" : "monotonic" ) << std::endl;
+        Results results;
+        LaunchBenchmarks( results, ec );
+        CopyBenchmarks( results, ec, maxSize );
+        if( !matmulSrc.empty() ) MatMulBenchmarks( results, ec, matmulSrc );
+        BuildBenchmarks( results, ec, platformName, deviceNum, matmulSrc );
+        std::ofstream os( outFileName.c_str() );
+        if( !os ) throw std::runtime_error( "Cannot open " + outFileName );
+        WriteJSON( os, names.first, names.second, results );
+        std::cout << "Results written to " << outFileName << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. Portable Computing Language> "
+                     "[device id - default is 0] "
+                     "[output file - default is gpupp-bench.json] "
+                     "[max transfer size in MB - default is 16]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    std::string outFileName = "gpupp-bench.json";
+    if( argc > 3 ) outFileName = argv[ 3 ];
+    size_t maxSize = 16;
+    if( argc > 4 ) maxSize = size_t( atoi( argv[ 4 ] ) );
+    if( maxSize == 0 ) {
+        std::cerr << "Invalid size" << std::endl;
+        return 1;
+    }
+    return Benchmark( argv[ 1 ], deviceNum, outFileName, maxSize * 1024 * 1024 );
+}
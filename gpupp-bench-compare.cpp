@@ -0,0 +1,333 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+
+// Compare two result files written by gpupp-bench. For each benchmark the
+// samples of the two runs are compared with the Mann-Whitney U test, which
+// does not assume normally distributed timings; a benchmark regressed when
+// the difference is significant and the median moved in the wrong direction
+// by more than the threshold. A benchmark of the baseline missing from the
+// current results, e.g. because it failed, counts as a regression unless
+// --allow-missing is passed. The exit code is 1 if any benchmark regressed,
+// 2 in case of errors, so that the tool can gate continuous integration.
+// Only the standard library is used: no OpenCL run-time is required.
+
+//------------------------------------------------------------------------------
+/// Benchmark samples read from a result file.
+struct BenchmarkSamples {
+    std::string unit;
+    bool higherIsBetter;
+    std::vector< double > samples;
+    BenchmarkSamples() : higherIsBetter( false ) {}
+};
+
+/// Benchmark name -> samples
+typedef std::map< std::string, BenchmarkSamples > ResultFile;
+
+//------------------------------------------------------------------------------
+/// Minimal reader of the JSON subset written by gpupp-bench: values are
+/// consumed in document order and unknown members are skipped.
+class JSONReader {
+public:
+    JSONReader( const std::string& text ) : text_( text ), pos_( 0 ) {}
+    /// Consume character, skipping white space.
+    /// \throw std::runtime_error in case the next character is different
+    void Expect( char c ) {
+        if( !Consume( c ) ) Error( std::string( "expected '" ) + c + "'" );
+    }
+    /// Consume character if it is the next one, skipping white space.
+    bool Consume( char c ) {
+        SkipSpace();
+        if( pos_ < text_.size() && text_[ pos_ ] == c ) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+    /// Returns string literal.
+    std::string String() {
+        Expect( '"' );
+        std::string s;
+        while( pos_ < text_.size() && text_[ pos_ ] != '"' ) {
+            if( text_[ pos_ ] == '\\' ) {
+                if( ++pos_ == text_.size() ) break;
+                // escape sequences other than quotes and backslashes are not
+                // produced by gpupp-bench: keep the escaped character
+                if( text_[ pos_ ] == 'n' ) s += '\n';
+                else if( text_[ pos_ ] == 't' ) s += '\t';
+                else s += text_[ pos_ ];
+            }
+            else s += text_[ pos_ ];
+            ++pos_;
+        }
+        Expect( '"' );
+        return s;
+    }
+    /// Returns number.
+    double Number() {
+        SkipSpace();
+        const char* begin = text_.c_str() + pos_;
+        char* end = 0;
+        const double d = std::strtod( begin, &end );
+        if( end == begin ) Error( "expected number" );
+        pos_ += end - begin;
+        return d;
+    }
+    /// Skip value of any type.
+    void Skip() {
+        SkipSpace();
+        if( pos_ == text_.size() ) Error( "unexpected end" );
+        const char c = text_[ pos_ ];
+        if( c == '"' ) String();
+        else if( c == '{' || c == '[' ) {
+            const char close = c == '{' ? '}' : ']';
+            ++pos_;
+            if( Consume( close ) ) return;
+            do {
+                if( c == '{' ) {
+                    String();
+                    Expect( ':' );
+                }
+                Skip();
+            } while( Consume( ',' ) );
+            Expect( close );
+        }
+        else if( text_.compare( pos_, 4, "true" ) == 0 || text_.compare( pos_, 4, "null" ) == 0 ) pos_ += 4;
+        else if( text_.compare( pos_, 5, "false" ) == 0 ) pos_ += 5;
+        else Number();
+    }
+    /// Throws std::runtime_error with position of the next character.
+    void Error( const std::string& msg ) const {
+        std::ostringstream os;
+        os << "JSON error at offset " << pos_ << ": " << msg;
+        throw std::runtime_error( os.str() );
+    }
+private:
+    void SkipSpace() {
+        while( pos_ < text_.size() && std::isspace( (unsigned char)( text_[ pos_ ] ) ) ) ++pos_;
+    }
+private:
+    const std::string& text_;
+    size_t pos_;
+};
+
+//------------------------------------------------------------------------------
+/// Read benchmark entry.
+void ReadBenchmark( JSONReader& r, ResultFile& results ) {
+    std::string name;
+    BenchmarkSamples b;
+    r.Expect( '{' );
+    if( !r.Consume( '}' ) ) {
+        do {
+            const std::string key = r.String();
+            r.Expect( ':' );
+            if( key == "name" ) name = r.String();
+            else if( key == "unit" ) b.unit = r.String();
+            else if( key == "better" ) b.higherIsBetter = r.String() == "higher";
+            else if( key == "samples" ) {
+                r.Expect( '[' );
+                if( !r.Consume( ']' ) ) {
+                    do b.samples.push_back( r.Number() ); while( r.Consume( ',' ) );
+                    r.Expect( ']' );
+                }
+            }
+            else r.Skip();
+        } while( r.Consume( ',' ) );
+        r.Expect( '}' );
+    }
+    if( name.empty() ) r.Error( "benchmark without name" );
+    results[ name ] = b;
+}
+
+//------------------------------------------------------------------------------
+/// Read result file.
+/// \throw std::runtime_error in case the file cannot be read or parsed
+ResultFile ReadResultFile( const std::string& fileName ) {
+    std::ifstream is( fileName.c_str() );
+    if( !is ) throw std::runtime_error( "Cannot open " + fileName );
+    std::ostringstream os;
+    os << is.rdbuf();
+    const std::string text = os.str();
+    JSONReader r( text );
+    ResultFile results;
+    r.Expect( '{' );
+    if( !r.Consume( '}' ) ) {
+        do {
+            const std::string key = r.String();
+            r.Expect( ':' );
+            if( key == "benchmarks" ) {
+                r.Expect( '[' );
+                if( !r.Consume( ']' ) ) {
+                    do ReadBenchmark( r, results ); while( r.Consume( ',' ) );
+                    r.Expect( ']' );
+                }
+            }
+            else r.Skip();
+        } while( r.Consume( ',' ) );
+        r.Expect( '}' );
+    }
+    return results;
+}
+
+//------------------------------------------------------------------------------
+double Median( std::vector< double > v ) {
+    if( v.empty() ) return 0.;
+    std::sort( v.begin(), v.end() );
+    const size_t n = v.size();
+    return n % 2 ? v[ n / 2 ] : 0.5 * ( v[ n / 2 - 1 ] + v[ n / 2 ] );
+}
+
+//------------------------------------------------------------------------------
+/// Two-sided p-value of the Mann-Whitney U test: normal approximation with
+/// continuity and tie corrections, adequate from about eight samples each.
+double MannWhitneyP( const std::vector< double >& a, const std::vector< double >& b ) {
+    const double n1 = double( a.size() );
+    const double n2 = double( b.size() );
+    if( n1 == 0. || n2 == 0. ) return 1.;
+    // (value, sample) pairs sorted by value; sample is 0 for a, 1 for b
+    std::vector< std::pair< double, int > > all;
+    for( size_t i = 0; i != a.size(); ++i ) all.push_back( std::make_pair( a[ i ], 0 ) );
+    for( size_t i = 0; i != b.size(); ++i ) all.push_back( std::make_pair( b[ i ], 1 ) );
+    std::sort( all.begin(), all.end() );
+    const double n = n1 + n2;
+    double rankSumA = 0.;
+    double ties = 0.; // sum of t^3 - t over groups of t equal values
+    for( size_t i = 0; i != all.size(); ) {
+        size_t j = i + 1;
+        while( j != all.size() && all[ j ].first == all[ i ].first ) ++j;
+        // equal values share the average of their ranks, ranks start at 1
+        const double rank = 0.5 * ( double( i + 1 ) + double( j ) );
+        for( size_t k = i; k != j; ++k ) {
+            if( all[ k ].second == 0 ) rankSumA += rank;
+        }
+        const double t = double( j - i );
+        ties += t * t * t - t;
+        i = j;
+    }
+    const double u = rankSumA - n1 * ( n1 + 1. ) / 2.;
+    const double mean = n1 * n2 / 2.;
+    const double variance = n1 * n2 / 12. * ( ( n + 1. ) - ties / ( n * ( n - 1. ) ) );
+    if( variance <= 0. ) return 1.;
+    const double d = std::fabs( u - mean ) - 0.5;
+    const double z = ( d > 0. ? d : 0. ) / std::sqrt( variance );
+    return std::erfc( z / std::sqrt( 2. ) );
+}
+
+//------------------------------------------------------------------------------
+/// Returns number in fixed notation.
+std::string Fixed( double d, int precision ) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision( precision ) << d;
+    return os.str();
+}
+
+//------------------------------------------------------------------------------
+int Compare( const std::string& baselineFile, const std::string& currentFile,
+             double threshold, double alpha, bool allowMissing ) {
+    const ResultFile baseline = ReadResultFile( baselineFile );
+    const ResultFile current = ReadResultFile( currentFile );
+    int regressions = 0;
+    int missing = 0;
+    std::cout << std::left << std::setw( 32 ) << "benchmark" << std::right
+              << std::setw( 14 ) << "baseline" << std::setw( 14 ) << "current"
+              << std::setw( 10 ) << "change" << std::setw( 10 ) << "p" << "  result\n";
+    for( ResultFile::const_iterator c = current.begin(); c != current.end(); ++c ) {
+        ResultFile::const_iterator b = baseline.find( c->first );
+        if( b == baseline.end() ) {
+            std::cout << std::left << std::setw( 32 ) << c->first << std::right << "  new\n";
+            continue;
+        }
+        const double before = Median( b->second.samples );
+        const double after = Median( c->second.samples );
+        const double change = before != 0. ? ( after - before ) / std::fabs( before ) : 0.;
+        // relative change, positive when worse
+        const double worse = c->second.higherIsBetter ? -change : change;
+        const double p = MannWhitneyP( b->second.samples, c->second.samples );
+        const bool significant = p < alpha;
+        const char* result = "unchanged";
+        if( significant && worse > threshold ) {
+            result = "REGRESSION";
+            ++regressions;
+        }
+        else if( significant && -worse > threshold ) result = "improvement";
+        std::cout << std::left << std::setw( 32 ) << c->first << std::right
+                  << std::setw( 14 ) << before << std::setw( 14 ) << after
+                  << std::setw( 9 ) << Fixed( 100. * change, 1 ) << '%'
+                  << std::setw( 10 ) << Fixed( p, 4 )
+                  << "  " << result << ' ' << c->second.unit << '\n';
+    }
+    for( ResultFile::const_iterator b = baseline.begin(); b != baseline.end(); ++b ) {
+        if( current.find( b->first ) == current.end() ) {
+            std::cout << std::left << std::setw( 32 ) << b->first << std::right
+                      << ( allowMissing ? "  missing\n" : "  MISSING\n" );
+            ++missing;
+        }
+    }
+    std::cout << regressions << " regression(s) above " << 100. * threshold
+              << "% at significance " << alpha << ", " << missing
+              << " missing benchmark(s)" << std::endl;
+    return regressions > 0 || ( missing > 0 && !allowMissing ) ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    bool allowMissing = false;
+    std::vector< std::string > args;
+    for( int i = 1; i < argc; ++i ) {
+        if( std::string( argv[ i ] ) == "--allow-missing" ) allowMissing = true;
+        else args.push_back( argv[ i ] );
+    }
+    if( args.size() < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " [--allow-missing] <baseline results> <current results> "
+                     "[regression threshold in % - default is 5] "
+                     "[significance level - default is 0.05]\n"
+                     "  --allow-missing: do not fail when benchmarks of the baseline "
+                     "are missing from the current results"
+                  << std::endl;
+        return 2;
+    }
+    double threshold = 5.;
+    if( args.size() > 2 ) threshold = atof( args[ 2 ].c_str() );
+    double alpha = 0.05;
+    if( args.size() > 3 ) alpha = atof( args[ 3 ].c_str() );
+    if( threshold < 0. || alpha <= 0. || alpha >= 1. ) {
+        std::cerr << "Invalid threshold or significance level" << std::endl;
+        return 2;
+    }
+    try {
+        return Compare( args[ 0 ], args[ 1 ], threshold / 100., alpha, allowMissing );
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
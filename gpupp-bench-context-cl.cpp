@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <utility>
+#include "opencl/gpupp.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+
+// Setup latency of short-lived execution contexts: context, queue, program
+// and kernel created and released at each iteration, assembled by
+// - copy:    CreateCLExecutionContext -> CreateCommandQueue -> BuildKernel
+//            with named intermediate contexts, i.e. handles copied at each hop
+// - chained: CreateContextAndKernel, handles created in place
+// - builder: CLExecutionContextBuilder, handles created in place
+// Handle pass-through cost is measured separately, without run-time calls.
+
+static const char* EMPTY_KERNEL_SRC =
+    "__kernel void Empty( __global float* a ) {}\n";
+
+//------------------------------------------------------------------------------
+/// Context assembled by copying handles through each step.
+struct CopySetup {
+    CLExecutionContext operator()( const char* platformName, int deviceNum ) const {
+        std::string buildOutput;
+        const CLExecutionContext c = CreateCLExecutionContext( platformName, deviceNum, CL_DEVICE_TYPE_ALL );
+        const CLExecutionContext q = CreateCommandQueue( c );
+        return BuildKernel( q, EMPTY_KERNEL_SRC, "Empty", buildOutput );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Context assembled by CreateContextAndKernel.
+struct ChainedSetup {
+    CLExecutionContext operator()( const char* platformName, int deviceNum ) const {
+        std::string buildOutput;
+        return CreateContextAndKernel( platformName, CL_DEVICE_TYPE_ALL, deviceNum,
+                                       EMPTY_KERNEL_SRC, "Empty", buildOutput );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Context assembled by CLExecutionContextBuilder.
+struct BuilderSetup {
+    CLExecutionContext operator()( const char* platformName, int deviceNum ) const {
+        return CLExecutionContextBuilder( platformName )
+                   .DeviceType( CL_DEVICE_TYPE_ALL )
+                   .Device( deviceNum )
+                   .Kernel( EMPTY_KERNEL_SRC, "Empty" )
+                   .Build();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Average time in microseconds to create and release a context.
+template < class SetupT >
+struct SetupRun {
+    const char* platformName;
+    int deviceNum;
+    int iterations;
+    double operator()() const {
+        const SetupT setup = SetupT();
+        Timer timer;
+        timer.Start();
+        for( int i = 0; i != iterations; ++i ) {
+            setup( platformName, deviceNum );
+        }
+        return 1000. * timer.Stop() / iterations;
+    }
+};
+
+//------------------------------------------------------------------------------
+template < class SetupT >
+Measurement SetupLatency( const char* platformName, int deviceNum, int iterations ) {
+    const SetupRun< SetupT > run = { platformName, deviceNum, iterations };
+    return RepeatSample( run );
+}
+
+//------------------------------------------------------------------------------
+/// Average time in nanoseconds to pass a context through three hops by copy
+/// or by move.
+struct PassThroughRun {
+    const CLExecutionContext* ec;
+    bool move;
+    int iterations;
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        for( int i = 0; i != iterations; ++i ) {
+            CLExecutionContext a( *ec );
+            if( move ) {
+                CLExecutionContext b( std::move( a ) );
+                CLExecutionContext c( std::move( b ) );
+                CLExecutionContext d( std::move( c ) );
+            } else {
+                CLExecutionContext b( a );
+                CLExecutionContext c( b );
+                CLExecutionContext d( c );
+            }
+        }
+        return 1E6 * timer.Stop() / ( 3. * iterations );
+    }
+};
+
+//------------------------------------------------------------------------------
+Measurement PassThroughLatency( const CLExecutionContext& ec, bool move, int iterations ) {
+    const PassThroughRun run = { &ec, move, iterations };
+    return RepeatSample( run );
+}
+
+//------------------------------------------------------------------------------
+void ContextBenchmark( const char* platformName, int deviceNum, int iterations ) {
+    try {
+        std::cout << "Context setup and release (us), average of " << iterations << " per sample\n";
+        std::cout << "  copy:    " << SetupLatency< CopySetup >( platformName, deviceNum, iterations ) << '\n';
+        std::cout << "  chained: " << SetupLatency< ChainedSetup >( platformName, deviceNum, iterations ) << '\n';
+        std::cout << "  builder: " << SetupLatency< BuilderSetup >( platformName, deviceNum, iterations ) << '\n';
+        const CLExecutionContext ec = BuilderSetup()( platformName, deviceNum );
+        const int hops = 1000 * iterations;
+        std::cout << "Pass-through per hop (ns), average of " << hops << " per sample\n";
+        std::cout << "  copy:    " << PassThroughLatency( ec, false, hops ) << '\n';
+        std::cout << "  move:    " << PassThroughLatency( ec, true, hops ) << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[device id - default is 0] "
+                     "[iterations per sample - default is 10]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    int iterations = 10;
+    if( argc > 3 ) iterations = atoi( argv[ 3 ] );
+    if( iterations <= 0 ) {
+        std::cerr << "Invalid number of iterations" << std::endl;
+        return 1;
+    }
+    ContextBenchmark( argv[ 1 ], deviceNum, iterations );
+    return 0;
+}
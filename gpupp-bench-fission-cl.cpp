@@ -0,0 +1,221 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "opencl/gpupp.h"
+#include "opencl/MultiDevice.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+#include "utility/HostGemm.h"
+
+// Memory-bound matrix * vector product (test/vecmatmul.cl built with -DROW)
+// on a CPU device used as a whole and split into sub-devices with
+// clCreateSubDevices. Rows are partitioned among sub-devices and the rows of
+// each sub-device are first touched on its NUMA node, so that each sub-device
+// streams the matrix from local memory.
+
+#ifdef DOUBLE
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
+typedef unsigned uint;
+
+//------------------------------------------------------------------------------
+/// Parses "numa" or "equal:<compute units>".
+CLDevicePartition ParsePartition( const std::string& s ) {
+    if( s == "numa" ) return CLDevicePartition::ByAffinityDomain( CL_DEVICE_AFFINITY_DOMAIN_NUMA );
+    if( s.compare( 0, 6, "equal:" ) == 0 && atoi( s.c_str() + 6 ) > 0 ) {
+        return CLDevicePartition::Equally( cl_uint( atoi( s.c_str() + 6 ) ) );
+    }
+    throw std::invalid_argument( "Invalid partition: " + s );
+}
+
+//------------------------------------------------------------------------------
+/// Multi-device context made of the single device of an execution context.
+CLMultiDeviceContext WholeDeviceContext( const CLExecutionContext& ec ) {
+    CLMultiDeviceContext mdc;
+    mdc.platform = ec.platform;
+    mdc.context = ec.context;
+    mdc.devices.push_back( ec.device );
+    mdc.commandQueues.push_back( CreateCommandQueue( ec, CL_QUEUE_PROFILING_ENABLE ).commandQueue );
+    mdc.numaNodes.push_back( -1 );
+    return mdc;
+}
+
+//------------------------------------------------------------------------------
+/// Returns bandwidth in GB/s of a W = M * V run; weights are kept unchanged
+/// so that slices do not move away from the memory placed for them.
+struct VecMatMulRun {
+    CLPartitionedKernel* kernel;
+    SizeArray gwgs;
+    SizeArray lwgs;
+    const CLMemObj* dM;
+    uint size;
+    const CLMemObj* dV;
+    const std::vector< CLMemObj >* dW;
+    double bytes; //!< bytes read and written by a run
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        kernel->Launch( gwgs, lwgs, *dM, size, size, *dV, PerDeviceArg( *dW ) );
+        kernel->Wait( 1. );
+        timer.Stop();
+        return bytes / timer.ElapsedNs();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Computes W = M * V on the devices of \c mdc and returns the bandwidth in
+/// GB/s of at least \c iterations runs; matrix memory is placed according to
+/// the row partition.
+Measurement VecMatMulBandwidth( const CLMultiDeviceContext& mdc,
+                                const std::string& src,
+                                const std::string& buildOptions,
+                                uint size,
+                                int iterations,
+                                std::vector< real_t >& W ) {
+    const size_t rowBytes = size * sizeof( real_t );
+    CLPartitionedKernel kernel( mdc, src, "VecMatMul", "-DROW " + buildOptions, 0 );
+    const CLPartitionedKernel::Slices slices = kernel.Partition( size, 1 );
+    std::cout << "  slices: " << slices << std::endl;
+
+    // (1) matrix: pages of each slice placed on the node of its device,
+    // then initialized in place
+    CLMemObj dM = CreateFirstTouchBuffer( mdc, slices, rowBytes, size * rowBytes, CL_MEM_READ_ONLY );
+    real_t* M = static_cast< real_t* >( CLMap( mdc.commandQueues[ 0 ], dM, CL_MAP_WRITE ) );
+    for( size_t i = 0; i != size_t( size ) * size; ++i ) M[ i ] = real_t( i % size ) / size;
+    const HEvent unmapped = CLUnmap( mdc.commandQueues[ 0 ], dM, M );
+    cl_event e = cl_event( unmapped );
+    ::clWaitForEvents( 1, &e );
+
+    // (2) vector shared by all devices, one output per device
+    const std::vector< real_t > V( size, real_t( 1 ) );
+    CLMemObj dV( mdc.context, rowBytes, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                 const_cast< real_t* >( &V[ 0 ] ) );
+    std::vector< CLMemObj > dW;
+    for( size_t d = 0; d != mdc.NumDevices(); ++d ) {
+        dW.push_back( CLMemObj( mdc.context, rowBytes, CL_MEM_WRITE_ONLY ) );
+    }
+
+    // (3) run until the median bandwidth is stable
+    const VecMatMulRun run = { &kernel, SizeArray( 1, size ), SizeArray(), &dM, size, &dV, &dW,
+                               double( size ) * rowBytes + 2. * rowBytes };
+    MeasureOptions options;
+    options.minRuns = iterations;
+    const Measurement bandwidth = RepeatSample( run, options );
+    W.resize( size );
+    kernel.Gather( dW, &W[ 0 ], sizeof( real_t ) );
+    return bandwidth;
+}
+
+//------------------------------------------------------------------------------
+void FissionBenchmark( const char* platformName,
+                       uint size,
+                       int iterations,
+                       const CLDevicePartition& partition,
+                       const std::string& buildOptions ) {
+    static const std::string SEPARATOR =
+#ifdef WIN32
+        "\\";
+#else
+        "/";
+#endif
+    std::string KERNEL_PATH;
+    if( getenv( "OPENCL_KERNEL_PATH" ) ) {
+        KERNEL_PATH = std::string( getenv( "OPENCL_KERNEL_PATH") ) +
+                      SEPARATOR +
+                      std::string( "vecmatmul.cl" );
+    } else {
+#ifdef WIN32
+        KERNEL_PATH = "C:\\projects\\gpupp\\test\\vecmatmul.cl";
+#else
+        KERNEL_PATH = "/project/csstaff/uvaretto/src/gpupp/test/vecmatmul.cl";
+#endif
+        std::cout << "OpenCL default kernel path: " << KERNEL_PATH << std::endl;
+        std::cout << "Set the default OpenCL kernel path "
+                     "with the OPENCL_KERNEL_PATH env var" << std::endl;
+    }
+    try {
+        const std::string src = LoadText( KERNEL_PATH );
+        CLExecutionContext ec = CreateCLExecutionContext( platformName, 0, CL_DEVICE_TYPE_CPU );
+        std::cout << std::fixed << std::setprecision( 2 );
+
+        std::cout << "Whole device" << std::endl;
+        std::vector< real_t > W1;
+        const Measurement whole = VecMatMulBandwidth( WholeDeviceContext( ec ), src, buildOptions,
+                                                      size, iterations, W1 );
+        std::cout << "  bandwidth (GB/s) " << whole << std::endl;
+
+        CLMultiDeviceContext sub = CreateCLSubDeviceContext( ec, partition );
+        std::cout << "Sub-devices: " << sub.NumDevices() << ", NUMA nodes:";
+        for( size_t d = 0; d != sub.numaNodes.size(); ++d ) std::cout << ' ' << sub.numaNodes[ d ];
+        std::cout << std::endl;
+        std::vector< real_t > WN;
+        const Measurement fissioned = VecMatMulBandwidth( sub, src, buildOptions, size, iterations, WN );
+        std::cout << "  bandwidth (GB/s) " << fissioned << std::endl;
+
+        std::cout << "Speedup: " << ( whole.median > 0. ? fissioned.median / whole.median : 0. ) << std::endl;
+        const ErrorStats errors = CompareResults( &WN[ 0 ], &W1[ 0 ], W1.size() );
+        std::cout << std::boolalpha << "PASSED: " << ( errors.maxAbsError == 0 ) << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. AMD Accelerated Parallel Processing> "
+                     "[matrix size - default is 8192] "
+                     "[minimum iterations - default is 10] "
+                     "[partition: numa or equal:<compute units> - default is numa] "
+                     "[build options e.g. -DDOUBLE]"
+                  << std::endl;
+        return 0;
+    }
+    int size = 8192;
+    if( argc > 2 ) size = atoi( argv[ 2 ] );
+    int iterations = 10;
+    if( argc > 3 ) iterations = atoi( argv[ 3 ] );
+    std::string partition = "numa";
+    if( argc > 4 ) partition = argv[ 4 ];
+    std::string buildOptions;
+    if( argc > 5 ) buildOptions = argv[ 5 ];
+    if( size <= 0 || iterations <= 0 ) {
+        std::cerr << "Invalid size or iterations" << std::endl;
+        return 1;
+    }
+    try {
+        FissionBenchmark( argv[ 1 ], uint( size ), iterations, ParsePartition( partition ), buildOptions );
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
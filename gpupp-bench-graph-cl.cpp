@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include "opencl/gpupp.h"
+#include "opencl/Graph.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+
+// Kernel with no body: measured time is host side overhead of issuing
+// the sequence.
+static const char* STEP_KERNEL_SRC =
+    "__kernel void Step( __global const float* in,\n"
+    "                    __global float* out,\n"
+    "                    uint n,\n"
+    "                    float alpha ) {}\n";
+
+// Each iteration uploads the input, runs three kernels and downloads the
+// output.
+static const int KERNELS_PER_ITERATION = 3;
+static const size_t ELEMENTS = 256;
+
+//------------------------------------------------------------------------------
+/// Buffers and host data of an iteration.
+struct IterationData {
+    const CLExecutionContext* ec;
+    CLMemObj* dIn;
+    CLMemObj* dTmp;
+    CLMemObj* dOut;
+    std::vector< float >* in;
+    std::vector< float >* out;
+    int iterations; //!< iterations per sample
+};
+
+//------------------------------------------------------------------------------
+/// Host time per iteration in microseconds issuing each operation directly.
+struct DirectRun {
+    IterationData d;
+    double operator()() const {
+        typedef unsigned uint;
+        const SizeArray gwgs( 1, ELEMENTS );
+        const SizeArray lwgs;
+        const uint n = ELEMENTS;
+        const float alpha = 2.0f;
+        Timer timer;
+        timer.Start();
+        for( int i = 0; i != d.iterations; ++i ) {
+            CLCopyHtoD( d.ec->commandQueue, &( *d.in )[ 0 ], *d.dIn, CL_FALSE );
+            for( int k = 0; k != KERNELS_PER_ITERATION; ++k ) {
+                HEvent e = InvokeKernelAsync( *d.ec, gwgs, lwgs,
+                                              ( VArgList(),
+                                                cl_mem( k == 0 ? *d.dIn : *d.dTmp ),
+                                                cl_mem( k == KERNELS_PER_ITERATION - 1 ? *d.dOut : *d.dTmp ),
+                                                n,
+                                                alpha ),
+                                              EventArray() );
+            }
+            CLCopyDtoH( d.ec->commandQueue, *d.dOut, &( *d.out )[ 0 ], CL_FALSE );
+        }
+        const double enqueueTime = timer.Stop();
+        ::clFinish( d.ec->commandQueue );
+        return 1000. * enqueueTime / d.iterations;
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Host time per iteration in microseconds replaying a recorded graph.
+struct ReplayRun {
+    IterationData d;
+    CLGraph* graph;
+    double operator()() const {
+        Timer timer;
+        timer.Start();
+        for( int i = 0; i != d.iterations; ++i ) {
+            graph->Replay();
+        }
+        const double enqueueTime = timer.Stop();
+        ::clFinish( d.ec->commandQueue );
+        return 1000. * enqueueTime / d.iterations;
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Record the operations of an iteration.
+void RecordIteration( CLGraph& graph, const IterationData& d ) {
+    typedef unsigned uint;
+    const SizeArray gwgs( 1, ELEMENTS );
+    const SizeArray lwgs;
+    const uint n = ELEMENTS;
+    const float alpha = 2.0f;
+    CLGraph::NodeId last = graph.AddCopyHtoD( &( *d.in )[ 0 ], *d.dIn, CLGraph::NodeIds() );
+    for( int k = 0; k != KERNELS_PER_ITERATION; ++k ) {
+        last = graph.AddKernel( d.ec->kernel, gwgs, lwgs, CLGraph::NodeIds( 1, last ),
+                                k == 0 ? *d.dIn : *d.dTmp,
+                                k == KERNELS_PER_ITERATION - 1 ? *d.dOut : *d.dTmp,
+                                n,
+                                alpha );
+    }
+    graph.AddCopyDtoH( *d.dOut, &( *d.out )[ 0 ], CLGraph::NodeIds( 1, last ) );
+}
+
+//------------------------------------------------------------------------------
+void GraphBenchmark( const char* platformName, int deviceNum, int iterations ) {
+    try {
+        std::string buildOutput;
+        CLExecutionContext ec =
+            CreateContextAndKernel( platformName,
+                                    CL_DEVICE_TYPE_ALL,
+                                    deviceNum,
+                                    STEP_KERNEL_SRC,
+                                    "Step",
+                                    buildOutput );
+        const size_t BYTE_SIZE = ELEMENTS * sizeof( float );
+        CLMemObj dIn( ec.context, BYTE_SIZE, CL_MEM_READ_ONLY );
+        CLMemObj dTmp( ec.context, BYTE_SIZE );
+        CLMemObj dOut( ec.context, BYTE_SIZE, CL_MEM_WRITE_ONLY );
+        std::vector< float > in( ELEMENTS, 1.0f );
+        std::vector< float > out( ELEMENTS );
+        const IterationData d = { &ec, &dIn, &dTmp, &dOut, &in, &out, iterations };
+        CLGraph graph( ec.commandQueue );
+        RecordIteration( graph, d );
+        const DirectRun direct = { d };
+        const ReplayRun replay = { d, &graph };
+        std::cout << "Iterations per sample:     " << iterations << '\n';
+        std::cout << "Direct calls (us/iteration) " << RepeatSample( direct ) << '\n';
+        std::cout << "Graph replay (us/iteration) " << RepeatSample( replay ) << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[device id - default is 0] "
+                     "[iterations per sample - default is 1000]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    int iterations = 1000;
+    if( argc > 3 ) iterations = atoi( argv[ 3 ] );
+    GraphBenchmark( argv[ 1 ], deviceNum, iterations );
+    return 0;
+}
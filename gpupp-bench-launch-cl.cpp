@@ -0,0 +1,222 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include "opencl/gpupp.h"
+#include "opencl/KernelArgCache.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+
+//------------------------------------------------------------------------------
+// Global allocation counter: operator new is replaced for the whole program
+// to report heap allocations per launch.
+static std::atomic< unsigned long long > allocations( 0 );
+
+void* operator new( size_t size ) {
+    ++allocations;
+    void* p = malloc( size > 0 ? size : 1 );
+    if( p == 0 ) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void* p ) noexcept {
+    free( p );
+}
+
+// Kernel with no body: measured time is host side launch overhead plus
+// run-time scheduling.
+static const char* EMPTY_KERNEL_SRC =
+    "__kernel void Empty( __global const float* a,\n"
+    "                     __global const float* b,\n"
+    "                     __global float* c,\n"
+    "                     uint width,\n"
+    "                     uint height,\n"
+    "                     float alpha ) {}\n";
+
+//------------------------------------------------------------------------------
+/// Buffers, sizes and scalar arguments passed to the empty kernel.
+struct LaunchArgs {
+    const CLExecutionContext* ec;
+    cl_mem a, b, c;
+    SizeArray gwgs;
+    SizeArray lwgs;
+    unsigned width;
+    unsigned height;
+    float alpha;
+    int numLaunches; //!< launches per sample
+};
+
+//------------------------------------------------------------------------------
+/// Launch through the VArgList based InvokeKernelAsync.
+struct VArgListLaunch {
+    void operator()( const LaunchArgs& p ) const {
+        cl_event e = InvokeKernelAsync( *p.ec, p.gwgs, p.lwgs,
+                                        ( VArgList(),
+                                          p.a,
+                                          p.b,
+                                          p.c,
+                                          p.width,
+                                          p.height,
+                                          p.alpha ) );
+        ::clReleaseEvent( e );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Launch through the variadic template Launch function.
+struct VariadicLaunch {
+    void operator()( const LaunchArgs& p ) const {
+        Launch( *p.ec, p.gwgs, p.lwgs, p.a, p.b, p.c, p.width, p.height, p.alpha );
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Launch through CLKernelHandler, setting all the parameters before each
+/// launch.
+struct KernelHandlerLaunch {
+    void operator()( const LaunchArgs& p ) const {
+        CLKernelHandler kh( *p.ec, p.gwgs, p.lwgs );
+        kh.SetParam( 0, p.a );
+        kh.SetParam( 1, p.b );
+        kh.SetParam( 2, p.c );
+        kh.SetParam( 3, p.width );
+        kh.SetParam( 4, p.height );
+        kh.SetParam( 5, p.alpha );
+        kh.AsyncRun();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Returns the host time in microseconds per launch of a batch of launches
+/// and accumulates the heap allocations made by the batch; allocations of
+/// RepeatSample() itself are not counted.
+template < class LaunchT >
+struct LaunchBatch {
+    LaunchT launch;
+    const LaunchArgs* p;
+    unsigned long long* allocated;
+    unsigned long long* launched;
+    double operator()() const {
+        const unsigned long long start = allocations;
+        Timer timer;
+        timer.Start();
+        for( int i = 0; i != p->numLaunches; ++i ) launch( *p );
+        ::clFinish( p->ec->commandQueue );
+        const double elapsed = timer.Stop();
+        *allocated += allocations - start;
+        *launched += p->numLaunches;
+        return 1000. * elapsed / p->numLaunches;
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Time per launch and heap allocations per launch, warm-up runs included.
+struct LaunchStats {
+    Measurement time;
+    double allocationsPerLaunch;
+};
+
+//------------------------------------------------------------------------------
+/// Repeat batches of launches until the median time per launch is stable.
+template < class LaunchT >
+LaunchStats MeasureLaunches( LaunchT launch, const LaunchArgs& p ) {
+    unsigned long long allocated = 0;
+    unsigned long long launched = 0;
+    const LaunchBatch< LaunchT > batch = { launch, &p, &allocated, &launched };
+    LaunchStats s;
+    s.time = RepeatSample( batch );
+    s.allocationsPerLaunch = launched > 0 ? double( allocated ) / launched : 0.;
+    return s;
+}
+
+//------------------------------------------------------------------------------
+/// Measure launch function with and without the kernel argument cache and
+/// print the host time per launch saved by not re-binding unchanged arguments.
+template < class LaunchT >
+void CompareArgCache( const char* name, LaunchT launch, const LaunchArgs& p ) {
+    KernelArgCache& cache = KernelArgCache::Instance();
+    cache.SetEnabled( false );
+    const LaunchStats uncached = MeasureLaunches( launch, p );
+    cache.SetEnabled( true );
+    cache.ResetStats();
+    const LaunchStats cached = MeasureLaunches( launch, p );
+    const KernelArgCache::Stats s = cache.GetStats();
+    cache.SetEnabled( false );
+    std::cout << name << " (launch/s): " << 1E6 / uncached.time.median
+              << "  allocations/launch: " << uncached.allocationsPerLaunch << '\n'
+              << "  time/launch (us) " << uncached.time << '\n'
+              << "  cached args (launch/s): " << 1E6 / cached.time.median
+              << "  allocations/launch: " << cached.allocationsPerLaunch
+              << "  skipped clSetKernelArg: " << 100. * s.HitRate() << "%\n"
+              << "  time/launch (us) " << cached.time << '\n'
+              << "  host time saved (us/launch): "
+              << uncached.time.median - cached.time.median << '\n';
+}
+
+//------------------------------------------------------------------------------
+void LaunchBenchmark( const char* platformName, int deviceNum, int numLaunches ) {
+    try {
+        std::string buildOutput;
+        CLExecutionContext ec =
+            CreateContextAndKernel( platformName,
+                                    CL_DEVICE_TYPE_ALL,
+                                    deviceNum,
+                                    EMPTY_KERNEL_SRC,
+                                    "Empty",
+                                    buildOutput );
+        const size_t BYTE_SIZE = 16 * 16 * sizeof( float );
+        CLMemObj dA( ec.context, BYTE_SIZE, CL_MEM_READ_ONLY );
+        CLMemObj dB( ec.context, BYTE_SIZE, CL_MEM_READ_ONLY );
+        CLMemObj dC( ec.context, BYTE_SIZE, CL_MEM_WRITE_ONLY );
+        // the warm-up batches of RepeatSample() absorb the lazy
+        // initialization of the run-time in the first launches
+        const LaunchArgs p = { &ec, dA, dB, dC, SizeArray( 1, 16 ), SizeArray( 1, 16 ),
+                               16, 16, 1.0f, numLaunches };
+        std::cout << "Launches per sample:     " << numLaunches << '\n';
+        CompareArgCache( "VArgList     ", VArgListLaunch(), p );
+        CompareArgCache( "Variadic     ", VariadicLaunch(), p );
+        CompareArgCache( "KernelHandler", KernelHandlerLaunch(), p );
+        std::cout << std::flush;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[device id - default is 0] "
+                     "[launches per sample - default is 10000]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    int numLaunches = 10000;
+    if( argc > 3 ) numLaunches = atoi( argv[ 3 ] );
+    LaunchBenchmark( argv[ 1 ], deviceNum, numLaunches );
+    return 0;
+}
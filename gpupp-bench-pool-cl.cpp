@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include "opencl/gpupp.h"
+#include "opencl/BufferPool.h"
+#include "utility/Timer.h"
+#include "utility/Measure.h"
+
+// Job loop pattern: a few temporaries of similar sizes are created,
+// written and destroyed at every iteration.
+static const int TEMPORARIES = 4;
+static const size_t MIN_SIZE = 64 * 1024;
+static const size_t MAX_SIZE = 1024 * 1024;
+
+//------------------------------------------------------------------------------
+/// Sizes of temporaries, generated once so that all runs allocate the
+/// same sequence.
+std::vector< size_t > GenerateSizes( int count ) {
+    std::vector< size_t > sizes( count );
+    srand( 1 );
+    for( int i = 0; i != count; ++i ) {
+        sizes[ i ] = MIN_SIZE + size_t( rand() ) % ( MAX_SIZE - MIN_SIZE );
+    }
+    return sizes;
+}
+
+//------------------------------------------------------------------------------
+/// Returns the time in microseconds per allocation of the whole sequence of
+/// sizes; buffers are allocated from \c pool if not NULL. A single byte is
+/// written to every buffer since some run-times defer allocation to first use.
+struct AllocationRun {
+    const CLExecutionContext* ec;
+    CLBufferPool* pool;
+    const std::vector< size_t >* sizes;
+    double operator()() const {
+        const char value = 0;
+        Timer timer;
+        timer.Start();
+        for( size_t i = 0; i + TEMPORARIES <= sizes->size(); i += TEMPORARIES ) {
+            std::vector< CLMemObj > tmp;
+            tmp.reserve( TEMPORARIES );
+            for( int t = 0; t != TEMPORARIES; ++t ) {
+                if( pool ) tmp.push_back( CLMemObj( *pool, ( *sizes )[ i + t ] ) );
+                else tmp.push_back( CLMemObj( ec->context, ( *sizes )[ i + t ] ) );
+                ::clEnqueueWriteBuffer( ec->commandQueue, tmp.back(), CL_FALSE, 0, 1,
+                                        &value, 0, 0, 0 );
+            }
+            ::clFinish( ec->commandQueue );
+        }
+        return 1000. * timer.Stop() / sizes->size();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Print allocation rate and statistics of the time per allocation.
+void PrintAllocationRate( const char* name, const CLExecutionContext& ec,
+                          CLBufferPool* pool, const std::vector< size_t >& sizes ) {
+    const AllocationRun run = { &ec, pool, &sizes };
+    const Measurement m = RepeatSample( run );
+    std::cout << name << " (alloc/s): " << 1E6 / m.median << '\n'
+              << "  us/alloc " << m << '\n';
+}
+
+//------------------------------------------------------------------------------
+void PoolBenchmark( const char* platformName, int deviceNum, int numAllocations ) {
+    try {
+        CLExecutionContext ec =
+            CreateCommandQueue( CreateCLExecutionContext( platformName,
+                                                          deviceNum,
+                                                          CL_DEVICE_TYPE_ALL ) );
+        const std::vector< size_t > sizes = GenerateSizes( numAllocations );
+        CLBufferPool classPool( ec.context );
+        CLBufferPool arenaPool( ec.context, CLBufferPool::ARENA, 8 * MAX_SIZE );
+        std::cout << "Allocations per sample:   " << numAllocations << '\n';
+        PrintAllocationRate( "clCreateBuffer ", ec, 0, sizes );
+        PrintAllocationRate( "Size classes   ", ec, &classPool, sizes );
+        std::cout << "  " << classPool.GetStats() << '\n';
+        PrintAllocationRate( "Arena          ", ec, &arenaPool, sizes );
+        std::cout << "  " << arenaPool.GetStats() << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0]
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[device id - default is 0] "
+                     "[allocations per sample - default is 1000]"
+                  << std::endl;
+        return 0;
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    int numAllocations = 1000;
+    if( argc > 3 ) numAllocations = atoi( argv[ 3 ] );
+    PoolBenchmark( argv[ 1 ], deviceNum, numAllocations );
+    return 0;
+}
@@ -0,0 +1,201 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+// 
+
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "opencl/gpupp.h"
+#include "opencl/Gemm.h"
+#include "utility/HostGemm.h"
+
+#ifdef DOUBLE
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
+typedef std::vector< real_t > Array;
+
+//------------------------------------------------------------------------------
+/// Problem shape.
+struct Shape {
+    int m, n, k;
+};
+
+//------------------------------------------------------------------------------
+/// Host reference; column-major problems are computed as the transposed
+/// row-major ones.
+void HostReference( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                    int m, int n, int k, real_t alpha, const Array& A, int lda,
+                    const Array& B, int ldb, real_t beta, Array& C, int ldc ) {
+    if( order == GEMM_ROW_MAJOR ) {
+        HostGemm( transA == GEMM_TRANS, transB == GEMM_TRANS, m, n, k,
+                  alpha, &A[ 0 ], lda, &B[ 0 ], ldb, beta, &C[ 0 ], ldc );
+    } else {
+        HostGemm( transB == GEMM_TRANS, transA == GEMM_TRANS, n, m, k,
+                  alpha, &B[ 0 ], ldb, &A[ 0 ], lda, beta, &C[ 0 ], ldc );
+    }
+}
+
+//------------------------------------------------------------------------------
+struct RandomGenerator {
+   RandomGenerator( int seed )  {
+       srand( seed );    
+   }
+   real_t operator()() const {
+       return rand() / real_t( RAND_MAX ) - real_t( 0.5 );
+   } 
+};
+
+//------------------------------------------------------------------------------
+/// Run one configuration on the device and compare with the host reference;
+/// leading dimensions are padded to check that they are honored.
+/// \return maximum absolute error relative to the reference magnitude
+double Check( const CLExecutionContext& ec, CLGemm& gemm, const Shape& s,
+              GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+              real_t alpha, real_t beta, double& kernelTime ) {
+    const bool rowMajor = order == GEMM_ROW_MAJOR;
+    const int aRows = transA == GEMM_TRANS ? s.k : s.m;
+    const int aCols = transA == GEMM_TRANS ? s.m : s.k;
+    const int bRows = transB == GEMM_TRANS ? s.n : s.k;
+    const int bCols = transB == GEMM_TRANS ? s.k : s.n;
+    const int PAD = 3;
+    const int lda = ( rowMajor ? aCols : aRows ) + PAD;
+    const int ldb = ( rowMajor ? bCols : bRows ) + PAD;
+    const int ldc = ( rowMajor ? s.n : s.m ) + PAD;
+    Array A( size_t( lda ) * ( rowMajor ? aRows : aCols ) );
+    Array B( size_t( ldb ) * ( rowMajor ? bRows : bCols ) );
+    Array C( size_t( ldc ) * ( rowMajor ? s.m : s.n ) );
+    std::generate( A.begin(), A.end(), RandomGenerator( 1 ) );
+    std::generate( B.begin(), B.end(), RandomGenerator( 1000 ) );
+    std::generate( C.begin(), C.end(), RandomGenerator( 2000 ) );
+    Array hC = C;
+    CLMemObj dA( ec.context, A.size() * sizeof( real_t ), CL_MEM_READ_ONLY );
+    CLMemObj dB( ec.context, B.size() * sizeof( real_t ), CL_MEM_READ_ONLY );
+    CLMemObj dC( ec.context, C.size() * sizeof( real_t ), CL_MEM_READ_WRITE );
+    CLCopyHtoD( ec.commandQueue, &A[ 0 ], dA );
+    CLCopyHtoD( ec.commandQueue, &B[ 0 ], dB );
+    CLCopyHtoD( ec.commandQueue, &C[ 0 ], dC );
+    HEvent e = gemm.Gemm( order, transA, transB, s.m, s.n, s.k,
+                          alpha, dA, lda, dB, ldb, beta, dC, ldc );
+    CLCopyDtoH( ec.commandQueue, dC, &C[ 0 ] );
+    kernelTime = e ? ProfilingInfo( e ).ExecutionTime() : 0.;
+    HostReference( order, transA, transB, s.m, s.n, s.k, alpha, A, lda, B, ldb, beta, hC, ldc );
+    // padding must be left untouched, hence compare whole arrays
+    const ErrorStats errors = CompareResults( &C[ 0 ], &hC[ 0 ], C.size() );
+    return errors.maxAbsError / std::max( 1, s.k );
+}
+
+//------------------------------------------------------------------------------
+/// Validates GEMM on all storage orders and transpose combinations over
+/// shapes that are and are not multiples of the tile sizes.
+void CLGemmTest( const char* platformName,
+                 int deviceNum,
+                 int matrixSize,
+                 real_t EPS ) {
+    static const std::string SEPARATOR =
+#ifdef WIN32
+        "\\";
+#else
+        "/";
+#endif
+    std::string KERNEL_PATH;
+    if( getenv( "OPENCL_KERNEL_PATH" ) ) {
+        KERNEL_PATH = std::string( getenv( "OPENCL_KERNEL_PATH") ) +
+                      SEPARATOR +
+                      std::string( "gemm.cl" );
+    } else {
+#ifdef WIN32
+        KERNEL_PATH = "C:\\projects\\gpupp\\test\\gemm.cl";
+#else
+        KERNEL_PATH = "/project/csstaff/uvaretto/src/gpupp/test/gemm.cl";
+#endif
+        std::cout << "OpenCL default kernel path: " << KERNEL_PATH << std::endl;
+        std::cout << "Set the default OpenCL kernel path "
+                     "with the OPENCL_KERNEL_PATH env var" << std::endl;    
+    }
+    try {
+        CLExecutionContext ec = 
+            CreateCommandQueue( CreateCLExecutionContext( platformName, deviceNum, CL_DEVICE_TYPE_ALL ),
+                                CL_QUEUE_PROFILING_ENABLE );
+        CLGemm gemm( ec, LoadText( KERNEL_PATH ) );
+        const bool DOUBLE_PRECISION = sizeof( real_t ) == sizeof( double );
+        std::cout << "GEMM parameters: " << gemm.GetParams( DOUBLE_PRECISION ) << std::endl;
+        const Shape SHAPES[] = { { 1, 1, 1 },
+                                 { 17, 33, 9 },
+                                 { 100, 75, 130 },
+                                 { 64, 128, 32 },
+                                 { matrixSize, matrixSize, matrixSize } };
+        const GemmOrder ORDERS[] = { GEMM_ROW_MAJOR, GEMM_COL_MAJOR };
+        const GemmTranspose TRANS[] = { GEMM_NO_TRANS, GEMM_TRANS };
+        bool passed = true;
+        for( int s = 0; s != sizeof( SHAPES ) / sizeof( SHAPES[ 0 ] ); ++s ) {
+            for( int o = 0; o != 2; ++o ) {
+                for( int ta = 0; ta != 2; ++ta ) {
+                    for( int tb = 0; tb != 2; ++tb ) {
+                        double time = 0.;
+                        // beta == 0 must not read C
+                        const real_t beta = ( s + ta + tb ) % 2 ? real_t( 0.5 ) : real_t( 0 );
+                        const double err = Check( ec, gemm, SHAPES[ s ], ORDERS[ o ], 
+                                                  TRANS[ ta ], TRANS[ tb ], real_t( 1.5 ), beta, time );
+                        const bool ok = err < EPS;
+                        passed = passed && ok;
+                        const Shape& sh = SHAPES[ s ];
+                        std::cout << sh.m << 'x' << sh.n << 'x' << sh.k
+                                  << ( o ? " col-major" : " row-major" )
+                                  << ( ta ? " A^T" : " A" ) << ( tb ? " B^T" : " B" )
+                                  << " beta=" << beta << " error: " << err;
+                        if( time > 0. ) {
+                            std::cout << " GFlops: " << 2. * sh.m * sh.n * sh.k / ( time * 1E6 );
+                        }
+                        std::cout << ( ok ? "" : " FAILED" ) << std::endl;
+                    }
+                }
+            }
+        }
+        std::cout << std::boolalpha << "PASSED: " << passed << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {    
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0] 
+                  << " <platform name e.g. AMD Accelerated Parallel Processing> "
+                     "[device id] "
+                     "[matrix size - default 512] "
+                     "[eps]"
+                  << std::endl;
+        return 0;          
+    }
+    int deviceNum = 0;
+    if( argc > 2 ) deviceNum = atoi( argv[ 2 ] );
+    int matrixSize = 512;
+    if( argc > 3 ) matrixSize = atoi( argv[ 3 ] );
+    real_t eps = real_t( 0.0001 );
+    if( argc > 4 ) eps = real_t( atof( argv[ 4 ] ) );
+    CLGemmTest( argv[1], deviceNum, matrixSize, eps );
+    return 0;
+}
@@ -22,8 +22,15 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <sstream>
 #include "opencl/gpupp.h"
+#include "opencl/ProgramBinaryCache.h"
+#include "opencl/StreamingExecutor.h"
+#include "opencl/Autotuner.h"
+#include "opencl/TuningDatabase.h"
 #include "utility/Timer.h"
+#include "utility/Measure.h"
+#include "utility/HostGemm.h"
 
 #ifdef DOUBLE
 typedef double real_t;
@@ -34,32 +41,18 @@ typedef float real_t;
 typedef std::vector< real_t > Array;
 
 //------------------------------------------------------------------------------
+/// Host reference: blocked, vectorized and multi-threaded.
 Array MatMul(const real_t* A, const real_t* B, int width, int height ) {
     Array C( width * height );
-    for(int row = 0; row != height; ++row ) {
-        for(int col = 0; col != width; ++col ) {
-            real_t v = real_t( 0 );
-            for( int i = 0; i != width; ++i ) {
-                v += A[ row * width + i ] * B[ i * width + col ];
-            }
-            C[ row * width + col ] = v;
-        }
-    }
+    HostGemm( false, false, height, width, width,
+              real_t( 1 ), A, width, B, width, real_t( 0 ), &C[ 0 ], width );
     return C;
 }
 
 //------------------------------------------------------------------------------
-struct eps {
-    eps( real_t v ) : eps_( v ) {} 
-    bool operator()( const real_t& v1, const real_t& v2 ) const {
-        return std::abs( v1 - v2 ) < eps_;
-    }
-    real_t eps_;
-};
-
-bool Verify( const Array& C1, const Array& C2, real_t EPS ) {
-    std::cout << C1.front() << ' ' << C2.front() << ' ' << C1.back() << ' ' << C2.back() << std::endl;
-    return std::equal( C1.begin(), C1.end(), C2.begin(), eps(EPS) );
+/// Compare result with reference in parallel.
+ErrorStats Verify( const Array& C, const Array& reference ) {
+    return CompareResults( &C[ 0 ], &reference[ 0 ], C.size() );
 }
 
 //------------------------------------------------------------------------------
@@ -86,12 +79,14 @@ struct PrintTime {
 };
 
 /// Shows how to use a high level C++ API to perform computation through OpenCL. 
+/// A workgroup size of zero selects the tile size through the Autotuner.
 void CLMatMulTest( const char* platformName,
                    int deviceNum,
                    int matrixSize,
                    real_t EPS, 
-                   const std::string& buildOptions,
-                   int wgroup_size ) {
+                   std::string buildOptions,
+                   int wgroup_size,
+                   int streamChunks ) {
     typedef unsigned uint;
 
     static const std::string SEPARATOR =
@@ -121,7 +116,7 @@ void CLMatMulTest( const char* platformName,
     const uint MATRIX_HEIGHT = MATRIX_WIDTH; // <- passed to OpenCL as uint
     const size_t MATRIX_SIZE = MATRIX_WIDTH * MATRIX_HEIGHT;
     const size_t MATRIX_BYTE_SIZE = sizeof( real_t ) * MATRIX_SIZE;
-    const size_t LOCAL_WGROUP_SIZE = wgroup_size;
+    const bool AUTOTUNE = wgroup_size == 0;
     try {
         // (1) init data
         Array A( MATRIX_SIZE );
@@ -134,21 +129,60 @@ void CLMatMulTest( const char* platformName,
         std::string buildOutput;  // compiler output
         const bool TRY_TO_COMPUTE_OPTIMAL_WGROUP_SIZE = true; 
         CLExecutionContext ec = 
-            CreateContextAndKernelFromFile( platformName, //<- platform name
-                                            CL_DEVICE_TYPE_ALL, //<- select all devices available on platform
-                                            deviceNum, //<- device number; use first available
-                                            KERNEL_PATH, //<- full path to file containing kernel source code
-                                            KERNEL_NAME, //<- name of kernel function
-                                            buildOutput, //<- compiler output
-                                            buildOptions, //<- compiler options
-                                            TRY_TO_COMPUTE_OPTIMAL_WGROUP_SIZE,
-                                            CL_QUEUE_PROFILING_ENABLE );
+            CreateCommandQueue( CreateCLExecutionContext( platformName, //<- platform name
+                                                          deviceNum, //<- device number; use first available
+                                                          CL_DEVICE_TYPE_ALL ), //<- select all devices available on platform
+                                CL_QUEUE_PROFILING_ENABLE );
+        const std::string KERNEL_SRC = LoadText( KERNEL_PATH );
+
+        // (3) allocate input and otput buffer that will be passed
+        // to kernel function
+        CLMemObj  dA( ec.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
+        CLMemObj  dB( ec.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
+        CLMemObj  dC( ec.context, MATRIX_BYTE_SIZE, CL_MEM_WRITE_ONLY );
+        SizeArray globalWGroupSize( 2 ); 
+        globalWGroupSize[ 0 ] = MATRIX_WIDTH;
+        globalWGroupSize[ 1 ] = MATRIX_HEIGHT;
+
+        // (2.1) select tile size: the local size of the tiled kernel must
+        // match the tile size, so each TILE_SIZE value is measured with
+        // one local size only; the best local size is stored in the tuning
+        // database, set GPUPP_TUNING_DB to keep it across runs
+        if( AUTOTUNE ) {
+            Autotuner tuner( ec, KERNEL_SRC, KERNEL_NAME, buildOptions );
+            const int TILE_SIZES[] = { 4, 8, 16, 32 };
+            for( int t = 0; t != sizeof( TILE_SIZES ) / sizeof( TILE_SIZES[ 0 ] ); ++t ) {
+                std::ostringstream os;
+                os << "-DTILE_SIZE=" << TILE_SIZES[ t ];
+                tuner.AddVariant( os.str(), 
+                                  std::vector< SizeArray >( 1, SizeArray( 2, TILE_SIZES[ t ] ) ) );
+            }
+            struct SetArgs {
+                cl_mem a, b, c;
+                uint width, height;
+                void operator()( cl_kernel k ) const {
+                    SetKernelArgs( k, 0, a, b, c, width, height );
+                }
+            };
+            const SetArgs setArgs = { dA, dB, dC, MATRIX_WIDTH, MATRIX_HEIGHT };
+            const Autotuner::Result best = tuner.Tune( globalWGroupSize, setArgs );
+            std::cout << "Autotuner: " << best << std::endl;
+            buildOptions = best.buildOptions;
+            wgroup_size = int( best.lwgs.empty() ? 0 : best.lwgs[ 0 ] );
+        }
+        ec = BuildKernel( ec, KERNEL_SRC, KERNEL_NAME, buildOutput, buildOptions,
+                          TRY_TO_COMPUTE_OPTIMAL_WGROUP_SIZE );
         if( !buildOptions.empty() ) {
             std::cout << "Build options: " << buildOptions << std::endl;
         }
         if( buildOutput.size() > 1 ) {
             std::cout << "Build output: " << buildOutput.size() << std::endl;
         }    
+        // set GPUPP_PROGRAM_CACHE_DIR to reuse compiled binaries across runs
+        if( ProgramBinaryCache::Instance().Enabled() ) {
+            std::cout << "Program binary cache: "
+                      << ProgramBinaryCache::Instance().GetStats() << std::endl;
+        }
 
         if( ec.wgroupSize > 0 ) std::cout << "Computed optimal workgroup size: " 
                                           << ec.wgroupSize << std::endl;
@@ -157,21 +191,14 @@ void CLMatMulTest( const char* platformName,
         // DEPRECATED IN OpenCL 1.1 SINCE NOT THREAD SAFE 
 		//EnableProfiling( ec.commandQueue );
 
-        // (3) allocate input and otput buffer that will be passed
-        // to kernel function
-        CLMemObj  dA( ec.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
-        CLMemObj  dB( ec.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
-        CLMemObj  dC( ec.context, MATRIX_BYTE_SIZE, CL_MEM_WRITE_ONLY );
-
         // (4) copy data into input buffers
         CLCopyHtoD( ec.commandQueue, &A[ 0 ], dA );
         CLCopyHtoD( ec.commandQueue, &B[ 0 ], dB );
         // (5) execute kernel
-        SizeArray globalWGroupSize( 2 ); 
-        SizeArray  localWGroupSize( 2, LOCAL_WGROUP_SIZE );//1, ec.wgroupSize > 0 ? ec.wgroupSize : 256  );
-        globalWGroupSize[ 0 ] = MATRIX_WIDTH;
-        globalWGroupSize[ 1 ] = MATRIX_HEIGHT;
-        cl_event kernelEvent = cl_event();
+        // an empty local size selects the tuned one
+        const SizeArray localWGroupSize = AUTOTUNE ? SizeArray()
+                                                   : SizeArray( 2, wgroup_size );
+        HEvent kernelEvent;
         // kernel signature:
         // void MatMul( const __global real_t* restrict A,
         //              const __global real_t* restrict B, 
@@ -187,25 +214,90 @@ void CLMatMulTest( const char* platformName,
                                   cl_mem( dC ),
                                   MATRIX_WIDTH,
                                   MATRIX_HEIGHT 
-                                )              //<- Marks the end of a variable argument list
+                                ),             //<- Marks the end of a variable argument list
+                                EventArray()   //<- no dependencies
                              );
         }
         // (6) read back results
         CLCopyDtoH( ec.commandQueue, dC, &C[ 0 ] );
         Array hC = MatMul( &A[0], &B[0], MATRIX_WIDTH, MATRIX_HEIGHT );
-        std::cout << std::boolalpha << "PASSED: " << Verify( C, hC, EPS ) << '\n';
-        // (6.1) print profilng information
+        const ErrorStats errors = Verify( C, hC );
+        std::cout << errors << '\n';
+        std::cout << std::boolalpha << "PASSED: " << ( errors.maxAbsError < EPS ) << '\n';
+        // (6.1) print profilng information; set GPUPP_KERNEL_STATS=1 to
+        // print statistics of all the launches at exit
+        const ProfilingInfo profile( kernelEvent );
         std::cout << "Kernel execution latency (ms): " 
-                  << ProfilingInfo( kernelEvent ).Latency()       << std::endl;
+                  << profile.Latency()       << std::endl;
         std::cout << "Kernel execution time (ms):    " 
-                  << ProfilingInfo( kernelEvent ).ExecutionTime() << std::endl;
+                  << profile.ExecutionTime() << std::endl;
+        // (6.2) repeat the launch until the median execution time is known
+        // within 1%: a single run is affected by clock ramp-up and caches
+        struct TimeLaunch {
+            const CLExecutionContext* ec;
+            SizeArray gwgs, lwgs;
+            cl_mem a, b, c;
+            uint width, height;
+            double operator()() const {
+                HEvent e = InvokeKernelSync( *ec, gwgs, lwgs,
+                                             ( VArgList(), a, b, c, width, height ),
+                                             EventArray() );
+                return ProfilingInfo( e ).ExecutionTime();
+            }
+        };
+        const TimeLaunch timeLaunch = { &ec, globalWGroupSize, localWGroupSize,
+                                        dA, dB, dC, MATRIX_WIDTH, MATRIX_HEIGHT };
+        const Measurement executionTime = RepeatSample( timeLaunch );
+        std::cout << "Kernel execution time (ms), repeated: " << executionTime << std::endl;
 
         const size_t TOTAL_OPS = MATRIX_WIDTH 
                                  * MATRIX_HEIGHT
                                  * ( MATRIX_WIDTH + MATRIX_WIDTH - 1 );
         const int GFLops = (double(TOTAL_OPS) / (1024 * 1024 * 1024))
-                           / (ProfilingInfo( kernelEvent ).ExecutionTime() / 1000);
+                           / (executionTime.median / 1000);
         std::cout << "GFLops: " << GFLops << std::endl;                                                     
+        // (6.3) stream rows of A through the kernel in chunks, overlapping
+        // transfers of each chunk with the computation of the previous one
+        if( streamChunks > 0 ) {
+            const uint CHUNK_ROWS = MATRIX_HEIGHT / streamChunks;
+            if( CHUNK_ROWS == 0 || MATRIX_HEIGHT % streamChunks != 0 
+                || ( wgroup_size > 0 && CHUNK_ROWS % wgroup_size != 0 ) ) {
+                throw std::logic_error( "Matrix size must be a multiple of "
+                                        "number of chunks times workgroup size" );
+            }
+            const size_t CHUNK_BYTE_SIZE = CHUNK_ROWS * MATRIX_WIDTH * sizeof( real_t );
+            Array sC( MATRIX_SIZE );
+            CLStreamingExecutor streamer( ec, CHUNK_BYTE_SIZE, CHUNK_BYTE_SIZE );
+            // chunks have a different global size: pass the tuned local size explicitly
+            const SizeArray chunkLocalWGroupSize = wgroup_size > 0 ? SizeArray( 2, wgroup_size )
+                                                                   : SizeArray();
+            const cl_mem B_MEM = dB;
+            struct SetChunkParams {
+                cl_mem b;
+                uint width;
+                void operator()( CLKernelHandler& kh, const CLStreamChunk& c ) const {
+                    const uint rows = uint( c.inSize / ( width * sizeof( real_t ) ) );
+                    SizeArray gwgs( 2 );
+                    gwgs[ 0 ] = width;
+                    gwgs[ 1 ] = rows;
+                    kh.SetGlobalWGroupSize( gwgs );
+                    kh.SetParam( 0, c.input );
+                    kh.SetParam( 1, b );
+                    kh.SetParam( 2, c.output );
+                    kh.SetParam( 3, width );
+                    kh.SetParam( 4, rows );
+                }
+            };
+            const SetChunkParams setChunkParams = { B_MEM, MATRIX_WIDTH };
+            const CLStreamingExecutor::Stats stats = 
+                streamer.Run( CLKernelHandler( ec, globalWGroupSize, chunkLocalWGroupSize ),
+                              &A[ 0 ], MATRIX_BYTE_SIZE, &sC[ 0 ], MATRIX_BYTE_SIZE,
+                              setChunkParams );
+            const ErrorStats streamErrors = Verify( sC, hC );
+            std::cout << streamErrors << '\n';
+            std::cout << std::boolalpha << "STREAMING PASSED: " << ( streamErrors.maxAbsError < EPS ) << '\n';
+            std::cout << "Streaming: " << stats << std::endl;
+        }
         // (7) release resources
         //ReleaseExecutionContext( ec );
     }
@@ -228,10 +320,11 @@ int main( int argc, char** argv ) {
                   << " <platform name e.g. NVIDIA CUDA> "
                      "[device id] "
                      "[matrix size] "
-                     "[workgroup size] "
+                     "[workgroup size - 'auto' to tune TILE_SIZE] "
                      "[eps] "
                      "[build options:\n\t"
-                     "-DDOUBLE -DTILE_WIDTH= -DTILE_HEIGHT]"
+                     "-DDOUBLE -DTILE_WIDTH= -DTILE_HEIGHT] "
+                     "[number of streaming chunks - default is 0, no streaming]"
                   << std::endl;
         return 0;          
     }
@@ -240,12 +333,14 @@ int main( int argc, char** argv ) {
     int matrixSize = 1024;
     if( argc > 3 ) matrixSize = atoi( argv[ 3 ] );
     int wgroup_size = 16;
-    if( argc > 4 ) wgroup_size = atoi( argv[ 4 ] );
+    if( argc > 4 ) wgroup_size = std::string( argv[ 4 ] ) == "auto" ? 0 : atoi( argv[ 4 ] );
     real_t eps = real_t( 0.0001 );
     if( argc > 5 ) eps = atof( argv[ 5 ] );
     std::string buildOptions;
     if( argc > 6 ) buildOptions = argv[ 6 ];
+    int streamChunks = 0;
+    if( argc > 7 ) streamChunks = atoi( argv[ 7 ] );
     CLMatMulTest( argv[1], deviceNum, matrixSize, eps, buildOptions,
-                  wgroup_size );
+                  wgroup_size, streamChunks );
     return 0;
 }
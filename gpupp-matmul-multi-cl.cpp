@@ -0,0 +1,196 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include "opencl/gpupp.h"
+#include "opencl/MultiDevice.h"
+#include "utility/Timer.h"
+#include "utility/HostGemm.h"
+
+#ifdef DOUBLE
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
+typedef std::vector< real_t > Array;
+
+//------------------------------------------------------------------------------
+/// Host reference: blocked, vectorized and multi-threaded.
+Array MatMul(const real_t* A, const real_t* B, int width, int height ) {
+    Array C( width * height );
+    HostGemm( false, false, height, width, width,
+              real_t( 1 ), A, width, B, width, real_t( 0 ), &C[ 0 ], width );
+    return C;
+}
+
+//------------------------------------------------------------------------------
+struct RandomGenerator {
+   RandomGenerator( int seed )  {
+       srand( seed );    
+   }
+   real_t operator()() const {
+       return rand() / real_t( RAND_MAX );
+   } 
+};
+
+//------------------------------------------------------------------------------
+/// Callback function object passed to scoped timer; will be invoked
+/// with elapsed time upon timer destruction.
+struct PrintTime {
+    void operator()( double t ) const {
+        std::cout << "Time: " << t << " (ms)" << std::endl;
+    }
+};
+
+/// Multiplies two matrices on all the devices of a platform: rows of the
+/// result are split among devices in proportion to their throughput, which
+/// is measured at every iteration.
+void CLMultiDeviceMatMulTest( const char* platformName,
+                              int matrixSize,
+                              real_t EPS, 
+                              std::string buildOptions,
+                              int tileSize,
+                              int iterations ) {
+    typedef unsigned uint;
+
+    static const std::string SEPARATOR =
+#ifdef WIN32
+        "\\";
+#else
+        "/";
+#endif
+    std::string KERNEL_PATH;
+    if( getenv( "OPENCL_KERNEL_PATH" ) ) {
+        KERNEL_PATH = std::string( getenv( "OPENCL_KERNEL_PATH") ) +
+                      SEPARATOR +
+                      std::string( "matmul.cl" );
+
+    } else {
+#ifdef WIN32
+        KERNEL_PATH = "C:\\projects\\gpupp\\test\\matmul.cl";
+#else
+        KERNEL_PATH = "/project/csstaff/uvaretto/src/gpupp/test/matmul.cl";
+#endif
+        std::cout << "OpenCL default kernel path: " << KERNEL_PATH << std::endl;
+        std::cout << "Set the default OpenCL kernel path "
+                     "with the OPENCL_KERNEL_PATH env var" << std::endl;    
+    }
+    const std::string KERNEL_NAME( "MatMul" );
+    const uint MATRIX_WIDTH = matrixSize; // <- passed to OpenCL as uint
+    const uint MATRIX_HEIGHT = MATRIX_WIDTH; // <- passed to OpenCL as uint
+    const size_t MATRIX_SIZE = MATRIX_WIDTH * MATRIX_HEIGHT;
+    const size_t MATRIX_BYTE_SIZE = sizeof( real_t ) * MATRIX_SIZE;
+    try {
+        // (1) init data
+        Array A( MATRIX_SIZE );
+        Array B( MATRIX_SIZE );
+        Array C( MATRIX_SIZE );
+        std::generate( A.begin(), A.end(), RandomGenerator( 1 ) );
+        std::generate( B.begin(), B.end(), RandomGenerator( 1000 ) );
+
+        // (2) create context with all the devices of the platform, with
+        // profiling enabled to measure the throughput of each device
+        CLMultiDeviceContext mdc = CreateCLMultiDeviceContext( platformName );
+        std::cout << "Devices: " << mdc.NumDevices() << std::endl;
+
+        // (3) build kernel for each device; rows (dimension 1) are
+        // partitioned among devices
+        std::ostringstream os;
+        os << "-DTILE_SIZE=" << tileSize << ' ' << buildOptions;
+        CLPartitionedKernel kernel( mdc, LoadText( KERNEL_PATH ), KERNEL_NAME, os.str(), 1 );
+
+        // (4) inputs are shared among devices; each device writes to its
+        // own output buffer since concurrent writes to the same buffer from
+        // different devices are undefined
+        CLMemObj dA( mdc.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
+        CLMemObj dB( mdc.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
+        std::vector< CLMemObj > dC;
+        for( size_t d = 0; d != mdc.NumDevices(); ++d ) {
+            dC.push_back( CLMemObj( mdc.context, MATRIX_BYTE_SIZE, CL_MEM_WRITE_ONLY ) );
+        }
+        CLCopyHtoD( mdc.commandQueues[ 0 ], &A[ 0 ], dA );
+        CLCopyHtoD( mdc.commandQueues[ 0 ], &B[ 0 ], dB );
+
+        // (5) execute kernel; weights are updated from the measured
+        // execution time of each slice after every launch
+        SizeArray globalWGroupSize( 2 ); 
+        globalWGroupSize[ 0 ] = MATRIX_WIDTH;
+        globalWGroupSize[ 1 ] = MATRIX_HEIGHT;
+        const SizeArray localWGroupSize( 2, tileSize );
+        for( int i = 0; i != iterations; ++i ) {
+            ScopedCBackTimer< PrintTime > pt;
+            const CLPartitionedKernel::Slices& slices = 
+                kernel.Launch( globalWGroupSize, localWGroupSize,
+                               dA, dB, PerDeviceArg( dC ), MATRIX_WIDTH, MATRIX_HEIGHT );
+            kernel.Wait();
+            std::cout << "Iteration " << i << ": " << slices << std::endl;
+        }
+        std::cout << "Weights:";
+        for( size_t d = 0; d != kernel.GetWeights().size(); ++d ) {
+            std::cout << ' ' << kernel.GetWeights()[ d ];
+        }
+        std::cout << std::endl;
+
+        // (6) gather rows computed by each device and verify
+        kernel.Gather( dC, &C[ 0 ], MATRIX_WIDTH * sizeof( real_t ) );
+        const Array hC = MatMul( &A[0], &B[0], MATRIX_WIDTH, MATRIX_HEIGHT );
+        const ErrorStats errors = CompareResults( &C[ 0 ], &hC[ 0 ], C.size() );
+        std::cout << errors << '\n';
+        std::cout << std::boolalpha << "PASSED: " << ( errors.maxAbsError < EPS ) << std::endl;
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {    
+    if( argc < 2 ) {
+        std::cout << "usage: " << argv[0] 
+                  << " <platform name e.g. NVIDIA CUDA> "
+                     "[matrix size - default is 1024] "
+                     "[tile size - default is 16] "
+                     "[eps] "
+                     "[iterations - default is 5] "
+                     "[build options e.g. -DDOUBLE]"
+                  << std::endl;
+        return 0;          
+    }
+    int matrixSize = 1024;
+    if( argc > 2 ) matrixSize = atoi( argv[ 2 ] );
+    int tileSize = 16;
+    if( argc > 3 ) tileSize = atoi( argv[ 3 ] );
+    real_t eps = real_t( 0.0001 );
+    if( argc > 4 ) eps = atof( argv[ 4 ] );
+    int iterations = 5;
+    if( argc > 5 ) iterations = atoi( argv[ 5 ] );
+    std::string buildOptions;
+    if( argc > 6 ) buildOptions = argv[ 6 ];
+    if( matrixSize <= 0 || tileSize <= 0 || matrixSize % tileSize != 0 || iterations <= 0 ) {
+        std::cerr << "Matrix size must be a multiple of the tile size" << std::endl;
+        return 1;
+    }
+    CLMultiDeviceMatMulTest( argv[ 1 ], matrixSize, eps, buildOptions, tileSize, iterations );
+    return 0;
+}
@@ -144,8 +144,9 @@ void CLMatMulTest()
         std::cout << "vector[1]    = " << outVector[ 1 ] << '\n';
         std::cout << "vector[last] = " << outVector.back() << std::endl;
         // (6.1) print profilng information
-        std::cout << "Kernel execution latency (ms): " << ProfilingInfo( kernelEvent ).Latency()       << std::endl;
-        std::cout << "Kernel execution time (ms):    " << ProfilingInfo( kernelEvent ).ExecutionTime() << std::endl;
+        const ProfilingInfo profile( kernelEvent );
+        std::cout << "Kernel execution latency (ms): " << profile.Latency()       << std::endl;
+        std::cout << "Kernel execution time (ms):    " << profile.ExecutionTime() << std::endl;
         // (7) release resources
         //ReleaseExecutionContext( ec );
     }
@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 #include "opencl/gpupp.h"
+#include "opencl/DeviceVector.h"
 #include "utility/Timer.h"
 
 // iota was removed (why?) from STL long ago.
@@ -110,13 +111,17 @@ void CLMatMulTest( const char* platformName, int deviceNum, int matrixSize ) {
         CLMemObj  inMatD( ec.context, MATRIX_BYTE_SIZE, CL_MEM_READ_ONLY );
         CLMemObj  inVecD( ec.context, VECTOR_BYTE_SIZE, CL_MEM_READ_ONLY );
         CLMemObj outVecD( ec.context, VECTOR_BYTE_SIZE, CL_MEM_WRITE_ONLY );
-        // (4) copy data into input buffers
-        CLCopyHtoD( ec.commandQueue, &inMatrix[ 0 ], inMatD );
-        CLCopyHtoD( ec.commandQueue, &inVector[ 0 ], inVecD );
+        // (4) copy data into input buffers; copies are non blocking and
+        // the kernel waits for their completion on the device
+        EventArray inputsCopied;
+        HEvent matrixCopied = CLCopyHtoD( ec.commandQueue, &inMatrix[ 0 ], inMatD, EventArray() );
+        HEvent vectorCopied = CLCopyHtoD( ec.commandQueue, &inVector[ 0 ], inVecD, EventArray() );
+        inputsCopied.push_back( matrixCopied );
+        inputsCopied.push_back( vectorCopied );
         // (5) execute kernel
         SizeArray globalWGroupSize( 1, MATRIX_HEIGHT ); 
         SizeArray  localWGroupSize( 1, ec.wgroupSize > 0 ? ec.wgroupSize : 256  );
-        cl_event kernelEvent = cl_event();
+        HEvent kernelEvent;
         // kernel signature:
         // void VecMatMul( const __global real_t* M,
         //                 uint width,
@@ -132,7 +137,8 @@ void CLMatMulTest( const char* platformName, int deviceNum, int matrixSize ) {
                                   MATRIX_HEIGHT ,
                                   cl_mem( inVecD ) ,
                                   cl_mem( outVecD )
-                                )              //<- Marks the end of a variable argument list
+                                ),             //<- Marks the end of a variable argument list
+                                inputsCopied
                              );
         }
         // (6) read back results
@@ -142,10 +148,27 @@ void CLMatMulTest( const char* platformName, int deviceNum, int matrixSize ) {
         std::cout << "vector[1]    = " << outVector[ 1 ] << '\n';
         std::cout << "vector[last] = " << outVector.back() << std::endl;
         // (6.1) print profilng information
+        const ProfilingInfo profile( kernelEvent );
         std::cout << "Kernel execution latency (ms): " 
-                  << ProfilingInfo( kernelEvent ).Latency()       << std::endl;
+                  << profile.Latency()       << std::endl;
         std::cout << "Kernel execution time (ms):    " 
-                  << ProfilingInfo( kernelEvent ).ExecutionTime() << std::endl;
+                  << profile.ExecutionTime() << std::endl;
+        // (6.2) same computation with DeviceVector: data is uploaded when
+        // bound to the kernel and downloaded on first host access, changing
+        // a single element of the input vector uploads that element only
+        DeviceVector< real_t > matrix( ec.context, ec.commandQueue, inMatrix, CL_MEM_READ_ONLY );
+        DeviceVector< real_t > vector( ec.context, ec.commandQueue, inVector, CL_MEM_READ_ONLY );
+        DeviceVector< real_t > result( ec.context, ec.commandQueue, VECTOR_SIZE, real_t( 0 ), CL_MEM_WRITE_ONLY );
+        Launch( ec, globalWGroupSize, localWGroupSize,
+                matrix, MATRIX_WIDTH, MATRIX_HEIGHT, vector, result );
+        std::cout << "DeviceVector: vector[0] = " << result[ 0 ] << '\n';
+        vector[ 0 ] = real_t( 1 );
+        Launch( ec, globalWGroupSize, localWGroupSize,
+                matrix, MATRIX_WIDTH, MATRIX_HEIGHT, vector, result );
+        std::cout << "DeviceVector: vector[0] = " << result[ 0 ] << '\n';
+        std::cout << "  matrix transfers: " << matrix.GetStats() << '\n';
+        std::cout << "  vector transfers: " << vector.GetStats() << '\n';
+        std::cout << "  result transfers: " << result.GetStats() << std::endl;
         // (7) release resources
         //ReleaseExecutionContext( ec );
     }
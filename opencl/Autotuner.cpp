@@ -0,0 +1,279 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "Autotuner.h"
+#include <algorithm>
+#include <stdexcept>
+#include "TuningDatabase.h"
+#include "OpenCLStatusCodesTable.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Work group limits of a kernel on a device.
+struct WGroupLimits
+{
+    size_t maxSize;        //!< CL_KERNEL_WORK_GROUP_SIZE
+    size_t multiple;       //!< CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    SizeArray maxItemSizes; //!< CL_DEVICE_MAX_WORK_ITEM_SIZES
+};
+
+//------------------------------------------------------------------------------
+WGroupLimits QueryLimits( cl_kernel k, cl_device_id device )
+{
+    WGroupLimits l;
+    l.maxSize = 0;
+    l.multiple = 1;
+    cl_int status = ::clGetKernelWorkGroupInfo( k, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof( size_t ), &l.maxSize, 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetKernelWorkGroupInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    //not available on OpenCL 1.0 run-times
+    status = ::clGetKernelWorkGroupInfo( k, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof( size_t ), &l.multiple, 0 );
+    if( status != CL_SUCCESS || l.multiple == 0 ) l.multiple = 1;
+    cl_uint dims = 0;
+    status = ::clGetDeviceInfo( device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof( cl_uint ), &dims, 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    l.maxItemSizes.resize( dims, l.maxSize );
+    if( dims > 0 )
+    {
+        status = ::clGetDeviceInfo( device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof( size_t ) * dims, &l.maxItemSizes[ 0 ], 0 );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    return l;
+}
+
+//------------------------------------------------------------------------------
+/// Returns \c true if local size can be used with global size.
+bool ValidLocalSize( const SizeArray& lwgs, const SizeArray& gwgs, const WGroupLimits& l )
+{
+    if( lwgs.size() != gwgs.size() || lwgs.size() > l.maxItemSizes.size() ) return false;
+    size_t n = 1;
+    for( size_t d = 0; d != lwgs.size(); ++d )
+    {
+        if( lwgs[ d ] == 0 || gwgs[ d ] % lwgs[ d ] != 0 || lwgs[ d ] > l.maxItemSizes[ d ] ) return false;
+        n *= lwgs[ d ];
+    }
+    return n <= l.maxSize;
+}
+
+//------------------------------------------------------------------------------
+/// Add power of two sizes of dimensions [d, size) to current candidate.
+void GenerateSizes( SizeArray& current, size_t d, size_t product,
+                    const SizeArray& gwgs, const WGroupLimits& l,
+                    std::vector< SizeArray >& out )
+{
+    if( d == current.size() )
+    {
+        if( product % l.multiple == 0 && ValidLocalSize( current, gwgs, l ) ) out.push_back( current );
+        return;
+    }
+    // the third dimension is not swept: too many candidates for little gain
+    const size_t maxDim = d < 2 ? l.maxSize : 1;
+    for( size_t s = 1; s <= maxDim && product * s <= l.maxSize; s *= 2 )
+    {
+        current[ d ] = s;
+        GenerateSizes( current, d + 1, product * s, gwgs, l, out );
+    }
+}
+}
+
+//------------------------------------------------------------------------------
+Autotuner::Autotuner( const CLExecutionContext& ec,
+                      const std::string& src,
+                      const std::string& kernelName,
+                      const std::string& baseOptions ) :
+    ec_( ec ), src_( src ), kernelName_( kernelName ),
+    baseOptions_( baseOptions ), repetitions_( 5 )
+{
+    if( ec.context == 0 ) throw std::logic_error( "Uninitialized execution context" );
+    ec_ = CreateCommandQueue( ec_, CL_QUEUE_PROFILING_ENABLE );
+}
+
+//------------------------------------------------------------------------------
+void Autotuner::AddLocalSize( const SizeArray& lwgs )
+{
+    lwgs_.push_back( lwgs );
+}
+
+//------------------------------------------------------------------------------
+void Autotuner::AddDefine( const std::string& name, const std::vector< std::string >& values )
+{
+    defines_.push_back( std::make_pair( name, values ) );
+}
+
+//------------------------------------------------------------------------------
+void Autotuner::AddVariant( const std::string& options, const std::vector< SizeArray >& lwgs )
+{
+    Variant v;
+    v.options = options;
+    v.lwgs = lwgs;
+    variants_.push_back( v );
+}
+
+//------------------------------------------------------------------------------
+void Autotuner::SetRepetitions( int r )
+{
+    if( r < 1 ) throw std::logic_error( "At least one repetition required" );
+    repetitions_ = r;
+}
+
+//------------------------------------------------------------------------------
+std::vector< Autotuner::Variant > Autotuner::Variants() const
+{
+    std::vector< std::string > options( 1, baseOptions_ );
+    for( size_t d = 0; d != defines_.size(); ++d )
+    {
+        if( defines_[ d ].second.empty() ) continue;
+        std::vector< std::string > expanded;
+        for( std::vector< std::string >::const_iterator o = options.begin(); o != options.end(); ++o )
+        {
+            for( std::vector< std::string >::const_iterator v = defines_[ d ].second.begin();
+                 v != defines_[ d ].second.end(); ++v )
+            {
+                expanded.push_back( *o + ( o->empty() ? "" : " " ) + "-D" + defines_[ d ].first + "=" + *v );
+            }
+        }
+        options.swap( expanded );
+    }
+    std::vector< Variant > variants;
+    // options from AddDefine() are measured only if defines were added or
+    // no explicit variant was given
+    if( !defines_.empty() || variants_.empty() )
+    {
+        for( std::vector< std::string >::const_iterator o = options.begin(); o != options.end(); ++o )
+        {
+            Variant v;
+            v.options = *o;
+            variants.push_back( v );
+        }
+    }
+    for( std::vector< Variant >::const_iterator i = variants_.begin(); i != variants_.end(); ++i )
+    {
+        Variant v = *i;
+        if( !baseOptions_.empty() ) v.options = baseOptions_ + ( v.options.empty() ? "" : " " ) + v.options;
+        variants.push_back( v );
+    }
+    return variants;
+}
+
+//------------------------------------------------------------------------------
+std::vector< SizeArray > Autotuner::Candidates( cl_kernel k,
+                                                const SizeArray& gwgs,
+                                                const std::vector< SizeArray >& lwgs ) const
+{
+    const WGroupLimits l = QueryLimits( k, ec_.device );
+    std::vector< SizeArray > c;
+    const std::vector< SizeArray >& requested = lwgs.empty() ? lwgs_ : lwgs;
+    if( requested.empty() )
+    {
+        SizeArray current( gwgs.size(), 1 );
+        GenerateSizes( current, 0, 1, gwgs, l, c );
+    }
+    else
+    {
+        for( std::vector< SizeArray >::const_iterator i = requested.begin(); i != requested.end(); ++i )
+        {
+            if( ValidLocalSize( *i, gwgs, l ) ) c.push_back( *i );
+        }
+    }
+    c.push_back( SizeArray() );
+    return c;
+}
+
+//------------------------------------------------------------------------------
+double Autotuner::Measure( cl_kernel k, const SizeArray& gwgs, const SizeArray& lwgs ) const
+{
+    std::vector< double > times;
+    // first launch is a warm-up and is not timed
+    for( int r = 0; r <= repetitions_; ++r )
+    {
+        // clEnqueueNDRangeKernel is called directly: EnqueueKernelAsync
+        // would replace the empty local size with the tuned one
+        cl_event e = 0;
+        const cl_int status = ::clEnqueueNDRangeKernel( ec_.commandQueue, k, cl_uint( gwgs.size() ), 0,
+                                                        &gwgs[ 0 ], lwgs.empty() ? 0 : &lwgs[ 0 ],
+                                                        0, 0, &e );
+        if( status != CL_SUCCESS ) return -1.;
+        const HEvent event( e );
+        if( ::clWaitForEvents( 1, &e ) != CL_SUCCESS ) return -1.;
+        if( r > 0 ) times.push_back( ProfilingInfo( e ).ExecutionTime() );
+    }
+    std::sort( times.begin(), times.end() );
+    return times[ times.size() / 2 ];
+}
+
+//------------------------------------------------------------------------------
+Autotuner::Result Autotuner::Tune( const SizeArray& gwgs, const ArgSetter& setArgs )
+{
+    if( gwgs.empty() ) throw std::logic_error( "Empty global work group size" );
+    results_.clear();
+    TuningDatabase& db = TuningDatabase::Instance();
+    const std::string deviceKey = TuningDatabase::DeviceKey( ec_.device );
+    const std::vector< Variant > variants = Variants();
+    Result best;
+    bool found = false;
+    for( std::vector< Variant >::const_iterator v = variants.begin(); v != variants.end(); ++v )
+    {
+        HKernel kernel;
+        try
+        {
+            std::string buildOutput;
+            const HProgram program = BuildProgram( ec_, src_, buildOutput, v->options );
+            cl_int status = CL_SUCCESS + 1;
+            cl_kernel k = ::clCreateKernel( program, kernelName_.c_str(), &status );
+            if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateKernel(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+            kernel = HKernel( k );
+        }
+        catch( const std::runtime_error& )
+        {
+            // invalid combination of options for this device
+            continue;
+        }
+        setArgs( kernel );
+        const std::vector< SizeArray > candidates = Candidates( kernel, gwgs, v->lwgs );
+        Result variantBest;
+        bool variantFound = false;
+        for( std::vector< SizeArray >::const_iterator c = candidates.begin(); c != candidates.end(); ++c )
+        {
+            Result r;
+            r.buildOptions = v->options;
+            r.lwgs = *c;
+            r.time = Measure( kernel, gwgs, *c );
+            if( r.time < 0. ) continue;
+            results_.push_back( r );
+            if( !variantFound || r.time < variantBest.time )
+            {
+                variantBest = r;
+                variantFound = true;
+            }
+        }
+        if( !variantFound ) continue;
+        TuningDatabase::Record record;
+        record.lwgs = variantBest.lwgs;
+        record.time = variantBest.time;
+        db.Store( deviceKey, kernelName_, gwgs, variantBest.buildOptions, record );
+        if( !found || variantBest.time < best.time )
+        {
+            best = variantBest;
+            found = true;
+        }
+    }
+    if( !found ) throw std::runtime_error( "No valid configuration found for kernel " + kernelName_ );
+    db.Save();
+    db.SetEnabled( true );
+    return best;
+}
@@ -0,0 +1,143 @@
+///\file opencl/Autotuner.h Search of the fastest work group size and build options of a kernel
+
+#ifndef AUTOTUNER_H_
+#define AUTOTUNER_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <iostream>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Times a kernel over a set of build option variants and local work group
+/// sizes and records the fastest configuration of each variant in
+/// TuningDatabase::Instance():
+///\code
+/// Autotuner tuner( ec, src, "MatMul", "-DDOUBLE" );
+/// tuner.AddDefine( "TILE_SIZE", values );
+/// const Autotuner::Result best = tuner.Tune( gwgs, setArgs );
+/// ec = BuildKernel( ec, src, "MatMul", buildOutput, best.buildOptions );
+/// // an empty local size selects the tuned one
+/// InvokeKernelSync( ec, gwgs, SizeArray(), args );
+///\endcode
+/// Variants are the cartesian product of the values passed to AddDefine()
+/// plus the ones passed to AddVariant(). When no local size is given,
+/// candidates are generated from powers of two whose product is a multiple
+/// of \c CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE; in all cases sizes
+/// that exceed \c CL_KERNEL_WORK_GROUP_SIZE or \c CL_DEVICE_MAX_WORK_ITEM_SIZES
+/// or do not divide the global size are skipped, as are variants that fail
+/// to build and launches that fail, e.g. because of too much local memory.
+/// The run-time default, i.e. an empty local size, is always measured.
+class Autotuner
+{
+public:
+    /// Sets the kernel arguments; invoked once per built variant.
+    typedef std::function< void ( cl_kernel ) > ArgSetter;
+    /// Measured configuration.
+    struct Result
+    {
+        std::string buildOptions; //!< options passed to the compiler
+        SizeArray lwgs;           //!< local work group size, empty for run-time default
+        double time;              //!< median kernel execution time in milliseconds
+        Result() : time( 0. ) {}
+    };
+    typedef std::vector< Result > Results;
+    /// Constructor.
+    /// \param[in] ec execution context with valid context and device; a
+    ///            separate command queue with profiling enabled is created
+    /// \param[in] src source code of program
+    /// \param[in] kernelName name of kernel function
+    /// \param[in] baseOptions build options common to all variants
+    /// \throw std::logic_error in case passed execution context is invalid
+    /// \throw std::runtime_error in case the command queue cannot be created
+    Autotuner( const CLExecutionContext& ec,
+               const std::string& src,
+               const std::string& kernelName,
+               const std::string& baseOptions = "" );
+    /// Add local size candidate used by variants with no sizes of their own.
+    void AddLocalSize( const SizeArray& lwgs );
+    /// Add values of a \c -D definition; each value multiplies the number
+    /// of variants.
+    void AddDefine( const std::string& name, const std::vector< std::string >& values );
+    /// Add variant with its own local size candidates, used when local
+    /// sizes depend on build options e.g. the tile size of a kernel using
+    /// local memory.
+    /// \param[in] options build options appended to the base options
+    /// \param[in] lwgs local size candidates; if empty the candidates of
+    ///            AddLocalSize() or generated ones are used
+    void AddVariant( const std::string& options,
+                     const std::vector< SizeArray >& lwgs = std::vector< SizeArray >() );
+    /// Set number of timed launches per configuration, default is 5; one
+    /// more untimed launch precedes the measurements.
+    void SetRepetitions( int r );
+    /// Measure all configurations, store the fastest one of each variant in
+    /// TuningDatabase::Instance(), save the database if a file is set and
+    /// enable it.
+    /// \param[in] gwgs global work group size
+    /// \param[in] setArgs function setting kernel arguments
+    /// \return fastest configuration
+    /// \throw std::runtime_error in case no configuration could be executed
+    Result Tune( const SizeArray& gwgs, const ArgSetter& setArgs );
+    /// Returns all configurations measured by the last call to Tune().
+    const Results& GetResults() const { return results_; }
+private:
+    /// Build options and local sizes to measure.
+    struct Variant
+    {
+        std::string options;
+        std::vector< SizeArray > lwgs;
+    };
+    /// Returns the build options of all variants.
+    std::vector< Variant > Variants() const;
+    /// Returns valid local sizes for kernel.
+    std::vector< SizeArray > Candidates( cl_kernel k,
+                                         const SizeArray& gwgs,
+                                         const std::vector< SizeArray >& lwgs ) const;
+    /// Returns median execution time, negative in case the launch fails.
+    double Measure( cl_kernel k, const SizeArray& gwgs, const SizeArray& lwgs ) const;
+private:
+    CLExecutionContext ec_;
+    std::string src_;
+    std::string kernelName_;
+    std::string baseOptions_;
+    std::vector< SizeArray > lwgs_;
+    std::vector< std::pair< std::string, std::vector< std::string > > > defines_;
+    std::vector< Variant > variants_;
+    int repetitions_;
+    Results results_;
+};
+
+///Overloaded operator to print a tuning result.
+inline std::ostream& operator<<( std::ostream& os, const Autotuner::Result& r )
+{
+    os << "options: '" << r.buildOptions << "' local size: ";
+    if( r.lwgs.empty() ) os << "default";
+    for( SizeArray::const_iterator i = r.lwgs.begin(); i != r.lwgs.end(); ++i )
+    {
+        if( i != r.lwgs.begin() ) os << 'x';
+        os << *i;
+    }
+    os << " time (ms): " << r.time;
+    return os;
+}
+
+#endif //AUTOTUNER_H_
@@ -0,0 +1,288 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "BufferPool.h"
+#include <stdexcept>
+#include <string>
+#include "OpenCLStatusCodesTable.h"
+#include "KernelArgCache.h"
+#include "../utility/alignment.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Smallest size class.
+const size_t MIN_SIZE_CLASS = 256;
+
+//------------------------------------------------------------------------------
+/// Largest base address alignment in bytes among the devices of a context.
+size_t ContextBaseAddressAlignment( cl_context ctx )
+{
+    size_t cd = 0;
+    cl_int status = ::clGetContextInfo( ctx, CL_CONTEXT_DEVICES, 0, 0, &cd );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetContextInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    std::vector< cl_device_id > devices( cd / sizeof( cl_device_id ) );
+    if( devices.empty() ) return MIN_SIZE_CLASS;
+    status = ::clGetContextInfo( ctx, CL_CONTEXT_DEVICES, cd, &devices[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetContextInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    size_t alignment = 1;
+    for( std::vector< cl_device_id >::const_iterator d = devices.begin(); d != devices.end(); ++d )
+    {
+        cl_uint bits = 0; // value is in bits
+        status = ::clGetDeviceInfo( *d, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof( bits ), &bits, 0 );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+        if( bits / 8 > alignment ) alignment = bits / 8;
+    }
+    return alignment;
+}
+}
+
+//------------------------------------------------------------------------------
+size_t CLBufferPool::SizeClass( size_t size )
+{
+    if( size <= MIN_SIZE_CLASS ) return MIN_SIZE_CLASS;
+    // four classes per power of two: internal fragmentation is below 25%
+    size_t p = MIN_SIZE_CLASS;
+    while( 2 * p < size ) p *= 2;
+    const size_t step = p / 4;
+    return AlignedOffset( size, int( step ) );
+}
+
+//------------------------------------------------------------------------------
+CLBufferPool::CLBufferPool( cl_context ctx,
+                            Mode mode,
+                            size_t arenaSize,
+                            cl_mem_flags arenaFlags,
+                            size_t maxFreeBytes ) :
+    ctx_( ctx ), mode_( mode ), maxFreeBytes_( maxFreeBytes ), alignment_( 1 ),
+    arena_( 0 ), arenaSize_( 0 ), freeBytes_( 0 ), bytesReserved_( 0 ),
+    bytesInUse_( 0 ), capacityInUse_( 0 ), acquisitions_( 0 ), hits_( 0 )
+{
+    if( mode_ != ARENA ) return;
+    if( arenaSize == 0 ) throw std::logic_error( "Arena size must be greater than zero" );
+    alignment_ = ContextBaseAddressAlignment( ctx_ );
+    arena_ = AllocateBuffer( arenaSize, arenaFlags );
+    arenaSize_ = arenaSize;
+    freeRanges_[ 0 ] = arenaSize;
+}
+
+//------------------------------------------------------------------------------
+CLBufferPool::~CLBufferPool()
+{
+    Trim();
+    // sub-buffers still in use keep the arena alive until they are released
+    if( arena_ ) ::clReleaseMemObject( arena_ );
+}
+
+//------------------------------------------------------------------------------
+cl_mem CLBufferPool::AllocateBuffer( size_t size, cl_mem_flags flags )
+{
+    cl_int status = CL_SUCCESS + 1;
+    cl_mem m = ::clCreateBuffer( ctx_, flags, size, 0, &status );
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "Error - clCreateBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    bytesReserved_ += size;
+    return m;
+}
+
+//------------------------------------------------------------------------------
+cl_mem CLBufferPool::AcquireFromClass( size_t size, cl_mem_flags flags, Block& b )
+{
+    b.capacity = SizeClass( size );
+    std::vector< cl_mem >& fl = freeLists_[ std::make_pair( flags, b.capacity ) ];
+    if( !fl.empty() )
+    {
+        cl_mem m = fl.back();
+        fl.pop_back();
+        freeBytes_ -= b.capacity;
+        ++hits_;
+        return m;
+    }
+    return AllocateBuffer( b.capacity, flags );
+}
+
+//------------------------------------------------------------------------------
+cl_mem CLBufferPool::AcquireFromArena( size_t size, cl_mem_flags flags, Block& b )
+{
+    b.capacity = AlignedOffset( size, int( alignment_ ) );
+    // best fit: smallest free range large enough
+    FreeRanges::iterator best = freeRanges_.end();
+    for( FreeRanges::iterator i = freeRanges_.begin(); i != freeRanges_.end(); ++i )
+    {
+        if( i->second >= b.capacity && ( best == freeRanges_.end() || i->second < best->second ) ) best = i;
+    }
+    if( best == freeRanges_.end() )
+    {
+        // arena exhausted: fall back to a dedicated buffer
+        b.capacity = size;
+        return AllocateBuffer( size, flags );
+    }
+    b.offset = best->first;
+    b.inArena = true;
+    const size_t remaining = best->second - b.capacity;
+    freeRanges_.erase( best );
+    if( remaining > 0 ) freeRanges_[ b.offset + b.capacity ] = remaining;
+    cl_buffer_region region;
+    region.origin = b.offset;
+    region.size = b.capacity;
+    cl_int status = CL_SUCCESS + 1;
+    cl_mem m = ::clCreateSubBuffer( arena_, flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &status );
+    if( status != CL_SUCCESS )
+    {
+        FreeArenaRange( b.offset, b.capacity );
+        throw std::runtime_error( "Error - clCreateSubBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    ++hits_;
+    return m;
+}
+
+//------------------------------------------------------------------------------
+void CLBufferPool::FreeArenaRange( size_t offset, size_t size )
+{
+    FreeRanges::iterator i = freeRanges_.insert( std::make_pair( offset, size ) ).first;
+    // coalesce with following range
+    FreeRanges::iterator next = i;
+    ++next;
+    if( next != freeRanges_.end() && i->first + i->second == next->first )
+    {
+        i->second += next->second;
+        freeRanges_.erase( next );
+    }
+    // coalesce with preceding range
+    if( i != freeRanges_.begin() )
+    {
+        FreeRanges::iterator prev = i;
+        --prev;
+        if( prev->first + prev->second == i->first )
+        {
+            prev->second += i->second;
+            freeRanges_.erase( i );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+cl_mem CLBufferPool::Acquire( size_t size, cl_mem_flags flags )
+{
+    if( flags & ( CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR ) )
+    {
+        throw std::invalid_argument( "Host pointer buffers cannot be pooled" );
+    }
+    if( size == 0 ) throw std::invalid_argument( "Zero size buffer requested" );
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ++acquisitions_;
+    Block b;
+    b.requested = size;
+    b.offset = 0;
+    b.flags = flags;
+    b.inArena = false;
+    cl_mem m = mode_ == ARENA ? AcquireFromArena( size, flags, b )
+                              : AcquireFromClass( size, flags, b );
+    inUse_[ m ] = b;
+    bytesInUse_ += size;
+    capacityInUse_ += b.capacity;
+    return m;
+}
+
+//------------------------------------------------------------------------------
+void CLBufferPool::Recycle( cl_mem mem )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    InUse::iterator i = inUse_.find( mem );
+    if( i == inUse_.end() ) throw std::logic_error( "Buffer not allocated by pool" );
+    const Block b = i->second;
+    inUse_.erase( i );
+    bytesInUse_ -= b.requested;
+    capacityInUse_ -= b.capacity;
+    if( b.inArena )
+    {
+        // the run-time can return the same handle for the next sub-buffer
+        KernelArgCache::Instance().Invalidate( mem );
+        ::clReleaseMemObject( mem );
+        FreeArenaRange( b.offset, b.capacity );
+    }
+    else if( mode_ == ARENA
+             || ( maxFreeBytes_ > 0 && freeBytes_ + b.capacity > maxFreeBytes_ ) )
+    {
+        KernelArgCache::Instance().Invalidate( mem );
+        ::clReleaseMemObject( mem );
+        bytesReserved_ -= b.capacity;
+    }
+    else
+    {
+        freeLists_[ std::make_pair( b.flags, b.capacity ) ].push_back( mem );
+        freeBytes_ += b.capacity;
+    }
+}
+
+//------------------------------------------------------------------------------
+size_t CLBufferPool::Capacity( cl_mem mem ) const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    InUse::const_iterator i = inUse_.find( mem );
+    if( i == inUse_.end() ) throw std::logic_error( "Buffer not allocated by pool" );
+    return i->second.capacity;
+}
+
+//------------------------------------------------------------------------------
+void CLBufferPool::Trim()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    for( FreeLists::iterator i = freeLists_.begin(); i != freeLists_.end(); ++i )
+    {
+        for( std::vector< cl_mem >::iterator m = i->second.begin(); m != i->second.end(); ++m )
+        {
+            KernelArgCache::Instance().Invalidate( *m );
+            ::clReleaseMemObject( *m );
+            bytesReserved_ -= i->first.second;
+        }
+    }
+    freeLists_.clear();
+    freeBytes_ = 0;
+}
+
+//------------------------------------------------------------------------------
+CLBufferPool::Stats CLBufferPool::GetStats() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    Stats s;
+    s.bytesReserved = bytesReserved_;
+    s.bytesInUse = bytesInUse_;
+    s.buffersInUse = inUse_.size();
+    s.acquisitions = acquisitions_;
+    s.hits = hits_;
+    s.fragmentation = 0.;
+    if( mode_ == ARENA )
+    {
+        size_t freeTotal = 0;
+        size_t largest = 0;
+        for( FreeRanges::const_iterator i = freeRanges_.begin(); i != freeRanges_.end(); ++i )
+        {
+            freeTotal += i->second;
+            if( i->second > largest ) largest = i->second;
+        }
+        if( freeTotal > 0 ) s.fragmentation = 1. - double( largest ) / freeTotal;
+    }
+    else if( capacityInUse_ > 0 )
+    {
+        s.fragmentation = 1. - double( bytesInUse_ ) / capacityInUse_;
+    }
+    return s;
+}
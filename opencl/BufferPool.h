@@ -0,0 +1,153 @@
+///\file opencl/BufferPool.h Recycling allocator for OpenCL buffers
+
+#ifndef BUFFER_POOL_H_
+#define BUFFER_POOL_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include <CL/cl.h>
+
+//------------------------------------------------------------------------------
+/// Per-context pool of device buffers. Two modes are available:
+/// - SIZE_CLASSES: requests are rounded up to a size class (four classes per
+///   power of two) and released buffers are kept in per class free lists to
+///   be handed out again without calling \c clCreateBuffer
+/// - ARENA: buffers are sub-buffers carved with \c clCreateSubBuffer out of a
+///   single allocation, at offsets aligned to the \c CL_DEVICE_MEM_BASE_ADDR_ALIGN
+///   value of the context devices; requests that do not fit into the arena
+///   are served by \c clCreateBuffer
+///
+/// Buffers are normally obtained through CLMemObj( CLBufferPool&, ... ), which
+/// returns them to the pool when the last reference is released. The pool
+/// must outlive all the buffers it allocated. All methods are thread safe.
+class CLBufferPool
+{
+public:
+    /// Allocation strategy.
+    enum Mode { SIZE_CLASSES, ARENA };
+    /// Pool usage counters.
+    struct Stats
+    {
+        size_t bytesReserved;   //!< device memory allocated by the pool
+        size_t bytesInUse;      //!< bytes requested by buffers currently in use
+        size_t buffersInUse;    //!< number of buffers currently in use
+        unsigned long long acquisitions; //!< total number of requests
+        unsigned long long hits;         //!< requests served without allocating device memory
+        /// Fraction of reserved memory not usable for new requests of the
+        /// largest free size: unused tail of size classes in SIZE_CLASSES
+        /// mode, free memory outside the largest free block in ARENA mode.
+        double fragmentation;
+        /// Fraction of requests served without allocating device memory.
+        double HitRate() const { return acquisitions ? double( hits ) / acquisitions : 0.; }
+    };
+    /// Constructor.
+    /// \param[in] ctx context owning the buffers
+    /// \param[in] mode allocation strategy
+    /// \param[in] arenaSize size in bytes of the arena, used in ARENA mode only
+    /// \param[in] arenaFlags memory flags of the arena, sub-buffers can only
+    ///            restrict access
+    /// \param[in] maxFreeBytes in SIZE_CLASSES mode, released buffers are
+    ///            returned to the run-time when the free lists would exceed
+    ///            this size; zero means no limit
+    /// \throw std::runtime_error in case the arena cannot be allocated
+    CLBufferPool( cl_context ctx,
+                  Mode mode = SIZE_CLASSES,
+                  size_t arenaSize = 0,
+                  cl_mem_flags arenaFlags = CL_MEM_READ_WRITE,
+                  size_t maxFreeBytes = 0 );
+    /// Destructor: releases free buffers and the arena.
+    ~CLBufferPool();
+    /// Returns buffer of at least \c size bytes.
+    /// \param[in] size requested size in bytes
+    /// \param[in] flags memory flags; host pointer flags are not supported
+    /// \throw std::invalid_argument in case flags contain \c CL_MEM_USE_HOST_PTR
+    ///        or \c CL_MEM_COPY_HOST_PTR
+    /// \throw std::runtime_error in case the buffer cannot be allocated
+    cl_mem Acquire( size_t size, cl_mem_flags flags = CL_MEM_READ_WRITE );
+    /// Give back buffer obtained from Acquire(); the pool takes ownership of
+    /// the caller's reference.
+    /// \throw std::logic_error in case the buffer was not allocated by the pool
+    void Recycle( cl_mem mem );
+    /// Returns number of bytes usable in buffer obtained from Acquire().
+    /// \throw std::logic_error in case the buffer was not allocated by the pool
+    size_t Capacity( cl_mem mem ) const;
+    /// Return free buffers to the run-time.
+    void Trim();
+    /// Returns usage counters.
+    Stats GetStats() const;
+    /// Returns context owning the buffers.
+    cl_context GetContext() const { return ctx_; }
+    /// Returns allocation strategy.
+    Mode GetMode() const { return mode_; }
+    /// Returns the size class a request is rounded up to in SIZE_CLASSES mode.
+    static size_t SizeClass( size_t size );
+private:
+    CLBufferPool( const CLBufferPool& );
+    CLBufferPool& operator=( const CLBufferPool& );
+    /// Buffer currently handed out.
+    struct Block
+    {
+        size_t requested; //!< requested size
+        size_t capacity;  //!< size class or aligned arena block size
+        size_t offset;    //!< offset in arena
+        cl_mem_flags flags;
+        bool inArena;     //!< sub-buffer of the arena
+    };
+    typedef std::map< cl_mem, Block > InUse;
+    /// (flags, size class) -> free buffers
+    typedef std::map< std::pair< cl_mem_flags, size_t >, std::vector< cl_mem > > FreeLists;
+    /// offset -> size of free arena ranges
+    typedef std::map< size_t, size_t > FreeRanges;
+    cl_mem AllocateBuffer( size_t size, cl_mem_flags flags );
+    cl_mem AcquireFromClass( size_t size, cl_mem_flags flags, Block& b );
+    cl_mem AcquireFromArena( size_t size, cl_mem_flags flags, Block& b );
+    void FreeArenaRange( size_t offset, size_t size );
+private:
+    mutable std::mutex mutex_;
+    cl_context ctx_;
+    Mode mode_;
+    size_t maxFreeBytes_;
+    size_t alignment_;
+    cl_mem arena_;
+    size_t arenaSize_;
+    FreeRanges freeRanges_;
+    FreeLists freeLists_;
+    size_t freeBytes_;
+    InUse inUse_;
+    size_t bytesReserved_;
+    size_t bytesInUse_;
+    size_t capacityInUse_;
+    unsigned long long acquisitions_;
+    unsigned long long hits_;
+};
+
+///Overloaded operator to print pool counters.
+inline std::ostream& operator<<( std::ostream& os, const CLBufferPool::Stats& s )
+{
+    os << "reserved: " << s.bytesReserved << " in use: " << s.bytesInUse
+       << " buffers: " << s.buffersInUse << " hit rate: " << s.HitRate()
+       << " fragmentation: " << s.fragmentation;
+    return os;
+}
+
+#endif //BUFFER_POOL_H_
@@ -0,0 +1,380 @@
+///\file opencl/DeviceVector.h Typed array mirrored in host and device memory
+
+#ifndef DEVICE_VECTOR_H_
+#define DEVICE_VECTOR_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <CL/cl.h>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// DeviceVector transfer counters.
+struct DeviceVectorStats
+{
+    size_t bytesToDevice;              //!< bytes copied from host to device
+    size_t bytesToHost;                //!< bytes copied from device to host
+    unsigned long long copiesToDevice; //!< number of host to device copies
+    unsigned long long copiesToHost;   //!< number of device to host copies
+};
+
+//------------------------------------------------------------------------------
+/// Array of \c T stored both in host memory and in an OpenCL buffer. Each
+/// side keeps track of the range of elements modified since the last
+/// synchronization and data is copied only when the other side is accessed,
+/// and only for the modified range:
+/// - host access through operator[] or HostData() downloads the range
+///   modified on the device; only writes mark elements as modified on the
+///   host, reads through the non-const operator[] do not
+/// - device access through DeviceBuffer() or kernel binding uploads the range
+///   modified on the host
+///
+/// Instances can be passed directly to Launch(): the buffer is synchronized
+/// when the argument is bound and, unless the buffer is \c CL_MEM_READ_ONLY,
+/// the whole array is marked as modified on the device since the kernel can
+/// write to it. Wrap with AsInput() to bind arrays the kernel only reads.
+/// \c CL_MEM_WRITE_ONLY arrays are never uploaded.
+///
+/// Copies are blocking and enqueued on the queue passed to the constructor:
+/// kernels writing to the array must be enqueued on the same in-order queue,
+/// or complete, before the array is accessed on the host.
+///
+/// Instances cannot be copied, since copies would share the buffer but not
+/// the modified ranges; they can be moved.
+///\code
+///  DeviceVector< float > x( ec.context, ec.commandQueue, n, 1.f );
+///  DeviceVector< float > y( ec.context, ec.commandQueue, n );
+///  Launch( ec, gwgs, lwgs, AsInput( x ), y, cl_uint( n ) ); // uploads x only
+///  x[ 0 ] = 2.f;                                             // marks x[ 0 ]
+///  Launch( ec, gwgs, lwgs, AsInput( x ), y, cl_uint( n ) ); // uploads x[ 0 ]
+///  std::cout << y[ 0 ];                                      // downloads y
+///\endcode
+template < typename T >
+class DeviceVector
+{
+public:
+    typedef T value_type;
+    typedef DeviceVectorStats Stats;
+    /// Constructor: all elements are set to \c value.
+    /// \param[in] ctx context owning the buffer
+    /// \param[in] cq command queue used to copy data
+    /// \param[in] size number of elements
+    /// \param[in] value initial value of elements
+    /// \param[in] flags memory flags of the buffer; host pointer flags are
+    ///            not supported
+    /// \throw std::runtime_error in case the buffer cannot be allocated
+    DeviceVector( cl_context ctx,
+                  cl_command_queue cq,
+                  size_t size = 0,
+                  const T& value = T(),
+                  cl_mem_flags flags = CL_MEM_READ_WRITE )
+        : host_( size, value ), buffer_( ctx, BufferSize( size ), flags ), cq_( cq )
+    {
+        hostDirty_.Add( 0, size );
+        ResetStats();
+    }
+    /// Constructor: elements are copied from \c data.
+    DeviceVector( cl_context ctx,
+                  cl_command_queue cq,
+                  const std::vector< T >& data,
+                  cl_mem_flags flags = CL_MEM_READ_WRITE )
+        : host_( data ), buffer_( ctx, BufferSize( data.size() ), flags ), cq_( cq )
+    {
+        hostDirty_.Add( 0, data.size() );
+        ResetStats();
+    }
+    /// Move constructor: \c other is left empty.
+    DeviceVector( DeviceVector&& other )
+        : host_( std::move( other.host_ ) ), buffer_( std::move( other.buffer_ ) ), cq_( other.cq_ ),
+          hostDirty_( other.hostDirty_ ), deviceDirty_( other.deviceDirty_ ), stats_( other.stats_ )
+    {
+        other.host_.clear();
+        other.hostDirty_.Clear();
+        other.deviceDirty_.Clear();
+    }
+    /// Move assignment: \c other is left empty.
+    DeviceVector& operator=( DeviceVector&& other )
+    {
+        if( this == &other ) return *this;
+        host_ = std::move( other.host_ );
+        buffer_ = std::move( other.buffer_ );
+        cq_ = other.cq_;
+        hostDirty_ = other.hostDirty_;
+        deviceDirty_ = other.deviceDirty_;
+        stats_ = other.stats_;
+        other.host_.clear();
+        other.hostDirty_.Clear();
+        other.deviceDirty_.Clear();
+        return *this;
+    }
+    /// Element access through the non-const operator[]: reading downloads
+    /// data modified on the device, assigning also marks the element as
+    /// modified on the host.
+    class Reference
+    {
+    public:
+        operator const T&() const { return static_cast< const DeviceVector& >( v_ )[ i_ ]; }
+        Reference& operator=( const T& x )
+        {
+            v_.Write( i_ ) = x;
+            return *this;
+        }
+        Reference& operator=( const Reference& r ) { return *this = static_cast< const T& >( r ); }
+        template < typename U > Reference& operator+=( const U& x )
+        {
+            v_.Write( i_ ) += x;
+            return *this;
+        }
+        template < typename U > Reference& operator-=( const U& x )
+        {
+            v_.Write( i_ ) -= x;
+            return *this;
+        }
+        template < typename U > Reference& operator*=( const U& x )
+        {
+            v_.Write( i_ ) *= x;
+            return *this;
+        }
+        template < typename U > Reference& operator/=( const U& x )
+        {
+            v_.Write( i_ ) /= x;
+            return *this;
+        }
+    private:
+        friend class DeviceVector;
+        Reference( DeviceVector& v, size_t i ) : v_( v ), i_( i ) {}
+        DeviceVector& v_;
+        size_t i_;
+    };
+    /// Returns number of elements.
+    size_t Size() const { return host_.size(); }
+    /// Returns \c true if the array has no elements.
+    bool Empty() const { return host_.empty(); }
+    /// Read element; downloads data modified on the device.
+    const T& operator[]( size_t i ) const
+    {
+        SyncHost();
+        return host_[ i ];
+    }
+    /// Access element; the element is marked as modified on the host only
+    /// when assigned, see Reference.
+    Reference operator[]( size_t i ) { return Reference( *this, i ); }
+    /// Returns pointer to host data for reading.
+    const T* HostData() const
+    {
+        SyncHost();
+        return host_.empty() ? 0 : &host_[ 0 ];
+    }
+    /// Returns pointer to \c count elements starting at \c first for reading
+    /// and writing; the range is marked as modified on the host.
+    /// \throw std::out_of_range in case the range is outside of the array
+    T* HostData( size_t first, size_t count )
+    {
+        CheckRange( first, count );
+        SyncHost();
+        hostDirty_.Add( first, first + count );
+        return count == 0 ? 0 : &host_[ first ];
+    }
+    /// Returns pointer to all host data for reading and writing; the whole
+    /// array is marked as modified on the host.
+    T* HostData() { return HostData( 0, Size() ); }
+    /// Overwrite \c count elements starting at \c first; data modified on
+    /// the device within the range is discarded instead of downloaded.
+    /// \throw std::out_of_range in case the range is outside of the array
+    void Assign( const T* data, size_t count, size_t first = 0 )
+    {
+        CheckRange( first, count );
+        if( !deviceDirty_.Within( first, first + count ) ) SyncHost();
+        else deviceDirty_.Clear();
+        std::copy( data, data + count, host_.begin() + first );
+        hostDirty_.Add( first, first + count );
+    }
+    /// Returns buffer for use in commands that read it; uploads data modified
+    /// on the host. Call MarkDeviceDirty() after enqueuing commands that
+    /// modify the buffer.
+    const CLMemObj& DeviceBuffer() const
+    {
+        SyncDevice();
+        return buffer_;
+    }
+    /// Record modification of \c count elements starting at \c first by
+    /// device commands; the range is downloaded on the next host access.
+    /// A zero count marks all the elements from \c first to the end.
+    /// \throw std::logic_error in case data modified on the host has not been
+    ///        uploaded
+    void MarkDeviceDirty( size_t first = 0, size_t count = 0 ) const
+    {
+        if( count == 0 ) count = Size() > first ? Size() - first : 0;
+        CheckRange( first, count );
+        if( !hostDirty_.Empty() ) throw std::logic_error( "DeviceVector modified on both host and device" );
+        deviceDirty_.Add( first, first + count );
+    }
+    /// Upload data modified on the host.
+    /// \throw std::runtime_error in case of errors while copying data
+    void SyncDevice() const
+    {
+        if( hostDirty_.Empty() ) return;
+        if( !( buffer_.GetFlags() & CL_MEM_WRITE_ONLY ) )
+        {
+            const size_t offset = hostDirty_.begin * sizeof( T );
+            const size_t bytes = ( hostDirty_.end - hostDirty_.begin ) * sizeof( T );
+            CLCopyHtoD( cq_, &host_[ hostDirty_.begin ], const_cast< CLMemObj& >( buffer_ ),
+                        CL_TRUE, offset, bytes );
+            stats_.bytesToDevice += bytes;
+            ++stats_.copiesToDevice;
+        }
+        hostDirty_.Clear();
+    }
+    /// Download data modified on the device.
+    /// \throw std::runtime_error in case of errors while copying data
+    void SyncHost() const
+    {
+        if( deviceDirty_.Empty() ) return;
+        const size_t offset = deviceDirty_.begin * sizeof( T );
+        const size_t bytes = ( deviceDirty_.end - deviceDirty_.begin ) * sizeof( T );
+        CLCopyDtoH( cq_, buffer_, &host_[ deviceDirty_.begin ], CL_TRUE, offset, bytes );
+        stats_.bytesToHost += bytes;
+        ++stats_.copiesToHost;
+        deviceDirty_.Clear();
+    }
+    /// Change number of elements; new elements are set to \c value and
+    /// the buffer is reallocated and uploaded on next device access.
+    /// \throw std::runtime_error in case of errors while copying data or
+    ///        allocating the buffer
+    void Resize( size_t size, const T& value = T() )
+    {
+        SyncHost();
+        host_.resize( size, value );
+        buffer_.Resize( BufferSize( size ) );
+        hostDirty_.Clear();
+        hostDirty_.Add( 0, size );
+    }
+    /// Bind array as kernel argument: uploads data modified on the host and,
+    /// if \c write is \c true and the buffer is not read-only, marks the
+    /// whole array as modified on the device.
+    /// \return address of the buffer handle, passed to \c clSetKernelArg
+    const cl_mem* BindKernelArg( bool write ) const
+    {
+        SyncDevice();
+        if( write && !( buffer_.GetFlags() & CL_MEM_READ_ONLY ) ) MarkDeviceDirty();
+        return buffer_.GetCLMemHandleAddress();
+    }
+    /// Returns transfer counters.
+    Stats GetStats() const { return stats_; }
+    /// Reset transfer counters.
+    void ResetStats()
+    {
+        stats_.bytesToDevice = 0;
+        stats_.bytesToHost = 0;
+        stats_.copiesToDevice = 0;
+        stats_.copiesToHost = 0;
+    }
+private:
+    DeviceVector( const DeviceVector& );
+    DeviceVector& operator=( const DeviceVector& );
+    /// Downloads data modified on the device and marks element as modified
+    /// on the host.
+    T& Write( size_t i )
+    {
+        SyncHost();
+        hostDirty_.Add( i, i + 1 );
+        return host_[ i ];
+    }
+    /// Half-open range of modified elements.
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+        Range() : begin( 0 ), end( 0 ) {}
+        bool Empty() const { return begin >= end; }
+        /// Extend range to include [b, e).
+        void Add( size_t b, size_t e )
+        {
+            if( b >= e ) return;
+            if( Empty() )
+            {
+                begin = b;
+                end = e;
+                return;
+            }
+            if( b < begin ) begin = b;
+            if( e > end ) end = e;
+        }
+        /// Returns \c true if the range is contained in [b, e).
+        bool Within( size_t b, size_t e ) const { return Empty() || ( b <= begin && end <= e ); }
+        void Clear() { begin = end = 0; }
+    };
+    /// Buffers cannot be empty.
+    static size_t BufferSize( size_t size ) { return ( size > 0 ? size : 1 ) * sizeof( T ); }
+    void CheckRange( size_t first, size_t count ) const
+    {
+        if( first > Size() || Size() - first < count ) throw std::out_of_range( "DeviceVector range" );
+    }
+private:
+    mutable std::vector< T > host_;
+    CLMemObj buffer_;
+    cl_command_queue cq_;
+    mutable Range hostDirty_;
+    mutable Range deviceDirty_;
+    mutable Stats stats_;
+};
+
+//------------------------------------------------------------------------------
+/// DeviceVector bound as a kernel argument the kernel does not write to.
+template < typename T >
+struct DeviceVectorInput
+{
+    const DeviceVector< T >& v;
+    explicit DeviceVectorInput( const DeviceVector< T >& dv ) : v( dv ) {}
+};
+
+/// Pass DeviceVector to Launch() without marking it modified on the device.
+template < typename T >
+inline DeviceVectorInput< T > AsInput( const DeviceVector< T >& v )
+{
+    return DeviceVectorInput< T >( v );
+}
+
+/// DeviceVector: binds the buffer, marking it modified on the device.
+template < typename T > struct KernelArg< DeviceVector< T > >
+{
+    static size_t Size( const DeviceVector< T >& ) { return sizeof( cl_mem ); }
+    static const void* Address( const DeviceVector< T >& v ) { return v.BindKernelArg( true ); }
+};
+/// DeviceVector read by the kernel: binds the buffer only.
+template < typename T > struct KernelArg< DeviceVectorInput< T > >
+{
+    static size_t Size( const DeviceVectorInput< T >& ) { return sizeof( cl_mem ); }
+    static const void* Address( const DeviceVectorInput< T >& i ) { return i.v.BindKernelArg( false ); }
+};
+
+///Overloaded operator to print transfer counters.
+inline std::ostream& operator<<( std::ostream& os, const DeviceVectorStats& s )
+{
+    os << "to device: " << s.bytesToDevice << " bytes in " << s.copiesToDevice << " copies"
+       << " to host: " << s.bytesToHost << " bytes in " << s.copiesToHost << " copies";
+    return os;
+}
+
+#endif //DEVICE_VECTOR_H_
@@ -0,0 +1,230 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "Gemm.h"
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include "OpenCLStatusCodesTable.h"
+
+namespace {
+//------------------------------------------------------------------------------
+template < typename T >
+T DeviceInfo( cl_device_id device, cl_device_info param )
+{
+    T v = T();
+    const cl_int status = ::clGetDeviceInfo( device, param, sizeof( T ), &v, 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    return v;
+}
+
+//------------------------------------------------------------------------------
+/// Check that a matrix stored with leading dimension \c ld has at least
+/// \c cols elements per row.
+void CheckLeadingDimension( int ld, int cols, const char* name )
+{
+    if( ld < 1 || ld < cols )
+    {
+        throw std::invalid_argument( std::string( "Invalid leading dimension of matrix " ) + name );
+    }
+}
+}
+
+//------------------------------------------------------------------------------
+GemmParams GemmParams::ForDevice( cl_device_id device, bool doublePrecision )
+{
+    const cl_device_type type = DeviceInfo< cl_device_type >( device, CL_DEVICE_TYPE );
+    const size_t maxWGroupSize = DeviceInfo< size_t >( device, CL_DEVICE_MAX_WORK_GROUP_SIZE );
+    const cl_ulong localMemSize = DeviceInfo< cl_ulong >( device, CL_DEVICE_LOCAL_MEM_SIZE );
+    GemmParams p;
+    p.wptM = 4;
+    p.wptN = 4;
+    p.tileK = 16;
+    if( type & CL_DEVICE_TYPE_CPU )
+    {
+        // few work-items per group, vectors as wide as the SIMD units
+        p.tileM = 32;
+        p.tileN = 32;
+        cl_uint width = 0;
+        ::clGetDeviceInfo( device, doublePrecision ? CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE
+                                                   : CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT,
+                           sizeof( width ), &width, 0 );
+        p.vectorWidth = 1;
+        while( p.vectorWidth < 8 && 2 * cl_uint( p.vectorWidth ) <= width ) p.vectorWidth *= 2;
+    }
+    else
+    {
+        // 256 work-items computing 16 elements each
+        p.tileM = 64;
+        p.tileN = 64;
+        p.vectorWidth = 4;
+    }
+    while( size_t( ( p.tileM / p.wptM ) * ( p.tileN / p.wptN ) ) > maxWGroupSize && p.tileM > p.wptM )
+    {
+        p.tileM /= 2;
+        p.tileN /= 2;
+    }
+    const size_t realSize = doublePrecision ? sizeof( double ) : sizeof( float );
+    while( ( p.tileM + p.tileN ) * p.tileK * realSize > localMemSize && p.tileK > 1 ) p.tileK /= 2;
+    while( p.vectorWidth > p.tileK || p.vectorWidth > p.tileM ) p.vectorWidth /= 2;
+    return p;
+}
+
+//------------------------------------------------------------------------------
+SizeArray GemmParams::LocalSize() const
+{
+    SizeArray lwgs( 2 );
+    lwgs[ 0 ] = tileN / wptN;
+    lwgs[ 1 ] = tileM / wptM;
+    return lwgs;
+}
+
+//------------------------------------------------------------------------------
+std::string GemmParams::BuildOptions() const
+{
+    std::ostringstream os;
+    os << "-DTILE_M=" << tileM << " -DTILE_N=" << tileN << " -DTILE_K=" << tileK
+       << " -DWPT_M=" << wptM << " -DWPT_N=" << wptN << " -DVW=" << vectorWidth;
+    return os.str();
+}
+
+//------------------------------------------------------------------------------
+void GemmParams::Validate() const
+{
+    if( tileM < 1 || tileN < 1 || tileK < 1 || wptM < 1 || wptN < 1 )
+    {
+        throw std::logic_error( "GEMM block sizes must be greater than zero" );
+    }
+    if( tileM % wptM != 0 || tileN % wptN != 0 )
+    {
+        throw std::logic_error( "GEMM tile sizes must be multiples of work-item block sizes" );
+    }
+    if( ( vectorWidth != 1 && vectorWidth != 2 && vectorWidth != 4 && vectorWidth != 8 )
+        || tileM % vectorWidth != 0 || tileN % vectorWidth != 0 || tileK % vectorWidth != 0 )
+    {
+        throw std::logic_error( "GEMM vector width must be 1, 2, 4 or 8 and divide tile sizes" );
+    }
+}
+
+//------------------------------------------------------------------------------
+CLGemm::CLGemm( const CLExecutionContext& ec, const std::string& src ) :
+    ec_( ec ), src_( src ), fixedParams_( false )
+{
+    if( ec.context == 0 || ec.commandQueue == 0 ) throw std::logic_error( "Uninitialized execution context" );
+}
+
+//------------------------------------------------------------------------------
+CLGemm::CLGemm( const CLExecutionContext& ec, const std::string& src, const GemmParams& params ) :
+    ec_( ec ), src_( src ), fixedParams_( true ), params_( params )
+{
+    if( ec.context == 0 || ec.commandQueue == 0 ) throw std::logic_error( "Uninitialized execution context" );
+    params_.Validate();
+}
+
+//------------------------------------------------------------------------------
+const CLGemm::Variant& CLGemm::GetVariant( bool doublePrecision, bool transA, bool transB )
+{
+    const int key = ( doublePrecision ? 4 : 0 ) | ( transA ? 2 : 0 ) | ( transB ? 1 : 0 );
+    std::map< int, Variant >::const_iterator i = variants_.find( key );
+    if( i != variants_.end() ) return i->second;
+    Variant v;
+    v.params = fixedParams_ ? params_ : GemmParams::ForDevice( ec_.device, doublePrecision );
+    std::string options;
+    if( doublePrecision ) options += "-DDOUBLE ";
+    if( transA ) options += "-DTRANS_A=1 ";
+    if( transB ) options += "-DTRANS_B=1 ";
+    for( ;; )
+    {
+        std::string buildOutput;
+        const CLExecutionContext ec = BuildKernel( ec_, src_, "Gemm", buildOutput,
+                                                   options + v.params.BuildOptions() );
+        v.kernel = ec.kernel;
+        // register usage can make the kernel limit lower than the device one
+        const size_t wgroupSize = v.params.LocalSize()[ 0 ] * v.params.LocalSize()[ 1 ];
+        if( ec.wgroupSize == 0 || wgroupSize <= ec.wgroupSize ) break;
+        if( fixedParams_ || v.params.tileM == v.params.wptM )
+        {
+            throw std::runtime_error( "GEMM work-group size not supported by the kernel" );
+        }
+        v.params.tileM /= 2;
+        v.params.tileN /= 2;
+        if( v.params.vectorWidth > v.params.tileM ) v.params.vectorWidth = v.params.tileM;
+    }
+    return variants_[ key ] = v;
+}
+
+//------------------------------------------------------------------------------
+GemmParams CLGemm::GetParams( bool doublePrecision )
+{
+    return GetVariant( doublePrecision, false, false ).params;
+}
+
+//------------------------------------------------------------------------------
+template < typename T >
+HEvent CLGemm::Run( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                    int m, int n, int k,
+                    T alpha, cl_mem A, int lda, cl_mem B, int ldb,
+                    T beta, cl_mem C, int ldc,
+                    const EventArray& waitList )
+{
+    if( m < 0 || n < 0 || k < 0 ) throw std::invalid_argument( "Negative GEMM size" );
+    // stored rows x columns of A and B in the order of the matrices
+    const bool rowMajor = order == GEMM_ROW_MAJOR;
+    CheckLeadingDimension( lda, ( transA == GEMM_TRANS ) == rowMajor ? m : k, "A" );
+    CheckLeadingDimension( ldb, ( transB == GEMM_TRANS ) == rowMajor ? k : n, "B" );
+    CheckLeadingDimension( ldc, rowMajor ? n : m, "C" );
+    if( m == 0 || n == 0 ) return HEvent();
+    if( !rowMajor )
+    {
+        // a column-major matrix is the transpose of the row-major matrix with
+        // the same storage: C^T = alpha * op( B )^T * op( A )^T + beta * C^T
+        std::swap( m, n );
+        std::swap( A, B );
+        std::swap( lda, ldb );
+        std::swap( transA, transB );
+    }
+    const Variant& v = GetVariant( sizeof( T ) == sizeof( double ),
+                                   transA == GEMM_TRANS, transB == GEMM_TRANS );
+    const SizeArray lwgs = v.params.LocalSize();
+    SizeArray gwgs( 2 );
+    gwgs[ 0 ] = ( ( n + v.params.tileN - 1 ) / v.params.tileN ) * lwgs[ 0 ];
+    gwgs[ 1 ] = ( ( m + v.params.tileM - 1 ) / v.params.tileM ) * lwgs[ 1 ];
+    return Launch( ec_.commandQueue, v.kernel, gwgs, lwgs, waitList,
+                   m, n, k, alpha, A, lda, B, ldb, beta, C, ldc );
+}
+
+//------------------------------------------------------------------------------
+HEvent CLGemm::Gemm( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                     int m, int n, int k,
+                     float alpha, cl_mem A, int lda, cl_mem B, int ldb,
+                     float beta, cl_mem C, int ldc,
+                     const EventArray& waitList )
+{
+    return Run( order, transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, waitList );
+}
+
+//------------------------------------------------------------------------------
+HEvent CLGemm::Gemm( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                     int m, int n, int k,
+                     double alpha, cl_mem A, int lda, cl_mem B, int ldb,
+                     double beta, cl_mem C, int ldc,
+                     const EventArray& waitList )
+{
+    return Run( order, transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, waitList );
+}
@@ -0,0 +1,137 @@
+///\file opencl/Gemm.h General matrix multiply on OpenCL devices
+
+#ifndef GEMM_H_
+#define GEMM_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <map>
+#include <iostream>
+#include "gpupp.h"
+
+/// Storage order of matrices.
+enum GemmOrder { GEMM_ROW_MAJOR, GEMM_COL_MAJOR };
+/// Operation applied to an input matrix.
+enum GemmTranspose { GEMM_NO_TRANS, GEMM_TRANS };
+
+//------------------------------------------------------------------------------
+/// Blocking parameters of the GEMM kernel in test/gemm.cl.
+struct GemmParams
+{
+    int tileM;       //!< rows of the block of C computed by a work-group
+    int tileN;       //!< columns of the block of C computed by a work-group
+    int tileK;       //!< depth of the blocks of A and B staged in local memory
+    int wptM;        //!< rows of the block of C computed by a work-item
+    int wptN;        //!< columns of the block of C computed by a work-item
+    int vectorWidth; //!< width of vector loads: 1, 2, 4 or 8
+    /// Returns parameters suited to the device: large register blocks and
+    /// work-groups on GPUs, small work-groups and the preferred vector
+    /// width on CPUs, reduced to fit the maximum work-group size and the
+    /// local memory size.
+    /// \throw std::runtime_error in case device info cannot be retrieved
+    static GemmParams ForDevice( cl_device_id device, bool doublePrecision );
+    /// Returns local work group size.
+    SizeArray LocalSize() const;
+    /// Returns \c -D options defining the parameters.
+    std::string BuildOptions() const;
+    /// Throws std::logic_error in case tile sizes are not multiples of the
+    /// work-item block sizes and vector width.
+    void Validate() const;
+};
+
+//------------------------------------------------------------------------------
+/// Computes C = alpha * op( A ) * op( B ) + beta * C through the kernel in
+/// test/gemm.cl, with the same argument conventions as the BLAS \c xGEMM
+/// functions: op( A ) is M x K, op( B ) is K x N, C is M x N and leading
+/// dimensions are the distance between consecutive rows, or columns in
+/// column-major order. Sizes need not be multiples of the tile sizes.
+/// Kernels are built on first use for each combination of precision and
+/// transpose flags. Instances are not thread safe: kernel arguments are
+/// set on shared kernel objects.
+///\code
+/// CLGemm gemm( ec, LoadText( "gemm.cl" ) );
+/// gemm.Gemm( GEMM_ROW_MAJOR, GEMM_NO_TRANS, GEMM_NO_TRANS, m, n, k,
+///            1.0f, dA, k, dB, n, 0.0f, dC, n );
+///\endcode
+class CLGemm
+{
+public:
+    /// Constructor; blocking parameters are selected with GemmParams::ForDevice.
+    /// \param[in] ec execution context with valid context, device and command queue
+    /// \param[in] src source code of test/gemm.cl
+    /// \throw std::logic_error in case passed execution context is invalid
+    CLGemm( const CLExecutionContext& ec, const std::string& src );
+    /// Constructor with explicit blocking parameters used for all precisions.
+    /// \throw std::logic_error in case passed execution context or
+    ///        parameters are invalid
+    CLGemm( const CLExecutionContext& ec, const std::string& src, const GemmParams& params );
+    /// Enqueue single precision GEMM into the command queue of the execution context.
+    /// \param[in] waitList events to wait for before execution
+    /// \return event associated with the kernel execution, empty if there
+    ///         is nothing to compute
+    /// \throw std::invalid_argument in case of negative sizes or leading
+    ///        dimensions smaller than the rows or columns they span
+    /// \throw std::runtime_error in case of errors building or launching the kernel
+    HEvent Gemm( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                 int m, int n, int k,
+                 float alpha, cl_mem A, int lda, cl_mem B, int ldb,
+                 float beta, cl_mem C, int ldc,
+                 const EventArray& waitList = EventArray() );
+    /// Enqueue double precision GEMM; requires \c cl_khr_fp64 support.
+    HEvent Gemm( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                 int m, int n, int k,
+                 double alpha, cl_mem A, int lda, cl_mem B, int ldb,
+                 double beta, cl_mem C, int ldc,
+                 const EventArray& waitList = EventArray() );
+    /// Returns the blocking parameters used for a precision, after the
+    /// reductions required by the kernel's maximum work-group size.
+    GemmParams GetParams( bool doublePrecision );
+private:
+    /// Built kernel and its parameters.
+    struct Variant
+    {
+        HKernel kernel;
+        GemmParams params;
+    };
+    /// Returns kernel for precision and transpose flags, building it if needed.
+    const Variant& GetVariant( bool doublePrecision, bool transA, bool transB );
+    template < typename T >
+    HEvent Run( GemmOrder order, GemmTranspose transA, GemmTranspose transB,
+                int m, int n, int k,
+                T alpha, cl_mem A, int lda, cl_mem B, int ldb,
+                T beta, cl_mem C, int ldc,
+                const EventArray& waitList );
+private:
+    CLExecutionContext ec_;
+    std::string src_;
+    bool fixedParams_;
+    GemmParams params_;
+    std::map< int, Variant > variants_;
+};
+
+///Overloaded operator to print GEMM parameters.
+inline std::ostream& operator<<( std::ostream& os, const GemmParams& p )
+{
+    os << "tile: " << p.tileM << 'x' << p.tileN << 'x' << p.tileK
+       << " work-item: " << p.wptM << 'x' << p.wptN << " vector width: " << p.vectorWidth;
+    return os;
+}
+
+#endif //GEMM_H_
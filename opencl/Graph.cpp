@@ -0,0 +1,282 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "Graph.h"
+#include <string>
+#include "OpenCLStatusCodesTable.h"
+#include "KernelArgCache.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Create new instance of a kernel from the same program.
+cl_kernel CloneKernel( cl_kernel k )
+{
+    cl_program program = 0;
+    cl_int status = ::clGetKernelInfo( k, CL_KERNEL_PROGRAM, sizeof( cl_program ), &program, 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetKernelInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    size_t nameSize = 0;
+    status = ::clGetKernelInfo( k, CL_KERNEL_FUNCTION_NAME, 0, 0, &nameSize );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetKernelInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    std::vector< char > name( nameSize + 1, char() );
+    status = ::clGetKernelInfo( k, CL_KERNEL_FUNCTION_NAME, nameSize, &name[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetKernelInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    cl_kernel clone = ::clCreateKernel( program, &name[ 0 ], &status );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateKernel(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    return clone;
+}
+}
+
+//------------------------------------------------------------------------------
+CLGraph::CLGraph( cl_command_queue cq ) : commandQueue_( cq ), inOrder_( true )
+{
+    cl_command_queue_properties prop = 0;
+    cl_int status = ::clGetCommandQueueInfo( cq, CL_QUEUE_PROPERTIES, sizeof( prop ), &prop, 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetCommandQueueInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    inOrder_ = ( prop & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE ) == 0;
+}
+
+//------------------------------------------------------------------------------
+CLGraph::~CLGraph()
+{
+    for( std::vector< Node >::iterator n = nodes_.begin(); n != nodes_.end(); ++n )
+    {
+        if( n->buffer == 0 ) continue;
+        KernelArgCache::Instance().Invalidate( n->buffer );
+        ::clReleaseMemObject( n->buffer );
+    }
+}
+
+//------------------------------------------------------------------------------
+void CLGraph::AddDeps( Node& n, const NodeIds& deps )
+{
+    for( NodeIds::const_iterator d = deps.begin(); d != deps.end(); ++d )
+    {
+        if( *d >= nodes_.size() ) throw std::logic_error( "Graph dependency on node not yet recorded" );
+        nodes_[ *d ].signals = true;
+    }
+    n.deps = deps;
+}
+
+//------------------------------------------------------------------------------
+CLGraph::NodeId CLGraph::AddKernelNode( cl_kernel k,
+                                        const SizeArray& gwgs,
+                                        const SizeArray& lwgs,
+                                        const NodeIds& deps )
+{
+    if( gwgs.empty() ) throw std::logic_error( "Empty global work group size" );
+    Node n;
+    n.type = KERNEL;
+    n.gwgs = gwgs;
+    n.lwgs = lwgs;
+    n.buffer = 0;
+    n.hostPtr = 0;
+    n.offset = 0;
+    n.size = 0;
+    n.signals = false;
+    AddDeps( n, deps );
+    n.kernel = HKernel( CloneKernel( k ) );
+    nodes_.push_back( n );
+    return nodes_.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+CLGraph::NodeId CLGraph::AddCopyNode( NodeType type,
+                                      const CLMemObj& mo,
+                                      void* hostPtr,
+                                      const NodeIds& deps,
+                                      size_t offset,
+                                      size_t size )
+{
+    if( size == 0 ) size = mo.GetSize() > offset ? mo.GetSize() - offset : 0;
+    if( offset > mo.GetSize() || mo.GetSize() - offset < size )
+    {
+        throw std::logic_error( "Error - buffer smaller than data size" );
+    }
+    Node n;
+    n.type = type;
+    n.buffer = 0;
+    n.hostPtr = hostPtr;
+    n.offset = offset;
+    n.size = size;
+    n.signals = false;
+    AddDeps( n, deps );
+    if( ::clRetainMemObject( mo ) != CL_SUCCESS ) throw std::runtime_error( "Error - clRetainMemObject()" );
+    n.buffer = mo;
+    nodes_.push_back( n );
+    return nodes_.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+CLGraph::NodeId CLGraph::AddCopyHtoD( const void* src,
+                                      const CLMemObj& dst,
+                                      const NodeIds& deps,
+                                      size_t offset,
+                                      size_t size )
+{
+    return AddCopyNode( COPY_HTOD, dst, const_cast< void* >( src ), deps, offset, size );
+}
+
+//------------------------------------------------------------------------------
+CLGraph::NodeId CLGraph::AddCopyDtoH( const CLMemObj& src,
+                                      void* dst,
+                                      const NodeIds& deps,
+                                      size_t offset,
+                                      size_t size )
+{
+    return AddCopyNode( COPY_DTOH, src, dst, deps, offset, size );
+}
+
+//------------------------------------------------------------------------------
+cl_kernel CLGraph::KernelNode( NodeId n ) const
+{
+    if( n >= nodes_.size() || nodes_[ n ].type != KERNEL ) throw std::logic_error( "Not a kernel node" );
+    return nodes_[ n ].kernel;
+}
+
+//------------------------------------------------------------------------------
+void CLGraph::SetHostPtr( NodeId n, void* p )
+{
+    if( n >= nodes_.size() || nodes_[ n ].type == KERNEL ) throw std::logic_error( "Not a copy node" );
+    nodes_[ n ].hostPtr = p;
+}
+
+//------------------------------------------------------------------------------
+void CLGraph::SetGlobalWGroupSize( NodeId n, const SizeArray& gwgs )
+{
+    KernelNode( n );
+    if( gwgs.empty() ) throw std::logic_error( "Empty global work group size" );
+    nodes_[ n ].gwgs = gwgs;
+}
+
+//------------------------------------------------------------------------------
+void CLGraph::Enqueue( const EventArray& waitList, cl_event* done )
+{
+    // on in-order queues the recording order satisfies all dependencies
+    const bool useEvents = !inOrder_;
+    events_.assign( nodes_.size(), cl_event() );
+    cl_int status = CL_SUCCESS;
+    try
+    {
+        for( size_t i = 0; i != nodes_.size(); ++i )
+        {
+            const Node& n = nodes_[ i ];
+            waitList_.clear();
+            if( n.deps.empty() || !useEvents )
+            {
+                // external dependencies: on in-order queues waiting in the
+                // first node is enough
+                if( i == 0 || useEvents ) waitList_ = waitList;
+            }
+            else
+            {
+                for( NodeIds::const_iterator d = n.deps.begin(); d != n.deps.end(); ++d )
+                {
+                    waitList_.push_back( events_[ *d ] );
+                }
+            }
+            const cl_uint numEvents = cl_uint( waitList_.size() );
+            const cl_event* events = waitList_.empty() ? 0 : &waitList_[ 0 ];
+            cl_event* event = useEvents && n.signals ? &events_[ i ] : 0;
+            const bool trace = CLTracer::Enabled();
+            const bool stats = KernelStats::Enabled();
+            const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+            cl_event traced = cl_event();
+            if( event == 0 && ( trace || ( stats && n.type == KERNEL ) ) ) event = &traced;
+            // an empty local size of kernel nodes selects the tuned one, if any
+            SizeArray tuned;
+            switch( n.type )
+            {
+            case KERNEL:
+            {
+                const size_t* local = n.lwgs.empty() ? 0 : &n.lwgs[ 0 ];
+                if( local == 0 && TunedLocalSize( commandQueue_, n.kernel, n.gwgs, tuned )
+                    && tuned.size() == n.gwgs.size() ) local = &tuned[ 0 ];
+                status = ::clEnqueueNDRangeKernel( commandQueue_, n.kernel, cl_uint( n.gwgs.size() ), 0,
+                                                   &n.gwgs[ 0 ], local, numEvents, events, event );
+                if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clEnqueueNDRangeKernel(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+                break;
+            }
+            case COPY_HTOD:
+                status = ::clEnqueueWriteBuffer( commandQueue_, n.buffer, CL_FALSE, n.offset, n.size,
+                                                 n.hostPtr, numEvents, events, event );
+                if( status != CL_SUCCESS ) throw std::runtime_error( "Error - clEnqueueWriteBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+                break;
+            case COPY_DTOH:
+                status = ::clEnqueueReadBuffer( commandQueue_, n.buffer, CL_FALSE, n.offset, n.size,
+                                                n.hostPtr, numEvents, events, event );
+                if( status != CL_SUCCESS ) throw std::runtime_error( "Error - clEnqueueReadBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+                break;
+            }
+            const HEvent recorded( traced );
+            if( trace && n.type == KERNEL )
+            {
+                CLTracer::Instance().RecordLaunch( commandQueue_, n.kernel, n.gwgs, *event, hostBegin, CLTracer::Now() );
+            }
+            else if( trace )
+            {
+                CLTracer::Instance().Record( n.type == COPY_HTOD ? CLTracer::COPY_HTOD : CLTracer::COPY_DTOH,
+                                             n.type == COPY_HTOD ? "CopyHtoD" : "CopyDtoH",
+                                             commandQueue_, *event, hostBegin, CLTracer::Now(), n.size );
+            }
+            if( stats && n.type == KERNEL )
+            {
+                const bool useTuned = n.lwgs.empty() && tuned.size() == n.gwgs.size();
+                KernelStats::Instance().RecordLaunch( n.kernel, n.gwgs, useTuned ? tuned : n.lwgs, *event );
+            }
+            else if( stats )
+            {
+                KernelStats::Instance().RecordCopy( n.type == COPY_HTOD ? KernelStats::HTOD : KernelStats::DTOH, n.size );
+            }
+        }
+        if( done != 0 )
+        {
+            // marker completes after all previously enqueued commands
+            status = ::clEnqueueMarker( commandQueue_, done );
+            if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clEnqueueMarker(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+        }
+        status = ::clFlush( commandQueue_ );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clFlush(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    catch( ... )
+    {
+        for( std::vector< cl_event >::iterator e = events_.begin(); e != events_.end(); ++e )
+        {
+            if( *e != 0 ) ::clReleaseEvent( *e );
+        }
+        throw;
+    }
+    for( std::vector< cl_event >::iterator e = events_.begin(); e != events_.end(); ++e )
+    {
+        if( *e != 0 ) ::clReleaseEvent( *e );
+    }
+}
+
+//------------------------------------------------------------------------------
+void CLGraph::Replay()
+{
+    Enqueue( EventArray(), 0 );
+}
+
+//------------------------------------------------------------------------------
+HEvent CLGraph::Replay( const EventArray& waitList )
+{
+    cl_event done = cl_event();
+    Enqueue( waitList, &done );
+    return HEvent( done );
+}
@@ -0,0 +1,170 @@
+///\file opencl/Graph.h Capture and replay of kernel and copy sequences
+
+#ifndef GRAPH_H_
+#define GRAPH_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <vector>
+#include <stdexcept>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Sequence of copies and kernel launches recorded once and replayed with a
+/// single call:
+///\code
+///  CLGraph g( ec.commandQueue );
+///  CLGraph::NodeId up = g.AddCopyHtoD( &A[ 0 ], dA, CLGraph::NodeIds() );
+///  CLGraph::NodeId k = g.AddKernel( ec.kernel, gwgs, lwgs, CLGraph::NodeIds( 1, up ),
+///                                   dA, dB, width );
+///  g.AddCopyDtoH( dB, &B[ 0 ], CLGraph::NodeIds( 1, k ) );
+///  for( ... ) {
+///      g.SetKernelArg( k, 2, newWidth ); // optional
+///      g.Replay();
+///  }
+///\endcode
+/// Every kernel node owns a private instance of the kernel, created from the
+/// same program, with its arguments bound at record time: replaying does not
+/// set any argument and is not affected by launches of the original kernel.
+/// Dependencies must refer to previously recorded nodes. On in-order queues
+/// they are implied by the recording order and replaying creates no event;
+/// on out-of-order queues they are translated into event wait lists.
+/// Buffers passed to copy nodes are retained by the graph; buffers bound as
+/// kernel arguments must outlive the graph.
+class CLGraph
+{
+public:
+    /// Index of recorded node.
+    typedef size_t NodeId;
+    /// Node dependencies.
+    typedef std::vector< NodeId > NodeIds;
+    /// Constructor.
+    /// \param cq queue all nodes are enqueued into
+    explicit CLGraph( cl_command_queue cq );
+    /// Destructor: releases private kernels and retained buffers.
+    ~CLGraph();
+    /// Record kernel launch. A private copy of the kernel is created and the
+    /// arguments are bound to it immediately.
+    /// \param[in] k kernel; only its program and name are used
+    /// \param[in] gwgs global work group size
+    /// \param[in] lwgs local work group size, empty to use the size stored in
+    ///            TuningDatabase::Instance(), if enabled, or let the run-time
+    ///            choose
+    /// \param[in] deps nodes that must complete before the kernel starts
+    /// \param[in] args kernel arguments, see Launch()
+    /// \return node id
+    /// \throw std::logic_error in case of invalid dependencies
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    template < typename... ArgsT >
+    NodeId AddKernel( cl_kernel k,
+                      const SizeArray& gwgs,
+                      const SizeArray& lwgs,
+                      const NodeIds& deps,
+                      const ArgsT&... args )
+    {
+        const NodeId id = AddKernelNode( k, gwgs, lwgs, deps );
+        AssertNumKernelArgs( nodes_.back().kernel, sizeof...( ArgsT ) );
+        SetKernelArgs( nodes_.back().kernel, 0, args... );
+        return id;
+    }
+    /// Record host to device copy of \c size bytes at \c offset; zero size
+    /// copies from offset to the end of the buffer.
+    /// \throw std::logic_error in case of invalid dependencies or range
+    NodeId AddCopyHtoD( const void* src,
+                        const CLMemObj& dst,
+                        const NodeIds& deps,
+                        size_t offset = 0,
+                        size_t size = 0 );
+    /// Record device to host copy of \c size bytes at \c offset; zero size
+    /// copies from offset to the end of the buffer.
+    /// \throw std::logic_error in case of invalid dependencies or range
+    NodeId AddCopyDtoH( const CLMemObj& src,
+                        void* dst,
+                        const NodeIds& deps,
+                        size_t offset = 0,
+                        size_t size = 0 );
+    /// Replace argument of a kernel node; the value is bound once and used by
+    /// all subsequent replays.
+    /// \throw std::logic_error in case the node is not a kernel node
+    /// \throw std::runtime_error in case \c clSetKernelArg fails
+    template < typename T >
+    void SetKernelArg( NodeId n, cl_uint pos, const T& value )
+    {
+        ::SetKernelArg( KernelNode( n ), pos, KernelArg< T >::Size( value ),
+                        KernelArg< T >::Address( value ) );
+    }
+    /// Replace host pointer of a copy node.
+    /// \throw std::logic_error in case the node is not a copy node
+    void SetHostPtr( NodeId n, void* p );
+    /// Replace global work group size of a kernel node.
+    /// \throw std::logic_error in case the node is not a kernel node
+    void SetGlobalWGroupSize( NodeId n, const SizeArray& gwgs );
+    /// Enqueue all nodes and flush the queue.
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    void Replay();
+    /// Enqueue all nodes after the events in the wait list complete.
+    /// \return event completing after all nodes
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    HEvent Replay( const EventArray& waitList );
+    /// Returns number of recorded nodes.
+    size_t Size() const { return nodes_.size(); }
+    /// Returns queue nodes are enqueued into.
+    cl_command_queue GetCommandQueue() const { return commandQueue_; }
+private:
+    CLGraph( const CLGraph& );
+    CLGraph& operator=( const CLGraph& );
+    enum NodeType { KERNEL, COPY_HTOD, COPY_DTOH };
+    /// Recorded operation.
+    struct Node
+    {
+        NodeType type;
+        HKernel kernel;   //!< private kernel instance
+        SizeArray gwgs;
+        SizeArray lwgs;
+        cl_mem buffer;    //!< retained copy source or target
+        void* hostPtr;
+        size_t offset;
+        size_t size;
+        NodeIds deps;
+        bool signals;     //!< other nodes wait for this node's event
+    };
+    NodeId AddKernelNode( cl_kernel k,
+                          const SizeArray& gwgs,
+                          const SizeArray& lwgs,
+                          const NodeIds& deps );
+    NodeId AddCopyNode( NodeType type,
+                        const CLMemObj& mo,
+                        void* hostPtr,
+                        const NodeIds& deps,
+                        size_t offset,
+                        size_t size );
+    void AddDeps( Node& n, const NodeIds& deps );
+    cl_kernel KernelNode( NodeId n ) const;
+    void Enqueue( const EventArray& waitList, cl_event* done );
+private:
+    cl_command_queue commandQueue_;
+    bool inOrder_;
+    std::vector< Node > nodes_;
+    /// events of current replay, indexed by node
+    std::vector< cl_event > events_;
+    /// scratch wait list
+    EventArray waitList_;
+};
+
+#endif //GRAPH_H_
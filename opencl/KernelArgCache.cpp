@@ -0,0 +1,143 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include "KernelArgCache.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include "OpenCLStatusCodesTable.h"
+
+//------------------------------------------------------------------------------
+KernelArgCache::KernelArgCache() : enabled_( false ), hits_( 0 ), misses_( 0 )
+{
+    const char* e = getenv( "GPUPP_KERNEL_ARG_CACHE" );
+    enabled_ = e != 0 && *e != 0 && std::string( e ) != "0";
+}
+
+//------------------------------------------------------------------------------
+KernelArgCache& KernelArgCache::Instance()
+{
+    // never destroyed: kernels and buffers held by other static objects
+    // invalidate their entries when released at exit
+    static KernelArgCache* i = new KernelArgCache;
+    return *i;
+}
+
+//------------------------------------------------------------------------------
+void KernelArgCache::SetEnabled( bool on )
+{
+    // values bound while disabled are not recorded: entries would be stale
+    if( !on ) Clear();
+    enabled_ = on;
+}
+
+//------------------------------------------------------------------------------
+std::shared_ptr< KernelArgCache::Entry > KernelArgCache::GetEntry( cl_kernel k )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::shared_ptr< Entry >& e = entries_[ k ];
+    if( !e ) e = std::make_shared< Entry >();
+    return e;
+}
+
+//------------------------------------------------------------------------------
+bool KernelArgCache::Set( cl_kernel k, cl_uint pos, size_t size, const void* address )
+{
+    const std::shared_ptr< Entry > e = GetEntry( k );
+    std::lock_guard< std::mutex > lock( e->mutex );
+    if( pos >= e->args.size() ) e->args.resize( pos + 1 );
+    Arg& a = e->args[ pos ];
+    const bool local = address == 0;
+    if( a.bound && a.size == size && a.local == local
+        && ( local || std::memcmp( a.bytes.data(), address, size ) == 0 ) )
+    {
+        ++hits_;
+        return false;
+    }
+    // a failed call leaves the argument in an unknown state
+    a.bound = false;
+    const cl_int status = ::clSetKernelArg( k, pos, size, address );
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "ERROR - clSetKernelArg(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    a.local = local;
+    a.size = size;
+    if( local ) a.bytes.clear();
+    else a.bytes.assign( static_cast< const char* >( address ), size );
+    a.bound = true;
+    ++misses_;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void KernelArgCache::Invalidate( cl_kernel k )
+{
+    if( !enabled_ ) return;
+    std::lock_guard< std::mutex > lock( mutex_ );
+    entries_.erase( k );
+}
+
+//------------------------------------------------------------------------------
+void KernelArgCache::Invalidate( cl_mem m )
+{
+    if( !enabled_ ) return;
+    std::lock_guard< std::mutex > lock( mutex_ );
+    for( Entries::iterator i = entries_.begin(); i != entries_.end(); ++i )
+    {
+        std::lock_guard< std::mutex > entryLock( i->second->mutex );
+        std::vector< Arg >& args = i->second->args;
+        for( std::vector< Arg >::iterator a = args.begin(); a != args.end(); ++a )
+        {
+            if( a->bound && !a->local && a->size == sizeof( cl_mem )
+                && std::memcmp( a->bytes.data(), &m, sizeof( cl_mem ) ) == 0 ) a->bound = false;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void KernelArgCache::Clear()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    entries_.clear();
+}
+
+//------------------------------------------------------------------------------
+size_t KernelArgCache::Size() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return entries_.size();
+}
+
+//------------------------------------------------------------------------------
+KernelArgCache::Stats KernelArgCache::GetStats() const
+{
+    Stats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    return s;
+}
+
+//------------------------------------------------------------------------------
+void KernelArgCache::ResetStats()
+{
+    hits_ = 0;
+    misses_ = 0;
+}
@@ -0,0 +1,125 @@
+///\file opencl/KernelArgCache.h Cache of kernel argument values bound through clSetKernelArg
+
+#ifndef KERNEL_ARG_CACHE_H_
+#define KERNEL_ARG_CACHE_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <CL/cl.h>
+
+//------------------------------------------------------------------------------
+/// Process-wide record of the bytes last bound to each argument of each
+/// kernel. Kernel arguments persist in the kernel object between launches:
+/// when the cache is enabled SetKernelArg() compares the new value with the
+/// recorded one and calls \c clSetKernelArg only for the arguments that
+/// changed, so that repeated launches with the same buffers and scalars do
+/// not pay for redundant calls into the run-time. The Launch() and
+/// InvokeKernel* functions and CLKernelHandler::SetParam() all bind arguments
+/// through SetKernelArg().
+///
+/// The cache is disabled by default and is enabled either by calling
+/// SetEnabled() or by setting the \c GPUPP_KERNEL_ARG_CACHE environment
+/// variable. While enabled, arguments must be set only through SetKernelArg():
+/// after calling \c clSetKernelArg directly the kernel must be invalidated
+/// with Invalidate(). Kernels released through HKernel and memory objects
+/// released through CLMemObj, CLBufferPool, CLStagingPool and CLGraph are
+/// invalidated automatically; other handles
+/// must be invalidated before they are released, since the run-time can
+/// reuse their values for new objects.
+///
+/// All methods are thread safe; each kernel has its own lock so that threads
+/// binding arguments of different kernels do not contend. Note that the
+/// arguments of a kernel are shared by all its users: threads launching the
+/// same kernel concurrently must still serialize binding and enqueueing.
+class KernelArgCache
+{
+public:
+    /// Cache usage counters.
+    struct Stats
+    {
+        unsigned long long hits;   //!< arguments not re-bound since unchanged
+        unsigned long long misses; //!< arguments bound with \c clSetKernelArg
+        /// Fraction of arguments that did not require a call to the run-time.
+        double HitRate() const { return hits + misses ? double( hits ) / ( hits + misses ) : 0.; }
+    };
+    /// Returns global instance.
+    static KernelArgCache& Instance();
+    /// Enable or disable the cache; disabling it removes all the entries.
+    void SetEnabled( bool on );
+    /// Returns \c true if SetKernelArg() goes through the cache.
+    bool Enabled() const { return enabled_; }
+    /// Bind argument unless the same value is already bound at the same
+    /// position; \c address is null for local memory arguments, which are
+    /// compared by size only.
+    /// \return \c true if \c clSetKernelArg was called
+    /// \throw std::runtime_error in case \c clSetKernelArg fails
+    bool Set( cl_kernel k, cl_uint pos, size_t size, const void* address );
+    /// Forget values recorded for kernel: all its arguments are bound again
+    /// on next use.
+    void Invalidate( cl_kernel k );
+    /// Forget all argument values referring to memory object.
+    void Invalidate( cl_mem m );
+    /// Remove all entries.
+    void Clear();
+    /// Returns number of kernels with recorded arguments.
+    size_t Size() const;
+    /// Returns usage counters.
+    Stats GetStats() const;
+    /// Reset usage counters.
+    void ResetStats();
+private:
+    /// Value last bound to an argument.
+    struct Arg
+    {
+        bool bound;        //!< false until first successful bind
+        bool local;        //!< local memory: no value, size only
+        size_t size;
+        std::string bytes; //!< capacity is reused when values change
+        Arg() : bound( false ), local( false ), size( 0 ) {}
+    };
+    /// Arguments of a kernel.
+    struct Entry
+    {
+        std::mutex mutex;
+        std::vector< Arg > args;
+    };
+    typedef std::map< cl_kernel, std::shared_ptr< Entry > > Entries;
+private:
+    KernelArgCache();
+    KernelArgCache( const KernelArgCache& );
+    KernelArgCache& operator=( const KernelArgCache& );
+    /// Returns entry for kernel, adding it if needed; entries are shared
+    /// so that invalidation does not destroy an entry in use by another thread.
+    std::shared_ptr< Entry > GetEntry( cl_kernel k );
+private:
+    mutable std::mutex mutex_;
+    Entries entries_;
+    std::atomic< bool > enabled_;
+    std::atomic< unsigned long long > hits_;
+    std::atomic< unsigned long long > misses_;
+};
+
+#endif //KERNEL_ARG_CACHE_H_
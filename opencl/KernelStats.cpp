@@ -0,0 +1,259 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include "KernelStats.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include "../utility/Json.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Value of the GPUPP_KERNEL_STATS environment variable, empty if not set.
+std::string StatsEnvironment()
+{
+    const char* e = getenv( "GPUPP_KERNEL_STATS" );
+    return e != 0 && std::string( e ) != "0" ? e : "";
+}
+
+//------------------------------------------------------------------------------
+/// Returns true if string ends with suffix.
+bool EndsWith( const std::string& s, const std::string& suffix )
+{
+    return s.size() >= suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+}
+
+std::atomic< bool > KernelStats::enabled_( !StatsEnvironment().empty() );
+
+//------------------------------------------------------------------------------
+KernelStats::KernelStats() : dumpRegistered_( false )
+{
+    transfers_[ HTOD ].count = transfers_[ HTOD ].bytes = 0;
+    transfers_[ DTOH ].count = transfers_[ DTOH ].bytes = 0;
+    const std::string env = StatsEnvironment();
+    if( !env.empty() ) DumpAtExit( env == "1" ? "" : env );
+}
+
+//------------------------------------------------------------------------------
+KernelStats& KernelStats::Instance()
+{
+    // never destroyed: completion callbacks can run while static objects
+    // are destroyed at exit
+    static KernelStats* i = new KernelStats;
+    return *i;
+}
+
+//------------------------------------------------------------------------------
+std::string KernelStats::NDRangeKey( const std::vector< size_t >& gwgs,
+                                     const std::vector< size_t >& lwgs )
+{
+    std::ostringstream os;
+    for( size_t i = 0; i != gwgs.size(); ++i ) os << ( i ? "x" : "" ) << gwgs[ i ];
+    if( !lwgs.empty() ) os << '/';
+    for( size_t i = 0; i != lwgs.size(); ++i ) os << ( i ? "x" : "" ) << lwgs[ i ];
+    return os.str();
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::RecordLaunch( cl_kernel k, const std::vector< size_t >& gwgs,
+                                const std::vector< size_t >& lwgs, cl_event e )
+{
+    if( e == 0 ) return;
+    char name[ 256 ] = "kernel";
+    ::clGetKernelInfo( k, CL_KERNEL_FUNCTION_NAME, sizeof( name ) - 1, name, 0 );
+    Pending* p = new Pending;
+    p->name = name;
+    p->ndrange = NDRangeKey( gwgs, lwgs );
+    // the reference is released by the callback
+    ::clRetainEvent( e );
+    if( ::clSetEventCallback( e, CL_COMPLETE, OnComplete, p ) != CL_SUCCESS )
+    {
+        ::clReleaseEvent( e );
+        delete p;
+    }
+}
+
+//------------------------------------------------------------------------------
+void CL_CALLBACK KernelStats::OnComplete( cl_event e, cl_int status, void* data )
+{
+    Pending* p = static_cast< Pending* >( data );
+    cl_ulong queued = 0;
+    cl_ulong started = 0;
+    cl_ulong ended = 0;
+    const bool profiled =
+        status == CL_COMPLETE
+        && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_QUEUED, sizeof( cl_ulong ), &queued, 0 ) == CL_SUCCESS
+        && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_START, sizeof( cl_ulong ), &started, 0 ) == CL_SUCCESS
+        && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_END, sizeof( cl_ulong ), &ended, 0 ) == CL_SUCCESS;
+    ::clReleaseEvent( e );
+    KernelStats& s = Instance();
+    if( profiled )
+    {
+        s.Record( p->name, p->ndrange, ended - started, started - queued );
+    }
+    else
+    {
+        std::lock_guard< std::mutex > lock( s.mutex_ );
+        ++s.entries_[ std::make_pair( p->name, p->ndrange ) ].unprofiled;
+    }
+    delete p;
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::Record( const std::string& name, const std::string& ndrange,
+                          unsigned long long executionTime, unsigned long long queueLatency )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    Entry& entry = entries_[ std::make_pair( name, ndrange ) ];
+    entry.execution.Add( executionTime );
+    entry.latency.Add( queueLatency );
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::RecordCopy( Direction d, size_t bytes )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ++transfers_[ d ].count;
+    transfers_[ d ].bytes += bytes;
+}
+
+//------------------------------------------------------------------------------
+std::vector< KernelStats::Summary > KernelStats::GetSummaries() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::vector< Summary > summaries;
+    summaries.reserve( entries_.size() );
+    for( Entries::const_iterator i = entries_.begin(); i != entries_.end(); ++i )
+    {
+        const HdrHistogram& x = i->second.execution;
+        const HdrHistogram& l = i->second.latency;
+        Summary s;
+        s.name = i->first.first;
+        s.ndrange = i->first.second;
+        s.count = x.Count();
+        s.unprofiled = i->second.unprofiled;
+        s.minExecution = x.Min();
+        s.medianExecution = x.Percentile( 0.5 );
+        s.p99Execution = x.Percentile( 0.99 );
+        s.maxExecution = x.Max();
+        s.minLatency = l.Min();
+        s.medianLatency = l.Percentile( 0.5 );
+        s.p99Latency = l.Percentile( 0.99 );
+        s.maxLatency = l.Max();
+        summaries.push_back( s );
+    }
+    return summaries;
+}
+
+//------------------------------------------------------------------------------
+KernelStats::Transfers KernelStats::GetTransfers( Direction d ) const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return transfers_[ d ];
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::WriteText( std::ostream& os ) const
+{
+    const std::vector< Summary > summaries = GetSummaries();
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision( 3 );
+    os << "Kernel statistics, times in microseconds (min / median / p99 / max)\n";
+    for( std::vector< Summary >::const_iterator s = summaries.begin(); s != summaries.end(); ++s )
+    {
+        os << s->name << ' ' << s->ndrange << "  launches: " << s->count;
+        if( s->unprofiled > 0 ) os << " (+" << s->unprofiled << " unprofiled)";
+        os << "\n  execution:     " << s->minExecution / 1E3 << " / " << s->medianExecution / 1E3
+           << " / " << s->p99Execution / 1E3 << " / " << s->maxExecution / 1E3
+           << "\n  queue latency: " << s->minLatency / 1E3 << " / " << s->medianLatency / 1E3
+           << " / " << s->p99Latency / 1E3 << " / " << s->maxLatency / 1E3 << '\n';
+    }
+    const Transfers htod = GetTransfers( HTOD );
+    const Transfers dtoh = GetTransfers( DTOH );
+    os << "Copies HtoD: " << htod.count << " bytes: " << htod.bytes << '\n'
+       << "Copies DtoH: " << dtoh.count << " bytes: " << dtoh.bytes << '\n';
+    os.flags( flags );
+    os.precision( precision );
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::WriteJSON( std::ostream& os ) const
+{
+    const std::vector< Summary > summaries = GetSummaries();
+    os << "{\"kernels\":[";
+    for( std::vector< Summary >::const_iterator s = summaries.begin(); s != summaries.end(); ++s )
+    {
+        os << ( s == summaries.begin() ? "\n" : ",\n" ) << "{\"name\":";
+        WriteJSONString( os, s->name );
+        os << ",\"ndrange\":";
+        WriteJSONString( os, s->ndrange );
+        os << ",\"count\":" << s->count << ",\"unprofiled\":" << s->unprofiled
+           << ",\"execution_ns\":{\"min\":" << s->minExecution << ",\"median\":" << s->medianExecution
+           << ",\"p99\":" << s->p99Execution << ",\"max\":" << s->maxExecution << '}'
+           << ",\"queue_latency_ns\":{\"min\":" << s->minLatency << ",\"median\":" << s->medianLatency
+           << ",\"p99\":" << s->p99Latency << ",\"max\":" << s->maxLatency << "}}";
+    }
+    const Transfers htod = GetTransfers( HTOD );
+    const Transfers dtoh = GetTransfers( DTOH );
+    os << "\n],\"copies\":{\"htod\":{\"count\":" << htod.count << ",\"bytes\":" << htod.bytes
+       << "},\"dtoh\":{\"count\":" << dtoh.count << ",\"bytes\":" << dtoh.bytes << "}}}\n";
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::WriteAtExit()
+{
+    const KernelStats& s = Instance();
+    std::string fileName;
+    {
+        std::lock_guard< std::mutex > lock( s.mutex_ );
+        fileName = s.dumpFileName_;
+    }
+    if( fileName.empty() )
+    {
+        s.WriteText( std::cerr );
+        return;
+    }
+    std::ofstream os( fileName.c_str() );
+    if( !os ) return;
+    if( EndsWith( fileName, ".json" ) ) s.WriteJSON( os );
+    else s.WriteText( os );
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::DumpAtExit( const std::string& fileName )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    dumpFileName_ = fileName;
+    if( dumpRegistered_ ) return;
+    dumpRegistered_ = true;
+    std::atexit( WriteAtExit );
+}
+
+//------------------------------------------------------------------------------
+void KernelStats::Clear()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    entries_.clear();
+    transfers_[ HTOD ].count = transfers_[ HTOD ].bytes = 0;
+    transfers_[ DTOH ].count = transfers_[ DTOH ].bytes = 0;
+}
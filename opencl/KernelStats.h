@@ -0,0 +1,147 @@
+///\file opencl/KernelStats.h Per-kernel execution statistics with latency histograms
+
+#ifndef KERNEL_STATS_H_
+#define KERNEL_STATS_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <CL/cl.h>
+#include "../utility/Histogram.h"
+
+//------------------------------------------------------------------------------
+/// Process-wide statistics of kernel launches, keyed by kernel function name
+/// and NDRange, and of bytes moved by copies in each direction. For each key
+/// the number of launches and the distributions of execution time
+/// (\c START to \c END) and queue latency (\c QUEUED to \c START) are kept
+/// in HdrHistogram instances, so that median and tail percentiles are
+/// available at any time with bounded memory whatever the number of launches.
+///
+/// When enabled, all the launches enqueued through gpupp are recorded
+/// automatically: a completion callback registered on the event of each
+/// launch reads its profiling counters, no event is kept alive after
+/// completion. Profiling counters are available only for queues created
+/// with \c CL_QUEUE_PROFILING_ENABLE; launches on other queues are counted
+/// as unprofiled. Timings obtained otherwise can be added with Record().
+///
+/// Statistics are disabled by default and are enabled either by calling
+/// SetEnabled() or by setting the \c GPUPP_KERNEL_STATS environment variable
+/// to the name of the file to write at exit, JSON if the name ends with
+/// \c .json and text otherwise, or to \c 1 to print the text report to the
+/// standard error. All methods are thread safe.
+class KernelStats
+{
+public:
+    /// Copy direction.
+    enum Direction { HTOD, DTOH };
+    /// Summary of the launches of a kernel with a given NDRange; times are
+    /// in nanoseconds.
+    struct Summary
+    {
+        std::string name;    //!< kernel function name
+        std::string ndrange; //!< global size, followed by local size if specified
+        unsigned long long count;      //!< launches with profiling information
+        unsigned long long unprofiled; //!< launches without profiling information
+        unsigned long long minExecution, medianExecution, p99Execution, maxExecution;
+        unsigned long long minLatency, medianLatency, p99Latency, maxLatency;
+    };
+    /// Copy counters.
+    struct Transfers
+    {
+        unsigned long long count; //!< number of copies
+        unsigned long long bytes; //!< bytes copied
+    };
+    /// Returns global instance.
+    static KernelStats& Instance();
+    /// Returns \c true if launches and copies are being recorded.
+    static bool Enabled() { return enabled_.load( std::memory_order_relaxed ); }
+    /// Start or stop recording; recorded statistics are kept.
+    void SetEnabled( bool on ) { enabled_ = on; }
+    /// Record launch: timings are read from the event when the kernel completes.
+    /// \param[in] lwgs local size, empty if selected by the run-time
+    void RecordLaunch( cl_kernel k, const std::vector< size_t >& gwgs,
+                       const std::vector< size_t >& lwgs, cl_event e );
+    /// Record launch timings in nanoseconds.
+    void Record( const std::string& name, const std::string& ndrange,
+                 unsigned long long executionTime, unsigned long long queueLatency );
+    /// Record copy.
+    void RecordCopy( Direction d, size_t bytes );
+    /// Returns summaries sorted by name and NDRange.
+    std::vector< Summary > GetSummaries() const;
+    /// Returns copy counters for direction.
+    Transfers GetTransfers( Direction d ) const;
+    /// Write human readable report; times in microseconds.
+    void WriteText( std::ostream& os ) const;
+    /// Write report in JSON format; times in nanoseconds.
+    void WriteJSON( std::ostream& os ) const;
+    /// Write report at exit to file, JSON if the name ends with \c .json,
+    /// or to the standard error if the name is empty.
+    void DumpAtExit( const std::string& fileName );
+    /// Remove all statistics.
+    void Clear();
+    /// Returns NDRange key: global sizes separated by 'x', followed by '/'
+    /// and the local sizes if not empty.
+    static std::string NDRangeKey( const std::vector< size_t >& gwgs,
+                                   const std::vector< size_t >& lwgs );
+private:
+    /// Statistics of a kernel and NDRange.
+    struct Entry
+    {
+        HdrHistogram execution;
+        HdrHistogram latency;
+        unsigned long long unprofiled;
+        Entry() : unprofiled( 0 ) {}
+    };
+    /// (name, NDRange) -> statistics
+    typedef std::map< std::pair< std::string, std::string >, Entry > Entries;
+    /// Data passed to the completion callback.
+    struct Pending
+    {
+        std::string name;
+        std::string ndrange;
+    };
+private:
+    KernelStats();
+    KernelStats( const KernelStats& );
+    KernelStats& operator=( const KernelStats& );
+    static void CL_CALLBACK OnComplete( cl_event e, cl_int status, void* data );
+    static void WriteAtExit();
+private:
+    mutable std::mutex mutex_;
+    Entries entries_;
+    Transfers transfers_[ 2 ];
+    std::string dumpFileName_;
+    bool dumpRegistered_;
+    static std::atomic< bool > enabled_;
+};
+
+///Overloaded operator to print the text report.
+inline std::ostream& operator<<( std::ostream& os, const KernelStats& s )
+{
+    s.WriteText( os );
+    return os;
+}
+
+#endif //KERNEL_STATS_H_
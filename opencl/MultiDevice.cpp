@@ -0,0 +1,298 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "MultiDevice.h"
+#include <stdexcept>
+#include <algorithm>
+#include "OpenCLStatusCodesTable.h"
+#include "../utility/Numa.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Destructor callback of first-touch buffers.
+void CL_CALLBACK FreeHostMemory( cl_mem, void* p )
+{
+    AlignedFree( p );
+}
+}
+
+//------------------------------------------------------------------------------
+CLExecutionContext CLMultiDeviceContext::DeviceContext( size_t i ) const
+{
+    if( i >= devices.size() ) throw std::range_error( "Invalid device index" );
+    CLExecutionContext ec( platform, devices[ i ], context );
+    ec.commandQueue = commandQueues[ i ];
+    return ec;
+}
+
+//------------------------------------------------------------------------------
+void CLMultiDeviceContext::Finish() const
+{
+    for( std::vector< HCommandQueue >::const_iterator q = commandQueues.begin(); q != commandQueues.end(); ++q )
+    {
+        const cl_int status = ::clFinish( *q );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clFinish(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+}
+
+//------------------------------------------------------------------------------
+CLMultiDeviceContext CreateCLMultiDeviceContext( const std::string& platformString,
+                                                 cl_device_type deviceType,
+                                                 cl_command_queue_properties prop )
+{
+    // the context created for the first device contains all the devices
+    // of the requested type
+    const CLExecutionContext ec = CreateCLExecutionContext( platformString, 0, deviceType );
+    CLMultiDeviceContext mdc;
+    mdc.platform = ec.platform;
+    mdc.context = ec.context;
+    size_t cd = 0;
+    cl_int status = ::clGetContextInfo( mdc.context, CL_CONTEXT_DEVICES, 0, 0, &cd );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetContextInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    mdc.devices.resize( cd / sizeof( cl_device_id ) );
+    if( mdc.devices.empty() ) throw std::runtime_error( "No devices in context" );
+    status = ::clGetContextInfo( mdc.context, CL_CONTEXT_DEVICES, cd, &mdc.devices[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetContextInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    for( std::vector< cl_device_id >::const_iterator d = mdc.devices.begin(); d != mdc.devices.end(); ++d )
+    {
+        CLExecutionContext dc( mdc.platform, *d, mdc.context );
+        mdc.commandQueues.push_back( CreateCommandQueue( dc, prop ).commandQueue );
+    }
+    mdc.numaNodes.assign( mdc.devices.size(), -1 );
+    return mdc;
+}
+
+//------------------------------------------------------------------------------
+CLMultiDeviceContext CreateCLSubDeviceContext( const CLExecutionContext& ec,
+                                               const CLDevicePartition& partition,
+                                               cl_command_queue_properties prop )
+{
+    if( ec.device == 0 ) throw std::logic_error( "Uninitialized execution context" );
+    std::vector< cl_device_partition_property > props;
+    if( partition.type == CLDevicePartition::EQUALLY )
+    {
+        props.push_back( CL_DEVICE_PARTITION_EQUALLY );
+        props.push_back( cl_device_partition_property( partition.computeUnits ) );
+    }
+    else
+    {
+        props.push_back( CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN );
+        props.push_back( cl_device_partition_property( partition.domain ) );
+    }
+    props.push_back( 0 );
+    cl_uint numDevices = 0;
+    cl_int status = ::clCreateSubDevices( ec.device, &props[ 0 ], 0, 0, &numDevices );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateSubDevices(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    CLMultiDeviceContext mdc;
+    mdc.platform = ec.platform;
+    mdc.devices.resize( numDevices );
+    status = ::clCreateSubDevices( ec.device, &props[ 0 ], numDevices, &mdc.devices[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateSubDevices(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    for( std::vector< cl_device_id >::const_iterator d = mdc.devices.begin(); d != mdc.devices.end(); ++d )
+    {
+        mdc.subDevices.push_back( HDevice( *d ) );
+    }
+    cl_context_properties ctxProps[] = { CL_CONTEXT_PLATFORM,
+                                         reinterpret_cast< cl_context_properties >( ec.platform ),
+                                         0 };
+    mdc.context = HContext( ::clCreateContext( ctxProps, numDevices, &mdc.devices[ 0 ], 0, 0, &status ) );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateContext(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    for( std::vector< cl_device_id >::const_iterator d = mdc.devices.begin(); d != mdc.devices.end(); ++d )
+    {
+        CLExecutionContext dc( mdc.platform, *d, mdc.context );
+        mdc.commandQueues.push_back( CreateCommandQueue( dc, prop ).commandQueue );
+    }
+    const bool numa = partition.type == CLDevicePartition::BY_AFFINITY_DOMAIN
+                      && partition.domain == CL_DEVICE_AFFINITY_DOMAIN_NUMA
+                      && int( numDevices ) <= NumaNodeCount();
+    for( cl_uint i = 0; i != numDevices; ++i ) mdc.numaNodes.push_back( numa ? int( i ) : -1 );
+    return mdc;
+}
+
+//------------------------------------------------------------------------------
+CLPartitionedKernel::CLPartitionedKernel( const CLMultiDeviceContext& mdc,
+                                          const std::string& src,
+                                          const std::string& kernelName,
+                                          const std::string& buildOptions,
+                                          size_t dimension ) :
+    mdc_( mdc ), weights_( mdc.NumDevices(), 1. / mdc.NumDevices() ), dimension_( dimension )
+{
+    for( size_t i = 0; i != mdc_.NumDevices(); ++i )
+    {
+        std::string buildOutput;
+        kernels_.push_back( BuildKernel( mdc_.DeviceContext( i ), src, kernelName,
+                                         buildOutput, buildOptions ).kernel );
+    }
+}
+
+//------------------------------------------------------------------------------
+void CLPartitionedKernel::SetWeights( const std::vector< double >& weights )
+{
+    if( weights.size() != weights_.size() ) throw std::invalid_argument( "Number of weights does not match number of devices" );
+    double total = 0.;
+    for( std::vector< double >::const_iterator w = weights.begin(); w != weights.end(); ++w )
+    {
+        if( !( *w > 0. ) ) throw std::invalid_argument( "Weights must be positive" );
+        total += *w;
+    }
+    for( size_t i = 0; i != weights.size(); ++i ) weights_[ i ] = weights[ i ] / total;
+}
+
+//------------------------------------------------------------------------------
+CLPartitionedKernel::Slices CLPartitionedKernel::Partition( size_t globalSize, size_t granularity ) const
+{
+    if( granularity == 0 || globalSize % granularity != 0 )
+    {
+        throw std::logic_error( "Global size must be a multiple of the local size" );
+    }
+    // largest remainder rounding of the number of blocks of each device
+    const size_t blocks = globalSize / granularity;
+    std::vector< size_t > counts( weights_.size() );
+    std::vector< double > remainders( weights_.size() );
+    size_t assigned = 0;
+    for( size_t i = 0; i != weights_.size(); ++i )
+    {
+        const double exact = weights_[ i ] * blocks;
+        counts[ i ] = size_t( exact );
+        remainders[ i ] = exact - counts[ i ];
+        assigned += counts[ i ];
+    }
+    while( assigned < blocks )
+    {
+        const size_t i = std::max_element( remainders.begin(), remainders.end() ) - remainders.begin();
+        ++counts[ i ];
+        remainders[ i ] = -1.;
+        ++assigned;
+    }
+    Slices slices;
+    size_t offset = 0;
+    for( size_t i = 0; i != counts.size(); ++i )
+    {
+        if( counts[ i ] == 0 ) continue;
+        Slice s;
+        s.device = i;
+        s.offset = offset;
+        s.size = counts[ i ] * granularity;
+        offset += s.size;
+        slices.push_back( s );
+    }
+    return slices;
+}
+
+//------------------------------------------------------------------------------
+void CLPartitionedKernel::EnqueueSlice( const Slice& s, const SizeArray& gwgs, const SizeArray& lwgs )
+{
+    SizeArray global( gwgs );
+    SizeArray offset( gwgs.size(), 0 );
+    global[ dimension_ ] = s.size;
+    offset[ dimension_ ] = s.offset;
+    cl_event e = cl_event();
+    EnqueueKernelAsync( mdc_.commandQueues[ s.device ], kernels_[ s.device ], global, lwgs,
+                        &e, EventArray(), offset );
+    events_.push_back( HEvent( e ) );
+}
+
+//------------------------------------------------------------------------------
+void CLPartitionedKernel::Wait( double smoothing )
+{
+    if( events_.empty() ) return;
+    const EventArray events( events_.begin(), events_.end() );
+    const cl_int status = ::clWaitForEvents( cl_uint( events.size() ), &events[ 0 ] );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clWaitForEvents(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    // throughput of devices that received work; the others keep their weight
+    std::vector< double > measured( weights_ );
+    for( size_t i = 0; i != slices_.size(); ++i )
+    {
+        double t = 0.;
+        try
+        {
+            t = ProfilingInfo( events_[ i ] ).ExecutionTime();
+        }
+        catch( const std::runtime_error& )
+        {
+            return; // profiling not enabled: keep current weights
+        }
+        if( t <= 0. ) return;
+        measured[ slices_[ i ].device ] = slices_[ i ].size / t;
+    }
+    // rescale the throughput of measured devices so that the total weight of
+    // the devices that received work does not change
+    double measuredTotal = 0.;
+    double weightTotal = 0.;
+    for( size_t i = 0; i != slices_.size(); ++i )
+    {
+        measuredTotal += measured[ slices_[ i ].device ];
+        weightTotal += weights_[ slices_[ i ].device ];
+    }
+    for( size_t i = 0; i != slices_.size(); ++i )
+    {
+        const size_t d = slices_[ i ].device;
+        weights_[ d ] = smoothing * weights_[ d ]
+                        + ( 1. - smoothing ) * measured[ d ] / measuredTotal * weightTotal;
+    }
+}
+
+//------------------------------------------------------------------------------
+CLMemObj CreateFirstTouchBuffer( const CLMultiDeviceContext& mdc,
+                                 const CLPartitionedKernel::Slices& slices,
+                                 size_t bytesPerIndex,
+                                 size_t size,
+                                 cl_mem_flags flags )
+{
+    const size_t allocSize = AlignedOffset( size > 0 ? size : 1, int( CLMemObj::ZERO_COPY_ALIGNMENT ) );
+    char* p = static_cast< char* >( AlignedAlloc( allocSize, CLMemObj::ZERO_COPY_ALIGNMENT ) );
+    if( p == 0 ) throw std::runtime_error( "Error - cannot allocate aligned host memory" );
+    // pages are placed by the first write: touch the region of each slice
+    // from its node, then whatever is left from the calling thread
+    size_t end = 0;
+    for( CLPartitionedKernel::Slices::const_iterator s = slices.begin(); s != slices.end(); ++s )
+    {
+        const size_t b = std::min( size, s->offset * bytesPerIndex );
+        const size_t e = std::min( size, ( s->offset + s->size ) * bytesPerIndex );
+        const int node = s->device < mdc.numaNodes.size() ? mdc.numaNodes[ s->device ] : -1;
+        if( e > b ) FirstTouch( p + b, e - b, node );
+        end = std::max( end, e );
+    }
+    if( allocSize > end ) FirstTouch( p + end, allocSize - end, -1 );
+    CLMemObj mo( mdc.context, size, flags | CL_MEM_USE_HOST_PTR, p );
+    const cl_int status = ::clSetMemObjectDestructorCallback( mo, FreeHostMemory, p );
+    if( status != CL_SUCCESS )
+    {
+        // the buffer could still be referenced by the run-time: leak memory
+        // rather than freeing it while in use
+        throw std::runtime_error( "ERROR - clSetMemObjectDestructorCallback(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    return mo;
+}
+
+//------------------------------------------------------------------------------
+void CLPartitionedKernel::Gather( const std::vector< CLMemObj >& outputs, void* pHostData, size_t bytesPerIndex )
+{
+    if( outputs.size() != mdc_.NumDevices() ) throw std::invalid_argument( "Number of buffers does not match number of devices" );
+    char* dst = static_cast< char* >( pHostData );
+    for( size_t i = 0; i != slices_.size(); ++i )
+    {
+        const Slice& s = slices_[ i ];
+        EventArray waitList;
+        if( i < events_.size() ) waitList.push_back( events_[ i ] );
+        CLCopyDtoH( mdc_.commandQueues[ s.device ], outputs[ s.device ], dst + s.offset * bytesPerIndex,
+                    waitList, CL_FALSE, s.offset * bytesPerIndex, s.size * bytesPerIndex );
+    }
+    mdc_.Finish();
+}
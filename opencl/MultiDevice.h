@@ -0,0 +1,271 @@
+///\file opencl/MultiDevice.h Execution on all the devices of a context
+
+#ifndef MULTI_DEVICE_H_
+#define MULTI_DEVICE_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <CL/cl.h>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Execution context spanning all the devices of an OpenCL context, with one
+/// command queue per device.
+struct CLMultiDeviceContext
+{
+    /// OpenCL platform id
+    cl_platform_id platform;
+    /// OpenCL context shared by all devices
+    HContext context;
+    /// Devices, in the order returned by \c CL_CONTEXT_DEVICES
+    std::vector< cl_device_id > devices;
+    /// Command queues, one per device
+    std::vector< HCommandQueue > commandQueues;
+    /// NUMA node local to each device, negative if unknown
+    std::vector< int > numaNodes;
+    /// Sub-devices created by CreateCLSubDeviceContext(), kept alive as long
+    /// as the context is in use; empty for root devices
+    std::vector< HDevice > subDevices;
+    /// Returns number of devices.
+    size_t NumDevices() const { return devices.size(); }
+    /// Returns single device execution context for device \c i, sharing
+    /// context and command queue with this instance.
+    /// \throw std::range_error in case the index is out of bounds
+    CLExecutionContext DeviceContext( size_t i ) const;
+    /// Wait for completion of the commands in all queues.
+    /// \throw std::runtime_error in case \c clFinish fails
+    void Finish() const;
+};
+
+//------------------------------------------------------------------------------
+/// Create context for all the devices of the requested type available on a
+/// platform and a command queue for each device.
+/// \param[in] platformString platform identifier e.g. "NVIDIA CUDA" or "ATI Stream"
+/// \param[in] deviceType type of devices requested
+/// \param[in] prop command queue properties; profiling is required to balance
+///            work among devices with CLPartitionedKernel
+/// \return valid multi-device context
+/// \throw std::runtime_error in case of failure to allocate resources
+CLMultiDeviceContext CreateCLMultiDeviceContext( const std::string& platformString,
+                                                 cl_device_type deviceType = CL_DEVICE_TYPE_ALL,
+                                                 cl_command_queue_properties prop = CL_QUEUE_PROFILING_ENABLE );
+
+//------------------------------------------------------------------------------
+/// Scheme used to split a device into sub-devices with \c clCreateSubDevices.
+struct CLDevicePartition
+{
+    enum Type { EQUALLY, BY_AFFINITY_DOMAIN };
+    Type type;
+    cl_uint computeUnits;             //!< compute units per sub-device, EQUALLY only
+    cl_device_affinity_domain domain; //!< affinity domain, BY_AFFINITY_DOMAIN only
+    /// Sub-devices with \c units compute units each.
+    static CLDevicePartition Equally( cl_uint units )
+    {
+        CLDevicePartition p = { EQUALLY, units, 0 };
+        return p;
+    }
+    /// One sub-device per affinity domain, e.g. per NUMA node.
+    static CLDevicePartition ByAffinityDomain( cl_device_affinity_domain d = CL_DEVICE_AFFINITY_DOMAIN_NUMA )
+    {
+        CLDevicePartition p = { BY_AFFINITY_DOMAIN, 0, d };
+        return p;
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Split the device of an execution context into sub-devices and create a
+/// context with a command queue for each sub-device; work is scheduled
+/// across them with CLPartitionedKernel. Requires OpenCL 1.2.
+/// When partitioning by NUMA affinity domain sub-device \c i is assumed to be
+/// local to NUMA node \c i, as implemented by CPU run-times, and \c numaNodes
+/// is set accordingly.
+/// \param[in] ec execution context with valid platform and device
+/// \param[in] partition partitioning scheme
+/// \param[in] prop command queue properties
+/// \return valid multi-device context
+/// \throw std::runtime_error in case the device cannot be partitioned
+CLMultiDeviceContext CreateCLSubDeviceContext( const CLExecutionContext& ec,
+                                               const CLDevicePartition& partition,
+                                               cl_command_queue_properties prop = CL_QUEUE_PROFILING_ENABLE );
+
+//------------------------------------------------------------------------------
+/// Kernel argument taking a different value on each device, e.g. a separate
+/// output buffer per device; values are indexed by device.
+template < typename T >
+struct PerDevice
+{
+    const std::vector< T >& values;
+    explicit PerDevice( const std::vector< T >& v ) : values( v ) {}
+};
+
+/// Pass one value per device to CLPartitionedKernel::Launch().
+template < typename T >
+inline PerDevice< T > PerDeviceArg( const std::vector< T >& v ) { return PerDevice< T >( v ); }
+
+/// Returns argument bound on device \c d: the argument itself.
+template < typename T >
+inline const T& SelectDeviceArg( const T& a, size_t ) { return a; }
+
+/// Returns argument bound on device \c d: value for the device.
+template < typename T >
+inline const T& SelectDeviceArg( const PerDevice< T >& a, size_t d ) { return a.values.at( d ); }
+
+//------------------------------------------------------------------------------
+/// Kernel executed on all the devices of a multi-device context. The NDRange
+/// is split along one dimension into slices proportional to the throughput
+/// of each device; each slice is launched on its device with a global offset
+/// so that \c get_global_id returns the same values as a single launch.
+///
+/// Slices start with equal weights; Wait() measures the execution time of
+/// each slice through the profiling information of the events and moves the
+/// weights towards the measured throughput, so that repeated launches
+/// converge to a balanced distribution.
+///
+/// Devices can safely share buffers they only read. Buffers written by the
+/// kernel should be separate for each device, passed with PerDeviceArg(), and
+/// collected with Gather(): the result of writes to the same buffer from
+/// different devices is undefined.
+///\code
+///  CLPartitionedKernel k( mdc, src, "MatMul", "-DTILE_SIZE=16", 1 );
+///  k.Launch( gwgs, lwgs, dA, dB, PerDeviceArg( dC ), width, height );
+///  k.Wait();
+///  k.Gather( dC, &C[ 0 ], width * sizeof( float ) );
+///\endcode
+class CLPartitionedKernel
+{
+public:
+    /// Range of the partitioned dimension assigned to a device.
+    struct Slice
+    {
+        size_t device; //!< device index
+        size_t offset; //!< first index
+        size_t size;   //!< number of indices
+    };
+    typedef std::vector< Slice > Slices;
+    /// Constructor: builds the kernel for every device.
+    /// \param[in] mdc multi-device context
+    /// \param[in] src source code of program
+    /// \param[in] kernelName name of kernel function
+    /// \param[in] buildOptions build options passed to OpenCL compiler
+    /// \param[in] dimension index of the partitioned dimension
+    /// \throw std::runtime_error in case of errors building the kernels
+    CLPartitionedKernel( const CLMultiDeviceContext& mdc,
+                         const std::string& src,
+                         const std::string& kernelName,
+                         const std::string& buildOptions = "",
+                         size_t dimension = 0 );
+    /// Set relative throughput of devices; weights are normalized.
+    /// \throw std::invalid_argument in case the number of weights does not
+    ///        match the number of devices or weights are not positive
+    void SetWeights( const std::vector< double >& weights );
+    /// Returns normalized weights.
+    const std::vector< double >& GetWeights() const { return weights_; }
+    /// Split \c globalSize indices in multiples of \c granularity
+    /// proportionally to the weights; devices with no work get no slice.
+    /// \throw std::logic_error in case globalSize is not a multiple of granularity
+    Slices Partition( size_t globalSize, size_t granularity ) const;
+    /// Bind arguments and launch one slice per device; arguments wrapped with
+    /// PerDeviceArg() take a different value on each device.
+    /// \param[in] gwgs global work group size
+    /// \param[in] lwgs local work group size; slices are multiples of the
+    ///            local size along the partitioned dimension when not empty
+    /// \return slices launched
+    /// \throw std::runtime_error in case of errors binding arguments or
+    ///        enqueuing kernels
+    template < typename... ArgsT >
+    const Slices& Launch( const SizeArray& gwgs, const SizeArray& lwgs, const ArgsT&... args )
+    {
+        if( dimension_ >= gwgs.size() ) throw std::logic_error( "Invalid partitioned dimension" );
+        slices_ = Partition( gwgs[ dimension_ ], lwgs.empty() ? 1 : lwgs[ dimension_ ] );
+        events_.clear();
+        for( Slices::const_iterator s = slices_.begin(); s != slices_.end(); ++s )
+        {
+            const cl_kernel k = kernels_[ s->device ];
+            AssertNumKernelArgs( k, sizeof...( ArgsT ) );
+            SetKernelArgs( k, 0, SelectDeviceArg( args, s->device )... );
+            EnqueueSlice( *s, gwgs, lwgs );
+        }
+        return slices_;
+    }
+    /// Wait for completion of the last launch and update weights from the
+    /// measured throughput of each device.
+    /// \param[in] smoothing weight of the previous distribution in [0, 1]:
+    ///            zero uses the last measurement only
+    /// \throw std::runtime_error in case of errors while waiting
+    void Wait( double smoothing = 0.5 );
+    /// Copy the region computed by each slice from device memory into host
+    /// memory; waits for the completion of the copies.
+    /// \param[in] outputs output buffers, one per device
+    /// \param[out] pHostData target of copy, receives the whole NDRange
+    /// \param[in] bytesPerIndex bytes written per index of the partitioned
+    ///            dimension, e.g. size of a row when partitioning rows
+    /// \throw std::invalid_argument in case the number of buffers does not
+    ///        match the number of devices
+    /// \throw std::runtime_error in case of errors while copying
+    void Gather( const std::vector< CLMemObj >& outputs, void* pHostData, size_t bytesPerIndex );
+    /// Returns slices of the last launch.
+    const Slices& GetSlices() const { return slices_; }
+    /// Returns kernel instance of device \c i.
+    cl_kernel GetKernel( size_t i ) const { return kernels_.at( i ); }
+private:
+    void EnqueueSlice( const Slice& s, const SizeArray& gwgs, const SizeArray& lwgs );
+private:
+    CLMultiDeviceContext mdc_;
+    std::vector< HKernel > kernels_;
+    std::vector< double > weights_;
+    size_t dimension_;
+    Slices slices_;
+    std::vector< HEvent > events_;
+};
+
+//------------------------------------------------------------------------------
+/// Create zero-copy buffer whose host memory is placed, page by page, on the
+/// NUMA node of the device computing each slice: the region of each slice is
+/// first written by a thread bound to the node, see FirstTouch(). Devices
+/// accessing host memory in place, i.e. CPU devices, then read local memory.
+/// Memory of devices with unknown node is written by the calling thread.
+/// \param[in] mdc multi-device context
+/// \param[in] slices slices as returned by CLPartitionedKernel::Partition()
+/// \param[in] bytesPerIndex bytes accessed per index of the partitioned
+///            dimension, e.g. size of a row when partitioning rows
+/// \param[in] size size of buffer in bytes
+/// \param[in] flags memory flags, \c CL_MEM_USE_HOST_PTR is added
+/// \return buffer with zero initialized memory
+/// \throw std::runtime_error in case memory cannot be allocated
+CLMemObj CreateFirstTouchBuffer( const CLMultiDeviceContext& mdc,
+                                 const CLPartitionedKernel::Slices& slices,
+                                 size_t bytesPerIndex,
+                                 size_t size,
+                                 cl_mem_flags flags = CL_MEM_READ_WRITE );
+
+///Overloaded operator to print slices.
+inline std::ostream& operator<<( std::ostream& os, const CLPartitionedKernel::Slices& s )
+{
+    for( CLPartitionedKernel::Slices::const_iterator i = s.begin(); i != s.end(); ++i )
+    {
+        if( i != s.begin() ) os << ' ';
+        os << "device " << i->device << ": [" << i->offset << ", " << i->offset + i->size << ')';
+    }
+    return os;
+}
+
+#endif //MULTI_DEVICE_H_
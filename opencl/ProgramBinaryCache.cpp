@@ -0,0 +1,342 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "ProgramBinaryCache.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include "OpenCLStatusCodesTable.h"
+#include "../utility/Hash.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Identifies cache files and their layout version.
+const char CACHE_FILE_MAGIC[] = "GPUPPBIN1\n";
+
+//------------------------------------------------------------------------------
+/// Returns device information as a string.
+std::string DeviceString( cl_device_id device, cl_device_info param )
+{
+    size_t size = 0;
+    cl_int status = ::clGetDeviceInfo( device, param, 0, 0, &size );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    std::vector< char > buf( size + 1, char() );
+    status = ::clGetDeviceInfo( device, param, size, &buf[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    return &buf[ 0 ];
+}
+
+//------------------------------------------------------------------------------
+/// Returns platform information as a string.
+std::string PlatformString( cl_platform_id platform, cl_platform_info param )
+{
+    std::vector< char > buf( 1 << 10, char() );
+    const cl_int status = ::clGetPlatformInfo( platform, param, buf.size() - 1, &buf[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetPlatformInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    return &buf[ 0 ];
+}
+
+//------------------------------------------------------------------------------
+/// Write 64 bit size in little endian order.
+void WriteSize( std::ostream& os, unsigned long long s )
+{
+    for( int i = 0; i != 8; ++i ) os.put( char( ( s >> ( 8 * i ) ) & 0xff ) );
+}
+
+//------------------------------------------------------------------------------
+/// Read 64 bit size in little endian order.
+bool ReadSize( std::istream& is, unsigned long long& s )
+{
+    s = 0;
+    for( int i = 0; i != 8; ++i )
+    {
+        const int c = is.get();
+        if( c == EOF ) return false;
+        s |= static_cast< unsigned long long >( c & 0xff ) << ( 8 * i );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/// Create directory; success if the directory already exists.
+bool MakeDirectory( const std::string& dir )
+{
+#ifdef _WIN32
+    return ::_mkdir( dir.c_str() ) == 0 || errno == EEXIST;
+#else
+    return ::mkdir( dir.c_str(), 0755 ) == 0 || errno == EEXIST;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// Atomically replace \c to with \c from.
+bool ReplaceFile( const std::string& from, const std::string& to )
+{
+#ifdef _WIN32
+    return ::MoveFileExA( from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+    return ::rename( from.c_str(), to.c_str() ) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+int ProcessId()
+{
+#ifdef _WIN32
+    return ::_getpid();
+#else
+    return ::getpid();
+#endif
+}
+}
+
+//------------------------------------------------------------------------------
+ProgramBinaryCache::ProgramBinaryCache() : hits_( 0 ), misses_( 0 ),
+    stores_( 0 ), rejected_( 0 ), tmpCounter_( 0 )
+{
+    const char* dir = getenv( "GPUPP_PROGRAM_CACHE_DIR" );
+    if( dir && *dir )
+    {
+        try
+        {
+            SetDirectory( dir );
+        }
+        catch( const std::exception& e )
+        {
+            std::cerr << e.what() << " - program binary cache disabled" << std::endl;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+ProgramBinaryCache& ProgramBinaryCache::Instance()
+{
+    static ProgramBinaryCache i;
+    return i;
+}
+
+//------------------------------------------------------------------------------
+void ProgramBinaryCache::SetDirectory( const std::string& dir )
+{
+    if( !dir.empty() && !MakeDirectory( dir ) )
+    {
+        throw std::runtime_error( "Cannot create program cache directory: " + dir );
+    }
+    std::lock_guard< std::mutex > lock( mutex_ );
+    dir_ = dir;
+}
+
+//------------------------------------------------------------------------------
+std::string ProgramBinaryCache::GetDirectory() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return dir_;
+}
+
+//------------------------------------------------------------------------------
+bool ProgramBinaryCache::Enabled() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return !dir_.empty();
+}
+
+//------------------------------------------------------------------------------
+std::string ProgramBinaryCache::MakeKey( cl_device_id device,
+                                         const std::string& src,
+                                         const std::string& buildOptions )
+{
+    cl_platform_id platform = cl_platform_id();
+    const cl_int status = ::clGetDeviceInfo( device, CL_DEVICE_PLATFORM, sizeof( platform ), &platform, 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    // fields are separated by a character that cannot appear in any of them
+    // so that different field combinations never produce the same key
+    std::string key;
+    key += PlatformString( platform, CL_PLATFORM_NAME );    key += '\0';
+    key += PlatformString( platform, CL_PLATFORM_VERSION ); key += '\0';
+    key += DeviceString( device, CL_DEVICE_NAME );          key += '\0';
+    key += DeviceString( device, CL_DEVICE_VERSION );       key += '\0';
+    key += DeviceString( device, CL_DRIVER_VERSION );       key += '\0';
+    key += buildOptions;                                    key += '\0';
+    key += src;
+    return key;
+}
+
+//------------------------------------------------------------------------------
+std::string ProgramBinaryCache::EntryPath( const std::string& key ) const
+{
+    static const std::string SEPARATOR =
+#ifdef _WIN32
+        "\\";
+#else
+        "/";
+#endif
+    std::ostringstream os;
+    os << GetDirectory() << SEPARATOR << std::hex << FNV1aHash( key ) << ".clbin";
+    return os.str();
+}
+
+//------------------------------------------------------------------------------
+HProgram ProgramBinaryCache::Load( cl_context ctx,
+                                   cl_device_id device,
+                                   const std::string& key,
+                                   const std::string& buildOptions,
+                                   std::string& buildOutput )
+{
+    std::ifstream is( EntryPath( key ).c_str(), std::ios::binary );
+    std::vector< char > magic( sizeof( CACHE_FILE_MAGIC ) - 1 );
+    unsigned long long keySize = 0;
+    if( !is
+        || !is.read( &magic[ 0 ], magic.size() )
+        || std::string( magic.begin(), magic.end() ) != CACHE_FILE_MAGIC
+        || !ReadSize( is, keySize )
+        || keySize != key.size() )
+    {
+        ++misses_;
+        return HProgram();
+    }
+    // the complete key is stored in the file to detect hash collisions
+    std::string storedKey( keySize, '\0' );
+    unsigned long long binarySize = 0;
+    if( !is.read( &storedKey[ 0 ], keySize )
+        || storedKey != key
+        || !ReadSize( is, binarySize )
+        || binarySize == 0 )
+    {
+        ++misses_;
+        return HProgram();
+    }
+    std::vector< unsigned char > binary( binarySize );
+    if( !is.read( reinterpret_cast< char* >( &binary[ 0 ] ), binarySize ) )
+    {
+        ++misses_;
+        return HProgram();
+    }
+
+    const size_t length = binary.size();
+    const unsigned char* data = &binary[ 0 ];
+    cl_int binaryStatus = CL_SUCCESS + 1;
+    cl_int status = CL_SUCCESS + 1;
+    cl_program p = ::clCreateProgramWithBinary( ctx, 1, &device, &length, &data, &binaryStatus, &status );
+    if( status != CL_SUCCESS || binaryStatus != CL_SUCCESS )
+    {
+        if( p != 0 ) ::clReleaseProgram( p );
+        ++rejected_;
+        ++misses_;
+        return HProgram();
+    }
+    HProgram program( p );
+    // building is still required to obtain an executable from a binary
+    const cl_int buildStatus = ::clBuildProgram( program, 1, &device, buildOptions.c_str(), 0, 0 );
+    char buffer[ 1 << 14 ] = "";
+    if( ::clGetProgramBuildInfo( program, device, CL_PROGRAM_BUILD_LOG, sizeof( buffer ), buffer, 0 ) == CL_SUCCESS
+        && buffer[ 0 ] != 0 ) buildOutput = &buffer[ 0 ];
+    if( buildStatus != CL_SUCCESS )
+    {
+        ++rejected_;
+        ++misses_;
+        return HProgram();
+    }
+    ++hits_;
+    return program;
+}
+
+//------------------------------------------------------------------------------
+void ProgramBinaryCache::Store( cl_program program, cl_device_id device, const std::string& key )
+{
+    // a program created from source is associated with all the devices in
+    // the context: find the binary of the one it was built for
+    cl_uint numDevices = 0;
+    if( ::clGetProgramInfo( program, CL_PROGRAM_NUM_DEVICES, sizeof( numDevices ), &numDevices, 0 ) != CL_SUCCESS
+        || numDevices == 0 ) return;
+    std::vector< cl_device_id > devices( numDevices );
+    if( ::clGetProgramInfo( program, CL_PROGRAM_DEVICES, sizeof( cl_device_id ) * numDevices, &devices[ 0 ], 0 ) != CL_SUCCESS ) return;
+    std::vector< size_t > sizes( numDevices );
+    if( ::clGetProgramInfo( program, CL_PROGRAM_BINARY_SIZES, sizeof( size_t ) * numDevices, &sizes[ 0 ], 0 ) != CL_SUCCESS ) return;
+    size_t d = 0;
+    while( d != numDevices && devices[ d ] != device ) ++d;
+    if( d == numDevices || sizes[ d ] == 0 ) return;
+    std::vector< std::vector< unsigned char > > binaries( numDevices );
+    std::vector< unsigned char* > pointers( numDevices, static_cast< unsigned char* >( 0 ) );
+    for( size_t i = 0; i != numDevices; ++i )
+    {
+        if( sizes[ i ] == 0 ) continue;
+        binaries[ i ].resize( sizes[ i ] );
+        pointers[ i ] = &binaries[ i ][ 0 ];
+    }
+    if( ::clGetProgramInfo( program, CL_PROGRAM_BINARIES, sizeof( unsigned char* ) * numDevices, &pointers[ 0 ], 0 ) != CL_SUCCESS ) return;
+
+    // write to a file private to this process and thread then rename: readers
+    // in other processes never observe a partially written entry
+    const std::string path = EntryPath( key );
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << ProcessId() << '.' << tmpCounter_++;
+    {
+        std::ofstream os( tmp.str().c_str(), std::ios::binary );
+        if( !os ) return;
+        os.write( CACHE_FILE_MAGIC, sizeof( CACHE_FILE_MAGIC ) - 1 );
+        WriteSize( os, key.size() );
+        os.write( key.data(), key.size() );
+        WriteSize( os, sizes[ d ] );
+        os.write( reinterpret_cast< const char* >( &binaries[ d ][ 0 ] ), sizes[ d ] );
+        if( !os )
+        {
+            os.close();
+            std::remove( tmp.str().c_str() );
+            return;
+        }
+    }
+    if( !ReplaceFile( tmp.str(), path ) )
+    {
+        std::remove( tmp.str().c_str() );
+        return;
+    }
+    ++stores_;
+}
+
+//------------------------------------------------------------------------------
+ProgramBinaryCache::Stats ProgramBinaryCache::GetStats() const
+{
+    Stats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    s.stores = stores_;
+    s.rejected = rejected_;
+    return s;
+}
+
+//------------------------------------------------------------------------------
+void ProgramBinaryCache::ResetStats()
+{
+    hits_ = 0;
+    misses_ = 0;
+    stores_ = 0;
+    rejected_ = 0;
+}
@@ -0,0 +1,111 @@
+///\file opencl/ProgramBinaryCache.h Persistent on-disk cache of compiled OpenCL programs
+
+#ifndef PROGRAM_BINARY_CACHE_H_
+#define PROGRAM_BINARY_CACHE_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Cache of program binaries (\c CL_PROGRAM_BINARIES) stored in a directory
+/// on disk. Entries are keyed by source text, build options, platform name and
+/// version, device name and version and driver version; a program loaded
+/// from the cache is rebuilt from source whenever the run-time rejects the
+/// binary.
+/// Entries are written to a temporary file and atomically renamed, so any
+/// number of processes can share the same cache directory.
+/// The cache is disabled until a directory is set, either by calling
+/// SetDirectory() or through the \c GPUPP_PROGRAM_CACHE_DIR environment
+/// variable.
+class ProgramBinaryCache
+{
+public:
+    /// Cache usage counters.
+    struct Stats
+    {
+        unsigned hits;     //!< programs created from a cached binary
+        unsigned misses;   //!< lookups that required a source build
+        unsigned stores;   //!< binaries written to disk
+        unsigned rejected; //!< cached binaries the run-time failed to load
+    };
+    /// Returns global instance, initialized from the \c GPUPP_PROGRAM_CACHE_DIR
+    /// environment variable.
+    static ProgramBinaryCache& Instance();
+    /// Set cache directory, created if it does not exist; an empty string
+    /// disables the cache.
+    /// \throw std::runtime_error in case the directory cannot be created
+    void SetDirectory( const std::string& dir );
+    /// Returns the cache directory, empty if the cache is disabled.
+    std::string GetDirectory() const;
+    /// Returns \c true if a cache directory is set.
+    bool Enabled() const;
+    /// Compute lookup key for a program built for a specific device.
+    /// \throw std::runtime_error in case device or platform info cannot be retrieved
+    static std::string MakeKey( cl_device_id device,
+                                const std::string& src,
+                                const std::string& buildOptions );
+    /// Create and build program from cached binary.
+    /// \param[in] ctx context to create the program into
+    /// \param[in] device target device
+    /// \param[in] key key returned by MakeKey()
+    /// \param[in] buildOptions build options passed to \c clBuildProgram
+    /// \param[out] buildOutput log from compiler
+    /// \return valid program in case of a hit, empty handle otherwise
+    HProgram Load( cl_context ctx,
+                   cl_device_id device,
+                   const std::string& key,
+                   const std::string& buildOptions,
+                   std::string& buildOutput );
+    /// Write the binary of a program built for \c device to the cache;
+    /// failures are not reported since the cache is an optimization only.
+    void Store( cl_program program, cl_device_id device, const std::string& key );
+    /// Returns usage counters.
+    Stats GetStats() const;
+    /// Reset usage counters.
+    void ResetStats();
+private:
+    ProgramBinaryCache();
+    ProgramBinaryCache( const ProgramBinaryCache& );
+    ProgramBinaryCache& operator=( const ProgramBinaryCache& );
+    /// Returns full path of cache file for key.
+    std::string EntryPath( const std::string& key ) const;
+private:
+    mutable std::mutex mutex_;
+    std::string dir_;
+    std::atomic< unsigned > hits_;
+    std::atomic< unsigned > misses_;
+    std::atomic< unsigned > stores_;
+    std::atomic< unsigned > rejected_;
+    std::atomic< unsigned > tmpCounter_;
+};
+
+///Overloaded operator to print cache counters.
+inline std::ostream& operator<<( std::ostream& os, const ProgramBinaryCache::Stats& s )
+{
+    os << "hits: " << s.hits << " misses: " << s.misses
+       << " stores: " << s.stores << " rejected: " << s.rejected;
+    return os;
+}
+
+#endif //PROGRAM_BINARY_CACHE_H_
@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "ProgramRegistry.h"
+#include <vector>
+#include <cstdlib>
+#include "OpenCLStatusCodesTable.h"
+#include "../utility/Hash.h"
+
+//------------------------------------------------------------------------------
+bool ProgramRegistry::Key::operator<( const Key& k ) const
+{
+    if( context != k.context ) return context < k.context;
+    if( device != k.device ) return device < k.device;
+    if( srcHash != k.srcHash ) return srcHash < k.srcHash;
+    return buildOptions < k.buildOptions;
+}
+
+//------------------------------------------------------------------------------
+ProgramRegistry::ProgramRegistry() : enabled_( false ), hits_( 0 ), misses_( 0 )
+{
+    const char* e = getenv( "GPUPP_PROGRAM_REGISTRY" );
+    enabled_ = e != 0 && *e != 0 && std::string( e ) != "0";
+}
+
+//------------------------------------------------------------------------------
+ProgramRegistry& ProgramRegistry::Instance()
+{
+    static ProgramRegistry i;
+    return i;
+}
+
+//------------------------------------------------------------------------------
+ProgramRegistry::Entry ProgramRegistry::Lookup( const CLExecutionContext& ec,
+                                                const std::string& src,
+                                                std::string& buildOutput,
+                                                const std::string& buildOptions )
+{
+    Key key;
+    key.context = ec.context;
+    key.device = ec.device;
+    key.srcHash = FNV1aHash( src );
+    key.buildOptions = buildOptions;
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        Entries::const_iterator i = entries_.find( key );
+        if( i != entries_.end() && i->second.src == src )
+        {
+            ++hits_;
+            return i->second;
+        }
+    }
+    // build outside of the lock: building can take seconds and must not
+    // stall lookups of other programs
+    ++misses_;
+    Entry entry;
+    entry.src = src;
+    entry.program = BuildProgram( ec, src, buildOutput, buildOptions );
+    cl_uint numKernels = 0;
+    cl_int status = ::clCreateKernelsInProgram( entry.program, 0, 0, &numKernels );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateKernelsInProgram(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    if( numKernels > 0 )
+    {
+        std::vector< cl_kernel > kernels( numKernels );
+        status = ::clCreateKernelsInProgram( entry.program, numKernels, &kernels[ 0 ], 0 );
+        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateKernelsInProgram(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+        for( std::vector< cl_kernel >::iterator k = kernels.begin(); k != kernels.end(); ++k )
+        {
+            HKernel kernel( *k );
+            std::vector< char > name( 256, char() );
+            size_t nameSize = 0;
+            status = ::clGetKernelInfo( kernel, CL_KERNEL_FUNCTION_NAME, 0, 0, &nameSize );
+            if( status == CL_SUCCESS && nameSize > name.size() ) name.resize( nameSize );
+            if( status == CL_SUCCESS ) status = ::clGetKernelInfo( kernel, CL_KERNEL_FUNCTION_NAME, name.size(), &name[ 0 ], 0 );
+            if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetKernelInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+            entry.kernels[ &name[ 0 ] ] = kernel;
+        }
+    }
+    std::lock_guard< std::mutex > lock( mutex_ );
+    // another thread might have registered the same program in the meantime:
+    // keep the first one so that all clients share the same kernels
+    Entries::iterator i = entries_.find( key );
+    if( i == entries_.end() ) entries_[ key ] = entry;
+    else if( i->second.src == src ) return i->second;
+    return entry;
+}
+
+//------------------------------------------------------------------------------
+HProgram ProgramRegistry::GetProgram( const CLExecutionContext& ec,
+                                      const std::string& src,
+                                      std::string& buildOutput,
+                                      const std::string& buildOptions )
+{
+    return Lookup( ec, src, buildOutput, buildOptions ).program;
+}
+
+//------------------------------------------------------------------------------
+HKernel ProgramRegistry::GetKernel( const CLExecutionContext& ec,
+                                    const std::string& src,
+                                    const std::string& kernelName,
+                                    std::string& buildOutput,
+                                    const std::string& buildOptions )
+{
+    const Entry e = Lookup( ec, src, buildOutput, buildOptions );
+    KernelMap::const_iterator k = e.kernels.find( kernelName );
+    if( k == e.kernels.end() ) throw std::range_error( "Kernel not found in program: " + kernelName );
+    return k->second;
+}
+
+//------------------------------------------------------------------------------
+ProgramRegistry::KernelMap ProgramRegistry::GetKernels( const CLExecutionContext& ec,
+                                                        const std::string& src,
+                                                        std::string& buildOutput,
+                                                        const std::string& buildOptions )
+{
+    return Lookup( ec, src, buildOutput, buildOptions ).kernels;
+}
+
+//------------------------------------------------------------------------------
+void ProgramRegistry::Evict( cl_context ctx )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    for( Entries::iterator i = entries_.begin(); i != entries_.end(); )
+    {
+        if( i->first.context == ctx ) entries_.erase( i++ );
+        else ++i;
+    }
+}
+
+//------------------------------------------------------------------------------
+void ProgramRegistry::Clear()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    entries_.clear();
+}
+
+//------------------------------------------------------------------------------
+size_t ProgramRegistry::Size() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return entries_.size();
+}
+
+//------------------------------------------------------------------------------
+ProgramRegistry::Stats ProgramRegistry::GetStats() const
+{
+    Stats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    return s;
+}
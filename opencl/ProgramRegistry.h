@@ -0,0 +1,130 @@
+///\file opencl/ProgramRegistry.h Process-wide registry of built programs and kernels
+
+#ifndef PROGRAM_REGISTRY_H_
+#define PROGRAM_REGISTRY_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// In-memory registry of programs built in the current process, keyed by
+/// context, device, source text hash and build options. A program is compiled
+/// once per key and all of its kernels are created at once through
+/// \c clCreateKernelsInProgram, so that any number of kernels can be retrieved
+/// from a multi-kernel source file without recompiling it.
+/// Programs retain their context: entries must be removed with Evict() or
+/// ReleaseExecutionContext() when a context is not used anymore.
+/// BuildKernel() retrieves programs from the registry only when it is enabled,
+/// either by calling SetEnabled() or by setting the \c GPUPP_PROGRAM_REGISTRY
+/// environment variable; the GetProgram() and GetKernel() methods can always
+/// be used directly.
+class ProgramRegistry
+{
+public:
+    /// Kernel name -> kernel.
+    typedef std::map< std::string, HKernel > KernelMap;
+    /// Registry usage counters.
+    struct Stats
+    {
+        unsigned hits;   //!< programs returned without building
+        unsigned misses; //!< programs built
+    };
+    /// Returns global instance.
+    static ProgramRegistry& Instance();
+    /// Enable or disable lookup from BuildKernel().
+    void SetEnabled( bool on ) { enabled_ = on; }
+    /// Returns \c true if BuildKernel() looks up programs in the registry.
+    bool Enabled() const { return enabled_; }
+    /// Returns program built from source for the device in the execution
+    /// context, building it through BuildProgram() on first request.
+    /// \param[in] ec valid execution context
+    /// \param[in] src source code of program
+    /// \param[out] buildOutput log from compiler, set only when the program is built
+    /// \param[in] buildOptions build options passed to OpenCL compiler
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    HProgram GetProgram( const CLExecutionContext& ec,
+                         const std::string& src,
+                         std::string& buildOutput,
+                         const std::string& buildOptions = "" );
+    /// Returns kernel instance registered for function \c kernelName in the
+    /// program built from \c src. The same instance is returned on every call:
+    /// kernel arguments are shared among all users of the instance, create a
+    /// private one with \c clCreateKernel when setting arguments concurrently.
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    /// \throw std::range_error in case the program has no such kernel
+    HKernel GetKernel( const CLExecutionContext& ec,
+                       const std::string& src,
+                       const std::string& kernelName,
+                       std::string& buildOutput,
+                       const std::string& buildOptions = "" );
+    /// Returns all kernels in the program built from \c src.
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    KernelMap GetKernels( const CLExecutionContext& ec,
+                          const std::string& src,
+                          std::string& buildOutput,
+                          const std::string& buildOptions = "" );
+    /// Remove all entries associated with context.
+    void Evict( cl_context ctx );
+    /// Remove all entries.
+    void Clear();
+    /// Returns number of registered programs.
+    size_t Size() const;
+    /// Returns usage counters.
+    Stats GetStats() const;
+private:
+    /// Lookup key.
+    struct Key
+    {
+        cl_context context;
+        cl_device_id device;
+        unsigned long long srcHash;
+        std::string buildOptions;
+        bool operator<( const Key& k ) const;
+    };
+    /// Registered program and its kernels.
+    struct Entry
+    {
+        std::string src;  //!< used to detect hash collisions
+        HProgram program;
+        KernelMap kernels;
+    };
+    typedef std::map< Key, Entry > Entries;
+private:
+    ProgramRegistry();
+    ProgramRegistry( const ProgramRegistry& );
+    ProgramRegistry& operator=( const ProgramRegistry& );
+    /// Returns a copy of the entry for key, building the program if needed.
+    Entry Lookup( const CLExecutionContext& ec,
+                  const std::string& src,
+                  std::string& buildOutput,
+                  const std::string& buildOptions );
+private:
+    mutable std::mutex mutex_;
+    Entries entries_;
+    std::atomic< bool > enabled_;
+    std::atomic< unsigned > hits_;
+    std::atomic< unsigned > misses_;
+};
+
+#endif //PROGRAM_REGISTRY_H_
@@ -0,0 +1,290 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "StagingPool.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "OpenCLStatusCodesTable.h"
+#include "BufferPool.h"
+#include "KernelArgCache.h"
+#include "KernelStats.h"
+#include "Tracer.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Returns \c true if the command associated with the event has completed,
+/// successfully or not; null events are complete.
+bool Completed( cl_event e )
+{
+    if( e == cl_event() ) return true;
+    cl_int status = CL_COMPLETE;
+    const cl_int s = ::clGetEventInfo( e, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof( status ), &status, 0 );
+    if( s != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetEventInfo(): " + OpenCLStatusCodesTable::Instance()[ s ] );
+    // negative values are error codes of failed commands
+    return status <= CL_COMPLETE;
+}
+
+//------------------------------------------------------------------------------
+/// Validate region and return its size.
+size_t RegionSize( const CLMemObj& mo, size_t offset, size_t size )
+{
+    if( size == 0 ) size = mo.GetSize() > offset ? mo.GetSize() - offset : 0;
+    if( offset > mo.GetSize() || mo.GetSize() - offset < size )
+    {
+        throw std::logic_error( "Error - region outside of buffer" );
+    }
+    return size;
+}
+}
+
+//------------------------------------------------------------------------------
+CLStagingPool::CLStagingPool( cl_context ctx, cl_command_queue cq, size_t chunkSize ) :
+    ctx_( ctx ), cq_( cq ), chunkSize_( chunkSize ), bytesReserved_( 0 ),
+    acquisitions_( 0 ), hits_( 0 )
+{}
+
+//------------------------------------------------------------------------------
+CLStagingPool::~CLStagingPool()
+{
+    for( Pending::iterator i = pending_.begin(); i != pending_.end(); ++i )
+    {
+        cl_event e = i->second;
+        if( e != cl_event() ) ::clWaitForEvents( 1, &e );
+        freeLists_[ i->first.capacity ].push_back( i->first );
+    }
+    pending_.clear();
+    Trim();
+    // blocks still in use are released as well: pointers handed out by
+    // Acquire() are not valid after the pool is destroyed
+    for( std::map< cl_mem, size_t >::iterator i = inUse_.begin(); i != inUse_.end(); ++i )
+    {
+        KernelArgCache::Instance().Invalidate( i->first );
+        ::clReleaseMemObject( i->first );
+    }
+}
+
+//------------------------------------------------------------------------------
+CLStagingPool::Block CLStagingPool::AllocateBlock( size_t capacity )
+{
+    cl_int status = CL_SUCCESS + 1;
+    Block b;
+    b.capacity = capacity;
+    b.buffer = ::clCreateBuffer( ctx_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, capacity, 0, &status );
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "Error - clCreateBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    b.hostPtr = ::clEnqueueMapBuffer( cq_, b.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                      0, capacity, 0, 0, 0, &status );
+    if( status != CL_SUCCESS )
+    {
+        ::clReleaseMemObject( b.buffer );
+        throw std::runtime_error( "Error - clEnqueueMapBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    bytesReserved_ += capacity;
+    return b;
+}
+
+//------------------------------------------------------------------------------
+void CLStagingPool::ReleaseBlock( const Block& b )
+{
+    cl_event e = cl_event();
+    if( ::clEnqueueUnmapMemObject( cq_, b.buffer, b.hostPtr, 0, 0, &e ) == CL_SUCCESS )
+    {
+        ::clWaitForEvents( 1, &e );
+        ::clReleaseEvent( e );
+    }
+    KernelArgCache::Instance().Invalidate( b.buffer );
+    ::clReleaseMemObject( b.buffer );
+    bytesReserved_ -= b.capacity;
+}
+
+//------------------------------------------------------------------------------
+void CLStagingPool::ReclaimCompleted()
+{
+    Pending::iterator end = pending_.begin();
+    for( Pending::iterator i = pending_.begin(); i != pending_.end(); ++i )
+    {
+        if( Completed( i->second ) ) freeLists_[ i->first.capacity ].push_back( i->first );
+        else *end++ = *i;
+    }
+    pending_.erase( end, pending_.end() );
+}
+
+//------------------------------------------------------------------------------
+CLStagingPool::Block CLStagingPool::Acquire( size_t size )
+{
+    if( size == 0 ) throw std::invalid_argument( "Zero size block requested" );
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ++acquisitions_;
+    ReclaimCompleted();
+    const size_t capacity = CLBufferPool::SizeClass( size );
+    std::vector< Block >& fl = freeLists_[ capacity ];
+    Block b;
+    if( !fl.empty() )
+    {
+        b = fl.back();
+        fl.pop_back();
+        ++hits_;
+    }
+    else b = AllocateBlock( capacity );
+    inUse_[ b.buffer ] = b.capacity;
+    return b;
+}
+
+//------------------------------------------------------------------------------
+void CLStagingPool::Recycle( const Block& b, const HEvent& pending )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::map< cl_mem, size_t >::iterator i = inUse_.find( b.buffer );
+    if( i == inUse_.end() ) throw std::logic_error( "Block not allocated by pool" );
+    inUse_.erase( i );
+    if( Completed( pending ) ) freeLists_[ b.capacity ].push_back( b );
+    else pending_.push_back( std::make_pair( b, pending ) );
+}
+
+//------------------------------------------------------------------------------
+HEvent CLStagingPool::CopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo,
+                                size_t offset, size_t size, const EventArray& waitList )
+{
+    size = RegionSize( mo, offset, size );
+    const size_t chunk = ChunkSize( size );
+    const char* src = static_cast< const char* >( pHostData );
+    HEvent last;
+    for( size_t done = 0; done < size; done += chunk )
+    {
+        const size_t n = size - done < chunk ? size - done : chunk;
+        const Block b = Acquire( n );
+        // the memcpy of this chunk overlaps with the transfer of the
+        // previous one, which has been enqueued but not waited for
+        std::memcpy( b.hostPtr, src + done, n );
+        // each chunk waits for the previous one: the event of the last chunk
+        // signals completion of the whole copy on out of order queues too
+        EventArray wl = waitList;
+        if( last != cl_event() ) wl.push_back( last );
+        const bool trace = CLTracer::Enabled();
+        const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+        cl_event e = cl_event();
+        const cl_int status = ::clEnqueueWriteBuffer( cq, mo.GetCLMemHandle(), CL_FALSE, offset + done, n,
+                                                      b.hostPtr, cl_uint( wl.size() ),
+                                                      wl.empty() ? 0 : &wl[ 0 ], &e );
+        if( status != CL_SUCCESS )
+        {
+            Recycle( b );
+            throw std::runtime_error( "Error - clEnqueueWriteBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+        }
+        last = HEvent( e );
+        if( KernelStats::Enabled() ) KernelStats::Instance().RecordCopy( KernelStats::HTOD, n );
+        if( trace )
+        {
+            CLTracer::Instance().Record( CLTracer::COPY_HTOD, "StagedCopyHtoD", cq, e, hostBegin, CLTracer::Now(), n );
+        }
+        Recycle( b, last );
+        // submit the chunk now, or the run-time can hold it back until the
+        // whole copy is enqueued and nothing overlaps; inside a CLBatchScope
+        // the batch decides when to flush
+        if( CLBatchScope* batch = CLBatchScope::Find( cq ) ) batch->Add();
+        else
+        {
+            const cl_int flushed = ::clFlush( cq );
+            if( flushed != CL_SUCCESS ) throw std::runtime_error( "Error - clFlush(): " + OpenCLStatusCodesTable::Instance()[ flushed ] );
+        }
+    }
+    return last;
+}
+
+//------------------------------------------------------------------------------
+void CLStagingPool::CopyDtoH( cl_command_queue cq, const CLMemObj& mo, void* pHostData,
+                              size_t offset, size_t size, const EventArray& waitList )
+{
+    size = RegionSize( mo, offset, size );
+    const size_t chunk = ChunkSize( size );
+    char* dst = static_cast< char* >( pHostData );
+    // enqueue all the reads first, then copy each chunk out of pinned memory
+    // as soon as its read completes
+    std::vector< std::pair< Block, HEvent > > reads;
+    cl_int status = CL_SUCCESS;
+    for( size_t done = 0; done < size && status == CL_SUCCESS; done += chunk )
+    {
+        const size_t n = size - done < chunk ? size - done : chunk;
+        const Block b = Acquire( n );
+        const bool trace = CLTracer::Enabled();
+        const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+        cl_event e = cl_event();
+        status = ::clEnqueueReadBuffer( cq, mo.GetCLMemHandle(), CL_FALSE, offset + done, n,
+                                        b.hostPtr, cl_uint( waitList.size() ),
+                                        waitList.empty() ? 0 : &waitList[ 0 ], &e );
+        if( status == CL_SUCCESS && KernelStats::Enabled() ) KernelStats::Instance().RecordCopy( KernelStats::DTOH, n );
+        if( status == CL_SUCCESS && trace )
+        {
+            CLTracer::Instance().Record( CLTracer::COPY_DTOH, "StagedCopyDtoH", cq, e, hostBegin, CLTracer::Now(), n );
+        }
+        reads.push_back( std::make_pair( b, status == CL_SUCCESS ? HEvent( e ) : HEvent() ) );
+    }
+    ::clFlush( cq );
+    cl_int waitStatus = CL_SUCCESS;
+    for( size_t i = 0; i != reads.size(); ++i )
+    {
+        cl_event e = reads[ i ].second;
+        if( status == CL_SUCCESS && waitStatus == CL_SUCCESS )
+        {
+            waitStatus = ::clWaitForEvents( 1, &e );
+            const size_t done = i * chunk;
+            const size_t n = size - done < chunk ? size - done : chunk;
+            if( waitStatus == CL_SUCCESS ) std::memcpy( dst + done, reads[ i ].first.hostPtr, n );
+        }
+        Recycle( reads[ i ].first, reads[ i ].second );
+    }
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "Error - clEnqueueReadBuffer(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    }
+    if( waitStatus != CL_SUCCESS )
+    {
+        throw std::runtime_error( "Error - clWaitForEvents(): " + OpenCLStatusCodesTable::Instance()[ waitStatus ] );
+    }
+}
+
+//------------------------------------------------------------------------------
+void CLStagingPool::Trim()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ReclaimCompleted();
+    for( FreeLists::iterator i = freeLists_.begin(); i != freeLists_.end(); ++i )
+    {
+        for( std::vector< Block >::iterator b = i->second.begin(); b != i->second.end(); ++b )
+        {
+            ReleaseBlock( *b );
+        }
+    }
+    freeLists_.clear();
+}
+
+//------------------------------------------------------------------------------
+CLStagingPool::Stats CLStagingPool::GetStats() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    Stats s;
+    s.bytesReserved = bytesReserved_;
+    s.blocksPending = pending_.size();
+    s.acquisitions = acquisitions_;
+    s.hits = hits_;
+    return s;
+}
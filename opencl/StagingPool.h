@@ -0,0 +1,156 @@
+///\file opencl/StagingPool.h Pinned host memory pool for host <-> device transfers
+
+#ifndef STAGING_POOL_H_
+#define STAGING_POOL_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include <CL/cl.h>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Pool of pinned (page-locked) host staging buffers. Blocks are
+/// \c CL_MEM_ALLOC_HOST_PTR buffers mapped once with \c clEnqueueMapBuffer
+/// when created and unmapped only when released: run-times transfer data
+/// between pinned memory and the device with DMA, while transfers from
+/// pageable memory go through an additional, internal, staging copy.
+///
+/// CopyHtoD() and CopyDtoH() move data through the pool in chunks so that the
+/// copy between pageable and pinned memory of one chunk overlaps with the
+/// transfer of the previous one; CopyHtoD() flushes the queue after each
+/// chunk, or adds it to the enclosing CLBatchScope of the queue, so that
+/// the transfer starts before the next chunk is copied. A block used by a
+/// non blocking command is handed out again only after the command completes.
+/// Each chunk transfer is recorded by CLTracer and KernelStats as a separate
+/// copy.
+///
+/// Blocks are rounded up to the size classes of CLBufferPool. The command
+/// queue passed to the constructor is used to map and unmap blocks and must
+/// outlive the pool. All methods are thread safe.
+class CLStagingPool
+{
+public:
+    /// Pinned host memory block.
+    struct Block
+    {
+        cl_mem buffer;   //!< buffer owning the memory
+        void* hostPtr;   //!< persistently mapped address of the buffer
+        size_t capacity; //!< size in bytes
+    };
+    /// Pool usage counters.
+    struct Stats
+    {
+        size_t bytesReserved;            //!< pinned memory allocated by the pool
+        size_t blocksPending;            //!< blocks waiting for commands to complete
+        unsigned long long acquisitions; //!< total number of requests
+        unsigned long long hits;         //!< requests served without allocating memory
+        /// Fraction of requests served without allocating memory.
+        double HitRate() const { return acquisitions ? double( hits ) / acquisitions : 0.; }
+    };
+    /// Constructor.
+    /// \param[in] ctx context owning the buffers
+    /// \param[in] cq command queue used to map and unmap blocks
+    /// \param[in] chunkSize size of the chunks transfers are split into;
+    ///            zero means no splitting
+    CLStagingPool( cl_context ctx, cl_command_queue cq, size_t chunkSize = 4 * 1024 * 1024 );
+    /// Destructor: waits for pending commands and releases all the blocks.
+    ~CLStagingPool();
+    /// Returns mapped block of at least \c size bytes.
+    /// \throw std::invalid_argument in case size is zero
+    /// \throw std::runtime_error in case the buffer cannot be allocated or mapped
+    Block Acquire( size_t size );
+    /// Give back block obtained from Acquire().
+    /// \param[in] b block
+    /// \param[in] pending event of the last command accessing the block; the
+    ///            block is reused only after the event completes
+    /// \throw std::logic_error in case the block was not allocated by the pool
+    void Recycle( const Block& b, const HEvent& pending = HEvent() );
+    /// Copy from pageable host memory to device memory through pinned blocks.
+    /// Source memory can be modified as soon as the function returns.
+    /// \param[in] cq command queue to operate on
+    /// \param[in] pHostData source
+    /// \param[in] mo target memory object
+    /// \param[in] offset starting point of copy operation in target buffer
+    /// \param[in] size number of bytes to copy: in case the value is zero the
+    ///            buffer is copied from offset to the end
+    /// \param[in] waitList events to wait for
+    /// \return event completing after all the data is copied
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    /// \throw std::logic_error in case the region is outside of the buffer
+    HEvent CopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo,
+                     size_t offset = 0, size_t size = 0,
+                     const EventArray& waitList = EventArray() );
+    /// Copy from device memory to pageable host memory through pinned blocks;
+    /// blocking.
+    /// \param[in] cq command queue to operate on
+    /// \param[in] mo source memory object
+    /// \param[out] pHostData target
+    /// \param[in] offset starting point of copy operation in source buffer
+    /// \param[in] size number of bytes to copy: in case the value is zero the
+    ///            buffer is copied from offset to the end
+    /// \param[in] waitList events to wait for
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    /// \throw std::logic_error in case the region is outside of the buffer
+    void CopyDtoH( cl_command_queue cq, const CLMemObj& mo, void* pHostData,
+                   size_t offset = 0, size_t size = 0,
+                   const EventArray& waitList = EventArray() );
+    /// Release free blocks; blocks still in use or pending are kept.
+    void Trim();
+    /// Returns usage counters.
+    Stats GetStats() const;
+    /// Returns context owning the buffers.
+    cl_context GetContext() const { return ctx_; }
+private:
+    CLStagingPool( const CLStagingPool& );
+    CLStagingPool& operator=( const CLStagingPool& );
+    /// Block and event of the last command accessing it.
+    typedef std::vector< std::pair< Block, HEvent > > Pending;
+    /// size class -> free blocks
+    typedef std::map< size_t, std::vector< Block > > FreeLists;
+    Block AllocateBlock( size_t capacity );
+    void ReleaseBlock( const Block& b );
+    /// Move blocks whose commands have completed to the free lists.
+    void ReclaimCompleted();
+    size_t ChunkSize( size_t size ) const { return chunkSize_ > 0 && chunkSize_ < size ? chunkSize_ : size; }
+private:
+    mutable std::mutex mutex_;
+    cl_context ctx_;
+    cl_command_queue cq_;
+    size_t chunkSize_;
+    FreeLists freeLists_;
+    Pending pending_;
+    std::map< cl_mem, size_t > inUse_;
+    size_t bytesReserved_;
+    unsigned long long acquisitions_;
+    unsigned long long hits_;
+};
+
+///Overloaded operator to print staging pool counters.
+inline std::ostream& operator<<( std::ostream& os, const CLStagingPool::Stats& s )
+{
+    os << "reserved: " << s.bytesReserved << " pending: " << s.blocksPending
+       << " hit rate: " << s.HitRate();
+    return os;
+}
+
+#endif //STAGING_POOL_H_
@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "StreamingExecutor.h"
+#include <algorithm>
+#include <stdexcept>
+#include "OpenCLStatusCodesTable.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Events of the commands issued for each chunk.
+struct ChunkEvents
+{
+    std::vector< HEvent > upload;
+    std::vector< HEvent > kernel;
+    std::vector< HEvent > download;
+    explicit ChunkEvents( size_t n ) : upload( n ), kernel( n ), download( n ) {}
+};
+
+//------------------------------------------------------------------------------
+/// Add time of commands to total and extend [first start, last end] interval.
+double AccumulateTime( const std::vector< HEvent >& events, cl_ulong& first, cl_ulong& last )
+{
+    double t = 0.;
+    for( std::vector< HEvent >::const_iterator i = events.begin(); i != events.end(); ++i )
+    {
+        if( *i == 0 ) continue;
+        const ProfilingInfo pi( *i );
+        t += pi.ExecutionTime();
+        first = std::min( first, pi.StartTime() );
+        last = std::max( last, pi.EndTime() );
+    }
+    return t;
+}
+}
+
+//------------------------------------------------------------------------------
+CLStreamingExecutor::CLStreamingExecutor( const CLExecutionContext& ec,
+                                          size_t inChunkBytes,
+                                          size_t outChunkBytes,
+                                          int numSlots,
+                                          int numQueues ) :
+    ec_( ec ), inChunkBytes_( inChunkBytes ), outChunkBytes_( outChunkBytes )
+{
+    if( ec.context == 0 ) throw std::logic_error( "Uninitialized execution context" );
+    if( inChunkBytes == 0 || outChunkBytes == 0 ) throw std::logic_error( "Chunk size must be greater than zero" );
+    if( numSlots < 2 ) throw std::logic_error( "At least two staging slots required" );
+    if( numQueues < 2 || numQueues > 3 ) throw std::logic_error( "Number of queues must be two or three" );
+    for( int q = 0; q != numQueues; ++q )
+    {
+        queues_.push_back( CreateCommandQueue( ec_, CL_QUEUE_PROFILING_ENABLE ).commandQueue );
+    }
+    for( int s = 0; s != numSlots; ++s )
+    {
+        inBuffers_.push_back( CLMemObj( ec_.context, inChunkBytes_, CL_MEM_READ_ONLY ) );
+        outBuffers_.push_back( CLMemObj( ec_.context, outChunkBytes_, CL_MEM_WRITE_ONLY ) );
+    }
+}
+
+//------------------------------------------------------------------------------
+CLStreamingExecutor::Stats CLStreamingExecutor::Run( const CLKernelHandler& kh,
+                                                     const void* in,
+                                                     size_t inBytes,
+                                                     void* out,
+                                                     size_t outBytes,
+                                                     const ChunkSetup& setup )
+{
+    const size_t numChunks = ( inBytes + inChunkBytes_ - 1 ) / inChunkBytes_;
+    if( numChunks != ( outBytes + outChunkBytes_ - 1 ) / outChunkBytes_ )
+    {
+        throw std::logic_error( "Input and output sizes require a different number of chunks" );
+    }
+    const size_t numSlots = inBuffers_.size();
+    cl_command_queue uploadQueue = queues_[ 0 ];
+    cl_command_queue computeQueue = queues_[ 1 ];
+    cl_command_queue downloadQueue = queues_[ 2 % queues_.size() ];
+    CLKernelHandler handler( kh );
+    handler.SetCommandQueue( computeQueue );
+    ChunkEvents events( numChunks );
+    std::vector< CLStreamChunk > chunks( numChunks );
+    for( size_t i = 0; i != numChunks; ++i )
+    {
+        CLStreamChunk& c = chunks[ i ];
+        c.index = i;
+        c.input = inBuffers_[ i % numSlots ];
+        c.output = outBuffers_[ i % numSlots ];
+        c.inOffset = i * inChunkBytes_;
+        c.inSize = std::min( inChunkBytes_, inBytes - c.inOffset );
+        c.outOffset = i * outChunkBytes_;
+        c.outSize = std::min( outChunkBytes_, outBytes - c.outOffset );
+    }
+    try
+    {
+        cl_int status = CL_SUCCESS;
+        EventArray waitList;
+        // chunk i is uploaded after chunk i - 1 has been handed to the compute
+        // queue: with upload and download on the same queue the download of
+        // chunk i - 1 would otherwise be queued behind the upload of chunk i
+        for( size_t i = 0; i != numChunks + 1; ++i )
+        {
+            if( i < numChunks )
+            {
+                // input slot is free once the kernel of its previous chunk is done
+                const CLStreamChunk& c = chunks[ i ];
+                waitList.clear();
+                if( i >= numSlots ) waitList.push_back( events.kernel[ i - numSlots ] );
+                events.upload[ i ] = CLCopyHtoD( uploadQueue,
+                                                 static_cast< const char* >( in ) + c.inOffset,
+                                                 inBuffers_[ i % numSlots ], waitList,
+                                                 CL_FALSE, 0, c.inSize );
+            }
+            if( i > 0 )
+            {
+                // output slot is free once the download of its previous chunk is done
+                const size_t k = i - 1;
+                const CLStreamChunk& c = chunks[ k ];
+                waitList.clear();
+                waitList.push_back( events.upload[ k ] );
+                if( k >= numSlots ) waitList.push_back( events.download[ k - numSlots ] );
+                setup( handler, c );
+                events.kernel[ k ] = handler.AsyncRun( waitList );
+                waitList.clear();
+                waitList.push_back( events.kernel[ k ] );
+                events.download[ k ] = CLCopyDtoH( downloadQueue, outBuffers_[ k % numSlots ],
+                                                   static_cast< char* >( out ) + c.outOffset,
+                                                   waitList, CL_FALSE, 0, c.outSize );
+            }
+            // submit commands: events waited on by other queues must reach the device
+            for( std::vector< HCommandQueue >::iterator q = queues_.begin(); q != queues_.end(); ++q )
+            {
+                ::clFlush( *q );
+            }
+        }
+        for( std::vector< HCommandQueue >::iterator q = queues_.begin(); q != queues_.end(); ++q )
+        {
+            status = ::clFinish( *q );
+            if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clFinish(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+        }
+    }
+    catch( ... )
+    {
+        // commands already enqueued still reference host memory
+        for( std::vector< HCommandQueue >::iterator q = queues_.begin(); q != queues_.end(); ++q )
+        {
+            ::clFinish( *q );
+        }
+        throw;
+    }
+    Stats s;
+    s.chunks = numChunks;
+    cl_ulong first = ~cl_ulong( 0 );
+    cl_ulong last = 0;
+    s.uploadTime = AccumulateTime( events.upload, first, last );
+    s.kernelTime = AccumulateTime( events.kernel, first, last );
+    s.downloadTime = AccumulateTime( events.download, first, last );
+    s.wallTime = last > first ? ( last - first ) / 1.E6 : 0.;
+    return s;
+}
@@ -0,0 +1,133 @@
+///\file opencl/StreamingExecutor.h Chunked pipeline overlapping transfers and kernel execution
+
+#ifndef STREAMING_EXECUTOR_H_
+#define STREAMING_EXECUTOR_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <vector>
+#include <functional>
+#include <iostream>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Chunk of data processed by one kernel launch.
+struct CLStreamChunk
+{
+    size_t index;     //!< chunk index, starting from zero
+    cl_mem input;     //!< device buffer holding the input chunk
+    cl_mem output;    //!< device buffer receiving the output chunk
+    size_t inOffset;  //!< offset in bytes of chunk in host input
+    size_t inSize;    //!< size in bytes of input chunk
+    size_t outOffset; //!< offset in bytes of chunk in host output
+    size_t outSize;   //!< size in bytes of output chunk
+};
+
+//------------------------------------------------------------------------------
+/// Streams a host array through a kernel chunk by chunk. Each chunk is copied
+/// into one of N device staging slots, processed and copied back; chunks
+/// rotate through the slots and commands are issued on separate upload,
+/// compute and download queues linked by events, so that the upload of chunk
+/// i + 1, the kernel processing chunk i and the download of chunk i - 1 can
+/// execute at the same time.
+/// Transfers overlap with kernel execution only when the host buffers are
+/// in pinned memory, depending on the OpenCL implementation.
+class CLStreamingExecutor
+{
+public:
+    /// Invoked before the kernel for each chunk is enqueued: sets the kernel
+    /// parameters, usually the slot buffers, and work group sizes for the chunk.
+    /// The kernel handler passed to the function is bound to the compute queue.
+    typedef std::function< void ( CLKernelHandler&, const CLStreamChunk& ) > ChunkSetup;
+    /// Timing of a run, computed from the command profiling information.
+    struct Stats
+    {
+        size_t chunks;       //!< number of processed chunks
+        double wallTime;     //!< ms from the start of the first command to the end of the last one
+        double uploadTime;   //!< ms spent in host to device copies
+        double kernelTime;   //!< ms spent in kernel execution
+        double downloadTime; //!< ms spent in device to host copies
+        /// Time of the same commands executed one after the other.
+        double SerialTime() const { return uploadTime + kernelTime + downloadTime; }
+        /// Fraction of serial time hidden by overlapping: zero when all
+        /// commands execute in sequence.
+        double OverlapRatio() const
+        {
+            const double s = SerialTime();
+            return s > 0. && wallTime < s ? 1. - wallTime / s : 0.;
+        }
+    };
+    /// Constructor: creates the command queues with profiling enabled and
+    /// the staging buffers.
+    /// \param[in] ec execution context with valid context and device
+    /// \param[in] inChunkBytes size in bytes of input chunks
+    /// \param[in] outChunkBytes size in bytes of output chunks
+    /// \param[in] numSlots number of staging buffer pairs, at least two
+    /// \param[in] numQueues number of command queues: with two queues upload
+    ///            and download share the same queue
+    /// \throw std::logic_error in case of invalid parameters
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    CLStreamingExecutor( const CLExecutionContext& ec,
+                         size_t inChunkBytes,
+                         size_t outChunkBytes,
+                         int numSlots = 3,
+                         int numQueues = 3 );
+    /// Process \c in into \c out and wait for completion. The number of chunks
+    /// is the number of input chunks, the last chunk can be partial; output
+    /// chunk \c i is copied to offset \c i times the output chunk size.
+    /// \param[in] kh kernel handler, copied and bound to the compute queue
+    /// \param[in] in host input
+    /// \param[in] inBytes size in bytes of input
+    /// \param[out] out host output
+    /// \param[in] outBytes size in bytes of output
+    /// \param[in] setup function invoked to set per-chunk kernel parameters
+    /// \return timing of the run
+    /// \throw std::logic_error in case input and output sizes require a
+    ///        different number of chunks
+    /// \throw std::runtime_error in case of errors while invoking OpenCL functions
+    Stats Run( const CLKernelHandler& kh,
+               const void* in,
+               size_t inBytes,
+               void* out,
+               size_t outBytes,
+               const ChunkSetup& setup );
+    int GetNumSlots() const { return int( inBuffers_.size() ); }
+    int GetNumQueues() const { return int( queues_.size() ); }
+    size_t GetInputChunkSize() const { return inChunkBytes_; }
+    size_t GetOutputChunkSize() const { return outChunkBytes_; }
+private:
+    CLExecutionContext ec_;
+    size_t inChunkBytes_;
+    size_t outChunkBytes_;
+    std::vector< HCommandQueue > queues_;
+    std::vector< CLMemObj > inBuffers_;
+    std::vector< CLMemObj > outBuffers_;
+};
+
+///Overloaded operator to print streaming timings.
+inline std::ostream& operator<<( std::ostream& os, const CLStreamingExecutor::Stats& s )
+{
+    os << "chunks: " << s.chunks << " wall (ms): " << s.wallTime
+       << " serial (ms): " << s.SerialTime() << " [upload: " << s.uploadTime
+       << " kernel: " << s.kernelTime << " download: " << s.downloadTime
+       << "] overlap: " << s.OverlapRatio();
+    return os;
+}
+
+#endif //STREAMING_EXECUTOR_H_
@@ -0,0 +1,327 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include "Tracer.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <limits>
+#include <cstdlib>
+#include <stdexcept>
+#include "../utility/Json.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Initial state of the tracer, read from the environment.
+bool TraceEnvironment()
+{
+    const char* e = getenv( "GPUPP_TRACE" );
+    return e != 0 && *e != 0 && std::string( e ) != "0";
+}
+
+//------------------------------------------------------------------------------
+/// Write nanosecond interval as microseconds.
+void WriteMicroseconds( std::ostream& os, long long ns )
+{
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision( 3 ) << ns / 1000.;
+    os.flags( flags );
+    os.precision( precision );
+}
+
+//------------------------------------------------------------------------------
+/// Write complete event ("X" phase) without closing brace.
+void WriteCompleteEvent( std::ostream& os, const std::string& name, const char* category,
+                         int pid, size_t tid, long long ts, long long dur )
+{
+    os << ",\n{\"name\":";
+    WriteJSONString( os, name );
+    os << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":" << pid
+       << ",\"tid\":" << tid << ",\"ts\":";
+    WriteMicroseconds( os, ts );
+    os << ",\"dur\":";
+    WriteMicroseconds( os, dur );
+}
+
+//------------------------------------------------------------------------------
+/// Write track name metadata event.
+void WriteTrackName( std::ostream& os, int pid, size_t tid, const std::string& name )
+{
+    os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid
+       << ",\"args\":{\"name\":";
+    WriteJSONString( os, name );
+    os << "}}";
+}
+
+//------------------------------------------------------------------------------
+/// Returns entry with no device times.
+CLTracer::Entry MakeEntry( CLTracer::Kind kind, const std::string& name, cl_command_queue cq,
+                           unsigned long long hostBegin, unsigned long long hostEnd, size_t bytes )
+{
+    CLTracer::Entry entry;
+    entry.kind = kind;
+    entry.name = name;
+    entry.queue = cq;
+    entry.thread = 0;
+    entry.bytes = bytes;
+    entry.hostBegin = hostBegin;
+    entry.hostEnd = hostEnd;
+    entry.hasDeviceTimes = false;
+    entry.queued = entry.submitted = entry.started = entry.ended = 0;
+    return entry;
+}
+
+/// Chrome trace process ids of host threads and command queues.
+const int HOST_PID = 1;
+const int DEVICE_PID = 2;
+}
+
+std::atomic< bool > CLTracer::enabled_( TraceEnvironment() );
+
+//------------------------------------------------------------------------------
+CLTracer::CLTracer() {}
+
+//------------------------------------------------------------------------------
+CLTracer& CLTracer::Instance()
+{
+    // never destroyed: commands can be recorded while other static objects
+    // are destroyed at exit
+    static CLTracer* i = new CLTracer;
+    return *i;
+}
+
+//------------------------------------------------------------------------------
+unsigned long long CLTracer::Now()
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(
+               std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//------------------------------------------------------------------------------
+const char* CLTracer::KindName( Kind kind )
+{
+    switch( kind )
+    {
+    case KERNEL:    return "kernel";
+    case COPY_HTOD: return "copy HtoD";
+    case COPY_DTOH: return "copy DtoH";
+    case MAP:       return "map";
+    case UNMAP:     return "unmap";
+    case BUILD:     return "build";
+    }
+    return "unknown";
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::Add( Entry& entry, cl_event e )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    const std::thread::id id = std::this_thread::get_id();
+    std::map< std::thread::id, size_t >::const_iterator t = threads_.find( id );
+    if( t == threads_.end() ) t = threads_.insert( std::make_pair( id, threads_.size() ) ).first;
+    entry.thread = t->second;
+    AddQueue( entry.queue );
+    entries_.push_back( entry );
+    events_.push_back( e );
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::AddQueue( cl_command_queue cq )
+{
+    if( cq == 0 ) return;
+    for( size_t i = 0; i != queues_.size(); ++i )
+    {
+        if( queues_[ i ].first == cq ) return;
+    }
+    // the queue might have been released when the trace is written: name
+    // the track now
+    std::ostringstream name;
+    name << "queue " << queues_.size();
+    cl_device_id device = 0;
+    char deviceName[ 256 ] = "";
+    if( ::clGetCommandQueueInfo( cq, CL_QUEUE_DEVICE, sizeof( device ), &device, 0 ) == CL_SUCCESS
+        && ::clGetDeviceInfo( device, CL_DEVICE_NAME, sizeof( deviceName ) - 1, deviceName, 0 ) == CL_SUCCESS )
+    {
+        name << " (" << deviceName << ')';
+    }
+    queues_.push_back( std::make_pair( cq, name.str() ) );
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::Record( Kind kind, const std::string& name, cl_command_queue cq, cl_event e,
+                       unsigned long long hostBegin, unsigned long long hostEnd, size_t bytes )
+{
+    Entry entry = MakeEntry( kind, name, cq, hostBegin, hostEnd, bytes );
+    if( e != 0 && ::clRetainEvent( e ) != CL_SUCCESS ) e = 0;
+    Add( entry, e );
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::RecordLaunch( cl_command_queue cq, cl_kernel k, const std::vector< size_t >& gwgs,
+                             cl_event e, unsigned long long hostBegin, unsigned long long hostEnd )
+{
+    char name[ 256 ] = "kernel";
+    ::clGetKernelInfo( k, CL_KERNEL_FUNCTION_NAME, sizeof( name ) - 1, name, 0 );
+    Entry entry = MakeEntry( KERNEL, name, cq, hostBegin, hostEnd, 0 );
+    std::ostringstream ndrange;
+    for( size_t i = 0; i != gwgs.size(); ++i ) ndrange << ( i ? "x" : "" ) << gwgs[ i ];
+    entry.detail = ndrange.str();
+    if( e != 0 && ::clRetainEvent( e ) != CL_SUCCESS ) e = 0;
+    Add( entry, e );
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::RecordHost( Kind kind, const std::string& name,
+                           unsigned long long hostBegin, unsigned long long hostEnd )
+{
+    Record( kind, name, 0, 0, hostBegin, hostEnd );
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::ResolveLocked()
+{
+    for( size_t i = 0; i != events_.size(); ++i )
+    {
+        cl_event e = events_[ i ];
+        if( e == 0 ) continue;
+        Entry& entry = entries_[ i ];
+        entry.hasDeviceTimes =
+            ::clWaitForEvents( 1, &e ) == CL_SUCCESS
+            && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_QUEUED, sizeof( cl_ulong ), &entry.queued, 0 ) == CL_SUCCESS
+            && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_SUBMIT, sizeof( cl_ulong ), &entry.submitted, 0 ) == CL_SUCCESS
+            && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_START, sizeof( cl_ulong ), &entry.started, 0 ) == CL_SUCCESS
+            && ::clGetEventProfilingInfo( e, CL_PROFILING_COMMAND_END, sizeof( cl_ulong ), &entry.ended, 0 ) == CL_SUCCESS;
+        ::clReleaseEvent( e );
+        events_[ i ] = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::Resolve()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ResolveLocked();
+}
+
+//------------------------------------------------------------------------------
+CLTracer::Entries CLTracer::GetEntries()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ResolveLocked();
+    return entries_;
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::WriteChromeTrace( std::ostream& os )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    ResolveLocked();
+    unsigned long long base = std::numeric_limits< unsigned long long >::max();
+    for( Entries::const_iterator i = entries_.begin(); i != entries_.end(); ++i )
+    {
+        if( i->hostBegin < base ) base = i->hostBegin;
+    }
+    // device counters are mapped to host time with one offset per queue:
+    // a command is queued while the host is inside the enqueue call, the
+    // smallest offset consistent with all the commands of the queue is used
+    std::vector< long long > offsets( queues_.size(), std::numeric_limits< long long >::min() );
+    std::map< cl_command_queue, size_t > queueIndex;
+    for( size_t q = 0; q != queues_.size(); ++q ) queueIndex[ queues_[ q ].first ] = q;
+    for( Entries::const_iterator i = entries_.begin(); i != entries_.end(); ++i )
+    {
+        if( !i->hasDeviceTimes ) continue;
+        long long& offset = offsets[ queueIndex[ i->queue ] ];
+        const long long o = ( long long )( i->hostBegin - base ) - ( long long )( i->queued );
+        if( o > offset ) offset = o;
+    }
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << HOST_PID << ",\"args\":{\"name\":\"host\"}},\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << DEVICE_PID << ",\"args\":{\"name\":\"command queues\"}}";
+    for( size_t t = 0; t != threads_.size(); ++t )
+    {
+        std::ostringstream name;
+        name << "thread " << t;
+        WriteTrackName( os, HOST_PID, t, name.str() );
+    }
+    for( size_t q = 0; q != queues_.size(); ++q ) WriteTrackName( os, DEVICE_PID, q, queues_[ q ].second );
+    for( Entries::const_iterator i = entries_.begin(); i != entries_.end(); ++i )
+    {
+        const char* category = KindName( i->kind );
+        WriteCompleteEvent( os, i->name, category, HOST_PID, i->thread,
+                            i->hostBegin - base, i->hostEnd - i->hostBegin );
+        os << ",\"args\":{";
+        if( !i->detail.empty() )
+        {
+            os << "\"ndrange\":";
+            WriteJSONString( os, i->detail );
+        }
+        if( i->bytes > 0 ) os << ( i->detail.empty() ? "" : "," ) << "\"bytes\":" << i->bytes;
+        os << "}}";
+        if( !i->hasDeviceTimes ) continue;
+        const long long offset = offsets[ queueIndex[ i->queue ] ];
+        WriteCompleteEvent( os, i->name, category, DEVICE_PID, queueIndex[ i->queue ],
+                            ( long long )( i->started ) + offset, ( long long )( i->ended - i->started ) );
+        os << ",\"args\":{\"queued to submit (us)\":";
+        WriteMicroseconds( os, ( long long )( i->submitted - i->queued ) );
+        os << ",\"submit to start (us)\":";
+        WriteMicroseconds( os, ( long long )( i->started - i->submitted ) );
+        if( !i->detail.empty() )
+        {
+            os << ",\"ndrange\":";
+            WriteJSONString( os, i->detail );
+        }
+        if( i->bytes > 0 ) os << ",\"bytes\":" << i->bytes;
+        os << "}}";
+    }
+    os << "\n]}\n";
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::WriteChromeTrace( const std::string& fileName )
+{
+    std::ofstream os( fileName.c_str() );
+    if( !os ) throw std::runtime_error( "Cannot open file: " + fileName );
+    WriteChromeTrace( os );
+    if( !os ) throw std::runtime_error( "Cannot write file: " + fileName );
+}
+
+//------------------------------------------------------------------------------
+void CLTracer::Clear()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    for( std::vector< cl_event >::iterator e = events_.begin(); e != events_.end(); ++e )
+    {
+        if( *e != 0 ) ::clReleaseEvent( *e );
+    }
+    events_.clear();
+    entries_.clear();
+    threads_.clear();
+    queues_.clear();
+}
+
+//------------------------------------------------------------------------------
+size_t CLTracer::Size() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return entries_.size();
+}
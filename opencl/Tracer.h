@@ -0,0 +1,162 @@
+///\file opencl/Tracer.h Timeline tracing of command queues with Chrome trace export
+
+#ifndef TRACER_H_
+#define TRACER_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <CL/cl.h>
+
+//------------------------------------------------------------------------------
+/// Process-wide recorder of the commands enqueued through gpupp: kernel
+/// launches, copies, map/unmap operations and program builds. For each
+/// command the host time spent in the enqueue call is recorded together with
+/// the thread that issued it; the event of the command is retained and its
+/// \c CL_PROFILING_COMMAND_QUEUED/SUBMIT/START/END values are read in bulk by
+/// Resolve(), after the commands complete, so that no profiling query is
+/// issued while the application is running. Device timestamps are available
+/// only for queues created with \c CL_QUEUE_PROFILING_ENABLE; commands of
+/// other queues appear on the host tracks only.
+///
+/// WriteChromeTrace() writes the timeline in the Chrome trace event format,
+/// readable by \c chrome://tracing and Perfetto, with one track per host
+/// thread and one track per command queue:
+///\code
+///  CLTracer::Instance().SetEnabled( true );
+///  ... // launches and copies
+///  CLTracer::Instance().WriteChromeTrace( "trace.json" );
+///\endcode
+/// Tracing is disabled by default and is enabled either by calling
+/// SetEnabled() or by setting the \c GPUPP_TRACE environment variable; when
+/// disabled the cost of each enqueue is a single relaxed atomic load.
+/// All methods are thread safe.
+class CLTracer
+{
+public:
+    /// Type of recorded operation.
+    enum Kind { KERNEL, COPY_HTOD, COPY_DTOH, MAP, UNMAP, BUILD };
+    /// Recorded operation; times are in nanoseconds, host times are read
+    /// from a monotonic clock, device times are the raw profiling counters.
+    struct Entry
+    {
+        Kind kind;
+        std::string name;         //!< kernel function name or operation
+        std::string detail;       //!< NDRange of kernels, empty for other operations
+        cl_command_queue queue;   //!< null for host-only operations
+        size_t thread;            //!< host thread index, in order of first use
+        size_t bytes;             //!< bytes transferred by copies
+        unsigned long long hostBegin;
+        unsigned long long hostEnd;
+        bool hasDeviceTimes;      //!< profiling counters available
+        cl_ulong queued;
+        cl_ulong submitted;
+        cl_ulong started;
+        cl_ulong ended;
+    };
+    typedef std::vector< Entry > Entries;
+    /// Returns global instance.
+    static CLTracer& Instance();
+    /// Returns \c true if operations are being recorded.
+    static bool Enabled() { return enabled_.load( std::memory_order_relaxed ); }
+    /// Start or stop recording; recorded entries are kept.
+    void SetEnabled( bool on ) { enabled_ = on; }
+    /// Returns host time stamp in nanoseconds from a monotonic clock.
+    static unsigned long long Now();
+    /// Record command associated with an event; the event is retained until
+    /// its profiling information is resolved.
+    void Record( Kind kind, const std::string& name, cl_command_queue cq, cl_event e,
+                 unsigned long long hostBegin, unsigned long long hostEnd,
+                 size_t bytes = 0 );
+    /// Record kernel launch; the kernel function name is read from the kernel.
+    void RecordLaunch( cl_command_queue cq, cl_kernel k, const std::vector< size_t >& gwgs,
+                       cl_event e, unsigned long long hostBegin, unsigned long long hostEnd );
+    /// Record host-only operation, e.g. a program build.
+    void RecordHost( Kind kind, const std::string& name,
+                     unsigned long long hostBegin, unsigned long long hostEnd );
+    /// Wait for completion of recorded commands, read their profiling
+    /// information and release their events.
+    void Resolve();
+    /// Returns copy of recorded entries, resolving them first.
+    Entries GetEntries();
+    /// Write resolved entries in Chrome trace event JSON format.
+    void WriteChromeTrace( std::ostream& os );
+    /// Write Chrome trace JSON file.
+    /// \throw std::runtime_error if the file cannot be written
+    void WriteChromeTrace( const std::string& fileName );
+    /// Remove all entries, releasing unresolved events.
+    void Clear();
+    /// Returns number of recorded entries.
+    size_t Size() const;
+    /// Returns printable name of kind.
+    static const char* KindName( Kind kind );
+private:
+    CLTracer();
+    CLTracer( const CLTracer& );
+    CLTracer& operator=( const CLTracer& );
+    /// Add entry with host thread index set; \c events_ is kept parallel
+    /// to \c entries_, null for resolved entries.
+    void Add( Entry& entry, cl_event e );
+    /// Name the track of queue on first use.
+    void AddQueue( cl_command_queue cq );
+    /// Resolve() with \c mutex_ held.
+    void ResolveLocked();
+private:
+    mutable std::mutex mutex_;
+    Entries entries_;
+    std::vector< cl_event > events_;
+    std::map< std::thread::id, size_t > threads_;
+    /// Queue -> track name, in order of first use.
+    std::vector< std::pair< cl_command_queue, std::string > > queues_;
+    static std::atomic< bool > enabled_;
+};
+
+//------------------------------------------------------------------------------
+/// Records the host time spent in a scope as a host-only tracer entry when
+/// tracing is enabled.
+class CLTraceScope
+{
+public:
+    CLTraceScope( CLTracer::Kind kind, const char* name ) :
+        kind_( kind ), name_( name ), begin_( CLTracer::Enabled() ? CLTracer::Now() : 0 ) {}
+    ~CLTraceScope()
+    {
+        if( begin_ == 0 ) return;
+        try
+        {
+            CLTracer::Instance().RecordHost( kind_, name_, begin_, CLTracer::Now() );
+        }
+        catch( ... ) {} // an entry lost from the trace must not abort the program
+    }
+private:
+    CLTraceScope( const CLTraceScope& );
+    CLTraceScope& operator=( const CLTraceScope& );
+    CLTracer::Kind kind_;
+    const char* name_;
+    unsigned long long begin_;
+};
+
+#endif //TRACER_H_
@@ -0,0 +1,433 @@
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include "TuningDatabase.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "OpenCLStatusCodesTable.h"
+
+namespace {
+//------------------------------------------------------------------------------
+/// Returns device information as a string.
+std::string DeviceString( cl_device_id device, cl_device_info param )
+{
+    size_t size = 0;
+    cl_int status = ::clGetDeviceInfo( device, param, 0, 0, &size );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    std::vector< char > buf( size + 1, char() );
+    status = ::clGetDeviceInfo( device, param, size, &buf[ 0 ], 0 );
+    if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetDeviceInfo(): " + OpenCLStatusCodesTable::Instance()[ status ] );
+    return &buf[ 0 ];
+}
+
+//------------------------------------------------------------------------------
+/// Format sizes as e.g. 1024x1024; empty sizes as '-'.
+std::string FormatSizes( const SizeArray& s )
+{
+    if( s.empty() ) return "-";
+    std::ostringstream os;
+    for( SizeArray::const_iterator i = s.begin(); i != s.end(); ++i )
+    {
+        if( i != s.begin() ) os << 'x';
+        os << *i;
+    }
+    return os.str();
+}
+
+//------------------------------------------------------------------------------
+/// Parse sizes written by FormatSizes.
+bool ParseSizes( const std::string& str, SizeArray& s )
+{
+    s.clear();
+    if( str == "-" ) return true;
+    std::istringstream is( str );
+    size_t v = 0;
+    while( is >> v )
+    {
+        s.push_back( v );
+        if( is.peek() == 'x' ) is.get();
+        else break;
+    }
+    return !s.empty() && is.eof();
+}
+
+//------------------------------------------------------------------------------
+/// Tabs and new lines are field and record separators.
+std::string Sanitize( std::string s )
+{
+    for( std::string::iterator c = s.begin(); c != s.end(); ++c )
+    {
+        if( *c == '\t' || *c == '\n' || *c == '\r' ) *c = ' ';
+    }
+    return s;
+}
+
+//------------------------------------------------------------------------------
+/// Split line at tabs.
+std::vector< std::string > SplitFields( const std::string& line )
+{
+    std::vector< std::string > fields;
+    std::string::size_type b = 0;
+    for( std::string::size_type e = line.find( '\t' ); e != std::string::npos; e = line.find( '\t', b ) )
+    {
+        fields.push_back( line.substr( b, e - b ) );
+        b = e + 1;
+    }
+    fields.push_back( line.substr( b ) );
+    return fields;
+}
+
+//------------------------------------------------------------------------------
+/// Atomically replace \c to with \c from.
+bool ReplaceFile( const std::string& from, const std::string& to )
+{
+#ifdef _WIN32
+    return ::MoveFileExA( from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+    return ::rename( from.c_str(), to.c_str() ) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+int ProcessId()
+{
+#ifdef _WIN32
+    return ::_getpid();
+#else
+    return ::getpid();
+#endif
+}
+}
+
+//------------------------------------------------------------------------------
+bool TuningDatabase::Key::operator<( const Key& k ) const
+{
+    if( device != k.device ) return device < k.device;
+    if( kernel != k.kernel ) return kernel < k.kernel;
+    if( gwgs != k.gwgs ) return gwgs < k.gwgs;
+    return buildOptions < k.buildOptions;
+}
+
+//------------------------------------------------------------------------------
+bool TuningDatabase::LaunchKey::operator<( const LaunchKey& k ) const
+{
+    if( kernel != k.kernel ) return kernel < k.kernel;
+    if( device != k.device ) return device < k.device;
+    return gwgs < k.gwgs;
+}
+
+//------------------------------------------------------------------------------
+TuningDatabase::TuningDatabase() : generation_( 0 ), enabled_( false )
+{
+    const char* p = getenv( "GPUPP_TUNING_DB" );
+    if( p != 0 && *p != 0 )
+    {
+        try
+        {
+            SetPath( p );
+        }
+        catch( const std::exception& e )
+        {
+            // keep the file untouched: Save() must not overwrite it with the
+            // records parsed before the error
+            std::cerr << e.what() << " - tuning database disabled" << std::endl;
+            std::lock_guard< std::mutex > lock( mutex_ );
+            path_.clear();
+            records_.clear();
+            enabled_ = false;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+TuningDatabase& TuningDatabase::Instance()
+{
+    // never destroyed: kernels held by other static objects invalidate their
+    // cached local sizes when released at exit
+    static TuningDatabase* i = new TuningDatabase;
+    return *i;
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::SetPath( const std::string& path )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    path_ = path;
+    if( !path_.empty() )
+    {
+        resolved_.clear();
+        ++generation_;
+        Load();
+        enabled_ = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::SetEnabled( bool on )
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    // kernels released while disabled did not invalidate their sizes
+    if( on && !enabled_ )
+    {
+        resolved_.clear();
+        ++generation_;
+    }
+    enabled_ = on;
+}
+
+//------------------------------------------------------------------------------
+std::string TuningDatabase::GetPath() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return path_;
+}
+
+//------------------------------------------------------------------------------
+std::string TuningDatabase::DeviceKey( cl_device_id device )
+{
+    return Sanitize( DeviceString( device, CL_DEVICE_VENDOR ) + ' '
+                     + DeviceString( device, CL_DEVICE_NAME ) + ' '
+                     + DeviceString( device, CL_DRIVER_VERSION ) );
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::Load()
+{
+    std::ifstream is( path_.c_str() );
+    if( !is ) return;
+    std::string line;
+    int lineNum = 0;
+    while( std::getline( is, line ) )
+    {
+        ++lineNum;
+        if( !line.empty() && line[ line.size() - 1 ] == '\r' ) line.erase( line.size() - 1 );
+        if( line.empty() || line[ 0 ] == '#' ) continue;
+        const std::vector< std::string > f = SplitFields( line );
+        Key k;
+        Record r;
+        if( f.size() != 6 || !ParseSizes( f[ 2 ], k.gwgs ) || !ParseSizes( f[ 4 ], r.lwgs ) )
+        {
+            std::ostringstream os;
+            os << "Invalid tuning database record at " << path_ << ':' << lineNum;
+            throw std::runtime_error( os.str() );
+        }
+        k.device = f[ 0 ];
+        k.kernel = f[ 1 ];
+        k.buildOptions = f[ 3 ];
+        r.time = atof( f[ 5 ].c_str() );
+        records_[ k ] = r;
+    }
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::Save() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    if( path_.empty() ) return;
+    // unique temporary name: processes sharing the database never write to
+    // the same file and readers never see a partially written one
+    std::ostringstream tmpName;
+    tmpName << path_ << '.' << ProcessId() << ".tmp";
+    const std::string tmp = tmpName.str();
+    {
+        std::ofstream os( tmp.c_str() );
+        os << "# device\tkernel\tglobal size\tbuild options\tlocal size\ttime (ms)\n";
+        for( Records::const_iterator i = records_.begin(); i != records_.end(); ++i )
+        {
+            os << i->first.device << '\t' << i->first.kernel << '\t'
+               << FormatSizes( i->first.gwgs ) << '\t' << i->first.buildOptions << '\t'
+               << FormatSizes( i->second.lwgs ) << '\t' << i->second.time << '\n';
+        }
+        if( !os ) throw std::runtime_error( "Cannot write tuning database " + tmp );
+    }
+    if( !ReplaceFile( tmp, path_ ) )
+    {
+        std::remove( tmp.c_str() );
+        throw std::runtime_error( "Cannot write tuning database " + path_ );
+    }
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::Store( const std::string& deviceKey,
+                            const std::string& kernelName,
+                            const SizeArray& gwgs,
+                            const std::string& buildOptions,
+                            const Record& r )
+{
+    Key k;
+    k.device = Sanitize( deviceKey );
+    k.kernel = Sanitize( kernelName );
+    k.gwgs = gwgs;
+    k.buildOptions = Sanitize( buildOptions );
+    std::lock_guard< std::mutex > lock( mutex_ );
+    records_[ k ] = r;
+    resolved_.clear();
+    ++generation_;
+}
+
+//------------------------------------------------------------------------------
+bool TuningDatabase::Lookup( const std::string& deviceKey,
+                             const std::string& kernelName,
+                             const SizeArray& gwgs,
+                             const std::string& buildOptions,
+                             Record& r ) const
+{
+    Key k;
+    k.device = Sanitize( deviceKey );
+    k.kernel = Sanitize( kernelName );
+    k.gwgs = gwgs;
+    k.buildOptions = Sanitize( buildOptions );
+    std::lock_guard< std::mutex > lock( mutex_ );
+    Records::const_iterator i = records_.find( k );
+    if( i == records_.end() ) return false;
+    r = i->second;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool TuningDatabase::Best( const std::string& deviceKey,
+                           const std::string& kernelName,
+                           const SizeArray& gwgs,
+                           std::string& buildOptions,
+                           Record& r ) const
+{
+    Key k;
+    k.device = Sanitize( deviceKey );
+    k.kernel = Sanitize( kernelName );
+    k.gwgs = gwgs;
+    std::lock_guard< std::mutex > lock( mutex_ );
+    bool found = false;
+    // records with the same device, kernel and size are contiguous, sorted
+    // by build options starting from the empty string
+    for( Records::const_iterator i = records_.lower_bound( k );
+         i != records_.end() && i->first.device == k.device
+         && i->first.kernel == k.kernel && i->first.gwgs == k.gwgs; ++i )
+    {
+        if( !found || i->second.time < r.time )
+        {
+            buildOptions = i->first.buildOptions;
+            r = i->second;
+            found = true;
+        }
+    }
+    return found;
+}
+
+//------------------------------------------------------------------------------
+bool TuningDatabase::LookupLocalSize( cl_command_queue cq,
+                                      cl_kernel k,
+                                      const SizeArray& gwgs,
+                                      SizeArray& lwgs )
+{
+    cl_device_id device = 0;
+    if( ::clGetCommandQueueInfo( cq, CL_QUEUE_DEVICE, sizeof( device ), &device, 0 ) != CL_SUCCESS ) return false;
+    LaunchKey launch;
+    launch.kernel = k;
+    launch.device = device;
+    launch.gwgs = gwgs;
+    unsigned long generation = 0;
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        generation = generation_;
+        ResolvedSizes::const_iterator i = resolved_.find( launch );
+        if( i != resolved_.end() )
+        {
+            if( i->second.found ) lwgs = i->second.lwgs;
+            return i->second.found;
+        }
+    }
+    char name[ 256 ] = { 0 };
+    if( ::clGetKernelInfo( k, CL_KERNEL_FUNCTION_NAME, sizeof( name ) - 1, name, 0 ) != CL_SUCCESS ) return false;
+    cl_program program = 0;
+    if( ::clGetKernelInfo( k, CL_KERNEL_PROGRAM, sizeof( program ), &program, 0 ) != CL_SUCCESS ) return false;
+    size_t optionsSize = 0;
+    if( ::clGetProgramBuildInfo( program, device, CL_PROGRAM_BUILD_OPTIONS, 0, 0, &optionsSize ) != CL_SUCCESS ) return false;
+    std::vector< char > options( optionsSize + 1, char() );
+    if( optionsSize > 0 &&
+        ::clGetProgramBuildInfo( program, device, CL_PROGRAM_BUILD_OPTIONS, optionsSize, &options[ 0 ], 0 ) != CL_SUCCESS ) return false;
+    std::string deviceKey;
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        std::map< cl_device_id, std::string >::const_iterator i = deviceKeys_.find( device );
+        if( i != deviceKeys_.end() ) deviceKey = i->second;
+    }
+    if( deviceKey.empty() )
+    {
+        try
+        {
+            deviceKey = DeviceKey( device );
+        }
+        catch( const std::runtime_error& )
+        {
+            return false;
+        }
+        std::lock_guard< std::mutex > lock( mutex_ );
+        deviceKeys_[ device ] = deviceKey;
+    }
+    Record r;
+    Resolved resolved;
+    resolved.found = Lookup( deviceKey, name, gwgs, &options[ 0 ], r );
+    resolved.lwgs = r.lwgs;
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        if( enabled_ && generation == generation_ ) resolved_[ launch ] = resolved;
+    }
+    if( resolved.found ) lwgs = resolved.lwgs;
+    return resolved.found;
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::Invalidate( cl_kernel k )
+{
+    // entries left from before disabling the database are dropped by
+    // SetEnabled() when it is enabled again
+    if( !enabled_ ) return;
+    std::lock_guard< std::mutex > lock( mutex_ );
+    LaunchKey first;
+    first.kernel = k;
+    first.device = 0;
+    ResolvedSizes::iterator i = resolved_.lower_bound( first );
+    while( i != resolved_.end() && i->first.kernel == k ) resolved_.erase( i++ );
+}
+
+//------------------------------------------------------------------------------
+void TuningDatabase::Clear()
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    records_.clear();
+    resolved_.clear();
+    ++generation_;
+}
+
+//------------------------------------------------------------------------------
+size_t TuningDatabase::Size() const
+{
+    std::lock_guard< std::mutex > lock( mutex_ );
+    return records_.size();
+}
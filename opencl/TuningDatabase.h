@@ -0,0 +1,161 @@
+///\file opencl/TuningDatabase.h Persistent database of tuned kernel launch configurations
+
+#ifndef TUNING_DATABASE_H_
+#define TUNING_DATABASE_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include "gpupp.h"
+
+//------------------------------------------------------------------------------
+/// Best local work group size found by the Autotuner for a kernel, keyed by
+/// device, kernel name, global work group size and program build options.
+/// The database is a text file with one tab separated record per line:
+///\code
+/// device  kernel  global size  build options  local size  time (ms)
+///\endcode
+/// Sizes are written as \c 1024x1024, an empty local size as \c -.
+///
+/// When enabled, launches through EnqueueKernelAsync(), and therefore Launch()
+/// and InvokeKernelAsync(), CLKernelHandler and CLGraph with an empty local
+/// work group size use the local size stored for the kernel. The size found
+/// for a kernel, device and global size is cached, so that only the first
+/// launch queries kernel name and build options from the run-time; later
+/// launches cost one \c clGetCommandQueueInfo call. The cache is cleared
+/// when records change and per kernel by ReleaseKernel(), since the run-time
+/// can reuse the handle of a released kernel; while the database is disabled
+/// nothing is cached and ReleaseKernel() does not access it.
+/// The database is enabled by setting a file path, through
+/// SetPath() or the \c GPUPP_TUNING_DB environment variable, or by calling
+/// SetEnabled() to use it in memory only.
+class TuningDatabase
+{
+public:
+    /// Tuned configuration.
+    struct Record
+    {
+        SizeArray lwgs; //!< local work group size, empty for run-time default
+        double time;    //!< kernel execution time in milliseconds
+        Record() : time( 0. ) {}
+    };
+    /// Returns global instance, initialized from the \c GPUPP_TUNING_DB
+    /// environment variable.
+    static TuningDatabase& Instance();
+    /// Set database file and load its records, if the file exists; an empty
+    /// path keeps records in memory only.
+    /// \throw std::runtime_error in case the file cannot be parsed
+    void SetPath( const std::string& path );
+    /// Returns database file path.
+    std::string GetPath() const;
+    /// Enable or disable lookup from launch functions.
+    void SetEnabled( bool on );
+    /// Returns \c true if launch functions look up local sizes.
+    bool Enabled() const { return enabled_; }
+    /// Returns string identifying device and driver.
+    /// \throw std::runtime_error in case device info cannot be retrieved
+    static std::string DeviceKey( cl_device_id device );
+    /// Add or replace record.
+    void Store( const std::string& deviceKey,
+                const std::string& kernelName,
+                const SizeArray& gwgs,
+                const std::string& buildOptions,
+                const Record& r );
+    /// Find record.
+    /// \return \c true if found
+    bool Lookup( const std::string& deviceKey,
+                 const std::string& kernelName,
+                 const SizeArray& gwgs,
+                 const std::string& buildOptions,
+                 Record& r ) const;
+    /// Find fastest record among all build options.
+    /// \param[out] buildOptions build options of fastest record
+    /// \return \c true if found
+    bool Best( const std::string& deviceKey,
+               const std::string& kernelName,
+               const SizeArray& gwgs,
+               std::string& buildOptions,
+               Record& r ) const;
+    /// Find local size for kernel enqueued into queue; device, kernel name and
+    /// build options are retrieved from the run-time on the first lookup for
+    /// kernel, device and global size, then cached.
+    /// \return \c true if found
+    bool LookupLocalSize( cl_command_queue cq,
+                          cl_kernel k,
+                          const SizeArray& gwgs,
+                          SizeArray& lwgs );
+    /// Forget cached local sizes of kernel; must be called before releasing
+    /// the kernel.
+    void Invalidate( cl_kernel k );
+    /// Write records to the database file, if set.
+    /// \throw std::runtime_error in case the file cannot be written
+    void Save() const;
+    /// Remove all records.
+    void Clear();
+    /// Returns number of records.
+    size_t Size() const;
+private:
+    TuningDatabase();
+    TuningDatabase( const TuningDatabase& );
+    TuningDatabase& operator=( const TuningDatabase& );
+    /// Lookup key.
+    struct Key
+    {
+        std::string device;
+        std::string kernel;
+        SizeArray gwgs;
+        std::string buildOptions;
+        bool operator<( const Key& k ) const;
+    };
+    typedef std::map< Key, Record > Records;
+    /// Key of local sizes cached by LookupLocalSize().
+    struct LaunchKey
+    {
+        cl_kernel kernel;
+        cl_device_id device;
+        SizeArray gwgs;
+        bool operator<( const LaunchKey& k ) const;
+    };
+    /// Cached lookup result.
+    struct Resolved
+    {
+        bool found;
+        SizeArray lwgs;
+        Resolved() : found( false ) {}
+    };
+    typedef std::map< LaunchKey, Resolved > ResolvedSizes;
+    void Load();
+private:
+    mutable std::mutex mutex_;
+    std::string path_;
+    Records records_;
+    /// device keys of devices seen by LookupLocalSize()
+    std::map< cl_device_id, std::string > deviceKeys_;
+    /// local sizes found by LookupLocalSize(), including failed lookups
+    ResolvedSizes resolved_;
+    /// incremented when records change, so that results of lookups
+    /// running concurrently are not cached
+    unsigned long generation_;
+    std::atomic< bool > enabled_;
+};
+
+#endif //TUNING_DATABASE_H_
@@ -18,6 +18,10 @@
 // 
 
 #include "gpupp.h"
+#include "ProgramBinaryCache.h"
+#include "ProgramRegistry.h"
+#include "KernelArgCache.h"
+#include "TuningDatabase.h"
 #include <fstream>
 #include <sstream>
 #include "OpenCLDeviceInfoTable.h"
@@ -25,12 +29,21 @@
 
 const OpenCLStatusCodesTable& clERRORS = OpenCLStatusCodesTable::Instance();
 
-namespace {
+//------------------------------------------------------------------------------
+cl_int CL_API_CALL ReleaseKernel( cl_kernel k )
+{
+    KernelArgCache::Instance().Invalidate( k );
+    TuningDatabase::Instance().Invalidate( k );
+    return ::clReleaseKernel( k );
+}
+
+//------------------------------------------------------------------------------
+void InvalidateKernelArgs( cl_mem m )
+{
+    KernelArgCache::Instance().Invalidate( m );
+}
+
 //-----------------------------------------------------------------------------
-/// Loads the content of a text file preserving EOL separators.
-/// \param[in] fname absolut path of text file
-/// \return string with file content
-/// \throw std::runtime_error in case the file cannot be opened
 std::string LoadText( const std::string& fname )
 {
     std::fstream is( fname.c_str() );
@@ -45,7 +58,6 @@ std::string LoadText( const std::string& fname )
     }
     return txt;
 }
-}
 
 //------------------------------------------------------------------------------
 Devices QueryDevices( cl_platform_id platformID )
@@ -213,10 +225,14 @@ Platforms QueryPlatforms()
     return retPlatforms;
 }
 
+namespace {
 //------------------------------------------------------------------------------
-CLExecutionContext CreateCLExecutionContext( const std::string& platformString,
-                                             int deviceNum,
-                                             cl_device_type deviceType  )
+/// Create context into \c ec; the functions below assemble execution
+/// contexts in place, without copying handles between instances.
+void InitContext( CLExecutionContext& ec,
+                  const std::string& platformString,
+                  int deviceNum,
+                  cl_device_type deviceType )
 {
     if( platformString.size() < 1 )
     {
@@ -269,7 +285,7 @@ CLExecutionContext CreateCLExecutionContext( const std::string& platformString,
     status = CL_SUCCESS - 1;
     
     //create context from specified type (GPU/CPU/DEFAULT/ACCELERATOR...)
-    HContext ctx( ::clCreateContextFromType( ctxProps, deviceType, 0, 0, &status ) );
+    ec.context = HContext( ::clCreateContextFromType( ctxProps, deviceType, 0, 0, &status ) );
 
     if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateContextFromType(): " + clERRORS[ status ] );
 
@@ -277,61 +293,111 @@ CLExecutionContext CreateCLExecutionContext( const std::string& platformString,
     //retrieve device to use:
     //1) retrieve the number of bytes required to store the list of devices
     size_t cd = cl_uint(); // 
-    status = ::clGetContextInfo( ctx, CL_CONTEXT_DEVICES, 0, 0, &cd );
+    status = ::clGetContextInfo( ec.context, CL_CONTEXT_DEVICES, 0, 0, &cd );
     if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetContextInfo(): " + clERRORS[ status ] );
     //2) create a vector of device ids to store the returned list of devices
     std::vector< cl_device_id > devices( cd / sizeof( cl_device_id ) );
-    status = ::clGetContextInfo( ctx, CL_CONTEXT_DEVICES, cd, &devices[ 0 ], 0 );
+    status = ::clGetContextInfo( ec.context, CL_CONTEXT_DEVICES, cd, &devices[ 0 ], 0 );
     if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetContextInfo(): " + clERRORS[ status ] );
     
     // get device at position specified in parameter list
-    if( size_t( deviceNum ) >= cd ) throw std::range_error( "Invalid device index" );
-    cl_device_id device = devices[ deviceNum ];
-    
-    // construct and return context
-    return CLExecutionContext( platform, device, ctx );
+    if( size_t( deviceNum ) >= devices.size() ) throw std::range_error( "Invalid device index" );
+    ec.platform = platform;
+    ec.device = devices[ deviceNum ];
 }
 
-//-----------------------------------------------------------------------------
-CLExecutionContext CreateCommandQueue( CLExecutionContext ec, cl_command_queue_properties prop = cl_command_queue_properties() )
+//------------------------------------------------------------------------------
+/// Create command queue into \c ec.
+void InitCommandQueue( CLExecutionContext& ec, cl_command_queue_properties prop )
 {
     if( ec.context == 0 ) throw std::logic_error( "Uninitialized execution context" );
     cl_int status = CL_SUCCESS + 1;
     cl_command_queue cq = ::clCreateCommandQueue( ec.context, ec.device, prop, &status ); // no properties defined, use default
     ec.commandQueue = HCommandQueue( cq );
     if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateCommandQueue(): " + clERRORS[ status ] );
+}
+}
+
+//------------------------------------------------------------------------------
+CLExecutionContext CreateCLExecutionContext( const std::string& platformString,
+                                             int deviceNum,
+                                             cl_device_type deviceType  )
+{
+    CLExecutionContext ec;
+    InitContext( ec, platformString, deviceNum, deviceType );
     return ec;
 }
 
 //-----------------------------------------------------------------------------
-CLExecutionContext BuildKernel( CLExecutionContext ec,
-                                const std::string& kernelSrc,
-                                const std::string& kernelName,
-                                std::string& buildOutput,
-                                const std::string& buildOptions,
-                                bool computeWGroupSize )
+CLExecutionContext CreateCommandQueue( CLExecutionContext ec, cl_command_queue_properties prop )
 {
+    InitCommandQueue( ec, prop );
+    return ec;
+}
 
-    assert( kernelSrc.size() > 0 );
-    assert( kernelName.size() > 0 );
+//-----------------------------------------------------------------------------
+HProgram BuildProgram( const CLExecutionContext& ec,
+                       const std::string& src,
+                       std::string& buildOutput,
+                       const std::string& buildOptions )
+{
+    assert( src.size() > 0 );
     if( ec.context == 0 ) throw std::logic_error( "Uninitialized execution context" );
-    
+    CLTraceScope trace( CLTracer::BUILD, "BuildProgram" );
+
+    //LOOKUP BINARY CACHE
+    ProgramBinaryCache& cache = ProgramBinaryCache::Instance();
+    std::string cacheKey;
+    if( cache.Enabled() )
+    {
+        cacheKey = ProgramBinaryCache::MakeKey( ec.device, src, buildOptions );
+        HProgram cached = cache.Load( ec.context, ec.device, cacheKey, buildOptions, buildOutput );
+        if( cached != 0 ) return cached;
+    }
+
     cl_int status = CL_SUCCESS + 1;
     //CREATE PROGRAM
-    const size_t kernelSrcLength = kernelSrc.size();
-    const char* src = kernelSrc.c_str();
-    ec.program = HProgram( clCreateProgramWithSource( ec.context, 1, &src, &kernelSrcLength, &status ) );
+    const size_t srcLength = src.size();
+    const char* srcText = src.c_str();
+    HProgram program( ::clCreateProgramWithSource( ec.context, 1, &srcText, &srcLength, &status ) );
     if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clCreateProgramWithSource(): " + clERRORS[ status ] );
     
     //BUILD PROGRAM
-    cl_int buildStatus = clBuildProgram( ec.program, 1, &ec.device, buildOptions.c_str(), 0, 0 );
+    cl_int buildStatus = ::clBuildProgram( program, 1, &ec.device, buildOptions.c_str(), 0, 0 );
     //log output if any
     char buffer[1 << 14] = "";
     size_t len = 0;
-    status = ::clGetProgramBuildInfo( ec.program, ec.device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
+    status = ::clGetProgramBuildInfo( program, ec.device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
     if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetProgramBuildInfo(): " + clERRORS[ status ] );
     if( buffer[ 0 ] != 0 ) buildOutput = &buffer[ 0 ]; 
-    if( buildStatus != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetBuildProgram: " + clERRORS[ status ] + "\n" + buildOutput );
+    if( buildStatus != CL_SUCCESS ) throw std::runtime_error( "ERROR - clGetBuildProgram: " + clERRORS[ buildStatus ] + "\n" + buildOutput );
+
+    //STORE BINARY
+    if( cache.Enabled() ) cache.Store( program, ec.device, cacheKey );
+    return program;
+}
+
+namespace {
+//-----------------------------------------------------------------------------
+/// Build program and create kernel into \c ec.
+void InitKernel( CLExecutionContext& ec,
+                 const std::string& kernelSrc,
+                 const std::string& kernelName,
+                 std::string& buildOutput,
+                 const std::string& buildOptions,
+                 bool computeWGroupSize )
+{
+
+    assert( kernelSrc.size() > 0 );
+    assert( kernelName.size() > 0 );
+    if( ec.context == 0 ) throw std::logic_error( "Uninitialized execution context" );
+    
+    cl_int status = CL_SUCCESS + 1;
+    //CREATE AND BUILD PROGRAM: a program already built in this context is
+    //reused when the registry is enabled
+    ProgramRegistry& registry = ProgramRegistry::Instance();
+    ec.program = registry.Enabled() ? registry.GetProgram( ec, kernelSrc, buildOutput, buildOptions )
+                                    : BuildProgram( ec, kernelSrc, buildOutput, buildOptions );
     
     //CREATE KERNEL
     ec.kernel = HKernel( clCreateKernel( ec.program, kernelName.c_str(), &status ) );
@@ -342,12 +408,30 @@ CLExecutionContext BuildKernel( CLExecutionContext ec,
     //on some cards the following value is not returned
     status = clGetKernelWorkGroupInfo( ec.kernel, ec.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof( size_t ), (void* ) &ec.wgroupSize, &returnedValueSize );
     if( status != CL_SUCCESS && status != CL_INVALID_VALUE ) throw std::runtime_error( "ERROR - clGetKernelWorkGroupInfo(): " + clERRORS[ status ] );
+    if( computeWGroupSize && ec.wgroupSize > 0 )
+    {
+        //largest multiple of the preferred size not exceeding the maximum;
+        //the preferred multiple is not available on OpenCL 1.0 run-times
+        size_t multiple = 0;
+        status = clGetKernelWorkGroupInfo( ec.kernel, ec.device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof( size_t ), (void* ) &multiple, &returnedValueSize );
+        if( status == CL_SUCCESS && multiple > 0 && ec.wgroupSize >= multiple ) ec.wgroupSize -= ec.wgroupSize % multiple;
+    }
     status = clGetKernelWorkGroupInfo( ec.kernel, ec.device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof( size_t ), (void* ) &ec.localMemSize, &returnedValueSize );
     if( status != CL_SUCCESS && status != CL_INVALID_VALUE ) throw std::runtime_error( "ERROR - clGetKernelWorkGroupInfo(): " + clERRORS[ status ] );
-    
-    return ec;
+}
 }
 
+//-----------------------------------------------------------------------------
+CLExecutionContext BuildKernel( CLExecutionContext ec,
+                                const std::string& kernelSrc,
+                                const std::string& kernelName,
+                                std::string& buildOutput,
+                                const std::string& buildOptions,
+                                bool computeWGroupSize )
+{
+    InitKernel( ec, kernelSrc, kernelName, buildOutput, buildOptions, computeWGroupSize );
+    return ec;
+}
 
 //-----------------------------------------------------------------------------
 CLExecutionContext CreateContextAndKernel( const std::string& platformString,
@@ -360,15 +444,11 @@ CLExecutionContext CreateContextAndKernel( const std::string& platformString,
                                            bool computeWGroupSize,										   
 										   cl_command_queue_properties prop )
 {
-    return
-        BuildKernel(
-            CreateCommandQueue(
-                CreateCLExecutionContext( platformString, deviceNum, deviceType ), prop ),
-            kernelSrc,
-            kernelName,
-            buildOutput, 
-            buildOptions,
-            computeWGroupSize );
+    CLExecutionContext ec;
+    InitContext( ec, platformString, deviceNum, deviceType );
+    InitCommandQueue( ec, prop );
+    InitKernel( ec, kernelSrc, kernelName, buildOutput, buildOptions, computeWGroupSize );
+    return ec;
 }
 
 //-----------------------------------------------------------------------------
@@ -393,12 +473,138 @@ CLExecutionContext CreateContextAndKernelFromFile( const std::string& platformSt
 								   prop );
 }
 
+//-----------------------------------------------------------------------------
+CLExecutionContextBuilder::CLExecutionContextBuilder( const std::string& platformString ) :
+    platform_( platformString ), deviceType_( CL_DEVICE_TYPE_DEFAULT ), deviceNum_( 0 ),
+    prop_( cl_command_queue_properties() ), computeWGroupSize_( false )
+{}
+
+//-----------------------------------------------------------------------------
+CLExecutionContextBuilder& CLExecutionContextBuilder::DeviceType( cl_device_type deviceType )
+{
+    deviceType_ = deviceType;
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+CLExecutionContextBuilder& CLExecutionContextBuilder::Device( int deviceNum )
+{
+    deviceNum_ = deviceNum;
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+CLExecutionContextBuilder& CLExecutionContextBuilder::QueueProperties( cl_command_queue_properties prop )
+{
+    prop_ = prop;
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+CLExecutionContextBuilder& CLExecutionContextBuilder::Kernel( const std::string& kernelSrc,
+                                                              const std::string& kernelName,
+                                                              const std::string& buildOptions,
+                                                              bool computeWGroupSize )
+{
+    kernelSrc_ = kernelSrc;
+    kernelName_ = kernelName;
+    buildOptions_ = buildOptions;
+    computeWGroupSize_ = computeWGroupSize;
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+CLExecutionContext CLExecutionContextBuilder::Build( std::string& buildOutput ) const
+{
+    CLExecutionContext ec;
+    InitContext( ec, platform_, deviceNum_, deviceType_ );
+    InitCommandQueue( ec, prop_ );
+    if( !kernelName_.empty() )
+    {
+        InitKernel( ec, kernelSrc_, kernelName_, buildOutput, buildOptions_, computeWGroupSize_ );
+    }
+    return ec;
+}
+
+//-----------------------------------------------------------------------------
+CLExecutionContext CLExecutionContextBuilder::Build() const
+{
+    std::string buildOutput;
+    return Build( buildOutput );
+}
+
 //------------------------------------------------------------------------------
-void CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo, cl_bool blocking, size_t offset, size_t size ) {
-    cl_int status = CL_SUCCESS + 1;
-    if( size == 0 && offset == 0 )
+thread_local CLBatchScope* CLBatchScope::innermost_ = 0;
+
+//------------------------------------------------------------------------------
+CLBatchScope::CLBatchScope( cl_command_queue cq, size_t maxCommands ) :
+    cq_( cq ), maxCommands_( maxCommands ), pending_( 0 ), flushes_( 0 ),
+    outer_( innermost_ )
+{
+    innermost_ = this;
+}
+
+//------------------------------------------------------------------------------
+CLBatchScope::~CLBatchScope()
+{
+    innermost_ = outer_;
+    if( pending_ > 0 ) ::clFlush( cq_ );
+}
+
+//------------------------------------------------------------------------------
+void CLBatchScope::Flush()
+{
+    if( pending_ == 0 ) return;
+    pending_ = 0;
+    ++flushes_;
+    const cl_int status = ::clFlush( cq_ );
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "ERROR - clFlush(): " + clERRORS[ status ] );
+    }
+}
+
+//------------------------------------------------------------------------------
+void CLBatchScope::Add()
+{
+    ++pending_;
+    if( maxCommands_ > 0 && pending_ >= maxCommands_ ) Flush();
+}
+
+//------------------------------------------------------------------------------
+CLBatchScope* CLBatchScope::Find( cl_command_queue cq )
+{
+    for( CLBatchScope* b = innermost_; b != 0; b = b->outer_ )
+    {
+        if( b->cq_ == cq ) return b;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+namespace {
+/// Enqueue copy between host and device memory; returns the event associated
+/// with the copy operation if \c event is not null.
+void EnqueueCopy( cl_command_queue cq, const CLMemObj& mo, void* pHostData, bool toDevice,
+                  cl_bool blocking, size_t offset, size_t size,
+                  const EventArray& waitList, cl_event* event )
+{
+    if( size == 0 ) size = mo.GetSize() > offset ? mo.GetSize() - offset : 0;
+    if( offset > mo.GetSize() || mo.GetSize() - offset < size )
     {
-        status = ::clEnqueueWriteBuffer( cq, mo.GetCLMemHandle(), blocking, 0, mo.GetSize(), pHostData, 0, 0, 0 );
+        throw std::logic_error( toDevice ? "Error - destination buffer smaller than data size"
+                                         : "Error - source buffer smaller than data size" ); 
+    }
+    const cl_uint numEvents = cl_uint( waitList.size() );
+    const cl_event* events = waitList.empty() ? 0 : &waitList[ 0 ];
+    const bool trace = CLTracer::Enabled();
+    const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+    cl_event traced = cl_event();
+    if( trace && event == 0 ) event = &traced;
+    if( toDevice )
+    {
+        const cl_int status = ::clEnqueueWriteBuffer( cq, mo.GetCLMemHandle(), blocking, offset, size,
+                                                      pHostData, numEvents, events, event );
         if( status != CL_SUCCESS )
         {
             throw std::runtime_error( "Error - clEnqueueWriteBuffer(): " + clERRORS[ status ] );
@@ -406,98 +612,216 @@ void CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo, cl_bo
     }
     else
     {
-        if( mo.GetSize() - offset < size )
-        {
-            throw std::logic_error( "Error - destination buffer smaller than data size" ); 
-        }
-        if( ::clEnqueueWriteBuffer( cq, mo.GetCLMemHandle(), blocking, offset, size, pHostData, 0, 0, 0 )
-            != CL_SUCCESS )
+        const cl_int status = ::clEnqueueReadBuffer( cq, mo.GetCLMemHandle(), blocking, offset, size,
+                                                     pHostData, numEvents, events, event );
+        if( status != CL_SUCCESS )
         {
-            throw std::runtime_error( "Error - clEnqueueWriteBuffer(): " + clERRORS[ status ] );
+            throw std::runtime_error( "Error - clEnqueueReadBuffer(): " + clERRORS[ status ] );
         }
     }
-    if( blocking == CL_TRUE )
+    if( KernelStats::Enabled() ) KernelStats::Instance().RecordCopy( toDevice ? KernelStats::HTOD : KernelStats::DTOH, size );
+    if( trace )
     {
-        status = ::clFinish( cq );
-        if(  status != CL_SUCCESS )
-        {
-            throw std::runtime_error( "Error - clFinish(): " + clERRORS[ status ] );
-        }
+        HEvent e( traced );
+        CLTracer::Instance().Record( toDevice ? CLTracer::COPY_HTOD : CLTracer::COPY_DTOH,
+                                     toDevice ? "CopyHtoD" : "CopyDtoH",
+                                     cq, *event, hostBegin, CLTracer::Now(), size );
+    }
+    if( !blocking )
+    {
+        if( CLBatchScope* batch = CLBatchScope::Find( cq ) ) batch->Add();
     }
 }
+}
+
+//------------------------------------------------------------------------------
+void CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo, cl_bool blocking, size_t offset, size_t size ) {
+    EnqueueCopy( cq, mo, const_cast< void* >( pHostData ), true, blocking, offset, size, EventArray(), 0 );
+}
+
+//------------------------------------------------------------------------------
+HEvent CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo, const EventArray& waitList,
+                   cl_bool blocking, size_t offset, size_t size ) {
+    cl_event e = cl_event();
+    EnqueueCopy( cq, mo, const_cast< void* >( pHostData ), true, blocking, offset, size, waitList, &e );
+    return HEvent( e );
+}
 
 //------------------------------------------------------------------------------
 void CLCopyDtoH( cl_command_queue cq, const CLMemObj& mo, void* pHostData, cl_bool blocking, size_t offset, size_t size )
 {
+    EnqueueCopy( cq, mo, pHostData, false, blocking, offset, size, EventArray(), 0 );
+}
+
+//------------------------------------------------------------------------------
+HEvent CLCopyDtoH( cl_command_queue cq, const CLMemObj& mo, void* pHostData, const EventArray& waitList,
+                   cl_bool blocking, size_t offset, size_t size )
+{
+    cl_event e = cl_event();
+    EnqueueCopy( cq, mo, pHostData, false, blocking, offset, size, waitList, &e );
+    return HEvent( e );
+}
+
+//------------------------------------------------------------------------------
+void* CLMap( cl_command_queue cq, const CLMemObj& mo, cl_map_flags flags, size_t offset, size_t size )
+{
+    if( size == 0 ) size = mo.GetSize() > offset ? mo.GetSize() - offset : 0;
+    if( offset > mo.GetSize() || mo.GetSize() - offset < size )
+    {
+        throw std::logic_error( "Error - mapped region outside of buffer" );
+    }
     cl_int status = CL_SUCCESS + 1;
-    if( size == 0 && offset == 0 )
+    const bool trace = CLTracer::Enabled();
+    const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+    cl_event e = cl_event();
+    void* p = ::clEnqueueMapBuffer( cq, mo.GetCLMemHandle(), CL_TRUE, flags, offset, size, 0, 0,
+                                    trace ? &e : 0, &status );
+    if( status != CL_SUCCESS )
     {
-        status = ::clEnqueueReadBuffer( cq, mo.GetCLMemHandle(), blocking, 0, mo.GetSize(), pHostData, 0, 0, 0 );
-        if( status != CL_SUCCESS )
-        {
-            throw std::runtime_error( "Error - clEnqueueReadBuffer(): " + clERRORS[ status ] );
-        }
+        throw std::runtime_error( "Error - clEnqueueMapBuffer(): " + clERRORS[ status ] );
     }
-    else
+    if( trace )
     {
-        if( mo.GetSize() - offset > size )
-        {
-            throw std::logic_error( "Error - destination buffer smaller than data size" ); 
-        }
-        if( ::clEnqueueReadBuffer( cq, mo.GetCLMemHandle(), blocking, offset, size, pHostData, 0, 0, 0 )
-            != CL_SUCCESS )
-        {
-            throw std::runtime_error( "Error - clEnqueueReadBuffer(): " + clERRORS[ status ] );
-        }
+        HEvent traced( e );
+        CLTracer::Instance().Record( CLTracer::MAP, "Map", cq, e, hostBegin, CLTracer::Now(), size );
     }
-    if( blocking == CL_TRUE )
+    return p;
+}
+
+//------------------------------------------------------------------------------
+HEvent CLUnmap( cl_command_queue cq, const CLMemObj& mo, void* mapped, const EventArray& waitList )
+{
+    const unsigned long long hostBegin = CLTracer::Enabled() ? CLTracer::Now() : 0;
+    cl_event e = cl_event();
+    const cl_int status = ::clEnqueueUnmapMemObject( cq, mo.GetCLMemHandle(), mapped,
+                                                     cl_uint( waitList.size() ),
+                                                     waitList.empty() ? 0 : &waitList[ 0 ], &e );
+    if( status != CL_SUCCESS )
     {
-        status = ::clFinish( cq );
-        if(  status != CL_SUCCESS )
-        {
-            throw std::runtime_error( "Error - clFinish(): " + clERRORS[ status ] );
-        }
+        throw std::runtime_error( "Error - clEnqueueUnmapMemObject(): " + clERRORS[ status ] );
+    }
+    HEvent event( e );
+    if( hostBegin != 0 )
+    {
+        CLTracer::Instance().Record( CLTracer::UNMAP, "Unmap", cq, e, hostBegin, CLTracer::Now(),
+                                     mo.GetSize() );
     }
+    return event;
 }
 
 
 //------------------------------------------------------------------------------
-cl_event InvokeKernelAsync( cl_command_queue cq,
-                        cl_kernel k,
-                        const SizeArray& gwgs,
-                        const SizeArray& lwgs,
-                        const VArgList& valist )
+void SetKernelArg( cl_kernel k, cl_uint pos, size_t size, const void* address )
 {
-    size_t pos = 0;
-    for( VArgList::ArgListConstIterator i = valist.Begin(); i != valist.End(); ++i, ++pos )
+    KernelArgCache& cache = KernelArgCache::Instance();
+    if( cache.Enabled() )
     {
-        cl_int status = CL_SUCCESS;
-        if( status = ::clSetKernelArg( k, pos, AnySizeOf( *i ), AnyAddress( *i ) ) != CL_SUCCESS )
-        {
-            
-            throw std::runtime_error( "ERROR - clSetKernelArg(): " + clERRORS[ status ] );
-        }
+        cache.Set( k, pos, size, address );
+        return;
     }
-    cl_event clevent = cl_event();
-    cl_int status = CL_SUCCESS + 1;
-    status = ::clEnqueueNDRangeKernel( cq, 
-                                       k,
-                                       gwgs.size(),
-                                       0,
-                                       &gwgs[ 0 ],
-                                       &lwgs[ 0 ], 0, 0, &clevent );
+    const cl_int status = ::clSetKernelArg( k, pos, size, address );
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "ERROR - clSetKernelArg(): " + clERRORS[ status ] );
+    }
+}
+
+//------------------------------------------------------------------------------
+bool TunedLocalSize( cl_command_queue cq,
+                     cl_kernel k,
+                     const SizeArray& gwgs,
+                     SizeArray& lwgs )
+{
+    TuningDatabase& db = TuningDatabase::Instance();
+    return db.Enabled() && db.LookupLocalSize( cq, k, gwgs, lwgs );
+}
+
+//------------------------------------------------------------------------------
+void EnqueueKernelAsync( cl_command_queue cq,
+                         cl_kernel k,
+                         const SizeArray& gwgs,
+                         const SizeArray& lwgs,
+                         cl_event* event,
+                         const EventArray& waitList,
+                         const SizeArray& offset )
+{
+    if( !offset.empty() && offset.size() != gwgs.size() )
+    {
+        throw std::logic_error( "Global offset and global size have different dimensions" );
+    }
+    //an empty local size selects the tuned one, if any
+    SizeArray tuned;
+    const size_t* local = lwgs.empty() ? 0 : &lwgs[ 0 ];
+    if( local == 0 && TunedLocalSize( cq, k, gwgs, tuned )
+        && tuned.size() == gwgs.size() ) local = &tuned[ 0 ];
+    const bool trace = CLTracer::Enabled();
+    const bool stats = KernelStats::Enabled();
+    const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+    cl_event traced = cl_event();
+    if( event == 0 && ( trace || stats ) ) event = &traced;
+    cl_int status = ::clEnqueueNDRangeKernel( cq,
+                                              k,
+                                              gwgs.size(),
+                                              offset.empty() ? 0 : &offset[ 0 ],
+                                              &gwgs[ 0 ],
+                                              local,
+                                              cl_uint( waitList.size() ),
+                                              waitList.empty() ? 0 : &waitList[ 0 ],
+                                              event );
     if(  status != CL_SUCCESS )
     {
         throw std::runtime_error( "ERROR - clEnqueueNDRangeKernel(): " + clERRORS[ status ] );
     }
-    if( ::clFlush( cq ) != CL_SUCCESS )
+    const HEvent recorded( traced );
+    if( trace ) CLTracer::Instance().RecordLaunch( cq, k, gwgs, *event, hostBegin, CLTracer::Now() );
+    if( stats ) KernelStats::Instance().RecordLaunch( k, gwgs, lwgs.empty() && local != 0 ? tuned : lwgs, *event );
+    if( CLBatchScope* batch = CLBatchScope::Find( cq ) )
+    {
+        batch->Add();
+        return;
+    }
+    status = ::clFlush( cq );
+    if( status != CL_SUCCESS )
     {
         throw std::runtime_error( "ERROR - clFlush(): " + clERRORS[ status ] );
     }
+}
 
+//------------------------------------------------------------------------------
+cl_event InvokeKernelAsync( cl_command_queue cq,
+                        cl_kernel k,
+                        const SizeArray& gwgs,
+                        const SizeArray& lwgs,
+                        const VArgList& valist )
+{
+    cl_uint pos = 0;
+    for( VArgList::ArgListConstIterator i = valist.Begin(); i != valist.End(); ++i, ++pos )
+    {
+        SetKernelArg( k, pos, AnySizeOf( *i ), AnyAddress( *i ) );
+    }
+    cl_event clevent = cl_event();
+    EnqueueKernelAsync( cq, k, gwgs, lwgs, &clevent );
     return clevent;
 }    
 
+//------------------------------------------------------------------------------
+HEvent InvokeKernelAsync( cl_command_queue cq,
+                          cl_kernel k,
+                          const SizeArray& gwgs,
+                          const SizeArray& lwgs,
+                          const VArgList& valist,
+                          const EventArray& waitList )
+{
+    cl_uint pos = 0;
+    for( VArgList::ArgListConstIterator i = valist.Begin(); i != valist.End(); ++i, ++pos )
+    {
+        SetKernelArg( k, pos, AnySizeOf( *i ), AnyAddress( *i ) );
+    }
+    cl_event clevent = cl_event();
+    EnqueueKernelAsync( cq, k, gwgs, lwgs, &clevent, waitList );
+    return HEvent( clevent );
+}
+
 //------------------------------------------------------------------------------
 cl_event InvokeKernelSync(  cl_command_queue cq,
                         cl_kernel k,
@@ -506,18 +830,37 @@ cl_event InvokeKernelSync(  cl_command_queue cq,
                         const VArgList& valist )
 {
     cl_event clevent = InvokeKernelAsync( cq, k, gwgs, lwgs, valist );
-    cl_int status = CL_SUCCESS + 1;
-    if( status = ::clFinish( cq ) != CL_SUCCESS )
+    const cl_int status = ::clWaitForEvents( 1, &clevent );
+    if( status != CL_SUCCESS )
     {
-        throw std::runtime_error( "ERROR - clFinish(): " + clERRORS[ status ] );
+        ::clReleaseEvent( clevent );
+        throw std::runtime_error( "ERROR - clWaitForEvents(): " + clERRORS[ status ] );
     }
-
     return clevent;
 }
 
+//------------------------------------------------------------------------------
+HEvent InvokeKernelSync( cl_command_queue cq,
+                         cl_kernel k,
+                         const SizeArray& gwgs,
+                         const SizeArray& lwgs,
+                         const VArgList& valist,
+                         const EventArray& waitList )
+{
+    HEvent e = InvokeKernelAsync( cq, k, gwgs, lwgs, valist, waitList );
+    const cl_event clevent = e;
+    const cl_int status = ::clWaitForEvents( 1, &clevent );
+    if( status != CL_SUCCESS )
+    {
+        throw std::runtime_error( "ERROR - clWaitForEvents(): " + clERRORS[ status ] );
+    }
+    return e;
+}
+
 //------------------------------------------------------------------------------
 void ReleaseExecutionContext( CLExecutionContext& ec )
 {
+    ProgramRegistry::Instance().Evict( ec.context );
     ec.commandQueue.Release();
     ec.program.Release();
     ec.kernel.Release();
@@ -26,9 +26,15 @@
 #include <cassert>
 #include <stdexcept>
 #include <map>
+#include <type_traits>
+#include <utility>
 #include <CL/cl.h>
 #include "../utility/varargs.h"
 #include "../utility/ResourceHandler.h"
+#include "../utility/alignment.h"
+#include "BufferPool.h"
+#include "Tracer.h"
+#include "KernelStats.h"
 
 ///Context resource name
 struct ContextName
@@ -50,6 +56,21 @@ struct CommandQueueName
 {
     operator const char*() const { return "CommandQueue"; }
 };
+///Event resource name
+struct EventName
+{
+    operator const char*() const { return "Event"; }
+};
+///Device resource name
+struct DeviceName
+{
+    operator const char*() const { return "Device"; }
+};
+
+///Release kernel reference and forget the argument values recorded for the
+///kernel by KernelArgCache and the local sizes cached by TuningDatabase;
+///used as the release function of HKernel.
+cl_int CL_API_CALL ReleaseKernel( cl_kernel k );
 
 ///Context resource handler
 typedef ResourceHandler< cl_context,
@@ -62,7 +83,7 @@ typedef ResourceHandler< cl_context,
 typedef ResourceHandler< cl_kernel,
                          cl_int,
                          ::clRetainKernel,
-                         ::clReleaseKernel,
+                         ReleaseKernel,
                          KernelName,
                          CL_SUCCESS > HKernel;
 ///Program resource handler
@@ -79,6 +100,25 @@ typedef ResourceHandler< cl_command_queue,
                          ::clReleaseCommandQueue,
                          CommandQueueName,
                          CL_SUCCESS > HCommandQueue; 
+///Event resource handler
+typedef ResourceHandler< cl_event,
+                         cl_int,
+                         ::clRetainEvent,
+                         ::clReleaseEvent,
+                         EventName,
+                         CL_SUCCESS > HEvent; 
+///Device resource handler: reference counting applies to sub-devices only,
+///root devices are not affected
+typedef ResourceHandler< cl_device_id,
+                         cl_int,
+                         ::clRetainDevice,
+                         ::clReleaseDevice,
+                         DeviceName,
+                         CL_SUCCESS > HDevice; 
+
+/// Events a command waits for before starting execution; HEvent instances
+/// convert to \c cl_event and can be stored directly.
+typedef std::vector< cl_event > EventArray;
 
 //-----------------------------------------------------------------------------
 /// Execution context with complete information on execution environment.
@@ -113,12 +153,13 @@ struct CLExecutionContext
     /// Default constructor: only initializes meaningful memebers used to detect
     /// proper initialization of class instances
     CLExecutionContext() : platform( cl_platform_id() ), device( cl_device_id() ), wgroupSize( 0 ), localMemSize( 0 ) {}
-    /// Constructor as used in CreateCLContext function.
+    /// Constructor as used in CreateCLContext function; the context handle
+    /// is moved into the instance when passed as a temporary.
     CLExecutionContext( cl_platform_id pl,
                         cl_device_id d,
-                        const HContext& ctx ) : 
+                        HContext ctx ) : 
                         platform( pl ), device( d ),
-                            context( ctx ), wgroupSize( 0 ), localMemSize( 0 ) {}
+                            context( std::move( ctx ) ), wgroupSize( 0 ), localMemSize( 0 ) {}
     
 };
 
@@ -171,20 +212,44 @@ void PrintPlatformsInfo( std::ostream& os, const Platforms& p,
 //-----------------------------------------------------------------------------
 /// Create command queue inside valid execution context.
 /// \attention it is the responsibility of the client code to release previously allocated queues
-/// \param[in] ec valid execution context
+/// \param[in] ec valid execution context; pass a temporary or use std::move()
+///            to move the handles instead of copying them
+/// \param[in] prop command queue properties
 /// \return copy of input context containing handle of allocated command queue
 /// \throw std::logic_error in case passed execution context is invalid
 /// \throw std::runtime_error in case of errors creating the command queue
-CLExecutionContext CreateCommandQueue( CLExecutionContext ec );
+CLExecutionContext CreateCommandQueue( CLExecutionContext ec,
+                                       cl_command_queue_properties prop = cl_command_queue_properties() );
 
 //-----------------------------------------------------------------------------
-/// Build kernel from source text. Valid program, kernel and info are added
-/// into a copy of the passed context.
+/// Create and build program from source text for the device in the execution
+/// context. When ProgramBinaryCache::Instance() is enabled the program is
+/// created from a cached binary if available and the binary of programs built
+/// from source is added to the cache.
 /// \param[in] ec valid execution context
+/// \param[in] src source code of program
+/// \param[out] buildOutput log from compiler
+/// \param[in] buildOptions build options passed to OpenCL compiler
+/// \return handle of built program
+/// \throw std::logic_error in case passed execution context is invalid
+/// \throw std::runtime_error in case of errors while invoking OpenCL functions
+HProgram BuildProgram( const CLExecutionContext& ec,
+                       const std::string& src,
+                       std::string& buildOutput,
+                       const std::string& buildOptions = "" );
+
+//-----------------------------------------------------------------------------
+/// Build kernel from source text. Valid program, kernel and info are added
+/// into a copy of the passed context. When ProgramRegistry::Instance() is
+/// enabled a program already built in the same context with the same source
+/// and options is reused; the kernel is always a new instance.
+/// \param[in] ec valid execution context; pass a temporary or use std::move()
+///            to move the handles instead of copying them
 /// \param[in] kernelSrc source code of program
 /// \param[in] kernelName name of kernel function
 /// \param[in] buildOptions build options passed to OpenCL compiler
-/// \param[in] computeWGroupSize ask run-time to compute optimal workgroup size
+/// \param[in] computeWGroupSize round the workgroup size returned by the
+///            run-time down to a multiple of the preferred workgroup size multiple
 /// \param[out] buildOutput log from compiler
 /// \return copy of passed execution context with added program and kernel handles
 /// \throw std::runtime_error in case of errors while invoking OpenCL functions
@@ -224,6 +289,13 @@ CLExecutionContext CreateContextAndKernel( const std::string& platformString,
                                            bool computeWGroupSize = false, 
 										   cl_command_queue_properties prop = cl_command_queue_properties() );
 
+//-----------------------------------------------------------------------------
+/// Loads the content of a text file preserving EOL separators.
+/// \param[in] fname absolut path of text file
+/// \return string with file content
+/// \throw std::runtime_error in case the file cannot be opened
+std::string LoadText( const std::string& fname );
+
 //-----------------------------------------------------------------------------
 /// Wrapper function that simply calls CreateContextAndKernel, which in turns
 /// calls CreateCLExecutionContext, CreateCommandQueue and BuildKernel in sequence.
@@ -254,48 +326,192 @@ CLExecutionContext CreateContextAndKernelFromFile( const std::string& platformSt
                                                    bool computeWGroupSize = false,
 												   cl_command_queue_properties prop = cl_command_queue_properties() );
 
+//------------------------------------------------------------------------------
+/// Assembles an execution context in place: context, command queue, program
+/// and kernel are created directly into the returned instance. Equivalent to
+/// CreateContextAndKernel() with named settings; the kernel is optional.
+/// \code
+/// std::string buildOutput;
+/// CLExecutionContext ec = CLExecutionContextBuilder( "NVIDIA CUDA" )
+///                             .DeviceType( CL_DEVICE_TYPE_GPU )
+///                             .QueueProperties( CL_QUEUE_PROFILING_ENABLE )
+///                             .Kernel( src, "MatMul", "-DTILE_SIZE=16" )
+///                             .Build( buildOutput );
+/// \endcode
+class CLExecutionContextBuilder
+{
+public:
+    /// Constructor.
+    /// \param[in] platformString platform identifier e.g. "NVIDIA CUDA" or "ATI Stream"
+    explicit CLExecutionContextBuilder( const std::string& platformString );
+    /// Set type of device, default is \c CL_DEVICE_TYPE_DEFAULT.
+    CLExecutionContextBuilder& DeviceType( cl_device_type deviceType );
+    /// Set index of device of the selected type, default is zero.
+    CLExecutionContextBuilder& Device( int deviceNum );
+    /// Set command queue properties, default is none.
+    CLExecutionContextBuilder& QueueProperties( cl_command_queue_properties prop );
+    /// Set kernel to build; without a kernel only context and command queue
+    /// are created. See BuildKernel() for the meaning of the parameters.
+    CLExecutionContextBuilder& Kernel( const std::string& kernelSrc,
+                                       const std::string& kernelName,
+                                       const std::string& buildOptions = "",
+                                       bool computeWGroupSize = false );
+    /// Create resources.
+    /// \param[out] buildOutput output log from compiler
+    /// \return valid CLExecutionContext
+    /// \throw std::runtime_error in case of failure to allocate resources
+    /// \throw std::range_error in case the index of the device is out if bounds
+    CLExecutionContext Build( std::string& buildOutput ) const;
+    /// Create resources discarding the compiler log.
+    CLExecutionContext Build() const;
+private:
+    std::string platform_;
+    cl_device_type deviceType_;
+    int deviceNum_;
+    cl_command_queue_properties prop_;
+    std::string kernelSrc_;
+    std::string kernelName_;
+    std::string buildOptions_;
+    bool computeWGroupSize_;
+};
+
+//------------------------------------------------------------------------------
+/// Forget argument values referring to memory object recorded by
+/// KernelArgCache; must be called before releasing a memory object that
+/// might be bound to a kernel, since its handle can be reused by the run-time.
+void InvalidateKernelArgs( cl_mem m );
+
 //------------------------------------------------------------------------------
 /// Wrapper for OpenCL memory object which performs automatic resource
-/// deallocation and reference counting.
+/// deallocation and reference counting. Copies of an object allocated from a
+/// CLBufferPool share a counter instead of run-time references: the buffer is
+/// returned to the pool when the last copy is destroyed.
 class CLMemObj
 {
     CLMemObj(); // cannot default construct since it requires a valid context;
                 // we could enable this by adding SetContext() method; this
                 // would however make things messy
 public:
+    /// Tag selecting the zero-copy constructor.
+    enum ZeroCopy { ZERO_COPY };
+    /// Alignment of host memory allocated by zero-copy objects: a page, as
+    /// required by most run-times to access host memory in place.
+    enum { ZERO_COPY_ALIGNMENT = 4096 };
+    /// Zero-copy allocations are rounded up to a multiple of this size.
+    enum { ZERO_COPY_SIZE_MULTIPLE = 64 };
     CLMemObj( cl_context ctx,
               size_t size,    
               cl_mem_flags flags = CL_MEM_READ_WRITE,
               void* hostPtr = 0 ) 
-              : ctx_( ctx ), size_( size ), flags_( flags ), hostPtr_( hostPtr )
+              : ctx_( ctx ), size_( size ), flags_( flags ), hostPtr_( hostPtr ), pool_( 0 ),
+                poolRefs_( 0 ), zeroCopy_( false )
+    {
+        AllocateMemObj( size );
+    }
+    /// Allocate host memory aligned to ZERO_COPY_ALIGNMENT and wrap it into a
+    /// \c CL_MEM_USE_HOST_PTR buffer; devices sharing memory with the host
+    /// access it in place and CLMap() does not copy data. Host memory is
+    /// released when the run-time destroys the buffer.
+    /// Data must be accessed through CLMap() and CLUnmap() only.
+    /// \param[in] ctx context
+    /// \param[in] size size in bytes
+    /// \param[in] flags memory flags, \c CL_MEM_USE_HOST_PTR is added
+    /// \throw std::runtime_error in case memory cannot be allocated
+    CLMemObj( cl_context ctx,
+              size_t size,
+              cl_mem_flags flags,
+              ZeroCopy )
+              : ctx_( ctx ), size_( size ), flags_( flags | CL_MEM_USE_HOST_PTR ), hostPtr_( 0 ),
+                pool_( 0 ), poolRefs_( 0 ), zeroCopy_( true )
+    {
+        AllocateMemObj( size );
+    }
+    /// Allocate buffer from pool; the buffer is returned to the pool
+    /// instead of being released when the last reference goes away.
+    CLMemObj( CLBufferPool& pool,
+              size_t size,
+              cl_mem_flags flags = CL_MEM_READ_WRITE )
+              : ctx_( pool.GetContext() ), size_( size ), flags_( flags ), hostPtr_( 0 ), pool_( &pool ),
+                poolRefs_( 0 ), zeroCopy_( false )
     {
         AllocateMemObj( size );
     }
     CLMemObj( const CLMemObj& other )
     {
         ctx_ = other.ctx_;
+        size_ = other.size_;
+        flags_ = other.flags_;
+        hostPtr_ = other.hostPtr_;
+        pool_ = other.pool_;
+        zeroCopy_ = other.zeroCopy_;
+        AcquireMemObj( other );
+    }
+    /// Move constructor: takes over the reference of \c other without
+    /// calling the run-time; \c other is left empty.
+    CLMemObj( CLMemObj&& other ) noexcept
+              : ctx_( other.ctx_ ), memObj_( other.memObj_ ), size_( other.size_ ),
+                flags_( other.flags_ ), hostPtr_( other.hostPtr_ ), pool_( other.pool_ ),
+                poolRefs_( other.poolRefs_ ), zeroCopy_( other.zeroCopy_ )
+    {
+        other.memObj_ = 0;
+        other.poolRefs_ = 0;
+    }
+    CLMemObj& operator=( const CLMemObj& other )
+    {
+        if( this == &other ) return *this;
+        ReleaseMemObj();
+        ctx_ = other.ctx_;
+        size_ = other.size_;
         flags_ = other.flags_;
         hostPtr_ = other.hostPtr_;
-        AcquireMemObj( other.memObj_ );
+        pool_ = other.pool_;
+        zeroCopy_ = other.zeroCopy_;
+        AcquireMemObj( other );
+        return *this;
     }
-    CLMemObj operator=( const CLMemObj& other )
+    /// Move assignment: takes over the reference of \c other without
+    /// calling the run-time; \c other is left empty.
+    CLMemObj& operator=( CLMemObj&& other )
     {
+        if( this == &other ) return *this;
         ReleaseMemObj();
         ctx_ = other.ctx_;
+        memObj_ = other.memObj_;
+        size_ = other.size_;
         flags_ = other.flags_;
         hostPtr_ = other.hostPtr_;
-        AcquireMemObj( other.memObj_ );
+        pool_ = other.pool_;
+        poolRefs_ = other.poolRefs_;
+        zeroCopy_ = other.zeroCopy_;
+        other.memObj_ = 0;
+        other.poolRefs_ = 0;
         return *this;
     }
     ~CLMemObj() { ReleaseMemObj(); }
     cl_mem GetCLMemHandle() const { return memObj_; }
+    /// Address of the wrapped handle, used to bind the object as a kernel
+    /// argument without copying it into a temporary.
+    const cl_mem* GetCLMemHandleAddress() const { return &memObj_; }
     operator cl_mem() const { return GetCLMemHandle(); }
     void* GetHostPtr() const { return hostPtr_; }
     size_t GetSize() const { return size_; }
+    cl_mem_flags GetFlags() const { return flags_; }
     cl_context GetCLContext() const { return ctx_; }
+    /// Returns pool the buffer was allocated from, NULL if not pooled.
+    CLBufferPool* GetPool() const { return pool_; }
+    /// Returns \c true if the buffer wraps host memory allocated by the object.
+    bool IsZeroCopy() const { return zeroCopy_; }
+    /// Change size of buffer; pooled buffers are reallocated only when the new
+    /// size exceeds the capacity of the pool block and no other object
+    /// references the buffer; zero-copy buffers get new host memory.
     cl_mem Resize( size_t newSize )
     {
         cl_mem oldMemObj = memObj_;
+        if( poolRefs_ != 0 && poolRefs_->Count() == 1 && newSize > 0 && newSize <= pool_->Capacity( memObj_ ) )
+        {
+            size_ = newSize;
+            return oldMemObj;
+        }
         ReleaseMemObj();
         AllocateMemObj( newSize );
         return oldMemObj;
@@ -303,6 +519,18 @@ public:
 private:
     void AllocateMemObj( size_t size )
     {
+        if( pool_ != 0 )
+        {
+            memObj_ = pool_->Acquire( size, flags_ );
+            poolRefs_ = new AtomicCounter( 1 );
+            size_ = size;
+            return;
+        }
+        if( zeroCopy_ )
+        {
+            AllocateZeroCopyMemObj( size );
+            return;
+        }
         cl_int statusCode = CL_SUCCESS + 1;
         memObj_ = ::clCreateBuffer( ctx_, flags_, size, hostPtr_, &statusCode );
         if( statusCode != CL_SUCCESS )
@@ -311,20 +539,69 @@ private:
         }
         size_ = size;
     }
+    void AllocateZeroCopyMemObj( size_t size )
+    {
+        const size_t allocSize = AlignedOffset( size > 0 ? size : 1, int( ZERO_COPY_SIZE_MULTIPLE ) );
+        void* p = AlignedAlloc( allocSize, ZERO_COPY_ALIGNMENT );
+        if( p == 0 ) throw std::runtime_error( "Error - cannot allocate aligned host memory" );
+        cl_int statusCode = CL_SUCCESS + 1;
+        cl_mem m = ::clCreateBuffer( ctx_, flags_, allocSize, p, &statusCode );
+        if( statusCode != CL_SUCCESS )
+        {
+            AlignedFree( p );
+            throw std::runtime_error( "Error - clCreateBuffer()" );
+        }
+        // host memory must outlive all the references to the buffer, including
+        // the ones held by the run-time for pending commands
+        if( ::clSetMemObjectDestructorCallback( m, FreeHostPtr, p ) != CL_SUCCESS )
+        {
+            ::clReleaseMemObject( m );
+            AlignedFree( p );
+            throw std::runtime_error( "Error - clSetMemObjectDestructorCallback()" );
+        }
+        memObj_ = m;
+        hostPtr_ = p;
+        size_ = size;
+    }
+    static void CL_CALLBACK FreeHostPtr( cl_mem, void* p ) { AlignedFree( p ); }
     void ReleaseMemObj()
     {
+        if( memObj_ == 0 ) return; // moved from
+        // pooled buffers hold a single run-time reference owned by the pool;
+        // the run-time reference count cannot be used instead since it
+        // includes references held by pending commands
+        if( poolRefs_ != 0 )
+        {
+            AtomicCounter* refs = poolRefs_;
+            poolRefs_ = 0;
+            if( refs->Dec() == 0 )
+            {
+                delete refs;
+                pool_->Recycle( memObj_ );
+            }
+            return;
+        }
+        InvalidateKernelArgs( memObj_ );
         if( ::clReleaseMemObject( memObj_ ) != CL_SUCCESS )
         {
             throw std::runtime_error( "Error - clReleaseMemObject()" );
         }
     }
-    void AcquireMemObj( cl_mem mo )
+    void AcquireMemObj( const CLMemObj& other )
     {
-        if( ::clRetainMemObject( mo ) != CL_SUCCESS )
+        if( other.poolRefs_ != 0 )
+        {
+            other.poolRefs_->Inc();
+            poolRefs_ = other.poolRefs_;
+            memObj_ = other.memObj_;
+            return;
+        }
+        poolRefs_ = 0;
+        if( ::clRetainMemObject( other.memObj_ ) != CL_SUCCESS )
         {
             throw std::runtime_error( "Error - clRetainMemObject()" );
         }
-        memObj_ = mo;
+        memObj_ = other.memObj_;
     }
 private:
     cl_context ctx_;
@@ -332,6 +609,9 @@ private:
     size_t size_;
     cl_mem_flags flags_;
     void* hostPtr_; 
+    CLBufferPool* pool_;
+    AtomicCounter* poolRefs_; //!< references shared by copies of a pooled buffer
+    bool zeroCopy_;
 };
 
 
@@ -342,12 +622,22 @@ private:
 ///\param pHostData source
 ///\param blocking set blocking or non blocking operation
 ///\param offset starting point of copy operation in source memory buffer
-///\param size number of bytes to copy: in case the value is zero the size
-///    specified in the mo parameter is used
+///\param size number of bytes to copy: in case the value is zero the
+///    buffer is copied from offset to the end
 ///\throw std::runtime_error.
 void CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo,
                  cl_bool blocking = CL_TRUE, size_t offset = 0, size_t size = 0 );
 
+//------------------------------------------------------------------------------
+///Copy from host memory to device memory after the events in the wait list
+///complete; non blocking by default.
+///\param waitList events to wait for
+///\return event associated with the copy operation
+///\throw std::runtime_error.
+HEvent CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo,
+                   const EventArray& waitList,
+                   cl_bool blocking = CL_FALSE, size_t offset = 0, size_t size = 0 );
+
 
 //------------------------------------------------------------------------------
 ///Copy from device memory to host memory.
@@ -356,16 +646,132 @@ void CLCopyHtoD( cl_command_queue cq, const void* pHostData, CLMemObj& mo,
 ///\param pHostData target of copy operation
 ///\param blocking set blocking or non blocking operation
 ///\param offset starting point of copy operation in source memory buffer
-///\param size number of bytes to copy: in case the value is zero the size
-///    specified in the mo parameter is used
+///\param size number of bytes to copy: in case the value is zero the
+///    buffer is copied from offset to the end
 ///\throw std::runtime_error.
 void CLCopyDtoH( cl_command_queue cq, const CLMemObj& mo, void* pHostData,
                  cl_bool blocking = CL_TRUE, size_t offset = 0, size_t size = 0 );
 
+//------------------------------------------------------------------------------
+///Copy from device memory to host memory after the events in the wait list
+///complete; non blocking by default.
+///\param waitList events to wait for
+///\return event associated with the copy operation
+///\throw std::runtime_error.
+HEvent CLCopyDtoH( cl_command_queue cq, const CLMemObj& mo, void* pHostData,
+                   const EventArray& waitList,
+                   cl_bool blocking = CL_FALSE, size_t offset = 0, size_t size = 0 );
+
+//------------------------------------------------------------------------------
+///Map region of memory object into host memory; blocking. No data is copied
+///when the buffer wraps host memory accessible by the device, e.g. zero-copy
+///objects and \c CL_MEM_ALLOC_HOST_PTR buffers on integrated devices.
+///\param cq command queue to operate on
+///\param mo memory object
+///\param flags \c CL_MAP_READ, \c CL_MAP_WRITE or \c CL_MAP_WRITE_INVALIDATE_REGION
+///\param offset starting point of mapped region
+///\param size number of bytes to map: in case the value is zero the
+///    buffer is mapped from offset to the end
+///\return host pointer to mapped region, valid until CLUnmap() is called
+///\throw std::runtime_error.
+void* CLMap( cl_command_queue cq, const CLMemObj& mo, cl_map_flags flags,
+             size_t offset = 0, size_t size = 0 );
+
+//------------------------------------------------------------------------------
+///Unmap region mapped with CLMap(); non blocking. The device sees data
+///written to the region only after the returned event completes.
+///\param cq command queue to operate on
+///\param mo memory object
+///\param mapped pointer returned by CLMap()
+///\param waitList events to wait for
+///\return event associated with the unmap operation
+///\throw std::runtime_error.
+HEvent CLUnmap( cl_command_queue cq, const CLMemObj& mo, void* mapped,
+                const EventArray& waitList = EventArray() );
+
 
 /// Type used for local and global workgroup size.
 typedef std::vector< size_t > SizeArray;
 
+//------------------------------------------------------------------------------
+/// Returns local size stored in TuningDatabase::Instance() for kernel
+/// enqueued into queue with global size \c gwgs, if the database is enabled.
+/// \return \c true if found
+bool TunedLocalSize( cl_command_queue cq,
+                     cl_kernel k,
+                     const SizeArray& gwgs,
+                     SizeArray& lwgs );
+
+//------------------------------------------------------------------------------
+/// Set a single kernel argument; when KernelArgCache is enabled
+/// \c clSetKernelArg is called only if the value differs from the one
+/// previously bound at the same position.
+/// \throw std::runtime_error in case \c clSetKernelArg fails
+void SetKernelArg( cl_kernel k, cl_uint pos, size_t size, const void* address );
+
+//------------------------------------------------------------------------------
+/// Batch of commands submitted to a command queue with a single \c clFlush.
+/// Asynchronous launches flush the queue after each enqueue so that the
+/// device starts working as soon as possible; when many small kernels are
+/// launched back to back the flushes dominate host time and the driver
+/// receives tiny submissions. While a scope is alive, kernel launches and
+/// non-blocking copies enqueued on its queue by the thread that created it
+/// are collected and flushed together when the scope ends or each time
+/// \c maxCommands commands have been collected:
+///\code
+///  {
+///      CLBatchScope batch( ec.commandQueue, 64 );
+///      for( int i = 0; i != n; ++i ) Launch( ec, gwgs, lwgs, dA, i );
+///  } // remaining launches are flushed here
+///\endcode
+/// Batching applies to Launch(), InvokeKernelAsync(), InvokeKernelSync(),
+/// CLKernelHandler::AsyncRun(), CLCopyHtoD() and CLCopyDtoH(). Blocking
+/// calls are not affected: the run-time flushes the queue before waiting.
+/// Commands enqueued on other queues that wait for events of the batch can
+/// only start after the batch is flushed: call Flush() before enqueuing them.
+/// Scopes can be nested, commands are collected by the innermost scope of
+/// the calling thread for the queue; scopes must be destroyed in reverse
+/// order of creation, which is always the case for automatic variables.
+class CLBatchScope
+{
+public:
+    /// Constructor.
+    /// \param[in] cq command queue
+    /// \param[in] maxCommands number of commands after which the batch is
+    ///            flushed; zero means flush only when the scope ends
+    explicit CLBatchScope( cl_command_queue cq, size_t maxCommands = 0 );
+    /// Destructor: flushes pending commands; errors are ignored, call
+    /// Flush() before the end of the scope to check them.
+    ~CLBatchScope();
+    /// Submit collected commands to the device.
+    /// \throw std::runtime_error in case \c clFlush fails
+    void Flush();
+    /// Record a command enqueued on the queue, flushing if the batch is full.
+    /// \throw std::runtime_error in case \c clFlush fails
+    void Add();
+    /// Returns command queue.
+    cl_command_queue GetCommandQueue() const { return cq_; }
+    /// Returns number of commands collected since last flush.
+    size_t Pending() const { return pending_; }
+    /// Returns number of flushes issued.
+    unsigned long long Flushes() const { return flushes_; }
+    /// Returns innermost scope created by the calling thread for queue,
+    /// null if none.
+    static CLBatchScope* Find( cl_command_queue cq );
+private:
+    CLBatchScope( const CLBatchScope& );
+    CLBatchScope& operator=( const CLBatchScope& );
+private:
+    cl_command_queue cq_;
+    size_t maxCommands_;
+    size_t pending_;
+    unsigned long long flushes_;
+    /// Enclosing scope of the same thread.
+    CLBatchScope* outer_;
+    /// Innermost scope of each thread.
+    static thread_local CLBatchScope* innermost_;
+};
+
 //------------------------------------------------------------------------------
 /// Utility class to setup and run kernels; does not do any resource management
 /// it is the resposnsibility of the client code to properly manage the
@@ -394,24 +800,57 @@ public:
     const SizeArray& GetGlobalWGroupSize() const { return gwgs_; }
     const SizeArray& GetLocalWGroupSize() const { return lwgs_; }
     void SetLocalWGroupSize( const SizeArray& lwgs )  { lwgs_ = lwgs; }
+    /// Set kernel argument through SetKernelArg(): unchanged values are not
+    /// bound again when KernelArgCache is enabled.
     template < typename T > void SetParam( int pos, T val )
     {
-        T v = val;
-        cl_int status = ::clSetKernelArg( kernel_, pos, sizeof( T ), &v );
-        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clSetKernelArg()" );
+        SetKernelArg( kernel_, cl_uint( pos ), sizeof( T ), &val );
     }
+    /// Enqueue kernel; the launch is added to the enclosing CLBatchScope
+    /// of the queue, if any.
     void AsyncRun()
     {
-        cl_int status = 
-            ::clEnqueueNDRangeKernel( commandQueue_, kernel_, gwgs_.size(), 0, &gwgs_[ 0 ], &lwgs_[ 0 ], 0, 0, 0 ); 
-        if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clEnqueueNDRangeKernel()" );
+        Enqueue( EventArray(), 0 );
+        if( CLBatchScope* batch = CLBatchScope::Find( commandQueue_ ) ) batch->Add();
+    }
+    /// Enqueue kernel after the events in \c waitList complete.
+    /// \return event associated with the kernel execution
+    HEvent AsyncRun( const EventArray& waitList )
+    {
+        cl_event e = cl_event();
+        Enqueue( waitList, &e );
+        HEvent event( e );
+        if( CLBatchScope* batch = CLBatchScope::Find( commandQueue_ ) ) batch->Add();
+        return event;
     }
     void SyncRun()
     {
+        Enqueue( EventArray(), 0 );
+        clFinish( commandQueue_ );
+    }
+private:
+    /// Enqueue kernel, recording the launch in CLTracer and KernelStats
+    /// when enabled; an empty local size selects the tuned one, if any.
+    void Enqueue( const EventArray& waitList, cl_event* event )
+    {
+        SizeArray tuned;
+        const SizeArray& lwgs = !lwgs_.empty() || !TunedLocalSize( commandQueue_, kernel_, gwgs_, tuned )
+                                || tuned.size() != gwgs_.size() ? lwgs_ : tuned;
+        const bool trace = CLTracer::Enabled();
+        const bool stats = KernelStats::Enabled();
+        const unsigned long long hostBegin = trace ? CLTracer::Now() : 0;
+        cl_event e = cl_event();
+        if( event == 0 && ( trace || stats ) ) event = &e;
         cl_int status = 
-            ::clEnqueueNDRangeKernel( commandQueue_, kernel_, gwgs_.size(), 0, &gwgs_[ 0 ], &lwgs_[ 0 ], 0, 0, 0 ); 
+            ::clEnqueueNDRangeKernel( commandQueue_, kernel_, gwgs_.size(), 0, &gwgs_[ 0 ],
+                                      lwgs.empty() ? 0 : &lwgs[ 0 ],
+                                      cl_uint( waitList.size() ),
+                                      waitList.empty() ? 0 : &waitList[ 0 ],
+                                      event ); 
         if( status != CL_SUCCESS ) throw std::runtime_error( "ERROR - clEnqueueNDRangeKernel()" );
-        clFinish( commandQueue_ );
+        const HEvent recorded( e );
+        if( trace ) CLTracer::Instance().RecordLaunch( commandQueue_, kernel_, gwgs_, *event, hostBegin, CLTracer::Now() );
+        if( stats ) KernelStats::Instance().RecordLaunch( kernel_, gwgs_, lwgs, *event );
     }
 private:
     cl_command_queue commandQueue_;
@@ -422,6 +861,8 @@ private:
 
 //------------------------------------------------------------------------------
 /// Invoke kernel asynchronously.  
+/// \attention the returned event must be released by the caller; use the
+/// overload taking a wait list to get an HEvent
 cl_event InvokeKernelAsync( cl_command_queue cq,
                             cl_kernel k,
                             const SizeArray& gwgs,
@@ -442,8 +883,36 @@ inline cl_event InvokeKernelAsync( const CLExecutionContext& ec,
                               valist );
 }
 
+//------------------------------------------------------------------------------
+/// Invoke kernel asynchronously after the events in the wait list complete.
+/// \return event associated with the kernel execution
+HEvent InvokeKernelAsync( cl_command_queue cq,
+                          cl_kernel k,
+                          const SizeArray& gwgs,
+                          const SizeArray& lwgs,
+                          const VArgList& valist,
+                          const EventArray& waitList );
+
+//------------------------------------------------------------------------------
+/// Invoke kernel asynchronously after the events in the wait list complete.
+inline HEvent InvokeKernelAsync( const CLExecutionContext& ec,
+                                 const SizeArray& gwgs,
+                                 const SizeArray& lwgs,
+                                 const VArgList& valist,
+                                 const EventArray& waitList )
+{
+    return InvokeKernelAsync( ec.commandQueue,
+                              ec.kernel,
+                              gwgs,
+                              lwgs,
+                              valist,
+                              waitList );
+}
+
 //------------------------------------------------------------------------------
 /// Invoke kernel synchronously.
+/// \attention the returned event must be released by the caller; use the
+/// overload taking a wait list to get an HEvent
 cl_event InvokeKernelSync( cl_command_queue cq,
                            cl_kernel k,
                            const SizeArray& gwgs,
@@ -465,7 +934,203 @@ inline cl_event InvokeKernelSync( const CLExecutionContext& ec,
 }
 
 //------------------------------------------------------------------------------
-/// Release resources stored in execution context.
+/// Invoke kernel after the events in the wait list complete and wait for
+/// its completion.
+/// \return event associated with the kernel execution
+HEvent InvokeKernelSync( cl_command_queue cq,
+                         cl_kernel k,
+                         const SizeArray& gwgs,
+                         const SizeArray& lwgs,
+                         const VArgList& valist,
+                         const EventArray& waitList );
+
+//------------------------------------------------------------------------------
+/// Invoke kernel after the events in the wait list complete and wait for
+/// its completion.
+inline HEvent InvokeKernelSync( const CLExecutionContext& ec,
+                                const SizeArray& gwgs,
+                                const SizeArray& lwgs,
+                                const VArgList& valist,
+                                const EventArray& waitList )
+{
+    return InvokeKernelSync( ec.commandQueue,
+                             ec.kernel,
+                             gwgs,
+                             lwgs,
+                             valist,
+                             waitList );
+}
+
+//------------------------------------------------------------------------------
+/// Local memory kernel argument: reserves \c size bytes of local memory for
+/// a \c __local pointer parameter of the kernel function.
+struct LocalMem
+{
+    size_t size; //!< number of bytes to reserve
+    explicit LocalMem( size_t s ) : size( s ) {}
+};
+
+//------------------------------------------------------------------------------
+/// Maps the type of a kernel argument to the size and address passed to
+/// \c clSetKernelArg. Only trivially copyable values are accepted; host
+/// pointers are rejected at compile time since they are never valid kernel
+/// arguments. Specialize to make additional types bindable.
+template < typename T >
+struct KernelArg
+{
+    static_assert( !std::is_pointer< T >::value,
+                   "Host pointers cannot be passed to kernels: use cl_mem or CLMemObj" );
+    static_assert( !std::is_array< T >::value,
+                   "Arrays cannot be passed to kernels: use a vector type or a buffer" );
+    static_assert( std::is_trivially_copyable< T >::value,
+                   "Kernel arguments must be trivially copyable" );
+    static size_t Size( const T& ) { return sizeof( T ); }
+    static const void* Address( const T& v ) { return &v; }
+};
+/// Memory object handle.
+template <> struct KernelArg< cl_mem >
+{
+    static size_t Size( const cl_mem& ) { return sizeof( cl_mem ); }
+    static const void* Address( const cl_mem& v ) { return &v; }
+};
+/// Sampler handle.
+template <> struct KernelArg< cl_sampler >
+{
+    static size_t Size( const cl_sampler& ) { return sizeof( cl_sampler ); }
+    static const void* Address( const cl_sampler& v ) { return &v; }
+};
+/// Memory object wrapper: binds the wrapped \c cl_mem handle.
+template <> struct KernelArg< CLMemObj >
+{
+    static size_t Size( const CLMemObj& ) { return sizeof( cl_mem ); }
+    static const void* Address( const CLMemObj& m ) { return m.GetCLMemHandleAddress(); }
+};
+/// Local memory: size only, no data.
+template <> struct KernelArg< LocalMem >
+{
+    static size_t Size( const LocalMem& l ) { return l.size; }
+    static const void* Address( const LocalMem& ) { return 0; }
+};
+
+//------------------------------------------------------------------------------
+/// Terminates recursion of SetKernelArgs.
+inline void SetKernelArgs( cl_kernel, cl_uint ) {}
+
+//------------------------------------------------------------------------------
+/// Bind a sequence of arguments to consecutive kernel parameters starting at
+/// \c pos; values are passed to the run-time directly from the caller's
+/// stack, no copy or heap allocation is performed.
+template < typename HeadT, typename... TailT >
+inline void SetKernelArgs( cl_kernel k, cl_uint pos,
+                           const HeadT& head, const TailT&... tail )
+{
+    SetKernelArg( k, pos, KernelArg< HeadT >::Size( head ),
+                          KernelArg< HeadT >::Address( head ) );
+    SetKernelArgs( k, pos + 1, tail... );
+}
+
+//------------------------------------------------------------------------------
+/// Enqueue kernel whose arguments have already been bound and flush the queue,
+/// or add the launch to the enclosing CLBatchScope of the queue.
+/// An empty local size selects the size stored in TuningDatabase::Instance()
+/// for the kernel, if enabled, or lets the run-time pick the workgroup size.
+/// \param[out] event if not null receives the event associated with the
+///             kernel execution; the caller is responsible for releasing it
+/// \param[in] waitList events to wait for before execution
+/// \param[in] offset global work offset, empty for no offset; kernels
+///            see it through \c get_global_id and \c get_global_offset, not
+///            through \c get_group_id
+/// \throw std::runtime_error in case of errors enqueuing the kernel
+void EnqueueKernelAsync( cl_command_queue cq,
+                         cl_kernel k,
+                         const SizeArray& gwgs,
+                         const SizeArray& lwgs,
+                         cl_event* event = 0,
+                         const EventArray& waitList = EventArray(),
+                         const SizeArray& offset = SizeArray() );
+
+//------------------------------------------------------------------------------
+/// Check, in debug builds only, that the number of arguments passed to a
+/// launch function matches the number of kernel parameters.
+inline void AssertNumKernelArgs( cl_kernel k, cl_uint n )
+{
+#ifndef NDEBUG
+    cl_uint numArgs = 0;
+    ::clGetKernelInfo( k, CL_KERNEL_NUM_ARGS, sizeof( cl_uint ), &numArgs, 0 );
+    assert( numArgs == n && "Wrong number of kernel arguments" );
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// Invoke kernel asynchronously binding arguments with compile-time type
+/// checking and without heap allocation; preferred over the VArgList based
+/// InvokeKernelAsync in launch intensive code:
+///\code
+///  Launch( ec, globalWGroupSize, localWGroupSize,
+///          dA, dB, dC, MATRIX_WIDTH, MATRIX_HEIGHT );
+///\endcode
+/// No event is created; use InvokeKernelAsync when profiling information is
+/// required.
+/// \throw std::runtime_error in case of errors binding arguments or enqueuing
+/// the kernel
+template < typename... ArgsT >
+inline void Launch( cl_command_queue cq,
+                    cl_kernel k,
+                    const SizeArray& gwgs,
+                    const SizeArray& lwgs,
+                    const ArgsT&... args )
+{
+    AssertNumKernelArgs( k, sizeof...( ArgsT ) );
+    SetKernelArgs( k, 0, args... );
+    EnqueueKernelAsync( cq, k, gwgs, lwgs );
+}
+
+//------------------------------------------------------------------------------
+/// Invoke kernel asynchronously after the events in the wait list complete;
+/// see Launch( cl_command_queue, ... ).
+/// \return event associated with the kernel execution
+template < typename... ArgsT >
+inline HEvent Launch( cl_command_queue cq,
+                      cl_kernel k,
+                      const SizeArray& gwgs,
+                      const SizeArray& lwgs,
+                      const EventArray& waitList,
+                      const ArgsT&... args )
+{
+    AssertNumKernelArgs( k, sizeof...( ArgsT ) );
+    SetKernelArgs( k, 0, args... );
+    cl_event e = cl_event();
+    EnqueueKernelAsync( cq, k, gwgs, lwgs, &e, waitList );
+    return HEvent( e );
+}
+
+//------------------------------------------------------------------------------
+/// Invoke kernel asynchronously; see Launch( cl_command_queue, ... ).
+template < typename... ArgsT >
+inline void Launch( const CLExecutionContext& ec,
+                    const SizeArray& gwgs,
+                    const SizeArray& lwgs,
+                    const ArgsT&... args )
+{
+    Launch( ec.commandQueue, ec.kernel, gwgs, lwgs, args... );
+}
+
+//------------------------------------------------------------------------------
+/// Invoke kernel asynchronously after the events in the wait list complete;
+/// see Launch( cl_command_queue, ... ).
+template < typename... ArgsT >
+inline HEvent Launch( const CLExecutionContext& ec,
+                      const SizeArray& gwgs,
+                      const SizeArray& lwgs,
+                      const EventArray& waitList,
+                      const ArgsT&... args )
+{
+    return Launch( ec.commandQueue, ec.kernel, gwgs, lwgs, waitList, args... );
+}
+
+//------------------------------------------------------------------------------
+/// Release resources stored in execution context and remove programs
+/// built in the context from ProgramRegistry::Instance().
 /// \param[in,out] ec valid execution context
 /// \throw std::runtime_error in case an operation fails.
 void ReleaseExecutionContext( CLExecutionContext& ec );
@@ -483,6 +1148,10 @@ public:
     double ExecutionTime() const { return ( commandEnd - commandStart ) / 1.E6; }
     ///@return delay in milliseconds between submission and start time
     double Latency() const { return ( commandStart - commandSubmitted ) / 1.E6; }
+    ///@return device time stamp in nanoseconds of command start
+    cl_ulong StartTime() const { return commandStart; }
+    ///@return device time stamp in nanoseconds of command end
+    cl_ulong EndTime() const { return commandEnd; }
 private:
     cl_ulong commandQueued;
     cl_ulong commandSubmitted;
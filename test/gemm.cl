@@ -0,0 +1,149 @@
+#ifdef DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64: enable
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
+// C = alpha * op(A) * op(B) + beta * C, all matrices in row-major order;
+// op(A) is M x K, op(B) is K x N, C is M x N.
+// Column-major problems are mapped to row-major ones by the host code
+// (see opencl/Gemm.cpp): C^T = alpha * op(B)^T * op(A)^T + beta * C^T.
+//
+// Build options, all required except TRANS_A, TRANS_B and DOUBLE:
+// TILE_M, TILE_N  size of the block of C computed by a work-group
+// TILE_K          depth of the blocks of A and B staged in local memory
+// WPT_M, WPT_N    size of the block of C computed by a work-item; the
+//                 work-group size is TILE_N / WPT_N x TILE_M / WPT_M
+// VW              width of vector loads from global memory: 1, 2, 4 or 8;
+//                 must divide TILE_M, TILE_N and TILE_K
+// TRANS_A=1       A is stored as K x M
+// TRANS_B=1       B is stored as N x K
+
+#ifndef TRANS_A
+#define TRANS_A 0
+#endif
+#ifndef TRANS_B
+#define TRANS_B 0
+#endif
+
+#define RTS_M ( TILE_M / WPT_M ) // work-group rows
+#define RTS_N ( TILE_N / WPT_N ) // work-group columns
+#define NUM_THREADS ( RTS_M * RTS_N )
+
+#define CONCAT_( a, b ) a##b
+#define CONCAT( a, b ) CONCAT_( a, b )
+
+// copy 'avail' elements, at most VW, from global memory and zero the rest;
+// a vector load is used when the whole chunk is within bounds
+inline void load_chunk( real_t* dst, __global const real_t* src, int avail ) {
+#if VW > 1
+    if( avail >= VW ) {
+        CONCAT( vstore, VW )( CONCAT( vload, VW )( 0, src ), 0, dst );
+        return;
+    }
+#endif
+    for( int i = 0; i != VW; ++i ) dst[ i ] = i < avail ? src[ i ] : (real_t) 0;
+}
+
+__kernel void
+Gemm( int M, int N, int K,
+      real_t alpha,
+      __global const real_t* restrict A, int lda,
+      __global const real_t* restrict B, int ldb,
+      real_t beta,
+      __global real_t* restrict C, int ldc ) {
+
+    // blocks of op(A) and op(B) are both stored with k as the row index so
+    // that the inner loop reads consecutive elements
+    __local real_t As[ TILE_K ][ TILE_M ];
+    __local real_t Bs[ TILE_K ][ TILE_N ];
+
+    const int tx = get_local_id( 0 );
+    const int ty = get_local_id( 1 );
+    const int tid = ty * RTS_N + tx;
+    const int row0 = get_group_id( 1 ) * TILE_M;
+    const int col0 = get_group_id( 0 ) * TILE_N;
+
+    real_t acc[ WPT_M ][ WPT_N ];
+    for( int wm = 0; wm != WPT_M; ++wm ) {
+        for( int wn = 0; wn != WPT_N; ++wn ) acc[ wm ][ wn ] = 0;
+    }
+    real_t chunk[ VW ];
+
+    for( int k0 = 0; k0 < K; k0 += TILE_K ) {
+        // (1) stage blocks into local memory; elements outside the matrices
+        // are zero and do not contribute to the result
+        for( int l = tid; l < TILE_M * TILE_K / VW; l += NUM_THREADS ) {
+#if TRANS_A
+            // A is K x M: rows of the block are contiguous along m
+            const int k = l / ( TILE_M / VW );
+            const int m = ( l % ( TILE_M / VW ) ) * VW;
+            const int gk = k0 + k;
+            const int gm = row0 + m;
+            const int avail = gk < K ? M - gm : 0;
+            load_chunk( chunk, A + ( avail > 0 ? gk * lda + gm : 0 ), avail );
+            for( int i = 0; i != VW; ++i ) As[ k ][ m + i ] = chunk[ i ];
+#else
+            // A is M x K: contiguous along k
+            const int m = l / ( TILE_K / VW );
+            const int k = ( l % ( TILE_K / VW ) ) * VW;
+            const int gk = k0 + k;
+            const int gm = row0 + m;
+            const int avail = gm < M ? K - gk : 0;
+            load_chunk( chunk, A + ( avail > 0 ? gm * lda + gk : 0 ), avail );
+            for( int i = 0; i != VW; ++i ) As[ k + i ][ m ] = chunk[ i ];
+#endif
+        }
+        for( int l = tid; l < TILE_N * TILE_K / VW; l += NUM_THREADS ) {
+#if TRANS_B
+            // B is N x K: contiguous along k
+            const int n = l / ( TILE_K / VW );
+            const int k = ( l % ( TILE_K / VW ) ) * VW;
+            const int gk = k0 + k;
+            const int gn = col0 + n;
+            const int avail = gn < N ? K - gk : 0;
+            load_chunk( chunk, B + ( avail > 0 ? gn * ldb + gk : 0 ), avail );
+            for( int i = 0; i != VW; ++i ) Bs[ k + i ][ n ] = chunk[ i ];
+#else
+            // B is K x N: contiguous along n
+            const int k = l / ( TILE_N / VW );
+            const int n = ( l % ( TILE_N / VW ) ) * VW;
+            const int gk = k0 + k;
+            const int gn = col0 + n;
+            const int avail = gk < K ? N - gn : 0;
+            load_chunk( chunk, B + ( avail > 0 ? gk * ldb + gn : 0 ), avail );
+            for( int i = 0; i != VW; ++i ) Bs[ k ][ n + i ] = chunk[ i ];
+#endif
+        }
+        barrier( CLK_LOCAL_MEM_FENCE );
+
+        // (2) multiply blocks; each work-item owns a strided WPT_M x WPT_N
+        // register block so that neighbouring work-items read neighbouring
+        // local memory banks
+        for( int k = 0; k != TILE_K; ++k ) {
+            real_t a[ WPT_M ];
+            real_t b[ WPT_N ];
+            for( int wm = 0; wm != WPT_M; ++wm ) a[ wm ] = As[ k ][ ty + wm * RTS_M ];
+            for( int wn = 0; wn != WPT_N; ++wn ) b[ wn ] = Bs[ k ][ tx + wn * RTS_N ];
+            for( int wm = 0; wm != WPT_M; ++wm ) {
+                for( int wn = 0; wn != WPT_N; ++wn ) acc[ wm ][ wn ] += a[ wm ] * b[ wn ];
+            }
+        }
+        barrier( CLK_LOCAL_MEM_FENCE );
+    }
+
+    // (3) write results within bounds; C is not read when beta is zero so
+    // that it can be uninitialized
+    for( int wm = 0; wm != WPT_M; ++wm ) {
+        const int gm = row0 + ty + wm * RTS_M;
+        if( gm >= M ) break;
+        for( int wn = 0; wn != WPT_N; ++wn ) {
+            const int gn = col0 + tx + wn * RTS_N;
+            if( gn >= N ) break;
+            const int idx = gm * ldc + gn;
+            C[ idx ] = beta == (real_t) 0 ? alpha * acc[ wm ][ wn ]
+                                          : alpha * acc[ wm ][ wn ] + beta * C[ idx ];
+        }
+    }
+}
@@ -34,8 +34,11 @@ MatMul( __global const real_t* restrict A,
     __local real_t M1[TILE_SIZE][TILE_SIZE];
     __local real_t M2[TILE_SIZE][TILE_SIZE];
 
-    const int blockRow = get_group_id(1); 
-    const int blockCol = get_group_id(0);
+    // block indices are derived from the global id, which includes the
+    // global work offset: get_group_id does not, and partitioned launches
+    // (see opencl/MultiDevice.h) assign rows to devices through the offset
+    const int blockRow = get_global_id(1) / TILE_SIZE; 
+    const int blockCol = get_global_id(0) / TILE_SIZE;
     const int row = get_local_id(1);
     const int col = get_local_id(0);
     real_t out = 0;
@@ -7,7 +7,11 @@ typedef float real_t;
 
 typedef unsigned uint;
 
+// build with -DROW to select the row-major matrix * vector path, whose
+// rows can be partitioned among devices
+#ifndef ROW
 #define COLUMN //2x speed increase
+#endif
 
 __kernel void VecMatMul( const __global real_t* M,
                          uint width,
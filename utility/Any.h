@@ -25,11 +25,29 @@
 #include <typeinfo>
 #include <vector>
 #include <iterator>
+#include <string>
+#include <stdexcept>
+#include <ostream>
+#include <new>
+#include <utility>
+#include <type_traits>
 
+class Any;
+// Friend functions defined inside Any are only found through argument
+// dependent lookup, which does not apply to calls with explicit template
+// arguments such as AnyPtr< T >( a ): declare them at namespace scope.
+template < class ValT > void CheckAnyTypeAndThrow( const Any& any );
+template < class AnyT > AnyT* AnyPtr( Any& any );
+template < class AnyT > const AnyT* AnyPtr( const Any& any );
+template < class AnyT > AnyT& AnyRef( Any& any );
+template < class AnyT > const AnyT& AnyRef( const Any& any );
+template < class AnyT > AnyT AnyVal( const Any& any );
 
 //------------------------------------------------------------------------------
-/// @brief Class that can hold instances of any type. Uses defaule new/delete
-/// operators.
+/// @brief Class that can hold instances of any type. Trivially copyable
+/// values small enough, e.g. OpenCL handles, scalars and vector types, are
+/// stored inline and never allocate; other values are allocated with the
+/// default new/delete operators.
 /// @todo allow client code to specify allocator
 /// @ingroup utility
 class Any
@@ -37,17 +55,23 @@ class Any
 public:
     /// Type used by Any::Type() method to signal an empty @c Any instance. 
     struct EMPTY_ {};
+    /// Size of inline storage: holds the value handler, i.e. a virtual table
+    /// pointer followed by values of up to 32 bytes.
+    enum { INLINE_STORAGE_SIZE = 48 };
     /// Default constructor, sets the internal pointer to @c NULL
     Any() : pval_( 0 ) {}
     /// Constructor accepting a parameter copied into internal type instance.
     template < class ValT >
     Any( const ValT& v ) 
-        : pval_( new ValHandler< ValT >( v ) )
+        : pval_( Create( v, &storage_ ) )
     {} 
     /// Copy constructor.
-    Any( const Any& a ) : pval_( a.pval_ ? a.pval_->Clone() : 0 ) {}
+    Any( const Any& a ) : pval_( a.pval_ ? a.pval_->Clone( &storage_ ) : 0 ) {}
+    /// Move constructor: takes over heap allocated values, copies inline ones;
+    /// does not throw, containers move Any instances when reallocating.
+    Any( Any&& a ) noexcept : pval_( 0 ) { MoveFrom( a ); }
     /// Destructor: deletes the contained data type.
-    ~Any() { delete pval_; }
+    ~Any() { Destroy(); }
 public:
     /// Returns @c true if instance empty.
     bool Empty() const { return pval_ == 0; }
@@ -57,16 +81,42 @@ public:
         //note gcc requires typeid(C) with C != void; compiles on vc++ 2008
         return !Empty() ? pval_->GetType() : typeid( EMPTY_ ); // 
     } 
-    /// Swap two Any instances by swapping the internal pointers.
-    Any& Swap( Any& a ) { std::swap( pval_, a.pval_ ); return *this; }
+    /// Swap two Any instances; internal pointers are swapped for heap
+    /// allocated values.
+    Any& Swap( Any& a )
+    {
+        if( &a == this ) return *this;
+        Any t( std::move( a ) );
+        a.MoveFrom( *this );
+        MoveFrom( t );
+        return *this;
+    }
     /// Assignment
-    Any& operator=( const Any& a ) { Any( a ).Swap( *this ); return *this; }
+    Any& operator=( const Any& a )
+    {
+        if( &a == this ) return *this;
+        Any t( a );
+        Destroy();
+        MoveFrom( t );
+        return *this;
+    }
+    /// Move assignment.
+    Any& operator=( Any&& a )
+    {
+        if( &a == this ) return *this;
+        Destroy();
+        MoveFrom( a );
+        return *this;
+    }
     /// Assignment from non - @c Any value.
     template < class ValT > 
     Any& operator=( const ValT& v )
     { 
         CheckAnyTypeAndThrow< ValT >( *this );
-        Any( v ).Swap( *this ); return *this;
+        Any t( v );
+        Destroy();
+        MoveFrom( t );
+        return *this;
     }
     /// Equality: check by converting value to contained value type then
     /// invoking equality operator on converted type.
@@ -202,10 +252,11 @@ private:
         CheckAnyTypeAndThrow< ValT >( *this );
     }
     /// @interface HandlerBase Wrapper for data storage.
-    struct HandlerBase // hint: use small object allocator
+    struct HandlerBase
     {
         virtual const std::type_info& GetType() const = 0;
-        virtual HandlerBase* Clone() const = 0;
+        /// Copy into \c storage if the value fits, on the heap otherwise.
+        virtual HandlerBase* Clone( void* storage ) const = 0;
         virtual ~HandlerBase() {}
         virtual size_t GetAlignment() const  = 0;
         virtual std::ostream& Serialize( std::ostream& os ) const = 0;
@@ -226,28 +277,99 @@ private:
         enum {Value = sizeof( D ) - sizeof( T )};
     };
 
+    /// Checks if values of type \c T can be written to output streams.
+    template < typename T > struct IsStreamable
+    {
+        template < typename U >
+        static char Test( decltype( std::declval< std::ostream& >() << std::declval< const U& >(), void() )* );
+        template < typename U >
+        static long Test( ... );
+        enum { Value = sizeof( Test< T >( 0 ) ) == 1 };
+    };
+    /// Print value.
+    template < typename T >
+    static std::ostream& Print( std::ostream& os, const T& v, std::true_type ) { return os << v; }
+    /// Print type name of values without output operator, e.g. OpenCL vector types.
+    template < typename T >
+    static std::ostream& Print( std::ostream& os, const T&, std::false_type ) { return os << typeid( T ).name(); }
+
     /// HandlerBase actual data container class.
     template < class T > struct ValHandler :  HandlerBase
     {
         typedef T Type;
         T val_;
-        size_t alignment_;
-        ValHandler( const T& v ) : val_( v ), alignment_( Align< T >::Value )
+        ValHandler( const T& v ) : val_( v )
         {}
         const std::type_info& GetType() const { return typeid( T ); }
-        ValHandler* Clone() const { return new ValHandler( val_ ); }
+        HandlerBase* Clone( void* storage ) const { return Create( val_, storage ); }
         std::ostream& Serialize( std::ostream& os ) const
         {
-            os << val_;
-            return os;
+            return Print( os, val_, std::integral_constant< bool, IsStreamable< T >::Value >() );
         }
         size_t SizeofData() const { return sizeof( Type ); }
         void* GetDataAddress() { return &val_; }
         const void* GetDataAddress() const { return &val_; }
-        size_t GetAlignment() const { return alignment_; } 
+        size_t GetAlignment() const { return Align< T >::Value; } 
+    };
+
+    /// Most restrictive alignment of fundamental types.
+    union MaxAlign
+    {
+        long double ld;
+        long long ll;
+        double d;
+        void* p;
+    };
+    enum { INLINE_STORAGE_ALIGNMENT = Align< MaxAlign >::Value };
+    typedef std::aligned_storage< INLINE_STORAGE_SIZE, INLINE_STORAGE_ALIGNMENT >::type InlineStorage;
+
+    /// Values stored inline: copying and destroying them must have no side
+    /// effects since inline values are copied when Any instances are moved.
+    template < class T > struct FitsInline
+    {
+        enum { Value = std::is_trivially_copyable< T >::value
+                       && sizeof( ValHandler< T > ) <= INLINE_STORAGE_SIZE
+                       && int( Align< ValHandler< T > >::Value ) <= int( INLINE_STORAGE_ALIGNMENT ) };
     };
 
-    ///Pointer to contained data: deleted when Any instance deleted.
+    /// Create handler in \c storage if the value fits, on the heap otherwise.
+    template < class T >
+    static HandlerBase* Create( const T& v, void* storage )
+    {
+        if( FitsInline< T >::Value ) return new ( storage ) ValHandler< T >( v );
+        return new ValHandler< T >( v );
+    }
+
+    /// Returns \c true if the value is stored inline.
+    bool Inline() const { return pval_ == static_cast< const void* >( &storage_ ); }
+
+    /// Destroy contained value; the instance is empty afterwards.
+    void Destroy()
+    {
+        if( Inline() ) pval_->~HandlerBase();
+        else delete pval_;
+        pval_ = 0;
+    }
+
+    /// Take value of \c a, leaving it empty; this instance must be empty.
+    void MoveFrom( Any& a )
+    {
+        if( a.Inline() )
+        {
+            pval_ = a.pval_->Clone( &storage_ );
+            a.Destroy();
+        }
+        else
+        {
+            pval_ = a.pval_;
+            a.pval_ = 0;
+        }
+    }
+
+    ///Inline storage for small values.
+    InlineStorage storage_;
+    ///Pointer to contained data: points to inline storage or to heap
+    ///allocated data deleted when Any instance deleted.
     HandlerBase* pval_;    
 
     ///Overloaded operator to serialize data to output streams.
@@ -0,0 +1,48 @@
+#ifndef HASH_H_
+#define HASH_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <cstddef>
+
+/// 64 bit FNV-1a hash of a sequence of bytes.
+/// \param data address of first byte
+/// \param size number of bytes
+/// \param h initial value, pass the value returned by a previous invocation
+///        to hash non contiguous data
+inline unsigned long long FNV1aHash( const void* data, size_t size,
+                                     unsigned long long h = 14695981039346656037ULL )
+{
+    const unsigned char* p = static_cast< const unsigned char* >( data );
+    for( const unsigned char* e = p + size; p != e; ++p )
+    {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/// 64 bit FNV-1a hash of a string.
+inline unsigned long long FNV1aHash( const std::string& s )
+{
+    return FNV1aHash( s.data(), s.size() );
+}
+
+#endif //HASH_H_
@@ -0,0 +1,133 @@
+///\file utility/Histogram.h Streaming log-linear histogram with bounded relative error
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+
+//------------------------------------------------------------------------------
+/// Histogram of non-negative integer values with constant relative
+/// resolution, in the style of HdrHistogram: values below 2^SUB_BUCKET_BITS
+/// are counted exactly, larger values fall into buckets whose width is
+/// 1/2^(SUB_BUCKET_BITS - 1) of their lower bound, so that percentiles are
+/// reported with less than 0.4% error whatever the range of the samples.
+/// Memory grows with the logarithm of the largest value (about 25 KiB for
+/// one second in nanoseconds) and recording a value is constant time.
+/// Minimum and maximum are tracked exactly. Not thread safe.
+class HdrHistogram
+{
+public:
+    /// Exact values below 2^SUB_BUCKET_BITS, 2^(SUB_BUCKET_BITS - 1)
+    /// sub-buckets per power of two above.
+    enum { SUB_BUCKET_BITS = 8 };
+    /// Default constructor.
+    HdrHistogram() : count_( 0 ), min_( std::numeric_limits< unsigned long long >::max() ), max_( 0 ) {}
+    /// Record value.
+    void Add( unsigned long long v )
+    {
+        const size_t i = Index( v );
+        if( i >= counts_.size() ) counts_.resize( i + 1, 0 );
+        ++counts_[ i ];
+        ++count_;
+        if( v < min_ ) min_ = v;
+        if( v > max_ ) max_ = v;
+    }
+    /// Add all the values recorded in another histogram.
+    void Add( const HdrHistogram& h )
+    {
+        if( h.counts_.size() > counts_.size() ) counts_.resize( h.counts_.size(), 0 );
+        for( size_t i = 0; i != h.counts_.size(); ++i ) counts_[ i ] += h.counts_[ i ];
+        count_ += h.count_;
+        if( h.min_ < min_ ) min_ = h.min_;
+        if( h.max_ > max_ ) max_ = h.max_;
+    }
+    /// Returns number of recorded values.
+    unsigned long long Count() const { return count_; }
+    /// Returns smallest recorded value, zero if empty.
+    unsigned long long Min() const { return count_ ? min_ : 0; }
+    /// Returns largest recorded value.
+    unsigned long long Max() const { return max_; }
+    /// Returns value below which fraction \c p of the recorded values lie,
+    /// i.e. Percentile( 0.5 ) is the median; zero if empty.
+    /// \param p fraction in [0, 1]
+    unsigned long long Percentile( double p ) const
+    {
+        if( count_ == 0 ) return 0;
+        if( p <= 0. ) return Min();
+        if( p >= 1. ) return Max();
+        // rank of the requested value, 1 based
+        unsigned long long rank = static_cast< unsigned long long >( p * count_ + 0.5 );
+        if( rank == 0 ) rank = 1;
+        unsigned long long seen = 0;
+        for( size_t i = 0; i != counts_.size(); ++i )
+        {
+            seen += counts_[ i ];
+            if( seen >= rank )
+            {
+                // bucket midpoint, clamped to the exact extremes
+                const unsigned long long v = Lowest( i ) + Width( i ) / 2;
+                return v < min_ ? min_ : v > max_ ? max_ : v;
+            }
+        }
+        return Max();
+    }
+    /// Remove all values.
+    void Clear()
+    {
+        counts_.clear();
+        count_ = 0;
+        min_ = std::numeric_limits< unsigned long long >::max();
+        max_ = 0;
+    }
+private:
+    enum { EXACT = 1 << SUB_BUCKET_BITS, HALF = EXACT / 2 };
+    /// Returns index of bucket containing value.
+    static size_t Index( unsigned long long v )
+    {
+        if( v < EXACT ) return size_t( v );
+        int msb = 0;
+        for( unsigned long long x = v; x >>= 1; ) ++msb;
+        const int shift = msb - SUB_BUCKET_BITS + 1;
+        return size_t( EXACT + ( shift - 1 ) * HALF + ( ( v >> shift ) - HALF ) );
+    }
+    /// Returns lowest value of bucket.
+    static unsigned long long Lowest( size_t i )
+    {
+        if( i < EXACT ) return i;
+        const int shift = int( ( i - EXACT ) / HALF ) + 1;
+        return ( ( i - EXACT ) % HALF + HALF ) << shift;
+    }
+    /// Returns number of values in bucket.
+    static unsigned long long Width( size_t i )
+    {
+        return i < EXACT ? 1 : 1ULL << ( ( i - EXACT ) / HALF + 1 );
+    }
+private:
+    std::vector< unsigned long long > counts_;
+    unsigned long long count_;
+    unsigned long long min_;
+    unsigned long long max_;
+};
+
+#endif //HISTOGRAM_H_
@@ -0,0 +1,414 @@
+#ifndef HOST_GEMM_H_
+#define HOST_GEMM_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <limits>
+#include <iostream>
+#if defined( __AVX__ )
+#include <immintrin.h>
+#define HOST_GEMM_AVX
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define HOST_GEMM_SSE2
+#endif
+
+//------------------------------------------------------------------------------
+/// Split [0, n) into at most \c numThreads contiguous ranges of multiples of
+/// \c grain elements and invoke f( begin, end ) on each range, the first one
+/// in the calling thread.
+/// \param numThreads maximum number of threads, zero means one per core
+template < typename F >
+void ParallelRanges( size_t n, int numThreads, F f, size_t grain = 1 )
+{
+    if( numThreads <= 0 ) numThreads = std::max( 1, int( std::thread::hardware_concurrency() ) );
+    const size_t chunks = ( n + grain - 1 ) / grain;
+    if( size_t( numThreads ) > chunks ) numThreads = int( std::max( size_t( 1 ), chunks ) );
+    const size_t perThread = ( chunks + numThreads - 1 ) / numThreads * grain;
+    std::vector< std::thread > threads;
+    for( int t = 1; t < numThreads && t * perThread < n; ++t )
+    {
+        threads.push_back( std::thread( f, t * perThread, std::min( n, ( t + 1 ) * perThread ) ) );
+    }
+    f( size_t( 0 ), std::min( n, perThread ) );
+    for( std::vector< std::thread >::iterator t = threads.begin(); t != threads.end(); ++t ) t->join();
+}
+
+//------------------------------------------------------------------------------
+/// Vector operations used by the host GEMM micro-kernel; the generic version
+/// operates on scalars and is specialized for SSE2 and AVX.
+template < typename T > struct SimdTraits
+{
+    typedef T Vec;
+    enum { WIDTH = 1 };
+    static Vec Load( const T* p ) { return *p; }
+    static void Store( T* p, Vec v ) { *p = v; }
+    static Vec Broadcast( T v ) { return v; }
+    static Vec Zero() { return T( 0 ); }
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return a * b + c; }
+};
+
+#if defined( HOST_GEMM_AVX )
+template <> struct SimdTraits< float >
+{
+    typedef __m256 Vec;
+    enum { WIDTH = 8 };
+    static Vec Load( const float* p ) { return _mm256_loadu_ps( p ); }
+    static void Store( float* p, Vec v ) { _mm256_storeu_ps( p, v ); }
+    static Vec Broadcast( float v ) { return _mm256_set1_ps( v ); }
+    static Vec Zero() { return _mm256_setzero_ps(); }
+#ifdef __FMA__
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return _mm256_fmadd_ps( a, b, c ); }
+#else
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return _mm256_add_ps( _mm256_mul_ps( a, b ), c ); }
+#endif
+};
+template <> struct SimdTraits< double >
+{
+    typedef __m256d Vec;
+    enum { WIDTH = 4 };
+    static Vec Load( const double* p ) { return _mm256_loadu_pd( p ); }
+    static void Store( double* p, Vec v ) { _mm256_storeu_pd( p, v ); }
+    static Vec Broadcast( double v ) { return _mm256_set1_pd( v ); }
+    static Vec Zero() { return _mm256_setzero_pd(); }
+#ifdef __FMA__
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return _mm256_fmadd_pd( a, b, c ); }
+#else
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return _mm256_add_pd( _mm256_mul_pd( a, b ), c ); }
+#endif
+};
+#elif defined( HOST_GEMM_SSE2 )
+template <> struct SimdTraits< float >
+{
+    typedef __m128 Vec;
+    enum { WIDTH = 4 };
+    static Vec Load( const float* p ) { return _mm_loadu_ps( p ); }
+    static void Store( float* p, Vec v ) { _mm_storeu_ps( p, v ); }
+    static Vec Broadcast( float v ) { return _mm_set1_ps( v ); }
+    static Vec Zero() { return _mm_setzero_ps(); }
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+};
+template <> struct SimdTraits< double >
+{
+    typedef __m128d Vec;
+    enum { WIDTH = 2 };
+    static Vec Load( const double* p ) { return _mm_loadu_pd( p ); }
+    static void Store( double* p, Vec v ) { _mm_storeu_pd( p, v ); }
+    static Vec Broadcast( double v ) { return _mm_set1_pd( v ); }
+    static Vec Zero() { return _mm_setzero_pd(); }
+    static Vec MulAdd( Vec a, Vec b, Vec c ) { return _mm_add_pd( _mm_mul_pd( a, b ), c ); }
+};
+#endif
+
+//------------------------------------------------------------------------------
+/// Cache-blocked GEMM on row-major matrices: blocks of B of KC x NC elements
+/// and of A of MC x KC elements are packed into contiguous panels that stay
+/// in L2 and L1 cache respectively, and a register-blocked micro-kernel
+/// computes MR x NR blocks of C from one panel of each.
+template < typename T > class HostGemmBlocked
+{
+    typedef SimdTraits< T > S;
+    typedef typename S::Vec Vec;
+public:
+    enum
+    {
+        NV = S::WIDTH == 1 ? 4 : 2,  //!< vectors per micro-kernel row
+        MR = 4,                      //!< micro-kernel rows
+        NR = S::WIDTH * NV,          //!< micro-kernel columns
+        MC = 128,                    //!< rows of packed A block
+        KC = 256,                    //!< depth of packed blocks
+        NC = 2048                    //!< columns of packed B block
+    };
+    /// Compute rows [m0, m1) of C; see HostGemm().
+    static void Rows( bool transA, bool transB, int m0, int m1, int n, int k,
+                      T alpha, const T* A, int lda, const T* B, int ldb,
+                      T beta, T* C, int ldc )
+    {
+        for( int i = m0; i < m1; ++i )
+        {
+            T* c = C + size_t( i ) * ldc;
+            // C is not read when beta is zero so that it can be uninitialized
+            if( beta == T( 0 ) ) std::fill( c, c + n, T( 0 ) );
+            else if( beta != T( 1 ) ) for( int j = 0; j != n; ++j ) c[ j ] *= beta;
+        }
+        if( k == 0 || alpha == T( 0 ) ) return;
+        std::vector< T > packedA( MC * KC );
+        std::vector< T > packedB( size_t( KC ) * NC );
+        for( int jc = 0; jc < n; jc += NC )
+        {
+            const int nc = std::min( int( NC ), n - jc );
+            for( int pc = 0; pc < k; pc += KC )
+            {
+                const int kc = std::min( int( KC ), k - pc );
+                PackB( transB, B, ldb, pc, kc, jc, nc, &packedB[ 0 ] );
+                for( int ic = m0; ic < m1; ic += MC )
+                {
+                    const int mc = std::min( int( MC ), m1 - ic );
+                    PackA( transA, A, lda, ic, mc, pc, kc, &packedA[ 0 ] );
+                    for( int jr = 0; jr < nc; jr += NR )
+                    {
+                        for( int ir = 0; ir < mc; ir += MR )
+                        {
+                            MicroKernel( kc, alpha, &packedA[ size_t( ir ) * kc ], &packedB[ size_t( jr ) * kc ],
+                                         C + size_t( ic + ir ) * ldc + jc + jr, ldc,
+                                         std::min( int( MR ), mc - ir ), std::min( int( NR ), nc - jr ) );
+                        }
+                    }
+                }
+            }
+        }
+    }
+private:
+    /// Element ( row, col ) of op( M ).
+    static T At( bool trans, const T* M, int ld, int row, int col )
+    {
+        return trans ? M[ size_t( col ) * ld + row ] : M[ size_t( row ) * ld + col ];
+    }
+    /// Pack mc x kc block of op( A ) into panels of MR rows stored column by
+    /// column; rows past the block are zero.
+    static void PackA( bool trans, const T* A, int lda, int i0, int mc, int p0, int kc, T* dst )
+    {
+        for( int ir = 0; ir < mc; ir += MR )
+        {
+            for( int p = 0; p != kc; ++p )
+            {
+                for( int r = 0; r != MR; ++r, ++dst )
+                {
+                    *dst = ir + r < mc ? At( trans, A, lda, i0 + ir + r, p0 + p ) : T( 0 );
+                }
+            }
+        }
+    }
+    /// Pack kc x nc block of op( B ) into panels of NR columns stored row by
+    /// row; columns past the block are zero.
+    static void PackB( bool trans, const T* B, int ldb, int p0, int kc, int j0, int nc, T* dst )
+    {
+        for( int jr = 0; jr < nc; jr += NR )
+        {
+            const int nr = std::min( int( NR ), nc - jr );
+            for( int p = 0; p != kc; ++p )
+            {
+                if( !trans && nr == NR )
+                {
+                    std::memcpy( dst, B + size_t( p0 + p ) * ldb + j0 + jr, NR * sizeof( T ) );
+                    dst += NR;
+                    continue;
+                }
+                for( int c = 0; c != NR; ++c, ++dst )
+                {
+                    *dst = c < nr ? At( trans, B, ldb, p0 + p, j0 + jr + c ) : T( 0 );
+                }
+            }
+        }
+    }
+    /// C[ 0:mr, 0:nr ] += alpha * packed A panel * packed B panel.
+    static void MicroKernel( int kc, T alpha, const T* a, const T* b, T* C, int ldc, int mr, int nr )
+    {
+        Vec acc[ MR ][ NV ];
+        for( int r = 0; r != MR; ++r )
+        {
+            for( int v = 0; v != NV; ++v ) acc[ r ][ v ] = S::Zero();
+        }
+        for( int p = 0; p != kc; ++p, a += MR, b += NR )
+        {
+            Vec bv[ NV ];
+            for( int v = 0; v != NV; ++v ) bv[ v ] = S::Load( b + v * S::WIDTH );
+            for( int r = 0; r != MR; ++r )
+            {
+                const Vec av = S::Broadcast( a[ r ] );
+                for( int v = 0; v != NV; ++v ) acc[ r ][ v ] = S::MulAdd( av, bv[ v ], acc[ r ][ v ] );
+            }
+        }
+        T tmp[ MR ][ NR ];
+        for( int r = 0; r != MR; ++r )
+        {
+            for( int v = 0; v != NV; ++v ) S::Store( &tmp[ r ][ v * S::WIDTH ], acc[ r ][ v ] );
+        }
+        for( int r = 0; r != mr; ++r )
+        {
+            T* c = C + size_t( r ) * ldc;
+            for( int j = 0; j != nr; ++j ) c[ j ] += alpha * tmp[ r ][ j ];
+        }
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Computes C = alpha * op( A ) * op( B ) + beta * C on the host for
+/// verification of device results or as a CPU fallback; matrices are in
+/// row-major order, op( A ) is m x k, op( B ) is k x n. Column-major
+/// problems are computed by swapping A with B and m with n.
+/// Rows of C are split among threads.
+/// \param transA \c true if A is stored as k x m
+/// \param transB \c true if B is stored as n x k
+/// \param numThreads maximum number of threads, zero means one per core
+template < typename T >
+void HostGemm( bool transA, bool transB, int m, int n, int k,
+               T alpha, const T* A, int lda, const T* B, int ldb,
+               T beta, T* C, int ldc, int numThreads = 0 )
+{
+    if( m <= 0 || n <= 0 ) return;
+    // threading costs more than it saves on small problems
+    if( double( m ) * n * k < 1E6 ) numThreads = 1;
+    struct RowRange
+    {
+        bool transA, transB;
+        int n, k;
+        T alpha;
+        const T* A;
+        int lda;
+        const T* B;
+        int ldb;
+        T beta;
+        T* C;
+        int ldc;
+        void operator()( size_t begin, size_t end ) const
+        {
+            HostGemmBlocked< T >::Rows( transA, transB, int( begin ), int( end ), n, k,
+                                        alpha, A, lda, B, ldb, beta, C, ldc );
+        }
+    };
+    const RowRange rows = { transA, transB, n, k, alpha, A, lda, B, ldb, beta, C, ldc };
+    ParallelRanges( size_t( m ), numThreads, rows, HostGemmBlocked< T >::MR );
+}
+
+//------------------------------------------------------------------------------
+/// Differences between computed values and reference values.
+struct ErrorStats
+{
+    double maxAbsError;           //!< max | result - reference |
+    double maxRelError;           //!< max | result - reference | / | reference |
+    unsigned long long maxUlp;    //!< max distance in units in the last place
+    size_t maxAbsErrorIndex;      //!< index of element with max absolute error
+    size_t count;                 //!< number of compared elements
+    ErrorStats() : maxAbsError( 0. ), maxRelError( 0. ), maxUlp( 0 ),
+                   maxAbsErrorIndex( 0 ), count( 0 ) {}
+    /// Merge statistics of another range.
+    void Merge( const ErrorStats& s )
+    {
+        if( s.maxAbsError > maxAbsError || ( s.maxAbsError != s.maxAbsError ) )
+        {
+            maxAbsError = s.maxAbsError;
+            maxAbsErrorIndex = s.maxAbsErrorIndex;
+        }
+        maxRelError = std::max( maxRelError, s.maxRelError );
+        maxUlp = std::max( maxUlp, s.maxUlp );
+        count += s.count;
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Position of a floating point value in the sequence of representable
+/// values, used to compute ULP distances.
+inline long long OrderedBits( float f )
+{
+    int i = 0;
+    std::memcpy( &i, &f, sizeof( i ) );
+    return i >= 0 ? i : ( long long )( std::numeric_limits< int >::min() ) - i;
+}
+
+inline long long OrderedBits( double d )
+{
+    long long i = 0;
+    std::memcpy( &i, &d, sizeof( i ) );
+    return i >= 0 ? i : std::numeric_limits< long long >::min() - i;
+}
+
+//------------------------------------------------------------------------------
+/// Returns number of representable values between \c a and \c b; NaNs are at
+/// maximum distance from any value.
+template < typename T >
+unsigned long long UlpDistance( T a, T b )
+{
+    if( a != a || b != b ) return std::numeric_limits< unsigned long long >::max();
+    const long long ia = OrderedBits( a );
+    const long long ib = OrderedBits( b );
+    return ia > ib ? ( unsigned long long )( ia ) - ( unsigned long long )( ib )
+                   : ( unsigned long long )( ib ) - ( unsigned long long )( ia );
+}
+
+//------------------------------------------------------------------------------
+/// Compare \c n computed values with reference values in parallel.
+/// \param numThreads maximum number of threads, zero means one per core
+template < typename T >
+ErrorStats CompareResults( const T* result, const T* reference, size_t n, int numThreads = 0 )
+{
+    struct Compare
+    {
+        const T* result;
+        const T* reference;
+        ErrorStats* stats;
+        size_t perRange;
+        void operator()( size_t begin, size_t end ) const
+        {
+            ErrorStats& s = stats[ begin / perRange ];
+            for( size_t i = begin; i != end; ++i )
+            {
+                const double ref = reference[ i ];
+                const double err = std::abs( double( result[ i ] ) - ref );
+                if( err > s.maxAbsError || err != err )
+                {
+                    s.maxAbsError = err;
+                    s.maxAbsErrorIndex = i;
+                }
+                if( ref != 0. ) s.maxRelError = std::max( s.maxRelError, err / std::abs( ref ) );
+                else if( err != 0. ) s.maxRelError = std::numeric_limits< double >::infinity();
+                s.maxUlp = std::max( s.maxUlp, UlpDistance( result[ i ], reference[ i ] ) );
+            }
+            s.count += end - begin;
+        }
+    };
+    // fixed size ranges so that each range writes into its own slot
+    const size_t RANGE = 1 << 16;
+    std::vector< ErrorStats > stats( n / RANGE + 1 );
+    const Compare compare = { result, reference, &stats[ 0 ], RANGE };
+    struct Ranges
+    {
+        const Compare* compare;
+        size_t range;
+        size_t n;
+        void operator()( size_t begin, size_t end ) const
+        {
+            for( size_t r = begin; r != end; ++r )
+            {
+                ( *compare )( r * range, std::min( n, ( r + 1 ) * range ) );
+            }
+        }
+    };
+    const Ranges ranges = { &compare, RANGE, n };
+    ParallelRanges( stats.size(), n < RANGE ? 1 : numThreads, ranges );
+    ErrorStats total;
+    for( std::vector< ErrorStats >::const_iterator s = stats.begin(); s != stats.end(); ++s ) total.Merge( *s );
+    return total;
+}
+
+///Overloaded operator to print error statistics.
+inline std::ostream& operator<<( std::ostream& os, const ErrorStats& s )
+{
+    os << "max abs error: " << s.maxAbsError << " (at " << s.maxAbsErrorIndex << ")"
+       << " max rel error: " << s.maxRelError << " max ULP: " << s.maxUlp;
+    return os;
+}
+
+#endif //HOST_GEMM_H_
@@ -0,0 +1,41 @@
+///\file utility/Json.h Helpers for writing JSON output
+
+#ifndef JSON_H_
+#define JSON_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <string>
+#include <ostream>
+
+/// Write string as JSON string literal; quotes and backslashes are escaped,
+/// control characters are replaced with spaces.
+inline void WriteJSONString( std::ostream& os, const std::string& s )
+{
+    os << '"';
+    for( std::string::const_iterator c = s.begin(); c != s.end(); ++c )
+    {
+        if( *c == '"' || *c == '\\' ) os << '\\' << *c;
+        else if( static_cast< unsigned char >( *c ) < 0x20 ) os << ' ';
+        else os << *c;
+    }
+    os << '"';
+}
+
+#endif //JSON_H_
@@ -0,0 +1,150 @@
+///\file utility/Measure.h Repeated measurements with robust statistics
+
+#ifndef MEASURE_H_
+#define MEASURE_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include "Timer.h"
+
+//------------------------------------------------------------------------------
+/// Stopping rules of RepeatMeasure() and RepeatSample().
+struct MeasureOptions
+{
+    int warmupRuns;  //!< runs executed before sampling and discarded
+    int minRuns;     //!< minimum number of samples
+    int maxRuns;     //!< maximum number of samples
+    double maxTime;  //!< sampling stops after this time in milliseconds
+    /// Sampling stops when the half width of the 95% confidence interval of
+    /// the median is below this fraction of the median.
+    double targetCI;
+    MeasureOptions() : warmupRuns( 3 ), minRuns( 10 ), maxRuns( 1000 ),
+                       maxTime( 2000. ), targetCI( 0.01 ) {}
+};
+
+//------------------------------------------------------------------------------
+/// Samples and statistics of repeated runs. The median and the median
+/// absolute deviation are used instead of mean and standard deviation since
+/// timings are skewed by interrupts and scheduling.
+struct Measurement
+{
+    std::vector< double > samples; //!< samples in the order they were taken
+    double median;
+    double mad;    //!< median absolute deviation from the median
+    double ciLow;  //!< lower bound of the 95% confidence interval of the median
+    double ciHigh; //!< upper bound of the 95% confidence interval of the median
+    bool converged; //!< \c true if the target confidence interval was reached
+    Measurement() : median( 0. ), mad( 0. ), ciLow( 0. ), ciHigh( 0. ), converged( false ) {}
+    /// Half width of the confidence interval relative to the median.
+    double RelativeCI() const { return median != 0. ? 0.5 * ( ciHigh - ciLow ) / median : 0.; }
+};
+
+//------------------------------------------------------------------------------
+/// Compute median, median absolute deviation and distribution free
+/// confidence interval of the median from the samples of a measurement.
+inline void ComputeStatistics( Measurement& m )
+{
+    const size_t n = m.samples.size();
+    if( n == 0 ) return;
+    std::vector< double > s( m.samples );
+    std::sort( s.begin(), s.end() );
+    m.median = n % 2 ? s[ n / 2 ] : 0.5 * ( s[ n / 2 - 1 ] + s[ n / 2 ] );
+    // the confidence interval of the median is bounded by the order
+    // statistics at n/2 -+ 1.96 sqrt(n)/2 (normal approximation of the
+    // binomial distribution)
+    const double h = 0.98 * std::sqrt( double( n ) );
+    const double lo = std::floor( 0.5 * n - h );
+    const double hi = std::ceil( 0.5 * n + h );
+    m.ciLow = s[ lo < 0. ? 0 : size_t( lo ) ];
+    m.ciHigh = s[ hi > n - 1 ? n - 1 : size_t( hi ) ];
+    for( std::vector< double >::iterator i = s.begin(); i != s.end(); ++i )
+    {
+        *i = std::fabs( *i - m.median );
+    }
+    std::sort( s.begin(), s.end() );
+    m.mad = n % 2 ? s[ n / 2 ] : 0.5 * ( s[ n / 2 - 1 ] + s[ n / 2 ] );
+}
+
+//------------------------------------------------------------------------------
+/// Invoke function object returning a sample, e.g. a device execution time
+/// read from an event, until the median is known with the requested
+/// precision or the maximum number of runs or time is reached.
+/// \param[in] f function object invoked as <tt>double f()</tt>
+template < class SampleT >
+Measurement RepeatSample( SampleT f, const MeasureOptions& o = MeasureOptions() )
+{
+    for( int i = 0; i < o.warmupRuns; ++i ) f();
+    Measurement m;
+    m.samples.reserve( o.maxRuns > 0 ? o.maxRuns : 0 );
+    const unsigned long long start = MonotonicClock::Now();
+    const unsigned long long maxTime = (unsigned long long)( o.maxTime * 1E6 );
+    while( int( m.samples.size() ) < o.maxRuns )
+    {
+        m.samples.push_back( f() );
+        if( int( m.samples.size() ) < o.minRuns ) continue;
+        ComputeStatistics( m );
+        m.converged = m.RelativeCI() <= o.targetCI;
+        if( m.converged || MonotonicClock::Now() - start >= maxTime ) return m;
+    }
+    ComputeStatistics( m );
+    return m;
+}
+
+//------------------------------------------------------------------------------
+/// Adapter returning the time in milliseconds taken by a function object.
+template < class FunT >
+struct TimedRun
+{
+    FunT f;
+    double operator()()
+    {
+        Timer t;
+        t.Start();
+        f();
+        return t.Stop();
+    }
+};
+
+//------------------------------------------------------------------------------
+/// Invoke function object until the median of its host execution time in
+/// milliseconds is known with the requested precision, see RepeatSample().
+/// \param[in] f function object invoked as <tt>f()</tt>
+template < class FunT >
+Measurement RepeatMeasure( FunT f, const MeasureOptions& o = MeasureOptions() )
+{
+    const TimedRun< FunT > t = { f };
+    return RepeatSample( t, o );
+}
+
+///Overloaded operator to print the statistics of a measurement.
+inline std::ostream& operator<<( std::ostream& os, const Measurement& m )
+{
+    os << "median: " << m.median << " MAD: " << m.mad
+       << " 95% CI: [" << m.ciLow << ", " << m.ciHigh << "] samples: "
+       << m.samples.size();
+    if( !m.converged ) os << " (not converged)";
+    return os;
+}
+
+#endif //MEASURE_H_
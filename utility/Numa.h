@@ -0,0 +1,134 @@
+///\file utility/Numa.h NUMA node discovery and first-touch page placement
+
+#ifndef NUMA_H_
+#define NUMA_H_
+//
+// Copyright (c) 2010 - Ugo Varetto
+//
+// This source code is free; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation; either version 3
+// of the License, or (at your option) any later version.
+//
+// This source code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this source code; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+// MA  02110-1301, USA.
+//
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#if defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//------------------------------------------------------------------------------
+/// Parses a Linux cpu or node list such as "0-7,16-23".
+inline std::vector< int > ParseCpuList( const std::string& list )
+{
+    std::vector< int > ids;
+    std::istringstream is( list );
+    std::string range;
+    while( std::getline( is, range, ',' ) )
+    {
+        if( range.empty() || range[ 0 ] < '0' || range[ 0 ] > '9' ) continue;
+        const std::string::size_type dash = range.find( '-' );
+        const int first = atoi( range.c_str() );
+        const int last = dash == std::string::npos ? first : atoi( range.c_str() + dash + 1 );
+        for( int i = first; i <= last; ++i ) ids.push_back( i );
+    }
+    return ids;
+}
+
+//------------------------------------------------------------------------------
+/// Returns CPUs of NUMA node \c node; empty if the node does not exist or the
+/// topology is not available on this platform.
+inline std::vector< int > NumaNodeCpus( int node )
+{
+#if defined( __linux__ )
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream is( path.str().c_str() );
+    std::string list;
+    if( node >= 0 && std::getline( is, list ) ) return ParseCpuList( list );
+#else
+    (void) node;
+#endif
+    return std::vector< int >();
+}
+
+//------------------------------------------------------------------------------
+/// Returns number of NUMA nodes, one if the topology is not available.
+inline int NumaNodeCount()
+{
+#if defined( __linux__ )
+    std::ifstream is( "/sys/devices/system/node/online" );
+    std::string list;
+    if( std::getline( is, list ) )
+    {
+        const std::vector< int > nodes = ParseCpuList( list );
+        if( !nodes.empty() ) return nodes.back() + 1;
+    }
+#endif
+    return 1;
+}
+
+#if defined( __linux__ )
+//------------------------------------------------------------------------------
+/// Thread function of FirstTouch(): binds the thread to \c cpus and writes
+/// zeros to memory.
+struct FirstTouchWriter
+{
+    void* p;
+    size_t size;
+    const std::vector< int >* cpus;
+    void operator()() const
+    {
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        for( std::vector< int >::const_iterator c = cpus->begin(); c != cpus->end(); ++c )
+        {
+            if( *c < CPU_SETSIZE ) CPU_SET( *c, &set );
+        }
+        // if binding fails pages are placed on the node the thread runs on
+        ::pthread_setaffinity_np( ::pthread_self(), sizeof( set ), &set );
+        std::memset( p, 0, size );
+    }
+};
+#endif
+
+//------------------------------------------------------------------------------
+/// Write zeros to \c size bytes of memory from a thread bound to the CPUs of
+/// NUMA node \c node. Operating systems with a first-touch policy, such as
+/// Linux by default, place each page on the node of the thread that writes it
+/// first: memory must not have been written before, e.g. memory returned by
+/// AlignedAlloc(). Memory is written by the calling thread when the node is
+/// negative or the topology is not available.
+inline void FirstTouch( void* p, size_t size, int node )
+{
+    if( size == 0 ) return;
+    const std::vector< int > cpus = NumaNodeCpus( node );
+#if defined( __linux__ )
+    if( !cpus.empty() )
+    {
+        const FirstTouchWriter w = { p, size, &cpus };
+        std::thread t( w );
+        t.join();
+        return;
+    }
+#endif
+    std::memset( p, 0, size );
+}
+
+#endif //NUMA_H_
@@ -20,6 +20,8 @@
 // 
 
 #include <stdexcept>
+#include <string>
+#include <atomic>
 
 //------------------------------------------------------------------------------
 ///Non-synchronized counter to keep track of number of references
@@ -52,6 +54,41 @@ private:
     unsigned count_;
 };
 
+//------------------------------------------------------------------------------
+///Lock-free counter to keep track of number of references: handlers of the
+///same resource can be copied and destroyed concurrently by different threads
+class AtomicCounter
+{
+public:
+    ///Constructor.
+    /// \param c start value for counter
+    AtomicCounter( unsigned c ) : count_( c ) {}
+    ///Default constructor.
+    AtomicCounter() : count_( 1 ) {}
+    ///Increment counter; new references are created from existing ones,
+    ///no ordering is required.
+    void Inc() {
+        count_.fetch_add( 1, std::memory_order_relaxed );
+    }
+    ///Decrement counter; acquire-release ordering makes all the accesses
+    ///through other references visible to the thread releasing the resource.
+    /// \return value of decremented counter.
+    unsigned Dec() {
+        return count_.fetch_sub( 1, std::memory_order_acq_rel ) - 1;
+    }
+    ///Check if counter is zero.
+    /// \return \c true if counter is zero
+    bool Zero() const { return count_.load( std::memory_order_acquire ) == 0; }
+    ///Return counter value
+    /// \return current value of counter
+    unsigned Count() const { return count_.load( std::memory_order_relaxed ); }
+private:
+    AtomicCounter( const AtomicCounter& );
+    AtomicCounter& operator=( const AtomicCounter& );
+    ///Counter.
+    std::atomic< unsigned > count_;
+};
+
 
 //------------------------------------------------------------------------------
 ///Generic resource handler for cases where the lifetime of resources is handled
@@ -60,9 +97,12 @@ private:
 ///\tparam ReturnTypeT type of value returned by resource handling functions
 ///\tparam RetainFunT type of function that increases the resource reference count
 ///\tparam ReleaseFunT type of function used to release the resource reference count
-///\tparam NameT printable name of resource; class needs to be convertible to const char*
+///\tparam NameT printable name of resource; class needs to be convertible to const char*;
+///        the name is only built when requested, handlers are two words long
 ///\tparam RETURN_SUCCESS_CODE identifier of successful operation
-///\tparam CounterT reference counter
+///\tparam CounterT reference counter; the default AtomicCounter allows sharing
+///        handlers among threads, SimpleCounter can be used for handlers
+///        confined to a single thread
 template< class ResourceT,
           class ReturnTypeT, 
 // _WIN32 is always defined for 32 and 64 bit
@@ -75,30 +115,56 @@ template< class ResourceT,
 #endif
           class NameT,
           ReturnTypeT RETURN_SUCCESS_CODE,    
-          class CounterT = SimpleCounter >
+          class CounterT = AtomicCounter >
 class ResourceHandler
 {
 public:
     ///Default constructor.
-    ResourceHandler() : resource_( ResourceT() ), resourceName_( NameT() ), counter_( 0 ) {}
-    ///Constructor.
+    ResourceHandler() : resource_( ResourceT() ), record_( 0 ) {}
+    ///Constructor; a null resource is not reference counted and never released.
     ///\param r resource handler
     ///\param count initial value of reference counter
-    explicit ResourceHandler( ResourceT r, unsigned count = 1 ) : resource_( r ), resourceName_( NameT() ),
-        counter_( new CounterT( count ) ) {}
+    explicit ResourceHandler( ResourceT r, unsigned count = 1 ) : resource_( r ),
+        record_( r == ResourceT() ? 0 : new Record( r, count ) ) {}
     ///Copy constructor
-    ResourceHandler( const ResourceHandler& r ) : resource_( r.resource_ ), resourceName_( NameT() ),
-        counter_( 0 )
+    ResourceHandler( const ResourceHandler& r ) : resource_( r.resource_ ), record_( r.record_ )
+    {
+        if( record_ ) record_->counter.Inc();
+    }
+    ///Move constructor: takes over the reference of \c r, the reference
+    ///count is not modified. Does not throw, containers of handlers move
+    ///them when reallocating.
+    ResourceHandler( ResourceHandler&& r ) noexcept : resource_( r.resource_ ), record_( r.record_ )
     {
-        AcquireResource( r );        
+        r.resource_ = ResourceT();
+        r.record_ = 0;
     }
     ///Assignment operator.
     ///\param r other resource handler instance
-    ResourceHandler operator=( const ResourceHandler& r )
+    ResourceHandler& operator=( const ResourceHandler& r )
+    {
+        if( r.record_ != record_ )
+        {
+            // acquire first: releasing might destroy the last other
+            // reference to a record owned by \c r
+            if( r.record_ ) r.record_->counter.Inc();
+            ReleaseResource();
+            record_ = r.record_;
+        }
+        resource_ = r.resource_;
+        return *this;
+    }
+    ///Move assignment operator: takes over the reference of \c r, the
+    ///reference count of the resource of \c r is not modified.
+    ///\param r other resource handler instance
+    ResourceHandler& operator=( ResourceHandler&& r )
     {
         if( &r == this ) return *this;
         ReleaseResource();
-        AcquireResource( r );
+        resource_ = r.resource_;
+        record_ = r.record_;
+        r.resource_ = ResourceT();
+        r.record_ = 0;
         return *this;
     }
     ///Automatic conversion to resource handler type.
@@ -106,10 +172,10 @@ public:
     ///Returns resource handler.
     ResourceT Handle() const { return resource_; }
     ///Returns resource readable name; works only if the tamplate parameter NameT can be converted to a const char*.
-    const char* Name() const { return resourceName_; }
-    ///Returns current reference count of resource.
-    unsigned RefCount() const { return counter_->Count(); }
-    ///Release resource.
+    const char* Name() const { return NameT(); }
+    ///Returns current reference count of resource, zero for null handlers.
+    unsigned RefCount() const { return record_ ? record_->counter.Count() : 0; }
+    ///Release resource; the handler is null afterwards.
     void Release() { ReleaseResource(); }
     ///Release resource when destroyed.
     ~ResourceHandler()
@@ -117,36 +183,34 @@ public:
         ReleaseResource();
     }
 private:
-    ///Acquire resource from other handler.
-    void AcquireResource( const ResourceHandler& rh )
+    ///Resource and reference counter shared by all the handlers of the same
+    ///resource, allocated once per resource.
+    struct Record
     {
-        if( rh.counter_ == 0 ) return;
-        counter_ = rh.counter_;
-        resource_ = rh.resource_;
-        counter_->Inc();
-    }
-    ///Release resource.
+        Record( ResourceT r, unsigned count ) : resource( r ), counter( count ) {}
+        ResourceT resource;
+        CounterT counter;
+    };
+    ///Release reference held by this handler and reset handler.
     ///\throw std::runtime_error in case an error is returned by the release function
     void ReleaseResource()
     {
-        if( !counter_ ) return;
-        if( counter_->Dec() == 0 )
+        Record* r = record_;
+        record_ = 0;
+        resource_ = ResourceT();
+        if( !r || r->counter.Dec() != 0 ) return;
+        const ReturnTypeT status = ReleaseFunT( r->resource );
+        delete r;
+        if( status != ReturnTypeT( RETURN_SUCCESS_CODE ) )
         {
-            if( ReleaseFunT( resource_ ) != ReturnTypeT( RETURN_SUCCESS_CODE ) )
-            {
-                throw( std::runtime_error( "Error: releasing resource \"" + resourceName_ + "\"" ) );
-            }
-            delete counter_;
-            counter_ = 0;
-        }                
+            throw( std::runtime_error( "Error: releasing resource \"" + std::string( NameT() ) + "\"" ) );
+        }
     }
 private:
-    ///Resource handler
+    ///Resource handler, copy of the record's one to avoid an indirection
     ResourceT resource_;
-    ///Resource name.
-    std::string resourceName_;
-    //Counter instance.
-    CounterT* counter_;
+    ///Shared resource record, null for null handlers.
+    Record* record_;
 };
 
 #endif //RESOURCE_HANDLER_H_
\ No newline at end of file
@@ -19,45 +19,154 @@
 // MA  02110-1301, USA.
 //
 
+#include <chrono>
+#include <cstdlib>
+#include <string>
 #ifdef _WIN32
 #include <windows.h>
 #include <WinNT.h>
+#endif
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define TIMER_HAS_TSC_
+#ifdef _MSC_VER
+#include <intrin.h>
 #else
-#include <sys/time.h>
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
 #endif
 
+/// Monotonic clock with nanosecond resolution: \c QueryPerformanceCounter on
+/// Windows, \c std::chrono::steady_clock elsewhere.
+///
+/// On x86 processors with an invariant time stamp counter, setting the
+/// \c GPUPP_TSC_TIMER environment variable selects a fast path that reads
+/// the counter directly and converts ticks to nanoseconds with a ratio
+/// calibrated against the monotonic clock at first use, which takes about
+/// 20 ms. The counter is read without serialization: it is meant for
+/// intervals much longer than the reordering window of the processor.
+class MonotonicClock
+{
+public:
+    /// Returns nanoseconds elapsed from an unspecified origin.
+    static unsigned long long Now()
+    {
+#ifdef TIMER_HAS_TSC_
+        const Tsc& tsc = GetTsc();
+        if( tsc.enabled ) return tsc.ns0 + (unsigned long long)( double( __rdtsc() - tsc.ticks0 ) * tsc.nsPerTick );
+#endif
+        return SystemNow();
+    }
+    /// Returns nanoseconds from the monotonic clock of the system.
+    static unsigned long long SystemNow()
+    {
+#ifdef _WIN32
+        static LARGE_INTEGER freq = Frequency();
+        LARGE_INTEGER t;
+        ::QueryPerformanceCounter( &t );
+        // split to avoid overflow of the product
+        return (unsigned long long)( t.QuadPart / freq.QuadPart ) * 1000000000ULL
+               + (unsigned long long)( t.QuadPart % freq.QuadPart ) * 1000000000ULL / freq.QuadPart;
+#else
+        return (unsigned long long)std::chrono::duration_cast< std::chrono::nanoseconds >(
+                   std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+    }
+    /// Returns \c true if the time stamp counter fast path is in use.
+    static bool UsesTsc()
+    {
+#ifdef TIMER_HAS_TSC_
+        return GetTsc().enabled;
+#else
+        return false;
+#endif
+    }
+private:
+#ifdef _WIN32
+    static LARGE_INTEGER Frequency()
+    {
+        LARGE_INTEGER f;
+        ::QueryPerformanceFrequency( &f );
+        return f;
+    }
+#endif
+#ifdef TIMER_HAS_TSC_
+    /// Calibration of the time stamp counter.
+    struct Tsc
+    {
+        bool enabled;
+        unsigned long long ticks0; //!< counter value at calibration
+        unsigned long long ns0;    //!< monotonic clock at calibration
+        double nsPerTick;
+        Tsc() : enabled( false ), ticks0( 0 ), ns0( 0 ), nsPerTick( 0. )
+        {
+            const char* e = getenv( "GPUPP_TSC_TIMER" );
+            if( e == 0 || *e == 0 || std::string( e ) == "0" || !Invariant() ) return;
+            // spin on the monotonic clock: sleeping would not be more accurate
+            const unsigned long long t0 = SystemNow();
+            const unsigned long long c0 = __rdtsc();
+            unsigned long long t1 = t0;
+            while( t1 - t0 < 20000000ULL ) t1 = SystemNow();
+            const unsigned long long c1 = __rdtsc();
+            if( c1 <= c0 ) return;
+            nsPerTick = double( t1 - t0 ) / double( c1 - c0 );
+            ticks0 = c1;
+            ns0 = t1;
+            enabled = true;
+        }
+        /// Returns \c true if the counter rate does not depend on power states.
+        static bool Invariant()
+        {
+#ifdef _MSC_VER
+            int r[ 4 ];
+            __cpuid( r, 0x80000000 );
+            if( (unsigned)r[ 0 ] < 0x80000007 ) return false;
+            __cpuid( r, 0x80000007 );
+            return ( r[ 3 ] & ( 1 << 8 ) ) != 0;
+#else
+            unsigned a = 0, b = 0, c = 0, d = 0;
+            if( __get_cpuid_max( 0x80000000, 0 ) < 0x80000007 ) return false;
+            __get_cpuid( 0x80000007, &a, &b, &c, &d );
+            return ( d & ( 1 << 8 ) ) != 0;
+#endif
+        }
+    };
+    static const Tsc& GetTsc()
+    {
+        static const Tsc tsc;
+        return tsc;
+    }
+#endif
+};
+
 /// Computes elapsed time in milliseconds returned as a double precision floating point number.
-/// Works on Linux, Windows and Mac OS.
+/// Time is read from MonotonicClock: it is not affected by changes of the system time.
 class Timer
 {
 public:
     ///Default constructor.
-    Timer();
+    Timer() : tstart_( 0 ), tend_( 0 ) {}
     ///Start timer.
-    void Start();
+    void Start() { tstart_ = MonotonicClock::Now(); }
     ///Stop timer.
     ///\return elapsed time in milliseconds since call to Start()
-    double Stop();
+    double Stop()
+    {
+        tend_ = MonotonicClock::Now();
+        return ElapsedTime();
+    }
     ///Computes elapsed time in milliseconds between a Start() and Stop() calls
-	///\return time elapesed between subsequent Start() and Stop() function calls
-    double ElapsedTime() const;
+    ///\return time elapesed between subsequent Start() and Stop() function calls
+    double ElapsedTime() const { return 1E-6 * double( tend_ - tstart_ ); }
+    ///Computes elapsed time in nanoseconds between a Start() and Stop() calls
+    unsigned long long ElapsedNs() const { return tend_ - tstart_; }
     ///Returns the time elapsed from the call to the Start() function;
     ///does not stop the timer.
     ///\return time in milliseconds elapsed from previous call to Start()
-    double DTime() const;
+    double DTime() const { return 1E-6 * double( MonotonicClock::Now() - tstart_ ); }
 private:
-    ///Reset timer.
-    void Reset();
-#ifdef WIN32
-    LARGE_INTEGER freq_;
-    LARGE_INTEGER tstart_;
-    LARGE_INTEGER tend_;
-    mutable LARGE_INTEGER tendTmp_;
-#else
-    timeval tstart_;
-    timeval tend_;
-    mutable timeval tendTmp_;
-#endif
+    unsigned long long tstart_;
+    unsigned long long tend_;
 private:
     ///Do not allow construction from other instance.
     Timer( const Timer& );
@@ -66,6 +175,8 @@ private:
 };
 
 ///Scoped timer: starts when declared, stops and invokes callback upon destruction.
+///Reports a single sample: use RepeatMeasure() in utility/Measure.h to
+///obtain statistics of repeated runs.
 template < class CBackT, class TimerT = Timer >
 class ScopedCBackTimer
 {
@@ -88,90 +199,4 @@ private:
     ScopedCBackTimer operator=( const ScopedCBackTimer& );
 };
 
-
-#ifdef WIN32 //WINDOWS
-
-inline Timer::Timer()
-{
-    ::QueryPerformanceFrequency( &freq_ );
-    tstart_.QuadPart = 0;
-    tend_.QuadPart = 0;
-}
-
-inline void Timer::Start()
-{
-    ::QueryPerformanceCounter( &tstart_ );
-}
-
-inline double Timer::Stop()
-{
-    ::QueryPerformanceCounter( &tend_ );
-    return DTime();
-}
-
-inline double Timer::ElapsedTime() const
-{
-    return 1000. * ( ( double ) tend_.QuadPart -
-           ( double ) tstart_.QuadPart) /( ( double ) freq_.QuadPart );
-}
-
-inline double Timer::DTime() const
-{
-    ::QueryPerformanceCounter( &tendTmp_ );
-    return 1000. * ( ( double ) tendTmp_.QuadPart -
-           ( double ) tstart_.QuadPart) /( ( double ) freq_.QuadPart );
-}
-
-inline void Timer::Reset()
-{
-    tstart_.QuadPart = 0;
-    tend_.QuadPart = 0;
-}
-
-#else //UNIX
-
-inline Timer::Timer()
-{
-    Reset();
-}
-
-inline void Timer::Start()
-{
-    ::gettimeofday( &tstart_, 0  );
-}
-
-inline double Timer::Stop()
-{
-    ::gettimeofday( &tend_, 0 );
-    return DTime();
-}
-
-inline double Timer::ElapsedTime() const
-{
-    const double t1 = ( double ) tstart_.tv_sec + ( double ) tstart_.tv_usec / 1E6;
-    const double t2 = ( double ) tend_.tv_sec   + ( double ) tend_.tv_usec / 1E6;
-    return 1000. * ( t2 - t1 );
-}
-
-inline double Timer::DTime() const
-{
-    ::gettimeofday( &tendTmp_, 0 );
-    const double t1 = ( double ) tstart_.tv_sec + ( double ) tstart_.tv_usec / 1E6;
-    const double t2 = ( double ) tendTmp_.tv_sec   + ( double ) tendTmp_.tv_usec / 1E6;
-    return 1000. * ( t2 - t1 );
-}
-
-
-inline void Timer::Reset()
-{
-    tstart_.tv_sec = 0;
-    tstart_.tv_usec = 0;
-    tend_.tv_sec = 0;
-    tend_.tv_usec = 0;
-
-}
-#endif
-
-
-
 #endif //TIMER_H_
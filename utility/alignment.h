@@ -19,6 +19,12 @@
 // MA  02110-1301, USA.
 // 
 
+#include <cstddef>
+#include <cstdlib>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
 /// Struct for computing alignment of data.
 template < typename T > struct Align
 {
@@ -47,4 +53,28 @@ inline T AlignedOffset( T off, int align )
     return m != 0 ? off - off % align + align : off;
 }
 
+/// Allocates \c size bytes at an address multiple of \c align, which must be
+/// a power of two multiple of \c sizeof( void* ); memory must be released
+/// with AlignedFree().
+/// \return address of allocated memory or NULL in case of failure
+inline void* AlignedAlloc( size_t size, size_t align )
+{
+#ifdef _WIN32
+    return ::_aligned_malloc( size, align );
+#else
+    void* p = 0;
+    return ::posix_memalign( &p, align, size ) == 0 ? p : 0;
+#endif
+}
+
+/// Releases memory allocated with AlignedAlloc().
+inline void AlignedFree( void* p )
+{
+#ifdef _WIN32
+    ::_aligned_free( p );
+#else
+    ::free( p );
+#endif
+}
+
 #endif //ALIGNMENT_H_
\ No newline at end of file
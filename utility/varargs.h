@@ -21,8 +21,8 @@
 
 
 #include <vector>
-#include <list>
 #include <iostream>
+#include <utility>
 
 #include "Any.h"
 
@@ -41,39 +41,79 @@
 ///                    )              //<- Marks the end of a variable argument list
 ///                  );
 ///\endcode 
+///The first INLINE_CAPACITY values are stored inside the list, longer lists
+///are moved to the heap; together with the inline storage of Any, building
+///a list of small values does not allocate memory.
 class VArgList
 {
 public:
-    typedef std::list< Any > ArgsType;
-    typedef ArgsType::size_type size_type;
-    typedef ArgsType::iterator ArgListIterator;
-    typedef ArgsType::const_iterator ArgListConstIterator;
+    ///Number of values stored without heap allocation.
+    enum { INLINE_CAPACITY = 16 };
+    typedef size_t size_type;
+    typedef Any* ArgListIterator;
+    typedef const Any* ArgListConstIterator;
     ///Constructor. Constructs a list from a single parameter.
     ///\param a parameter added to list.
-    VArgList( const Any& a ) { l_.push_back( a ); }
+    VArgList( const Any& a ) : size_( 0 ) { PushBack( a ); }
     ///Default constructor.
-    VArgList() {}
+    VArgList() : size_( 0 ) {}
     ///Returns iterator pointing at beginning of parameter sequence.
-    ArgListConstIterator Begin() const { return l_.begin(); }
+    ArgListConstIterator Begin() const { return Data(); }
     ///Returns iterator pointing at the end of parameter sequence.
-    ArgListConstIterator End() const { return l_.end(); }
+    ArgListConstIterator End() const { return Data() + size_; }
     ///Returns a constant iterator pointing at beginning of parameter sequence.
-    ArgListIterator Begin() { return l_.begin(); }
+    ArgListIterator Begin() { return Data(); }
     ///Returns a constant iterator pointing at end of parameter sequence.
-    ArgListIterator End() { return l_.end(); }
+    ArgListIterator End() { return Data() + size_; }
     ///Returns number of values in list.
-    size_type Size() const { return l_.size(); }
+    size_type Size() const { return size_; }
+    ///Append value to list.
+    void PushBack( Any a )
+    {
+        if( size_ < size_type( INLINE_CAPACITY ) )
+        {
+            args_[ size_++ ] = std::move( a );
+            return;
+        }
+        if( size_ == size_type( INLINE_CAPACITY ) )
+        {
+            // first spill: move inline values to the heap
+            heapArgs_.reserve( 2 * INLINE_CAPACITY );
+            for( int i = 0; i != INLINE_CAPACITY; ++i ) heapArgs_.push_back( std::move( args_[ i ] ) );
+        }
+        heapArgs_.push_back( std::move( a ) );
+        ++size_;
+    }
 public:
-    ///Overloaded \c ',' operator.
+    ///Overloaded \c ',' operator appending to a temporary list: the value
+    ///is added in place and the list is moved, not copied, into the result,
+    ///which can safely be bound to a reference outliving the expression.
     ///\param al argument list
     ///\param a parameter to be added to list
-    friend VArgList operator,( VArgList al, const Any& a )
+    friend VArgList operator,( VArgList&& al, Any a )
     {
-        al.l_.push_back( a );
-        return al;
+        al.PushBack( std::move( a ) );
+        return std::move( al );
     }
+    ///Overloaded \c ',' operator: returns a copy of \c al with \c a appended.
+    ///\param al argument list
+    ///\param a parameter to be added to list
+    friend VArgList operator,( const VArgList& al, Any a )
+    {
+        VArgList l( al );
+        l.PushBack( std::move( a ) );
+        return l;
+    }
+private:
+    const Any* Data() const { return size_ > size_type( INLINE_CAPACITY ) ? &heapArgs_[ 0 ] : args_; }
+    Any* Data() { return size_ > size_type( INLINE_CAPACITY ) ? &heapArgs_[ 0 ] : args_; }
 private:
-    ArgsType l_;
+    ///Values of lists with up to INLINE_CAPACITY elements.
+    Any args_[ INLINE_CAPACITY ];
+    ///Values of longer lists.
+    std::vector< Any > heapArgs_;
+    ///Number of values.
+    size_type size_;
 };
 
 #endif //VARARGS_H_
\ No newline at end of file